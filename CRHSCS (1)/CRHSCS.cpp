@@ -1,20 +1,1017 @@
-// CRHSCS.cpp : This file contains the 'main' function. Program execution begins and ends there.
+// ###########################################################################################################################
+// CRHSCS.cpp :
 //
+// Description: Benchmark of the CharMatch and FacialDetection pipelines on synthetic input, so a build can be measured
+//              without a camera and compared against another build. From a fixed seed it renders frames of random text
+//              in several fonts, sizes, stroke widths and noise levels, and frames with faces pasted at random places
+//              and sizes (crops of the faces found in --faces IMAGE, or drawn faces without it), then times every stage
+//              of both pipelines:
+//
+//                  text     threshold, contours, resize, classify
+//                  faces    gray, pyramid, faces, eyes (cascade is the face and feature cascades together)
+//
+//              It reports the average latency of every stage, the throughput and the peak memory of the process. With
+//              --output the same numbers are written as JSON lines, one per benchmark, so two builds run with the same
+//              seed can be diffed line by line: the glyphs, accuracy and faces fields only change when the results
+//              change, the ms and fps fields show the speed. pgo.sh compares the release, tuned and profile guided
+//              CMake builds this way.
+//
+//              --check-allocations runs the text pipeline on warm buffers and counts its heap allocations per stage
+//              instead, see runAllocationCheck. --check-preprocess compares the fused preprocessing with the three
+//              OpenCV calls it replaces, --check-segment the connected component segmentation with findContours on
+//              dense pages of small text; run them with --width 1920 --height 1080 for full HD.
+//              --bench-descriptors compares the feature descriptors a model can be trained with, accuracy on held out
+//              glyphs against bytes per row and time per glyph, see runDescriptorBenchmark. --bench-cache times
+//              a mostly static scene without and with the frame to frame glyph cache, see runCacheBenchmark.
+//
+//              The classifier is trained from model.bin or the XML files in the working directory like CharMatch, or
+//              on rendered glyphs of the benchmark fonts when neither is there. The face benchmark needs the cascade
+//              files of FacialDetection in the working directory and is skipped without them.
+//
+// ###########################################################################################################################
+
+#include<opencv2/core/core.hpp>
+#include<opencv2/highgui/highgui.hpp>
+#include<opencv2/imgproc/imgproc.hpp>
+
+#include "Common/AllocationCounter.h"
+#include "Common/CharClassifier.h"
+#include "Common/CharFrameContext.h"
+#include "Common/CharPreprocess.h"
+#include "Common/FaceDetector.h"
+#include "Common/FaceTracker.h"
+#include "Common/FeatureDescriptor.h"
+#include "Common/GlyphBatch.h"
+#include "Common/GlyphSegmenter.h"
+#include "Common/JsonLines.h"
+#include "Common/Metrics.h"
+#include "Common/ModelFile.h"
+#include "Common/ProcessMemory.h"
+#include "Common/SyntheticWorkload.h"
+#include "Common/WorkStealingPool.h"
+
+#include<algorithm>
+#include<iostream>
+#include<memory>
+#include<sstream>
+#include<string>
+#include<vector>
+
+// global variables ///////////////////////////////////////////////////////////////////////////////
+const int MIN_CONTOUR_AREA = 100;
+const int RESIZED_IMAGE_WIDTH = 20;
+const int RESIZED_IMAGE_HEIGHT = 30;
+
+const std::string MODEL_FILE_NAME = "model.bin";
+const std::string IMAGES_FILE_NAME = "images.xml";
+const std::string CLASSIFICATIONS_FILE_NAME = "classifications.xml";
+
+const uint64_t DEFAULT_SEED = 12345;
+const int DEFAULT_TEXT_FRAMES = 24;                 // distinct frames rendered for each benchmark
+const int DEFAULT_FACE_FRAMES = 24;
+const int DEFAULT_REPEATS = 5;                      // timed passes over the frames, after one untimed warm-up pass
+const int DEFAULT_FRAME_WIDTH = 640;
+const int DEFAULT_FRAME_HEIGHT = 480;
+const double FACE_MATCH_OVERLAP = 0.5;              // intersection over union a detection needs to count as a pasted face
+const double FACE_CROP_MARGIN = 0.1;                // faces cut from --faces IMAGE grow by this fraction on every side
+const double METRICS_INTERVAL = 60.0;               // seconds between two writes of --metrics, which also writes at the end
+const int MAX_GLYPHS_PER_FRAME = 256;               // the frame context of the text benchmark is reserved for this many
+const int CACHE_SCENE_FRAMES = 30;                  // --bench-cache: frames every text frame stays in view
+const double CACHE_CAMERA_NOISE = 3.0;              // --bench-cache: gaussian noise added to every frame, gray levels
+
+// the dense pages of --check-segment, as many lines and chars as fit at these font scales
+const int DENSE_PAGE_LINES = 24;
+const int DENSE_PAGE_CHARS_PER_LINE = 80;
+const double DENSE_PAGE_MIN_SCALE = 0.8;
+const double DENSE_PAGE_MAX_SCALE = 1.2;
+
+// font scales and stroke widths of the glyphs the fallback classifier is trained on
+const double TRAINING_SCALES[] = { 1.0, 1.5, 2.0 };
+const int TRAINING_THICKNESSES[] = { 1, 2, 3 };
+
+enum TextStage {
+    TEXT_STAGE_THRESHOLD,
+    TEXT_STAGE_CONTOURS,
+    TEXT_STAGE_RESIZE,
+    TEXT_STAGE_CLASSIFY,
+    TEXT_STAGE_COUNT
+};
+
+const char* TEXT_STAGE_NAMES[TEXT_STAGE_COUNT] = { "threshold", "contours", "resize", "classify" };
+
+struct BenchmarkSettings {
+    uint64_t seed = DEFAULT_SEED;
+    int intTextFrames = DEFAULT_TEXT_FRAMES;
+    int intFaceFrames = DEFAULT_FACE_FRAMES;
+    int intRepeats = DEFAULT_REPEATS;
+    cv::Size frameSize = cv::Size(DEFAULT_FRAME_WIDTH, DEFAULT_FRAME_HEIGHT);
+    std::string strFaces;                           // image with real faces to paste, empty draws faces
+    std::string strTag;                             // build name written into every JSON line
+    int intPreprocessThreads = 0;                   // threads of the preprocessing and segmentation strips, 0 one per core
+    VoteOptions voteOptions;                        // vote and rejection of the text benchmark classifier
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// resized pixels and labels of the rendered glyphs of the benchmark fonts, one row per glyph
+void renderTrainingGlyphs(cv::Mat& matFeatures, cv::Mat& matClassifications) {
+
+    // every char of every font, scale and stroke width, cut out the way CharTrain and CharMatch do it
+    GlyphBatch glyphBatch(RESIZED_IMAGE_WIDTH, RESIZED_IMAGE_HEIGHT);
+    std::vector<int> vecLabels;
+    CharPreprocessor charPreprocessor;
+    GlyphSegmenter glyphSegmenter;
+    cv::Mat matImage, matThresh;
+    std::vector<cv::Rect> vecRects;
+
+    for (char chrGlyph : SYNTHETIC_CHARSET) {
+        for (int intFont : SYNTHETIC_FONTS) {
+            for (double dblScale : TRAINING_SCALES) {
+                for (int intThickness : TRAINING_THICKNESSES) {
+                    SyntheticWorkload::renderGlyph(chrGlyph, intFont, dblScale, intThickness, matImage);
+                    charPreprocessor.process(matImage, matThresh);
+                    glyphSegmenter.findRects(matThresh, MIN_CONTOUR_AREA, vecRects);
+                    if (vecRects.empty()) {
+                        continue;
+                    }
+
+                    // the biggest contour is the char, anything else is a piece the blur did not join
+                    cv::Rect rectChar = vecRects[0];
+                    for (const cv::Rect& rect : vecRects) {
+                        rectChar = rect.area() > rectChar.area() ? rect : rectChar;
+                    }
+                    glyphBatch.add(matThresh, rectChar);
+                    vecLabels.push_back((int)chrGlyph);
+                }
+            }
+        }
+    }
+
+    glyphBatch.features().copyTo(matFeatures);
+    cv::Mat(vecLabels, true).copyTo(matClassifications);
+}
+
+// train on model.bin or the XML files like CharMatch, or on rendered glyphs of the benchmark fonts when neither exists
+// matFeatures and modelFile hold the training rows and must live as long as the classifier, strSource says which was used
+bool loadClassifier(MappedModelFile& modelFile, cv::Mat& matFeatures, CharClassifier& charClassifier, std::string& strSource) {
+
+    cv::Mat matClassifications;
+
+    if (modelFile.open(MODEL_FILE_NAME)) {
+        strSource = MODEL_FILE_NAME;
+        if (!charClassifier.train(modelFile.features(), modelFile.classifications())) {
+            return false;
+        }
+        charClassifier.setDescriptor(modelFile.descriptor());
+        return true;
+    }
+
+    if (readXmlModel(IMAGES_FILE_NAME, CLASSIFICATIONS_FILE_NAME, matFeatures, matClassifications)) {
+        strSource = IMAGES_FILE_NAME;
+        return charClassifier.train(matFeatures, matClassifications);
+    }
+
+    renderTrainingGlyphs(matFeatures, matClassifications);
+    strSource = "synthetic";
+    return charClassifier.train(matFeatures, matClassifications);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// chars of strFound that match strExpected at the same line and position
+int countMatchingChars(const std::string& strFound, const std::string& strExpected) {
+
+    std::istringstream foundLines(strFound), expectedLines(strExpected);
+    std::string strFoundLine, strExpectedLine;
+    int intMatching = 0;
+
+    while (std::getline(foundLines, strFoundLine) && std::getline(expectedLines, strExpectedLine)) {
+        for (size_t i = 0; i < strFoundLine.size() && i < strExpectedLine.size(); i++) {
+            intMatching += strFoundLine[i] == strExpectedLine[i] ? 1 : 0;
+        }
+    }
+    return intMatching;
+}
+
+void addCommonFields(JsonLine& jsonLine, const char* pBenchmark, const BenchmarkSettings& settings) {
+    jsonLine.add("benchmark", pBenchmark)
+            .add("tag", settings.strTag)
+            .add("seed", (unsigned long long)settings.seed)
+            .add("width", settings.frameSize.width)
+            .add("height", settings.frameSize.height)
+            .add("repeats", settings.intRepeats);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void renderTextFrames(const BenchmarkSettings& settings, std::vector<cv::Mat>& vecFrames, std::vector<std::string>& vecTexts) {
+
+    SyntheticWorkload workload(settings.seed);
+    SyntheticTextOptions textOptions;
+    vecFrames.resize(settings.intTextFrames);
+    vecTexts.resize(settings.intTextFrames);
+    for (int i = 0; i < settings.intTextFrames; i++) {
+        workload.renderText(settings.frameSize, textOptions, vecFrames[i], vecTexts[i]);
+    }
+}
+
+// reads a counter between the stages of runTextStages
+typedef uint64_t (*StageMark)();
+
+uint64_t tickMark() {
+    return (uint64_t)cv::getTickCount();
+}
+
+uint64_t allocationMark() {
+    return allocationCounts().total();
+}
 
-#include <iostream>
+// the CharMatch pipeline on one frame, every buffer comes from frameContext: arrMarks[s] is read before stage s and
+// arrMarks[TEXT_STAGE_COUNT] after the last one
+void runTextStages(const CharClassifier& charClassifier, const cv::Mat& matFrame, CharFrameContext& frameContext,
+                   StageMark fnMark, uint64_t arrMarks[TEXT_STAGE_COUNT + 1]) {
 
-int main()
-{
-    std::cout << "Hello World!\n";
+    arrMarks[TEXT_STAGE_THRESHOLD] = fnMark();
+    frameContext.preprocessor.process(matFrame, frameContext.matThresh);
+
+    arrMarks[TEXT_STAGE_CONTOURS] = fnMark();
+    frameContext.segmenter.findRects(frameContext.matThresh, MIN_CONTOUR_AREA, frameContext.vecRects);
+
+    arrMarks[TEXT_STAGE_RESIZE] = fnMark();
+    frameContext.glyphBatch.clear();
+    for (const cv::Rect& rect : frameContext.vecRects) {
+        frameContext.glyphBatch.add(frameContext.matThresh, rect);
+    }
+
+    arrMarks[TEXT_STAGE_CLASSIFY] = fnMark();
+    frameContext.glyphBatch.classify(charClassifier, frameContext.vecChars, frameContext.strText);
+
+    arrMarks[TEXT_STAGE_COUNT] = fnMark();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// the CharMatch pipeline on rendered text: the warm-up pass checks the text found, the timed passes measure every stage
+void runTextBenchmark(const CharClassifier& charClassifier, const BenchmarkSettings& settings, std::ostream& report, ResultWriter* pWriter) {
+
+    std::vector<cv::Mat> vecFrames;
+    std::vector<std::string> vecTexts;
+    renderTextFrames(settings, vecFrames, vecTexts);
+
+    std::unique_ptr<WorkStealingPool> pPool;
+    if (settings.intPreprocessThreads != 1) {
+        pPool.reset(new WorkStealingPool(settings.intPreprocessThreads));
+    }
+    CharFrameContext frameContext(RESIZED_IMAGE_WIDTH, RESIZED_IMAGE_HEIGHT, pPool.get());
+    frameContext.reserve(settings.frameSize, MAX_GLYPHS_PER_FRAME);
+
+    uint64_t arrMarks[TEXT_STAGE_COUNT + 1];
+    uint64_t arrTicks[TEXT_STAGE_COUNT] = {};
+    uint64_t glyphs = 0, rejected = 0, charsExpected = 0, charsMatching = 0;
+
+    for (int pass = 0; pass <= settings.intRepeats; pass++) {
+        for (int i = 0; i < settings.intTextFrames; i++) {
+
+            runTextStages(charClassifier, vecFrames[i], frameContext, tickMark, arrMarks);
+
+            if (pass == 0) {
+                glyphs += frameContext.vecChars.size();
+                rejected += frameContext.glyphBatch.rejected();
+                charsMatching += countMatchingChars(frameContext.strText, vecTexts[i]);
+                for (char chr : vecTexts[i]) {
+                    charsExpected += chr != '\n' ? 1 : 0;
+                }
+                continue;
+            }
+
+            for (int s = 0; s < TEXT_STAGE_COUNT; s++) {
+                arrTicks[s] += arrMarks[s + 1] - arrMarks[s];
+            }
+        }
+    }
+
+    double dblTicksPerMs = cv::getTickFrequency() / 1000.0;
+    double dblFrames = (double)settings.intTextFrames * settings.intRepeats;
+    uint64_t totalTicks = 0;
+    for (int s = 0; s < TEXT_STAGE_COUNT; s++) {
+        totalTicks += arrTicks[s];
+    }
+    double dblTotalMs = totalTicks / dblTicksPerMs;
+    double dblFps = dblTotalMs > 0 ? dblFrames * 1000.0 / dblTotalMs : 0.0;
+    double dblAccuracy = charsExpected > 0 ? (double)charsMatching / charsExpected : 0.0;
+
+    report << "text, " << settings.intTextFrames << " frames x " << settings.intRepeats << " passes, "
+              << glyphs << " glyphs found for " << charsExpected << " chars, " << rejected << " rejected, accuracy " << dblAccuracy
+              << "\n  ms per frame:";
+    for (int s = 0; s < TEXT_STAGE_COUNT; s++) {
+        report << " " << TEXT_STAGE_NAMES[s] << " " << arrTicks[s] / dblTicksPerMs / dblFrames;
+    }
+    report << " | total " << dblTotalMs / dblFrames << "\n  " << dblFps << " frames/s, "
+              << dblFps * glyphs / std::max(1, settings.intTextFrames) << " glyphs/s\n";
+
+    if (pWriter != nullptr) {
+        JsonLine jsonLine;
+        addCommonFields(jsonLine, "text", settings);
+        jsonLine.add("frames", settings.intTextFrames)
+                .add("glyphs", (unsigned long long)glyphs)
+                .add("rejected", (unsigned long long)rejected)
+                .add("chars", (unsigned long long)charsExpected)
+                .add("accuracy", dblAccuracy);
+        jsonLine.beginObject("ms");
+        for (int s = 0; s < TEXT_STAGE_COUNT; s++) {
+            jsonLine.add(TEXT_STAGE_NAMES[s], arrTicks[s] / dblTicksPerMs / dblFrames);
+        }
+        jsonLine.add("total", dblTotalMs / dblFrames).endObject();
+        jsonLine.add("fps", dblFps)
+                .add("peak_rss_bytes", (unsigned long long)peakResidentBytes());
+        pWriter->write(jsonLine);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// --bench-cache: the text pipeline on a mostly static scene, without and with the GlyphCache. Every rendered text
+// frame stays in view for CACHE_SCENE_FRAMES frames, each with fresh camera noise, then the next one replaces it. Both
+// runs see the same frames; reports the time of every stage, the hit rate and whether the cache changed any text
+int runCacheBenchmark(const CharClassifier& charClassifier, const BenchmarkSettings& settings, std::ostream& report, ResultWriter* pWriter) {
+
+    std::vector<cv::Mat> vecScenes;
+    std::vector<std::string> vecTexts;
+    renderTextFrames(settings, vecScenes, vecTexts);
+
+    std::unique_ptr<WorkStealingPool> pPool;
+    if (settings.intPreprocessThreads != 1) {
+        pPool.reset(new WorkStealingPool(settings.intPreprocessThreads));
+    }
+
+    const char* arrRuns[2] = { "off", "on" };
+    uint64_t arrTicks[2][TEXT_STAGE_COUNT] = {};
+    uint64_t arrMatching[2] = {};
+    std::vector<std::string> vecFound[2];
+    uint64_t lookups = 0, hits = 0, charsExpected = 0;
+    uint64_t frames = (uint64_t)vecScenes.size() * CACHE_SCENE_FRAMES;
+
+    for (int run = 0; run < 2; run++) {
+        CharFrameContext frameContext(RESIZED_IMAGE_WIDTH, RESIZED_IMAGE_HEIGHT, pPool.get());
+        frameContext.reserve(settings.frameSize, MAX_GLYPHS_PER_FRAME);
+        if (run == 1) {
+            frameContext.glyphBatch.setCache(&frameContext.glyphCache, charClassifier);
+        }
+
+        // the same noise in both runs
+        cv::RNG rng(settings.seed);
+        cv::Mat matWide, matNoise, matFrame;
+        uint64_t arrMarks[TEXT_STAGE_COUNT + 1];
+
+        for (size_t s = 0; s < vecScenes.size(); s++) {
+            for (int f = 0; f < CACHE_SCENE_FRAMES; f++) {
+                vecScenes[s].convertTo(matWide, CV_16SC(vecScenes[s].channels()));
+                matNoise.create(matWide.size(), matWide.type());
+                rng.fill(matNoise, cv::RNG::NORMAL, 0, CACHE_CAMERA_NOISE);
+                matWide += matNoise;
+                matWide.convertTo(matFrame, CV_8U);
+
+                runTextStages(charClassifier, matFrame, frameContext, tickMark, arrMarks);
+
+                for (int t = 0; t < TEXT_STAGE_COUNT; t++) {
+                    arrTicks[run][t] += arrMarks[t + 1] - arrMarks[t];
+                }
+                arrMatching[run] += countMatchingChars(frameContext.strText, vecTexts[s]);
+                vecFound[run].push_back(frameContext.strText);
+
+                if (run == 0) {
+                    for (char chr : vecTexts[s]) {
+                        charsExpected += chr != '\n' ? 1 : 0;
+                    }
+                }
+            }
+        }
+
+        if (run == 1) {
+            lookups = frameContext.glyphCache.lookups();
+            hits = frameContext.glyphCache.hits();
+        }
+    }
+
+    uint64_t framesDiffering = 0;
+    for (size_t i = 0; i < vecFound[0].size(); i++) {
+        framesDiffering += vecFound[0][i] != vecFound[1][i] ? 1 : 0;
+    }
+
+    double dblTicksPerMs = cv::getTickFrequency() / 1000.0;
+    double dblHitRate = lookups > 0 ? (double)hits / lookups : 0.0;
+    double arrTotalMs[2] = {};
+
+    report << "glyph cache, " << vecScenes.size() << " scenes x " << CACHE_SCENE_FRAMES << " frames, camera noise "
+           << CACHE_CAMERA_NOISE << ", " << hits << " of " << lookups << " glyphs reused, hit rate " << dblHitRate << "\n";
+
+    for (int run = 0; run < 2; run++) {
+        double dblAccuracy = charsExpected > 0 ? (double)arrMatching[run] / (charsExpected * CACHE_SCENE_FRAMES) : 0.0;
+        report << "  cache " << arrRuns[run] << "\tms per frame:";
+        for (int t = 0; t < TEXT_STAGE_COUNT; t++) {
+            double dblMs = arrTicks[run][t] / dblTicksPerMs / frames;
+            arrTotalMs[run] += dblMs;
+            report << " " << TEXT_STAGE_NAMES[t] << " " << dblMs;
+        }
+        report << " | total " << arrTotalMs[run] << ", accuracy " << dblAccuracy << "\n";
+    }
+    report << "  speedup " << (arrTotalMs[1] > 0 ? arrTotalMs[0] / arrTotalMs[1] : 0.0) << "x, "
+           << framesDiffering << " of " << frames << " frames read differently with the cache\n";
+
+    if (pWriter != nullptr) {
+        JsonLine jsonLine;
+        addCommonFields(jsonLine, "glyph_cache", settings);
+        jsonLine.add("frames", (unsigned long long)frames)
+                .add("lookups", (unsigned long long)lookups)
+                .add("hits", (unsigned long long)hits)
+                .add("hit_rate", dblHitRate)
+                .add("frames_differing", (unsigned long long)framesDiffering);
+        for (int run = 0; run < 2; run++) {
+            jsonLine.beginObject(run == 0 ? "ms_uncached" : "ms_cached");
+            for (int t = 0; t < TEXT_STAGE_COUNT; t++) {
+                jsonLine.add(TEXT_STAGE_NAMES[t], arrTicks[run][t] / dblTicksPerMs / frames);
+            }
+            jsonLine.add("total", arrTotalMs[run]).endObject();
+        }
+        pWriter->write(jsonLine);
+    }
+
+    return 0;
 }
 
-// Run program: Ctrl + F5 or Debug > Start Without Debugging menu
-// Debug program: F5 or Debug > Start Debugging menu
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// --check-allocations: the heap allocations of every stage of the text pipeline once its frame context is warm, a
+// pass over the frames after one warm-up pass over the same frames.
+//
+// The frame context runs on a WorkStealingPool and OpenCV keeps its threads, the way CharMatch runs the pipeline, so
+// the check covers the parallel strips of the preprocessing and the segmentation. The check fails when any stage
+// allocates.
+int runAllocationCheck(const CharClassifier& charClassifier, const BenchmarkSettings& settings, std::ostream& report) {
+
+    installMatAllocationCounter();
+
+    std::vector<cv::Mat> vecFrames;
+    std::vector<std::string> vecTexts;
+    renderTextFrames(settings, vecFrames, vecTexts);
+
+    WorkStealingPool pool(settings.intPreprocessThreads);
+    CharFrameContext frameContext(RESIZED_IMAGE_WIDTH, RESIZED_IMAGE_HEIGHT, &pool);
+    frameContext.reserve(settings.frameSize, MAX_GLYPHS_PER_FRAME);
+
+    uint64_t arrMarks[TEXT_STAGE_COUNT + 1];
+    uint64_t arrAllocations[TEXT_STAGE_COUNT] = {};
+
+    // warm-up, the buffers grow to the largest frame
+    for (const cv::Mat& matFrame : vecFrames) {
+        runTextStages(charClassifier, matFrame, frameContext, allocationMark, arrMarks);
+    }
+
+    for (const cv::Mat& matFrame : vecFrames) {
+        runTextStages(charClassifier, matFrame, frameContext, allocationMark, arrMarks);
+        for (int s = 0; s < TEXT_STAGE_COUNT; s++) {
+            arrAllocations[s] += arrMarks[s + 1] - arrMarks[s];
+        }
+    }
+
+    double dblFrames = std::max(1, settings.intTextFrames);
+    bool blnPassed = true;
+    report << "allocations per frame after warm-up, " << settings.intTextFrames << " frames, " << pool.threads() << " threads\n ";
+    for (int s = 0; s < TEXT_STAGE_COUNT; s++) {
+        report << " " << TEXT_STAGE_NAMES[s] << " " << arrAllocations[s] / dblFrames;
+        blnPassed = blnPassed && arrAllocations[s] == 0;
+    }
+    report << "\n" << (blnPassed ? "passed" : "failed, a stage allocates") << "\n";
 
-// Tips for Getting Started: 
-//   1. Use the Solution Explorer window to add/manage files
-//   2. Use the Team Explorer window to connect to source control
-//   3. Use the Output window to see build output and other messages
-//   4. Use the Error List window to view errors
-//   5. Go to Project > Add New Item to create new code files, or Project > Add Existing Item to add existing code files to the project
-//   6. In the future, to open this project again, go to File > Open > Project and select the .sln file
+    return blnPassed ? 0 : 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// --check-preprocess: CharPreprocessor against the three OpenCV calls it replaces, on the rendered text frames. The
+// threshold images have to match bit for bit, on the calling thread and on the pool; the times show what one pass
+// over strips saves over three passes over full size images
+int runPreprocessCheck(const BenchmarkSettings& settings, std::ostream& report) {
+
+    std::vector<cv::Mat> vecFrames;
+    std::vector<std::string> vecTexts;
+    renderTextFrames(settings, vecFrames, vecTexts);
+
+    WorkStealingPool pool(settings.intPreprocessThreads);
+    CharPreprocessor singlePreprocessor;
+    CharPreprocessor poolPreprocessor(&pool);
+
+    cv::Mat matGrayscale, matBlurred, matReference, matSingle, matPooled;
+    uint64_t arrTicks[3] = {};
+    uint64_t pixelsDifferent = 0;
+
+    for (int pass = 0; pass <= settings.intRepeats; pass++) {
+        for (const cv::Mat& matFrame : vecFrames) {
+
+            int64_t t0 = cv::getTickCount();
+            preprocessCharImageReference(matFrame, matGrayscale, matBlurred, matReference);
+            int64_t t1 = cv::getTickCount();
+            singlePreprocessor.process(matFrame, matSingle);
+            int64_t t2 = cv::getTickCount();
+            poolPreprocessor.process(matFrame, matPooled);
+            int64_t t3 = cv::getTickCount();
+
+            if (pass == 0) {
+                pixelsDifferent += cv::countNonZero(matReference != matSingle) + cv::countNonZero(matReference != matPooled);
+                continue;
+            }
+
+            arrTicks[0] += t1 - t0;
+            arrTicks[1] += t2 - t1;
+            arrTicks[2] += t3 - t2;
+        }
+    }
+
+    // the reference writes and reads back the grayscale, the blurred and the float image of the mean
+    double dblFrames = (double)std::max(1, settings.intTextFrames) * settings.intRepeats;
+    double dblTicksPerMs = cv::getTickFrequency() / 1000.0;
+    double dblIntermediateMb = (double)settings.frameSize.area() * (2 + sizeof(float)) / (1024 * 1024);
+
+    report << "preprocess, " << settings.frameSize.width << "x" << settings.frameSize.height << ", " << settings.intTextFrames << " frames x "
+           << settings.intRepeats << " passes\n  ms per frame: reference " << arrTicks[0] / dblTicksPerMs / dblFrames
+           << " fused " << arrTicks[1] / dblTicksPerMs / dblFrames
+           << " fused on " << pool.threads() << " threads " << arrTicks[2] / dblTicksPerMs / dblFrames
+           << "\n  full size images between the passes: reference " << dblIntermediateMb << " MB, fused none, "
+           << poolPreprocessor.scratchBytes() / 1024 << " KB of strip buffers on " << pool.threads() << " threads\n"
+           << (pixelsDifferent == 0 ? "passed, identical" : "failed, " + std::to_string(pixelsDifferent) + " pixels differ") << "\n";
+
+    return pixelsDifferent == 0 ? 0 : 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// --check-segment: GlyphSegmenter against findContours on dense pages, many lines of small text with hundreds of
+// glyphs a frame. The rects have to be the same and in the same order, on the calling thread and on the pool
+int runSegmentCheck(const BenchmarkSettings& settings, std::ostream& report) {
+
+    SyntheticWorkload workload(settings.seed);
+    SyntheticTextOptions pageOptions;
+    pageOptions.intLines = DENSE_PAGE_LINES;
+    pageOptions.intCharsPerLine = DENSE_PAGE_CHARS_PER_LINE;
+    pageOptions.dblMinScale = DENSE_PAGE_MIN_SCALE;
+    pageOptions.dblMaxScale = DENSE_PAGE_MAX_SCALE;
+
+    // the threshold images are made once, only the segmentation is timed
+    CharPreprocessor charPreprocessor;
+    std::vector<cv::Mat> vecPages(settings.intTextFrames);
+    cv::Mat matPage;
+    std::string strText;
+    for (cv::Mat& matThresh : vecPages) {
+        workload.renderText(settings.frameSize, pageOptions, matPage, strText);
+        charPreprocessor.process(matPage, matThresh);
+    }
+
+    WorkStealingPool pool(settings.intPreprocessThreads);
+    GlyphSegmenter singleSegmenter;
+    GlyphSegmenter poolSegmenter(&pool);
+
+    cv::Mat matThreshCopy;
+    std::vector<cv::Rect> vecReference, vecSingle, vecPooled;
+    uint64_t arrTicks[3] = {};
+    uint64_t glyphs = 0;
+    int intPagesDifferent = 0;
+
+    for (int pass = 0; pass <= settings.intRepeats; pass++) {
+        for (const cv::Mat& matThresh : vecPages) {
+
+            int64_t t0 = cv::getTickCount();
+            findCharRectsReference(matThresh, matThreshCopy, MIN_CONTOUR_AREA, vecReference);
+            int64_t t1 = cv::getTickCount();
+            singleSegmenter.findRects(matThresh, MIN_CONTOUR_AREA, vecSingle);
+            int64_t t2 = cv::getTickCount();
+            poolSegmenter.findRects(matThresh, MIN_CONTOUR_AREA, vecPooled);
+            int64_t t3 = cv::getTickCount();
+
+            if (pass == 0) {
+                glyphs += vecReference.size();
+                intPagesDifferent += vecSingle != vecReference || vecPooled != vecReference ? 1 : 0;
+                continue;
+            }
+
+            arrTicks[0] += t1 - t0;
+            arrTicks[1] += t2 - t1;
+            arrTicks[2] += t3 - t2;
+        }
+    }
+
+    double dblFrames = (double)std::max(1, settings.intTextFrames) * settings.intRepeats;
+    double dblTicksPerMs = cv::getTickFrequency() / 1000.0;
+
+    report << "segment, " << settings.frameSize.width << "x" << settings.frameSize.height << ", " << settings.intTextFrames << " pages x "
+           << settings.intRepeats << " passes, " << glyphs / std::max(1, settings.intTextFrames) << " glyphs per page\n  ms per page: findContours "
+           << arrTicks[0] / dblTicksPerMs / dblFrames
+           << " components " << arrTicks[1] / dblTicksPerMs / dblFrames
+           << " components on " << pool.threads() << " threads " << arrTicks[2] / dblTicksPerMs / dblFrames << "\n"
+           << (intPagesDifferent == 0 ? "passed, identical" : "failed, the rects differ on " + std::to_string(intPagesDifferent) + " pages") << "\n";
+
+    return intPagesDifferent == 0 ? 0 : 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// --bench-descriptors: every descriptor of FeatureDescriptor.h trained on the rendered glyphs of the benchmark fonts
+// and tested on the glyphs of the rendered text frames, which it has not seen. The glyphs of a frame are matched one
+// to one with its text in reading order, a frame whose glyph count differs is left out. Reports the accuracy, the bytes
+// of a training row and the time to extract and to classify one glyph
+int runDescriptorBenchmark(const BenchmarkSettings& settings, std::ostream& report, ResultWriter* pWriter) {
+
+    cv::Mat matTrainingPixels, matTrainingLabels;
+    renderTrainingGlyphs(matTrainingPixels, matTrainingLabels);
+
+    std::vector<cv::Mat> vecFrames;
+    std::vector<std::string> vecTexts;
+    renderTextFrames(settings, vecFrames, vecTexts);
+
+    // the held out glyphs, resized the way CharMatch resizes them
+    CharPreprocessor charPreprocessor;
+    GlyphSegmenter glyphSegmenter;
+    ReadingOrder readingOrder;
+    GlyphBatch heldOut(RESIZED_IMAGE_WIDTH, RESIZED_IMAGE_HEIGHT, MAX_GLYPHS_PER_FRAME);
+    std::vector<int> vecLabels;
+    cv::Mat matThresh;
+    std::vector<cv::Rect> vecRects;
+    std::vector<RecognizedChar> vecChars;
+    std::string strText, strChars;
+    int intFramesUsed = 0;
+
+    for (size_t f = 0; f < vecFrames.size(); f++) {
+        charPreprocessor.process(vecFrames[f], matThresh);
+        glyphSegmenter.findRects(matThresh, MIN_CONTOUR_AREA, vecRects);
+
+        vecChars.clear();
+        for (const cv::Rect& rect : vecRects) {
+            RecognizedChar recognizedChar = { rect, ' ', 0.0f, 0.0f };
+            vecChars.push_back(recognizedChar);
+        }
+        readingOrder.sort(vecChars, strText);
+
+        strChars.clear();
+        for (char chr : vecTexts[f]) {
+            if (chr != '\n') {
+                strChars.push_back(chr);
+            }
+        }
+
+        // a glyph too many or too few shifts every label after it
+        if (vecChars.size() != strChars.size()) {
+            continue;
+        }
+
+        intFramesUsed++;
+        for (size_t i = 0; i < vecChars.size(); i++) {
+            heldOut.add(matThresh, vecChars[i].rect);
+            vecLabels.push_back((unsigned char)strChars[i]);
+        }
+    }
+
+    // trap for a held out set without a single usable frame
+    if (vecLabels.empty()) {
+        std::cerr << "error, no text frame segmented into as many glyphs as it has chars\n";
+        return -1;
+    }
+
+    cv::Mat matHeldOutPixels = heldOut.features();
+    double dblTicksPerUs = cv::getTickFrequency() / 1000000.0;
+    double dblGlyphs = (double)vecLabels.size() * settings.intRepeats;
+
+    report << "descriptors, " << matTrainingPixels.rows << " training glyphs, " << vecLabels.size() << " held out glyphs from "
+           << intFramesUsed << " of " << vecFrames.size() << " frames, " << settings.intRepeats << " passes\n";
+
+    for (int d = 0; d < (int)DESCRIPTOR_COUNT; d++) {
+        FeatureDescriptor descriptor = (FeatureDescriptor)d;
+        FeatureExtractor featureExtractor(descriptor, RESIZED_IMAGE_WIDTH, RESIZED_IMAGE_HEIGHT);
+
+        cv::Mat matTraining;
+        featureExtractor.extract(matTrainingPixels, matTraining);
+
+        CharClassifier charClassifier;
+        if (!charClassifier.train(matTraining, matTrainingLabels)) {
+            return -1;
+        }
+        charClassifier.setDescriptor(descriptor);
+
+        // the first pass warms up, the others are timed; pixels and bits rows are a copy of the pixels
+        cv::Mat matHeldOut;
+        std::vector<int> vecResults;
+        std::vector<Neighbor> vecNeighbors;
+        uint64_t extractTicks = 0, classifyTicks = 0;
+
+        for (int pass = 0; pass <= settings.intRepeats; pass++) {
+            int64_t t0 = cv::getTickCount();
+            featureExtractor.extract(matHeldOutPixels, matHeldOut);
+            int64_t t1 = cv::getTickCount();
+            charClassifier.findNearestBatch(matHeldOut, 1, vecResults, vecNeighbors);
+            int64_t t2 = cv::getTickCount();
+
+            if (pass > 0) {
+                extractTicks += t1 - t0;
+                classifyTicks += t2 - t1;
+            }
+        }
+
+        int intCorrect = 0;
+        for (size_t i = 0; i < vecLabels.size(); i++) {
+            intCorrect += vecResults[i] == vecLabels[i] ? 1 : 0;
+        }
+        double dblAccuracy = (double)intCorrect / vecLabels.size();
+        double dblExtractUs = extractTicks / dblTicksPerUs / dblGlyphs;
+        double dblClassifyUs = classifyTicks / dblTicksPerUs / dblGlyphs;
+        uint64_t modelBytes = (uint64_t)featureExtractor.bytesPerRow() * charClassifier.rows();
+
+        report << "  " << FeatureExtractor::name(descriptor) << "\t" << featureExtractor.cols() << " values, "
+               << featureExtractor.bytesPerRow() << " bytes/row, " << modelBytes / 1024 << " KB of rows, accuracy " << dblAccuracy
+               << ", extract " << dblExtractUs << " us/glyph, classify " << dblClassifyUs << " us/glyph\n";
+
+        if (pWriter != nullptr) {
+            JsonLine jsonLine;
+            addCommonFields(jsonLine, "descriptor", settings);
+            jsonLine.add("descriptor", FeatureExtractor::name(descriptor))
+                    .add("cols", featureExtractor.cols())
+                    .add("bytes_per_row", featureExtractor.bytesPerRow())
+                    .add("model_bytes", (unsigned long long)modelBytes)
+                    .add("training_glyphs", matTrainingPixels.rows)
+                    .add("held_out_glyphs", (int)vecLabels.size())
+                    .add("accuracy", dblAccuracy)
+                    .add("extract_us", dblExtractUs)
+                    .add("classify_us", dblClassifyUs);
+            pWriter->write(jsonLine);
+        }
+    }
+
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// the faces of the --faces image with a margin, or the whole image when the cascade finds none
+void cutFaceCrops(FaceDetector& detector, const std::string& strFaces, std::vector<cv::Mat>& vecCrops) {
+
+    cv::Mat matImage = cv::imread(strFaces);
+    if (matImage.empty()) {
+        std::cerr << "error: unable to read " << strFaces << ", drawing faces instead\n";
+        return;
+    }
+
+    cv::Mat matGray;
+    std::vector<cv::Rect> vecFaces;
+    detector.prepareGray(matImage, matGray);
+    detector.detectFaces(matGray, vecFaces);
+
+    cv::Rect imageRect(0, 0, matImage.cols, matImage.rows);
+    for (const cv::Rect& face : vecFaces) {
+        int intMarginX = cvRound(face.width * FACE_CROP_MARGIN);
+        int intMarginY = cvRound(face.height * FACE_CROP_MARGIN);
+        cv::Rect crop = cv::Rect(face.x - intMarginX, face.y - intMarginY, face.width + 2 * intMarginX, face.height + 2 * intMarginY) & imageRect;
+        vecCrops.push_back(matImage(crop).clone());
+    }
+    if (vecCrops.empty()) {
+        vecCrops.push_back(matImage);
+    }
+}
+
+// the FacialDetection pipeline on frames with pasted faces: the warm-up pass counts the faces found, the timed passes
+// measure every stage
+void runFaceBenchmark(const BenchmarkSettings& settings, std::ostream& report, ResultWriter* pWriter) {
+
+    FaceDetector detector;
+    if (!detector.load()) {
+        report << "faces, skipped, the cascade files are not in the working directory\n";
+        if (pWriter != nullptr) {
+            JsonLine jsonLine;
+            addCommonFields(jsonLine, "faces", settings);
+            jsonLine.addBool("skipped", true);
+            pWriter->write(jsonLine);
+        }
+        return;
+    }
+
+    std::vector<cv::Mat> vecCrops;
+    if (!settings.strFaces.empty()) {
+        cutFaceCrops(detector, settings.strFaces, vecCrops);
+    }
+
+    SyntheticWorkload workload(settings.seed);
+    SyntheticFaceOptions faceOptions;
+    std::vector<cv::Mat> vecFrames(settings.intFaceFrames);
+    std::vector<std::vector<cv::Rect>> vecTruth(settings.intFaceFrames);
+    for (int i = 0; i < settings.intFaceFrames; i++) {
+        workload.renderFaces(settings.frameSize, vecCrops, faceOptions, vecFrames[i], vecTruth[i]);
+    }
+
+    cv::Mat matGray;
+    std::vector<DetectedFace> detectedFaces;
+    uint64_t facesPasted = 0, facesFound = 0, detections = 0;
+
+    for (int pass = 0; pass <= settings.intRepeats; pass++) {
+
+        // only the timed passes count
+        if (pass == 1) {
+            detector.times().clear();
+        }
+
+        for (int i = 0; i < settings.intFaceFrames; i++) {
+            detector.detect(vecFrames[i], matGray, detectedFaces);
+
+            if (pass == 0) {
+                facesPasted += vecTruth[i].size();
+                detections += detectedFaces.size();
+                for (const cv::Rect& face : vecTruth[i]) {
+                    for (const DetectedFace& detectedFace : detectedFaces) {
+                        if (FaceTracker::overlap(face, detectedFace.face) >= FACE_MATCH_OVERLAP) {
+                            facesFound++;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    const FaceStageTimes& stageTimes = detector.times();
+    double dblTicksPerMs = cv::getTickFrequency() / 1000.0;
+    double dblFrames = stageTimes.frames > 0 ? (double)stageTimes.frames : 1.0;
+    double dblCascadeMs = (stageTimes.arrTicks[FACE_STAGE_FACES] + stageTimes.arrTicks[FACE_STAGE_EYES] +
+                           stageTimes.arrTicks[FACE_STAGE_MOUTH] + stageTimes.arrTicks[FACE_STAGE_NOSE]) / dblTicksPerMs;
+    double dblTotalMs = stageTimes.totalMs();
+    double dblFps = dblTotalMs > 0 ? stageTimes.frames * 1000.0 / dblTotalMs : 0.0;
+    double dblRecall = facesPasted > 0 ? (double)facesFound / facesPasted : 0.0;
+
+    report << "faces, " << settings.intFaceFrames << " frames x " << settings.intRepeats << " passes, "
+              << (vecCrops.empty() ? "drawn" : std::to_string(vecCrops.size()) + " pasted") << " faces found " << facesFound << " of " << facesPasted
+              << ", " << detections << " detections\n  ";
+    stageTimes.report(report, "ms per frame");
+    report << "  cascade " << dblCascadeMs / dblFrames << " ms per frame, " << dblFps << " frames/s\n";
+
+    if (pWriter != nullptr) {
+        JsonLine jsonLine;
+        addCommonFields(jsonLine, "faces", settings);
+        jsonLine.add("frames", settings.intFaceFrames)
+                .add("crops", vecCrops.empty() ? "drawn" : settings.strFaces)
+                .add("faces", (unsigned long long)facesPasted)
+                .add("found", (unsigned long long)facesFound)
+                .add("detections", (unsigned long long)detections)
+                .add("recall", dblRecall);
+        jsonLine.beginObject("ms");
+        for (int s = 0; s < FACE_STAGE_COUNT; s++) {
+            jsonLine.add(FaceStageTimes::stageName(s), stageTimes.arrTicks[s] / dblTicksPerMs / dblFrames);
+        }
+        jsonLine.add("cascade", dblCascadeMs / dblFrames)
+                .add("total", dblTotalMs / dblFrames)
+                .endObject();
+        jsonLine.add("fps", dblFps)
+                .add("peak_rss_bytes", (unsigned long long)peakResidentBytes());
+        pWriter->write(jsonLine);
+    }
+}
+
+
+int main(int argc, char** argv) {
+
+    BenchmarkSettings settings;
+    std::string strOutput;
+    std::string strMetrics;
+    bool blnCheckAllocations = false;
+    bool blnCheckPreprocess = false;
+    bool blnCheckSegment = false;
+    bool blnBenchDescriptors = false;
+    bool blnBenchCache = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string strArg = argv[i];
+
+        // --seed N renders other frames, the same seed renders the same frames on every build
+        if (strArg == "--seed" && i + 1 < argc) {
+            settings.seed = std::stoull(argv[++i]);
+        }
+        // --text-frames N and --face-frames N set the frames of each benchmark, 0 skips it
+        else if (strArg == "--text-frames" && i + 1 < argc) {
+            settings.intTextFrames = std::stoi(argv[++i]);
+        }
+        else if (strArg == "--face-frames" && i + 1 < argc) {
+            settings.intFaceFrames = std::stoi(argv[++i]);
+        }
+        // --repeats N timed passes over the frames
+        else if (strArg == "--repeats" && i + 1 < argc) {
+            settings.intRepeats = std::max(1, std::stoi(argv[++i]));
+        }
+        else if (strArg == "--width" && i + 1 < argc) {
+            settings.frameSize.width = std::stoi(argv[++i]);
+        }
+        else if (strArg == "--height" && i + 1 < argc) {
+            settings.frameSize.height = std::stoi(argv[++i]);
+        }
+        // --faces IMAGE pastes the faces of a photo instead of drawn faces
+        else if (strArg == "--faces" && i + 1 < argc) {
+            settings.strFaces = argv[++i];
+        }
+        // --tag NAME names the build in the JSON lines
+        else if (strArg == "--tag" && i + 1 < argc) {
+            settings.strTag = argv[++i];
+        }
+        // --output PATH writes the results as JSON lines to a file, or to stdout ("-") without the report
+        else if (strArg == "--output" && i + 1 < argc) {
+            strOutput = argv[++i];
+        }
+        // --metrics PATH writes the p50 / p99 / max latency of every stage in the Prometheus text format, see Metrics.h
+        else if (strArg == "--metrics" && i + 1 < argc) {
+            strMetrics = argv[++i];
+        }
+        // --check-allocations counts the heap allocations of the text pipeline instead of timing it, see runAllocationCheck
+        else if (strArg == "--check-allocations") {
+            blnCheckAllocations = true;
+        }
+        // --check-preprocess compares the fused preprocessing with the OpenCV calls it replaces, see runPreprocessCheck
+        else if (strArg == "--check-preprocess") {
+            blnCheckPreprocess = true;
+        }
+        // --check-segment compares the connected component segmentation with findContours, see runSegmentCheck
+        else if (strArg == "--check-segment") {
+            blnCheckSegment = true;
+        }
+        // --bench-cache times the text pipeline on a mostly static scene without and with the glyph cache
+        else if (strArg == "--bench-cache") {
+            blnBenchCache = true;
+        }
+        // --bench-descriptors compares the feature descriptors on held out glyphs, see runDescriptorBenchmark
+        else if (strArg == "--bench-descriptors") {
+            blnBenchDescriptors = true;
+        }
+        // --vote K, --min-confidence C and --max-distance D set the vote and rejection of the classifier, see VoteOptions
+        else if (strArg == "--vote" && i + 1 < argc) {
+            settings.voteOptions.k = std::max(1, std::stoi(argv[++i]));
+        }
+        else if (strArg == "--min-confidence" && i + 1 < argc) {
+            settings.voteOptions.dblMinConfidence = std::stod(argv[++i]);
+        }
+        else if (strArg == "--max-distance" && i + 1 < argc) {
+            settings.voteOptions.dblMaxDistance = std::stod(argv[++i]);
+        }
+        // --preprocess-threads N runs the preprocessing and segmentation strips of a frame on N threads, 1 on the calling thread
+        else if (strArg == "--preprocess-threads" && i + 1 < argc) {
+            settings.intPreprocessThreads = std::max(0, std::stoi(argv[++i]));
+        }
+    }
+
+    MetricsReporter metricsReporter;
+    if (!strMetrics.empty()) {
+        metricsReporter.start(strMetrics, METRICS_INTERVAL);
+    }
+
+    ResultWriter resultWriter;
+    ResultWriter* pWriter = nullptr;
+    if (!strOutput.empty()) {
+        if (!resultWriter.open(strOutput)) {
+            return -1;
+        }
+        pWriter = &resultWriter;
+    }
+
+    // with the JSON lines on stdout the report goes to stderr
+    std::ostream& report = strOutput == "-" ? std::cerr : std::cout;
+
+    if (blnCheckPreprocess) {
+        return runPreprocessCheck(settings, report);
+    }
+    if (blnCheckSegment) {
+        return runSegmentCheck(settings, report);
+    }
+    if (blnBenchDescriptors) {
+        return runDescriptorBenchmark(settings, report, pWriter);
+    }
+
+    MappedModelFile modelFile;
+    cv::Mat matFeatures;
+    CharClassifier charClassifier;
+    std::string strModel;
+
+    if (settings.intTextFrames > 0) {
+        if (!loadClassifier(modelFile, matFeatures, charClassifier, strModel)) {
+            std::cerr << "error, unable to train the classifier\n";
+            return -1;
+        }
+        charClassifier.setVoting(settings.voteOptions);
+        report << "classifier: " << charClassifier.rows() << " samples from " << strModel
+                  << ", " << simdLevelName(charClassifier.simdLevel()) << " kernels\n";
+        if (blnCheckAllocations) {
+            return runAllocationCheck(charClassifier, settings, report);
+        }
+        if (blnBenchCache) {
+            return runCacheBenchmark(charClassifier, settings, report, pWriter);
+        }
+        runTextBenchmark(charClassifier, settings, report, pWriter);
+    }
+
+    if (settings.intFaceFrames > 0) {
+        runFaceBenchmark(settings, report, pWriter);
+    }
+
+    report << "memory: peak " << peakResidentBytes() / (1024 * 1024) << " MB, now " << residentBytes() / (1024 * 1024) << " MB\n";
+
+    if (pWriter != nullptr) {
+        JsonLine jsonLine;
+        addCommonFields(jsonLine, "summary", settings);
+        jsonLine.add("model", strModel)
+                .add("samples", charClassifier.rows())
+                .add("simd", simdLevelName(charClassifier.simdLevel()))
+                .add("rss_bytes", (unsigned long long)residentBytes())
+                .add("peak_rss_bytes", (unsigned long long)peakResidentBytes());
+        pWriter->write(jsonLine);
+    }
+
+    return 0;
+}
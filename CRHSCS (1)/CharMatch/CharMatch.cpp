@@ -8,6 +8,11 @@
 //              the numbers (1-9) and alphabets (A-Z) in the format of K Nearest Neighbors logic. Then the program captures an input
 //              char from a webcam and matches against the pre-trained image data. If the char is found in the image data, 
 //              then it outputs the corresponding classification char (label).
+//              After a capture the 'L' key walks its chars so misread ones can be relabeled; they are learned at once
+//              and kept in a sample log that is compacted into the model file, see SampleLog.h
+//              --vote K classifies by the vote of the K nearest training rows, --min-confidence and --max-distance
+//              drop the blobs that match no char well enough before they reach the output
+//              The webcam is read on its own thread, a capture always matches the newest frame, see FrameRing
 // 
 // ########################################################################################################################### 
 
@@ -16,98 +21,891 @@
 #include<opencv2/imgproc/imgproc.hpp>
 #include<opencv2/ml/ml.hpp>
 
+#include "../Common/BatchRunner.h"
+#include "../Common/CharClassifier.h"
+#include "../Common/CharFrameContext.h"
+#include "../Common/CharPreprocess.h"
+#include "../Common/CharRecognizer.h"
+#include "../Common/FrameRing.h"
+#include "../Common/FrameSource.h"
+#include "../Common/GlyphBatch.h"
+#include "../Common/JsonLines.h"
+#include "../Common/KnnIndex.h"
+#include "../Common/Metrics.h"
+#include "../Common/ModelFile.h"
+#include "../Common/SampleLog.h"
+#include "../Common/StreamingOcr.h"
+
 #include<iostream>
+#include<memory>
 #include<sstream>
+#include<stdexcept>
+#include<string>
 
 // global variables ///////////////////////////////////////////////////////////////////////////////
 const int MIN_CONTOUR_AREA = 100;
 const int RESIZED_IMAGE_WIDTH = 20;
 const int RESIZED_IMAGE_HEIGHT = 30;
 
+const std::string MODEL_FILE_NAME = "model.bin";                    // binary model written by CharTrain, preferred over the XML files
+const std::string IMAGES_FILE_NAME = "images.xml";                  // XML training images, used when there is no binary model
+const std::string CLASSIFICATIONS_FILE_NAME = "classifications.xml";
+const std::string INDEX_FILE_NAME = "model.idx";                    // search index written by CharTrain --index, used when it fits the model
+const std::string SAMPLE_LOG_FILE_NAME = "model.log";               // samples added by the operator since the last compaction, see SampleLog.h
+const int COMPACT_SAMPLES = 32;                                     // logged samples that start a compaction into the model file
+const int STARTUP_BENCHMARK_RUNS = 20;                              // number of loads averaged by --bench-startup
+const int KNN_BENCHMARK_QUERIES = 2000;                             // number of noisy samples classified by --bench-knn
+const double KNN_BENCHMARK_NOISE = 0.05;                            // fraction of pixels randomized in each benchmark sample
+const int DEFAULT_BENCHMARK_K = 5;                                  // neighbors searched by --bench-index without --k
+const std::string DEFAULT_INPUT = "0";                              // FrameSource spec used without --input, the default camera
+const uint64_t DEFAULT_SEGMENT_FRAMES = 300;                        // video frames per batch item, see --segment-frames
+const double DEFAULT_METRICS_INTERVAL = 10.0;                       // seconds between two writes of --metrics
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// load the training data, the binary model is mapped when it exists and the XML files are the fallback
+// the images come back as uint8 rows straight from the mapping, or as floats from the XML file
+bool loadTrainingData(MappedModelFile& modelFile, cv::Mat& matClassificationInts, cv::Mat& matTrainingImagesAsFlattened) {
+
+    if (modelFile.open(MODEL_FILE_NAME)) {
+
+        // both are used straight from the mapping
+        matClassificationInts = modelFile.classifications();
+        matTrainingImagesAsFlattened = modelFile.features();
+
+        return true;
+    }
+
+    return readXmlModel(IMAGES_FILE_NAME, CLASSIFICATIONS_FILE_NAME, matTrainingImagesAsFlattened, matClassificationInts);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// time the startup work (load + train) for the XML files against the binary model file
+void runStartupBenchmark() {
+
+    // the benchmark needs both formats, create the binary model from the XML files if it is missing
+    MappedModelFile probe;
+    if (!probe.open(MODEL_FILE_NAME)) {
+        if (!convertXmlModel(IMAGES_FILE_NAME, CLASSIFICATIONS_FILE_NAME, MODEL_FILE_NAME, MODEL_FEATURE_U8, RESIZED_IMAGE_WIDTH, RESIZED_IMAGE_HEIGHT)) {
+            return;
+        }
+    }
+    probe.close();
+
+    double dblXmlLoadMs = 0, dblXmlTotalMs = 0;
+    double dblBinLoadMs = 0, dblBinTotalMs = 0;
+    double dblTicksPerMs = cv::getTickFrequency() / 1000.0;
+
+    for (int run = 0; run < STARTUP_BENCHMARK_RUNS; run++) {
+
+        // XML: parse both files, then train
+        {
+            int64_t t0 = cv::getTickCount();
+            cv::Mat matClassificationInts, matTrainingImagesAsFlattenedFloats;
+            readXmlModel(IMAGES_FILE_NAME, CLASSIFICATIONS_FILE_NAME, matTrainingImagesAsFlattenedFloats, matClassificationInts);
+            int64_t t1 = cv::getTickCount();
+            CharClassifier charClassifier;
+            charClassifier.train(matTrainingImagesAsFlattenedFloats, matClassificationInts);
+            int64_t t2 = cv::getTickCount();
+
+            dblXmlLoadMs += (t1 - t0) / dblTicksPerMs;
+            dblXmlTotalMs += (t2 - t0) / dblTicksPerMs;
+        }
+
+        // binary: map the model file, then train
+        {
+            int64_t t0 = cv::getTickCount();
+            MappedModelFile modelFile;
+            cv::Mat matClassificationInts, matTrainingImagesAsFlattened;
+            loadTrainingData(modelFile, matClassificationInts, matTrainingImagesAsFlattened);
+            int64_t t1 = cv::getTickCount();
+            CharClassifier charClassifier;
+            charClassifier.train(matTrainingImagesAsFlattened, matClassificationInts);
+            int64_t t2 = cv::getTickCount();
+
+            dblBinLoadMs += (t1 - t0) / dblTicksPerMs;
+            dblBinTotalMs += (t2 - t0) / dblTicksPerMs;
+        }
+    }
+
+    std::cout << "startup benchmark, average of " << STARTUP_BENCHMARK_RUNS << " runs\n";
+    std::cout << "  xml     load = " << dblXmlLoadMs / STARTUP_BENCHMARK_RUNS << " ms, load + train = " << dblXmlTotalMs / STARTUP_BENCHMARK_RUNS << " ms\n";
+    std::cout << "  binary  load = " << dblBinLoadMs / STARTUP_BENCHMARK_RUNS << " ms, load + train = " << dblBinTotalMs / STARTUP_BENCHMARK_RUNS << " ms\n\n";
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// intCount uint8 rows, each a random row of matRows with KNN_BENCHMARK_NOISE of its pixels replaced by random values
+void makeNoisySamples(const cv::Mat& matRows, int intCount, cv::RNG& rng, cv::Mat& matSamples) {
+
+    matSamples.create(intCount, matRows.cols, CV_8UC1);
+    for (int i = 0; i < matSamples.rows; i++) {
+        matRows.row(rng.uniform(0, matRows.rows)).convertTo(matSamples.row(i), CV_8U);
+        uchar* pSample = matSamples.ptr<uchar>(i);
+        for (int j = 0; j < matSamples.cols; j++) {
+            if (rng.uniform(0.0, 1.0) < KNN_BENCHMARK_NOISE) {
+                pSample[j] = (uchar)rng.uniform(0, 256);
+            }
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// classify noisy copies of the training images with KNearest and with CharClassifier at every SIMD level,
+// report the time per sample and how many labels differ from KNearest
+void runKnnBenchmark() {
+
+    MappedModelFile modelFile;
+    cv::Mat matClassificationInts, matTrainingImagesAsFlattened;
+
+    if (!loadTrainingData(modelFile, matClassificationInts, matTrainingImagesAsFlattened)) {
+        return;
+    }
+
+    // reference KNearest, trained on floats like CharMatch used to
+    cv::Mat matTrainingImagesAsFlattenedFloats;
+    matTrainingImagesAsFlattened.convertTo(matTrainingImagesAsFlattenedFloats, CV_32F);
+    cv::Ptr<cv::ml::KNearest> kNearest(cv::ml::KNearest::create());
+    kNearest->train(matTrainingImagesAsFlattenedFloats, cv::ml::ROW_SAMPLE, matClassificationInts);
+
+    // build the samples: a random training image with some pixels replaced by random values
+    cv::RNG rng(12345);
+    cv::Mat matSamples;
+    makeNoisySamples(matTrainingImagesAsFlattened, KNN_BENCHMARK_QUERIES, rng, matSamples);
+    cv::Mat matSamplesFloat;
+    matSamples.convertTo(matSamplesFloat, CV_32F);
+
+    double dblTicksPerUs = cv::getTickFrequency() / 1000000.0;
+
+    // KNearest, one sample per call like the capture loop
+    std::vector<int> vecReference(matSamples.rows);
+    int64_t t0 = cv::getTickCount();
+    for (int i = 0; i < matSamples.rows; i++) {
+        cv::Mat matCurrentChar(0, 0, CV_32F);
+        kNearest->findNearest(matSamplesFloat.row(i), 1, matCurrentChar);
+        vecReference[i] = int(matCurrentChar.at<float>(0, 0));
+    }
+    double dblReferenceUs = (cv::getTickCount() - t0) / dblTicksPerUs / matSamples.rows;
+
+    std::cout << "knn benchmark, " << matSamples.rows << " samples against " << matTrainingImagesAsFlattened.rows << " training images\n";
+    std::cout << "  KNearest           " << dblReferenceUs << " us/sample\n";
+
+    CharClassifier charClassifier;
+    charClassifier.train(matTrainingImagesAsFlattened, matClassificationInts);
+
+    DistanceMetric arrMetrics[] = { DISTANCE_L2, DISTANCE_HAMMING };
+    SimdLevel arrLevels[] = { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+
+    for (DistanceMetric metric : arrMetrics) {
+        charClassifier.setMetric(metric);
+
+        for (SimdLevel level : arrLevels) {
+
+            // skip levels this CPU does not have, they would only repeat the best supported one
+            if (level > detectSimdLevel()) {
+                continue;
+            }
+            charClassifier.setSimdLevel(level);
+
+            std::vector<Neighbor> vecNeighbors;
+            int intMismatches = 0;
+            int64_t t1 = cv::getTickCount();
+            for (int i = 0; i < matSamples.rows; i++) {
+                if (charClassifier.findNearest(matSamples.ptr<uint8_t>(i), 1, vecNeighbors) != vecReference[i]) {
+                    intMismatches++;
+                }
+            }
+            double dblUs = (cv::getTickCount() - t1) / dblTicksPerUs / matSamples.rows;
+
+            std::cout << "  " << (metric == DISTANCE_L2 ? "l2      " : "hamming ") << simdLevelName(level) << "\t   "
+                << dblUs << " us/sample, speedup " << dblReferenceUs / dblUs << "x, "
+                << intMismatches << " labels differ from KNearest\n";
+        }
+    }
+
+    // every sample in one findNearestBatch call, the way a captured frame is classified
+    charClassifier.setMetric(DISTANCE_L2);
+    charClassifier.setSimdLevel(detectSimdLevel());
+
+    std::vector<int> vecResults;
+    std::vector<Neighbor> vecNeighbors;
+    int64_t t2 = cv::getTickCount();
+    charClassifier.findNearestBatch(matSamples, 1, vecResults, vecNeighbors);
+    double dblBatchUs = (cv::getTickCount() - t2) / dblTicksPerUs / matSamples.rows;
+
+    int intBatchMismatches = 0;
+    for (int i = 0; i < matSamples.rows; i++) {
+        if (vecResults[i] != vecReference[i]) {
+            intBatchMismatches++;
+        }
+    }
+
+    std::cout << "  l2 batch " << simdLevelName(detectSimdLevel()) << "\t   " << dblBatchUs << " us/sample, speedup "
+        << dblReferenceUs / dblBatchUs << "x, " << intBatchMismatches << " labels differ from KNearest\n";
+    std::cout << "\n";
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// one index configuration of --bench-index
+struct IndexBenchmarkCase {
+    const char* pName;
+    KnnIndexType indexType;
+    double dblSlack;
+    int intCandidatesPerK;                          // pq candidates per neighbor asked for
+};
+
+// recall and latency of every index against the brute force scan: the training set, grown to intRows rows with noisy
+// copies when asked to, is searched for the k nearest rows of noisy samples. recall is the share of the true k
+// nearest rows an index finds, labels the share of samples it gives the same label as the scan
+void runIndexBenchmark(int k, int intRows) {
+
+    MappedModelFile modelFile;
+    cv::Mat matClassificationInts, matTrainingImagesAsFlattened;
+
+    if (!loadTrainingData(modelFile, matClassificationInts, matTrainingImagesAsFlattened)) {
+        return;
+    }
+
+    cv::RNG rng(12345);
+    cv::Mat matRows, matLabels;
+    matTrainingImagesAsFlattened.convertTo(matRows, CV_8U);
+    matClassificationInts.reshape(1, matRows.rows).convertTo(matLabels, CV_32S);
+    if (intRows > matRows.rows) {
+        cv::Mat matGrown;
+        makeNoisySamples(matRows, intRows - matRows.rows, rng, matGrown);
+
+        // the label of a grown row is the one of the row it was copied from, found again as its nearest original
+        CharClassifier original;
+        original.train(matRows, matLabels);
+        std::vector<int> vecGrownLabels;
+        std::vector<Neighbor> vecNeighbors;
+        original.findNearestBatch(matGrown, 1, vecGrownLabels, vecNeighbors);
+
+        matRows.push_back(matGrown);
+        matLabels.push_back(cv::Mat(vecGrownLabels, true));
+    }
+
+    CharClassifier charClassifier;
+    charClassifier.train(matRows, matLabels);
+    k = std::max(1, std::min(k, charClassifier.rows()));
+
+    cv::Mat matSamples;
+    makeNoisySamples(matRows, KNN_BENCHMARK_QUERIES, rng, matSamples);
+
+    // the true neighbors, from the brute force scan
+    std::vector<int> vecTruthLabels;
+    std::vector<Neighbor> vecTruth;
+    charClassifier.findNearestBatch(matSamples, k, vecTruthLabels, vecTruth);
+
+    IndexBenchmarkCase arrCases[] = {
+        { "brute", KNN_INDEX_BRUTE, 0.0, 0 },
+        { "vptree", KNN_INDEX_VPTREE, 0.0, 0 },
+        { "vptree slack 0.5", KNN_INDEX_VPTREE, 0.5, 0 },
+        { "vptree slack 1", KNN_INDEX_VPTREE, 1.0, 0 },
+        { "pq 4k candidates", KNN_INDEX_PQ, 0.0, 4 },
+        { "pq 16k candidates", KNN_INDEX_PQ, 0.0, 16 }
+    };
+
+    double dblTicksPerMs = cv::getTickFrequency() / 1000.0;
+    std::cout << "index benchmark, " << matSamples.rows << " samples against " << charClassifier.rows() << " training rows, k = " << k << "\n";
+
+    KnnIndex knnIndex;
+    std::vector<Neighbor> vecNeighbors(k);
+    for (const IndexBenchmarkCase& indexCase : arrCases) {
+
+        // the pq cases share one build, only the candidates change
+        double dblBuildMs = 0;
+        if (knnIndex.empty() || knnIndex.type() != indexCase.indexType) {
+            int64_t t0 = cv::getTickCount();
+            knnIndex.build(charClassifier, indexCase.indexType);
+            dblBuildMs = (cv::getTickCount() - t0) / dblTicksPerMs;
+        }
+        knnIndex.setSlack(indexCase.dblSlack);
+        knnIndex.setCandidates(indexCase.intCandidatesPerK * k);
+
+        uint64_t found = 0;
+        int intSameLabels = 0;
+        int64_t t1 = cv::getTickCount();
+        for (int s = 0; s < matSamples.rows; s++) {
+            knnIndex.search(charClassifier, matSamples.ptr<uint8_t>(s), k, vecNeighbors.data());
+
+            const Neighbor* pTruth = &vecTruth[(size_t)s * k];
+            for (int j = 0; j < k; j++) {
+                for (int n = 0; n < k; n++) {
+                    if (vecNeighbors[n].intIndex == pTruth[j].intIndex) {
+                        found++;
+                        break;
+                    }
+                }
+            }
+            intSameLabels += charClassifier.label(vecNeighbors[0].intIndex) == vecTruthLabels[s] ? 1 : 0;
+        }
+        double dblUs = (cv::getTickCount() - t1) / dblTicksPerMs * 1000.0 / matSamples.rows;
+
+        std::cout << "  " << indexCase.pName << "\t" << dblUs << " us/sample, recall " << (double)found / ((double)matSamples.rows * k)
+                  << ", labels " << (double)intSameLabels / matSamples.rows << ", " << knnIndex.bytes() / 1024 << " KB";
+        if (dblBuildMs > 0) {
+            std::cout << ", built in " << dblBuildMs << " ms";
+        }
+        std::cout << "\n";
+    }
+    std::cout << "\n";
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// one JSON line with the recognized chars of a frame
+JsonLine charResultJson(const std::string& strSource, uint64_t frameIndex, const std::string& strName, const cv::Size& size,
+                        double dblMs, const std::string& strText, const std::vector<RecognizedChar>& vecChars) {
+
+    JsonLine jsonLine;
+    jsonLine.add("source", strSource)
+        .add("frame", (unsigned long long)frameIndex)
+        .add("name", strName)
+        .add("width", size.width)
+        .add("height", size.height)
+        .add("ms", dblMs)
+        .add("text", strText);
+
+    jsonLine.beginArray("chars");
+    for (const RecognizedChar& recognizedChar : vecChars) {
+        jsonLine.beginObject()
+            .add("label", std::string(1, recognizedChar.chrLabel))
+            .add("confidence", (double)recognizedChar.fltConfidence)
+            .add("distance", (double)recognizedChar.fltDistance)
+            .addRect(recognizedChar.rect)
+            .endObject();
+    }
+    jsonLine.endArray();
+
+    return jsonLine;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// recognize every frame of the input without a window, one JSON line per frame; blnGlyphCache reuses the results of
+// glyphs that did not change from one frame to the next, see GlyphCache. The input is read on its own thread, a camera
+// skips the frames recognition is too slow for, see FrameRing
+int runHeadless(const CharClassifier& charClassifier, const std::string& strInput, const std::string& strOutput, uint64_t maxFrames,
+                bool blnGlyphCache, double dblCacheDifference) {
+
+    FrameSource frameSource;
+    if (!frameSource.open(strInput)) {
+        return -1;
+    }
+
+    ResultWriter resultWriter;
+    if (!resultWriter.open(strOutput)) {
+        return -1;
+    }
+
+    // one frame at a time, the preprocessing of every frame runs its strips on all cores
+    WorkStealingPool preprocessPool;
+    CharRecognizer charRecognizer(charClassifier, RESIZED_IMAGE_WIDTH, RESIZED_IMAGE_HEIGHT, MIN_CONTOUR_AREA, &preprocessPool);
+    charRecognizer.setCaching(blnGlyphCache, dblCacheDifference);
+
+    std::vector<RecognizedChar> vecRecognizedChars;
+    uint64_t frames = 0;
+    double dblTicksPerMs = cv::getTickFrequency() / 1000.0;
+    int64_t startTick = cv::getTickCount();
+
+    FrameRing frameRing;
+    frameRing.start(frameSource);
+
+    const RingFrame* pRingFrame = nullptr;
+    while ((maxFrames == 0 || frames < maxFrames) && (pRingFrame = frameRing.acquireNewest()) != nullptr) {
+
+        int64_t t0 = cv::getTickCount();
+        const std::string& strText = charRecognizer.recognize(pRingFrame->frame, vecRecognizedChars);
+        double dblMs = (cv::getTickCount() - t0) / dblTicksPerMs;
+        double dblLatencyMs = frameRing.recordResult(*pRingFrame);
+
+        resultWriter.write(charResultJson(frameSource.spec(), pRingFrame->frameIndex, pRingFrame->strName,
+                                          pRingFrame->frame.size(), dblMs, strText, vecRecognizedChars)
+                               .add("latency_ms", dblLatencyMs));
+        frameRing.release(pRingFrame);
+        frames++;
+    }
+    frameRing.stop();
+
+    // summary on stderr so it never mixes with the JSON lines on stdout
+    double dblSeconds = (cv::getTickCount() - startTick) / cv::getTickFrequency();
+    std::cerr << "processed " << frames << " frames in " << dblSeconds << " s ("
+        << (dblSeconds > 0 ? frames / dblSeconds : 0.0) << " fps)\n";
+    frameRing.report(std::cerr);
+    if (blnGlyphCache) {
+        std::cerr << "glyph cache: " << charRecognizer.cache().hits() << " of " << charRecognizer.cache().lookups()
+            << " glyphs reused, hit rate " << 100.0 * charRecognizer.cache().hitRate() << "%\n";
+    }
+
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// headless continuous recognition of every frame of the input, prints the text whenever it changes,
+// or writes every frame as a JSON line when an output is given
+int runStreaming(const CharClassifier& charClassifier, const std::string& strInput, const std::string& strOutput, uint64_t maxFrames,
+                 bool blnGlyphCache, double dblCacheDifference) {
+
+    FrameSource frameSource;
+    if (!frameSource.open(strInput)) {
+        return -1;
+    }
+
+    ResultWriter resultWriter;
+    bool blnJson = !strOutput.empty();
+    if (blnJson && !resultWriter.open(strOutput)) {
+        return -1;
+    }
+
+    StreamingOcrOptions options;
+    options.intImageWidth = RESIZED_IMAGE_WIDTH;
+    options.intImageHeight = RESIZED_IMAGE_HEIGHT;
+    options.dblMinContourArea = MIN_CONTOUR_AREA;
+    options.maxFrames = maxFrames;
+    options.blnGlyphCache = blnGlyphCache;
+    options.dblCacheMaxDifference = dblCacheDifference;
+
+    // the stats reports go to stdout, keep them out of JSON lines written there
+    if (blnJson && strOutput == "-") {
+        options.dblReportSeconds = 0;
+    }
+
+    StreamingOcr streamingOcr(charClassifier, options);
+
+    std::string strLastText;
+    double dblTicksPerMs = cv::getTickFrequency() / 1000.0;
+    streamingOcr.run(frameSource, [&](const OcrFrame& ocrFrame) {
+        if (blnJson) {
+            resultWriter.write(charResultJson(frameSource.spec(), ocrFrame.seq, frameSource.spec() + "#" + std::to_string(ocrFrame.seq),
+                                              ocrFrame.frame.size(), ocrFrame.processTicks / dblTicksPerMs, ocrFrame.strText, ocrFrame.vecChars)
+                                   .add("latency_ms", (cv::getTickCount() - ocrFrame.captureTick) / dblTicksPerMs));
+        }
+        else if (ocrFrame.strText != strLastText) {
+            std::cout << "frame " << ocrFrame.seq << ": numbers read = " << ocrFrame.strText << "\n";
+            strLastText = ocrFrame.strText;
+        }
+    });
+
+    return 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// recognize all images and videos of the inputs on a work stealing pool, the JSON lines come out in input order
+// whatever the number of threads; with blnScaling the batch is timed for 1 .. intThreads threads instead
+int runBatchMode(const CharClassifier& charClassifier, const std::vector<std::string>& vecInputs, const std::string& strOutput,
+                 int intThreads, uint64_t segmentFrames, bool blnScaling) {
+
+    std::vector<BatchItem> vecItems;
+    if (!planBatch(vecInputs, segmentFrames, vecItems)) {
+        return -1;
+    }
+
+    if (intThreads <= 0) {
+        intThreads = WorkStealingPool::hardwareThreads();
+    }
+
+    // one recognizer (scratch images and glyph batch) per worker, the classifier is only read and is shared
+    std::vector<std::unique_ptr<CharRecognizer>> vecRecognizers;
+    for (int i = 0; i < intThreads; i++) {
+        vecRecognizers.emplace_back(new CharRecognizer(charClassifier, RESIZED_IMAGE_WIDTH, RESIZED_IMAGE_HEIGHT, MIN_CONTOUR_AREA));
+    }
+
+    double dblTicksPerMs = cv::getTickFrequency() / 1000.0;
+
+    BatchProcessFn fnProcess = [&](const BatchItem& item, int intWorker, std::vector<std::string>& vecLines) -> uint64_t {
+
+        FrameSource frameSource;
+        if (!openBatchItem(item, frameSource)) {
+            return 0;
+        }
+
+        CharRecognizer& charRecognizer = *vecRecognizers[intWorker];
+        cv::Mat frame;
+        std::vector<RecognizedChar> vecRecognizedChars;
+        uint64_t frames = 0;
+
+        while ((item.frameCount == 0 || frames < item.frameCount) && frameSource.read(frame)) {
+            int64_t t0 = cv::getTickCount();
+            const std::string& strText = charRecognizer.recognize(frame, vecRecognizedChars);
+            double dblMs = (cv::getTickCount() - t0) / dblTicksPerMs;
+
+            vecLines.push_back(charResultJson(item.strSpec, frameSource.frameIndex(), frameSource.frameName(),
+                                              frame.size(), dblMs, strText, vecRecognizedChars).str());
+            frames++;
+        }
+        return frames;
+    };
+
+    if (blnScaling) {
+        reportBatchScaling(vecItems, intThreads, fnProcess);
+        return 0;
+    }
+
+    ResultWriter resultWriter;
+    if (!resultWriter.open(strOutput)) {
+        return -1;
+    }
+
+    WorkStealingPool pool(intThreads);
+    BatchResult batchResult = runBatch(pool, vecItems, fnProcess, &resultWriter);
+
+    // summary on stderr so it never mixes with the JSON lines on stdout
+    std::cerr << "batch of " << vecItems.size() << " items, " << batchResult.frames << " frames in " << batchResult.dblSeconds
+        << " s (" << (batchResult.dblSeconds > 0 ? batchResult.frames / batchResult.dblSeconds : 0.0) << " fps) on "
+        << intThreads << " threads, " << batchResult.steals << " items stolen\n";
+
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// fold the logged samples into the model file, and build the index again when one is in use, of its type and with its
+// options, so the next start still finds one that fits the model; the running classifier already searches every row
+// and is left as it is
+bool compactModel(SampleLog& sampleLog, const CharClassifier& charClassifier) {
+
+    int intSamples = sampleLog.samples();
+    int64_t t0 = cv::getTickCount();
+
+    if (!sampleLog.compact(charClassifier, MODEL_FILE_NAME, RESIZED_IMAGE_WIDTH, RESIZED_IMAGE_HEIGHT)) {
+        return false;
+    }
+
+    if (charClassifier.index() != nullptr) {
+        MappedModelFile compactedFile;
+        CharClassifier compactedClassifier;
+        KnnIndex compactedIndex;
+        if (!compactedFile.open(MODEL_FILE_NAME)
+            || !compactedClassifier.train(compactedFile.features(), compactedFile.classifications())
+            || !compactedIndex.build(compactedClassifier, charClassifier.index()->type(), charClassifier.index()->indexOptions())
+            || !compactedIndex.write(INDEX_FILE_NAME)) {
+            std::cerr << "error, unable to build the index of the compacted model\n";
+            return false;
+        }
+    }
+
+    std::cerr << "compacted " << intSamples << " samples into " << MODEL_FILE_NAME << ", " << charClassifier.rows() << " rows, in "
+              << (cv::getTickCount() - t0) / (cv::getTickFrequency() / 1000.0) << " ms\n";
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// walk the chars of the last capture in reading order and let the operator correct them: a key of one of the chars
+// CharTrain accepts relabels the glyph shown, which is added to the classifier at once and logged, any other key keeps
+// the glyph as read and esc stops
+void correctCapture(CharFrameContext& frameContext, CharClassifier& charClassifier, SampleLog& sampleLog) {
+
+    cv::Mat matSample;
+    FeatureExtractor featureExtractor(charClassifier.descriptor(), RESIZED_IMAGE_WIDTH, RESIZED_IMAGE_HEIGHT);
+    std::vector<uint8_t> vecFeatures(featureExtractor.cols());
+
+    for (size_t i = 0; i < frameContext.vecChars.size(); i++) {
+        const RecognizedChar& recognizedChar = frameContext.vecChars[i];
+
+        cv::Mat matROI = frameContext.matThresh(recognizedChar.rect);
+        cv::imshow("ROI", matROI);
+        std::cout << "char " << i + 1 << " of " << frameContext.vecChars.size() << " read as " << recognizedChar.chrLabel
+                  << ", press the right char, any other key keeps it, esc stops\n";
+
+        int intChar = cv::waitKey(0);
+
+        if (intChar == 27) {
+            break;
+        }
+
+        bool blnValid = (intChar >= '0' && intChar <= '9') || (intChar >= 'A' && intChar <= 'Z');
+        if (!blnValid || intChar == recognizedChar.chrLabel) {
+            continue;
+        }
+
+        // the same resize and descriptor the capture was classified with
+        cv::resize(matROI, matSample, cv::Size(RESIZED_IMAGE_WIDTH, RESIZED_IMAGE_HEIGHT));
+        featureExtractor.extractRow(matSample.data, vecFeatures.data());
+
+        if (charClassifier.addSample(vecFeatures.data(), intChar) && sampleLog.append(vecFeatures.data(), intChar)) {
+            std::cout << "learned " << (char)intChar << ", " << sampleLog.samples() << " samples not yet in " << MODEL_FILE_NAME << "\n";
+        }
+
+        if (sampleLog.samples() >= COMPACT_SAMPLES) {
+            compactModel(sampleLog, charClassifier);
+        }
+    }
+}
+
+
+int main(int argc, char** argv) {
+
+    // use Hamming distance on the binarized images instead of L2
+    bool blnHamming = false;
+
+    // recognize every frame without a window instead of waiting for the 'C' key
+    bool blnStream = false;
+    uint64_t maxFrames = 0;
+
+    // reuse the results of unchanged glyphs from frame to frame in --stream and --headless
+    bool blnGlyphCache = false;
+    double dblCacheDifference = GLYPH_CACHE_MAX_DIFFERENCE;
+
+    // input and output of the headless modes
+    bool blnHeadless = false;
+    std::vector<std::string> vecInputs;
+    std::string strOutput;
+
+    // parallel processing of many recorded inputs
+    bool blnBatch = false;
+    bool blnBatchScaling = false;
+    int intThreads = 0;
+    uint64_t segmentFrames = DEFAULT_SEGMENT_FRAMES;
+
+    // stage latency histograms
+    std::string strMetrics;
+    double dblMetricsInterval = DEFAULT_METRICS_INTERVAL;
+
+    // fold the sample log into the model file and exit
+    bool blnCompact = false;
+
+    // k nearest rows voting on every glyph and the glyphs rejected as noise
+    VoteOptions voteOptions;
+
+    // search index benchmark
+    bool blnBenchIndex = false;
+    int intBenchK = DEFAULT_BENCHMARK_K;
+    int intBenchRows = 0;
+
+    // a number that does not parse names its option instead of ending the program with an uncaught exception
+    std::string strArg;
+    try {
+        for (int i = 1; i < argc; i++) {
+            strArg = argv[i];
+
+            // --bench-startup compares loading the XML files against the binary model, then exits
+            if (strArg == "--bench-startup") {
+                runStartupBenchmark();
+                return 0;
+            }
+            // --bench-knn compares KNearest against CharClassifier, then exits
+            else if (strArg == "--bench-knn") {
+                runKnnBenchmark();
+                return 0;
+            }
+            // --bench-index [--k N] [--index-rows N] reports recall and latency of every index, then exits
+            else if (strArg == "--bench-index") {
+                blnBenchIndex = true;
+            }
+            else if (strArg == "--k" && i + 1 < argc) {
+                intBenchK = std::stoi(argv[++i]);
+            }
+            else if (strArg == "--index-rows" && i + 1 < argc) {
+                intBenchRows = std::stoi(argv[++i]);
+            }
+            else if (strArg == "--hamming") {
+                blnHamming = true;
+            }
+            // --vote K lets the K nearest rows vote, --min-confidence C and --max-distance D drop the glyphs whose vote
+            // is less clear or whose nearest row is further, see VoteOptions
+            else if (strArg == "--vote" && i + 1 < argc) {
+                voteOptions.k = std::max(1, std::stoi(argv[++i]));
+            }
+            else if (strArg == "--min-confidence" && i + 1 < argc) {
+                voteOptions.dblMinConfidence = std::stod(argv[++i]);
+            }
+            else if (strArg == "--max-distance" && i + 1 < argc) {
+                voteOptions.dblMaxDistance = std::stod(argv[++i]);
+            }
+            // --compact writes the samples of the sample log into the model file, then exits
+            else if (strArg == "--compact") {
+                blnCompact = true;
+            }
+            // --stream [--frames N] runs the multi threaded continuous pipeline, optionally for N frames
+            else if (strArg == "--stream") {
+                blnStream = true;
+            }
+            else if (strArg == "--frames" && i + 1 < argc) {
+                maxFrames = std::stoull(argv[++i]);
+            }
+            // --glyph-cache [--cache-difference F] reuses the result of a glyph whose rect is the same as in the previous
+            // frame and whose pixels differ in at most the fraction F, see GlyphCache
+            else if (strArg == "--glyph-cache") {
+                blnGlyphCache = true;
+            }
+            else if (strArg == "--cache-difference" && i + 1 < argc) {
+                dblCacheDifference = std::stod(argv[++i]);
+            }
+            // --input SPEC reads a camera, video, image, directory or raw stdin instead of camera 0, see FrameSource.h
+            // --batch takes any number of them, the other modes use the last one
+            else if (strArg == "--input" && i + 1 < argc) {
+                vecInputs.push_back(argv[++i]);
+            }
+            // --headless recognizes every frame of the input without a window and writes one JSON line per frame
+            else if (strArg == "--headless") {
+                blnHeadless = true;
+            }
+            // --output PATH writes the JSON lines to a file instead of stdout ("-")
+            else if (strArg == "--output" && i + 1 < argc) {
+                strOutput = argv[++i];
+            }
+            // --batch [--threads N] [--segment-frames N] processes all inputs in parallel, --bench-scaling times it for 1 .. N threads
+            else if (strArg == "--batch") {
+                blnBatch = true;
+            }
+            else if (strArg == "--bench-scaling") {
+                blnBatch = true;
+                blnBatchScaling = true;
+            }
+            else if (strArg == "--threads" && i + 1 < argc) {
+                intThreads = std::stoi(argv[++i]);
+            }
+            else if (strArg == "--segment-frames" && i + 1 < argc) {
+                segmentFrames = std::stoull(argv[++i]);
+            }
+            // --metrics PATH [--metrics-interval S] writes p50 / p99 / max of every stage in the Prometheus text format
+            // to PATH ("-" stdout) every S seconds
+            else if (strArg == "--metrics" && i + 1 < argc) {
+                strMetrics = argv[++i];
+            }
+            else if (strArg == "--metrics-interval" && i + 1 < argc) {
+                dblMetricsInterval = std::stod(argv[++i]);
+                if (!(dblMetricsInterval >= METRICS_MIN_INTERVAL)) {
+                    std::cerr << "error, --metrics-interval must be at least " << METRICS_MIN_INTERVAL << " seconds\n";
+                    return -1;
+                }
+            }
+        }
+    }
+    catch (const std::invalid_argument&) {
+        std::cerr << "error, " << strArg << " needs a number\n";
+        return -1;
+    }
+    catch (const std::out_of_range&) {
+        std::cerr << "error, the value of " << strArg << " is out of range\n";
+        return -1;
+    }
 
-int main() {
+    if (blnBenchIndex) {
+        runIndexBenchmark(intBenchK, intBenchRows);
+        return 0;
+    }
+
+    // the timers cost next to nothing until the reporter turns them on, it writes a last time when main returns
+    MetricsReporter metricsReporter;
+    if (!strMetrics.empty() && !metricsReporter.start(strMetrics, dblMetricsInterval)) {
+        return -1;
+    }
 
-    // read in previously trained classifications
+    std::string strInput = vecInputs.empty() ? DEFAULT_INPUT : vecInputs.back();
+
+    // read in previously trained classifications and training images
     // read the classification numbers into this variable as if it is a vector
     cv::Mat matClassificationInts;      
 
-    // open the classifications file
-    cv::FileStorage fsClassifications("classifications.xml", cv::FileStorage::READ);        
+    // read multiple images into this single image variable as if it is a vector
+    cv::Mat matTrainingImagesAsFlattened;
+
+    // keeps the binary model mapped while its data is in use
+    MappedModelFile modelFile;
 
     // trap for file errors
-    if (fsClassifications.isOpened() == false) {
-        std::cout << "error, unable to open training classifications file, exiting program\n\n";
+    if (!loadTrainingData(modelFile, matClassificationInts, matTrainingImagesAsFlattened)) {
+        std::cout << "error, unable to load training data, exiting program\n\n";
         return(0);
     }
 
-    // read classifications section into Mat classifications variable
-    fsClassifications["classifications"] >> matClassificationInts;
+    // instantiate the KNN classifier
+    CharClassifier charClassifier;
 
-    // close the classifications file
-    fsClassifications.release();                                        
+    // load the pre-trained data to train computer, uint8 rows from the model file are used without a copy
+    charClassifier.train(matTrainingImagesAsFlattened, matClassificationInts);
 
-    // read in training images
-    // read multiple images into this single image variable as if it is a vector
-    cv::Mat matTrainingImagesAsFlattenedFloats;
+    // the rows of the model file may be descriptors of the glyphs rather than their pixels, the glyphs of every
+    // capture are then described the same way before they are classified
+    if (modelFile.isOpen()) {
+        charClassifier.setDescriptor(modelFile.descriptor());
+        if (modelFile.descriptor() != DESCRIPTOR_PIXELS) {
+            std::cerr << "model rows are " << FeatureExtractor::name(modelFile.descriptor()) << " descriptors\n";
+        }
+    }
 
-    // open the training images file
-    cv::FileStorage fsTrainingImages("images.xml", cv::FileStorage::READ);          
+    // search through the index CharTrain built for these rows when there is one, the brute force scan otherwise
+    KnnIndex knnIndex;
+    if (knnIndex.read(INDEX_FILE_NAME, charClassifier)) {
+        charClassifier.setIndex(&knnIndex);
+        std::cerr << "searching " << charClassifier.rows() << " training rows through the " << KnnIndex::typeName(knnIndex.type()) << " index\n";
+    }
 
-    // trap for file error
-    if (fsTrainingImages.isOpened() == false) {
-        std::cout << "error, unable to open training images file, exiting program\n\n";
-        return(0);
+    if (blnHamming) {
+        charClassifier.setMetric(DISTANCE_HAMMING);
     }
+    charClassifier.setVoting(voteOptions);
 
-    // read images section into Mat training images variable
-    fsTrainingImages["images"] >> matTrainingImagesAsFlattenedFloats;
+    // the samples added since the last compaction, on top of the model rows; the index stays in use for those
+    SampleLog sampleLog;
+    if (sampleLog.open(SAMPLE_LOG_FILE_NAME, charClassifier) && sampleLog.samples() > 0) {
+        std::cerr << sampleLog.samples() << " samples added from " << SAMPLE_LOG_FILE_NAME << "\n";
+    }
 
-    // close the traning images file
-    fsTrainingImages.release();                                                 
+    if (blnCompact) {
+        return compactModel(sampleLog, charClassifier) ? 0 : -1;
+    }
 
-    // instantiate the KNN object
-    cv::Ptr<cv::ml::KNearest>  kNearest(cv::ml::KNearest::create());            
+    if (blnStream) {
+        return runStreaming(charClassifier, strInput, strOutput, maxFrames, blnGlyphCache, dblCacheDifference);
+    }
 
-    // load the pre-trained data to train computer
-    // note that both parameters have to be of type Mat (a single Mat)
-    //      even though in reality they are multiple images and numbers
-    kNearest->train(matTrainingImagesAsFlattenedFloats, cv::ml::ROW_SAMPLE, matClassificationInts);
+    if (blnBatch) {
+        if (vecInputs.empty()) {
+            std::cerr << "error, --batch needs at least one --input\n";
+            return -1;
+        }
+        return runBatchMode(charClassifier, vecInputs, strOutput.empty() ? "-" : strOutput, intThreads, segmentFrames, blnBatchScaling);
+    }
 
-    // match the input from webcam 
+    if (blnHeadless) {
+        return runHeadless(charClassifier, strInput, strOutput.empty() ? "-" : strOutput, maxFrames, blnGlyphCache, dblCacheDifference);
+    }
+
+    // match the input from webcam (or whatever --input names)
 
-    // Open the default camera
-    cv::VideoCapture cap(0);
+    // Open the input, the default camera unless --input was given
+    FrameSource cap;
 
     // trap for error
-    if (!cap.isOpened())
+    if (!cap.open(strInput))
     {
-        std::cerr << "Unable to open the camera\n";
         return -1;
     }
 
 
     cv::Mat frame;                  // read in the test numbers image
-    cv::Mat matGrayscale;           // converted test image to grayscale
-    cv::Mat matBlurred;             // bluured test image
-    cv::Mat matThresh;              // threshed test image
-    cv::Mat matThreshCopy;          // copy of the thresh image
 
-    std::string strFinalString;     // declare final string, this will have the final number sequence by the end of the program
+    // preprocessing strips, threshed image, contours, glyphs and the final string of the capture,
+    // kept from one capture to the next so matching does not allocate once they have grown
+    WorkStealingPool preprocessPool;
+    CharFrameContext frameContext(RESIZED_IMAGE_WIDTH, RESIZED_IMAGE_HEIGHT, &preprocessPool);
+
+    // the camera is read on its own thread, so the frame shown and captured is the newest one even after a long
+    // capture or correction, see FrameRing
+    FrameRing frameRing;
+    frameRing.start(cap);
+    const RingFrame* pRingFrame = nullptr;
 
     while (true)
     {
+        // the frame of the previous pass goes back to the ring
+        frameRing.release(pRingFrame);
+
         // capture the test char
-        cap >> frame;
+        pRingFrame = frameRing.acquireNewest();
 
-        // Check if the frame is empty
-        if (frame.empty())
+        // Check if the capture has ended
+        if (pRingFrame == nullptr)
         {
             std::cerr << "Unable to capture frame\n";
             break;
         }
 
         // show the test input image with green boxes drawn around found digits
-        cv::imshow("frame", frame);     
+        cv::imshow("frame", pRingFrame->frame);
 
         // Check if the user pressed the 'C' or 'c' key for capture and ready for matching
         int key = cv::waitKey(1);
@@ -123,113 +921,66 @@ int main() {
             break;
         }
 
+        // 'L' or 'l' goes through the chars of the last capture so misread ones can be corrected, see correctCapture
+        if ((key == 76) || (key == 108))
+        {
+            correctCapture(frameContext, charClassifier, sampleLog);
+        }
+
         // Check if the user pressed the 'C' or 'c' key for capture ==> user is ready with the test image
         if ((key == 67) || (key == 99))
         {
-            // convert to grayscale
-            cv::cvtColor(frame, matGrayscale, cv::COLOR_BGR2GRAY);         
-
-            // blur
-            cv::GaussianBlur(matGrayscale, // input image
-                matBlurred,                // output image
-                cv::Size(5, 5),            // smoothing window width and height in pixels
-                0);                        // sigma value, determines how much the image will be blurred, zero makes function choose the sigma value
-
-            // filter image from grayscale to black and white
-            cv::adaptiveThreshold(matBlurred,         // input image
-                matThresh,                            // output image
-                255,                                  // make pixels that pass the threshold full white
-                cv::ADAPTIVE_THRESH_GAUSSIAN_C,       // use gaussian rather than mean, seems to give better results
-                cv::THRESH_BINARY_INV,                // invert so foreground will be white, background will be black
-                11,                                   // size of a pixel neighborhood used to calculate threshold value
-                2);                                   // constant subtracted from the mean or weighted mean
-
-            // make a copy of the thresh image, this in necessary because findContours modifies the image
-            matThreshCopy = matThresh.clone();              
-
-            std::vector<std::vector<cv::Point> > ptContours;        // declare a vector for the contours
-            std::vector<cv::Vec4i> v4iHierarchy;                    // declare a vector for the hierarchy (we won't use this in this program but this may be helpful for reference)
-
-            
-            cv::findContours(matThreshCopy,             // input image, make sure to use a copy since the function will modify this image in the course of finding contours
-                ptContours,                             // output contours
-                v4iHierarchy,                           // output hierarchy
-                cv::RETR_EXTERNAL,                      // retrieve the outermost contours only
-                cv::CHAIN_APPROX_SIMPLE);               // compress horizontal, vertical, and diagonal segments and leave only their end points
-            
-            
-            /*
-            // this is to draw a line around the edge
-            cv::findContours(matThreshCopy,             // input image, make sure to use a copy since the function will modify this image in the course of finding contours
-                ptContours,                             // output contours
-                v4iHierarchy,                           // output hierarchy
-                cv::RETR_TREE,                          // retrieve all possible contours from the image, compared to outermost contours only
-                cv::CHAIN_APPROX_NONE);                 // store all contour points. slower than CHAON_APPROX_SIMPLE
-            */
-
-            /*
-            // display edges around the input char
-             
-            cv::Mat image_copy = frame.clone();
-            cv::drawContours(image_copy, ptContours, -1, cv::Scalar(0, 255, 0), 2);
-            cv::imshow("edges around", image_copy);
-            */
-
-            // go through all contours
-            for (int i = 0; i < ptContours.size(); i++) {
-
-                // debugging for contours
-                // std::cout << "\n\n" << "contour at " << i << " = " << ptContours[i] << "\n\n"; 
-
-                // proceed if contour is big enough to consider
-                if (cv::contourArea(ptContours[i]) > MIN_CONTOUR_AREA) {
-
-                    // get the bounding rect
-                    cv::Rect boundingRect = cv::boundingRect(ptContours[i]);                
-                    
-                    // draw red rectangle around each contour as we ask user for input
-                    cv::rectangle(frame, boundingRect, cv::Scalar(0, 0, 255), 2);      
-
-                    // get ROI image of bounding rect
-                    cv::Mat matROI = matThresh(boundingRect);          
-                    cv::imshow("ROI", matROI);     
-
-                    // resize image, this will be more consistent for recognition and storage
-                    cv::Mat matROIResized;
-                    cv::resize(matROI, matROIResized, cv::Size(RESIZED_IMAGE_WIDTH, RESIZED_IMAGE_HEIGHT));     
-
-                    // convert the input Mat to float, necessary for call to find_nearest
-                    cv::Mat matROIFloat;
-                    matROIResized.convertTo(matROIFloat, CV_32FC1);             
-
-                    // flatten the source array (20x30) to 1x1 row
-                    cv::Mat matROIFlattenedFloat = matROIFloat.reshape(1, 1);
-
-                    // char the input test char represents
-                    cv::Mat matCurrentChar(0, 0, CV_32F);
-
-                    // call find_nearest to find the nearrest matching char in the trained data
-                    kNearest->findNearest(matROIFlattenedFloat, 1, matCurrentChar);     
-
-                    // find the float data in the Classification file
-                    float fltCurrentChar = (float)matCurrentChar.at<float>(0, 0);
-
-                    // find the ASCII char to display
-                    strFinalString = char(int(fltCurrentChar));        
-
-                    // show the ASCII char
-                    std::cout << "\n\n" << "numbers read = " << strFinalString << "\n\n";       
+            // the ring keeps its frame, the rectangles are drawn into a copy
+            pRingFrame->frame.copyTo(frame);
 
-                }
+            // grayscale, blur and threshold the capture the same way the training images were prepared
+            frameContext.preprocessor.process(frame, frameContext.matThresh);
+
+            // bounding rects of every contour big enough to consider, ignore noises
+            frameContext.segmenter.findRects(frameContext.matThresh, MIN_CONTOUR_AREA, frameContext.vecRects);
+
+            // forget the glyphs of the previous capture
+            frameContext.glyphBatch.clear();
+
+            // go through all chars
+            for (size_t i = 0; i < frameContext.vecRects.size(); i++) {
+                // get the bounding rect
+                const cv::Rect& boundingRect = frameContext.vecRects[i];
+
+                // draw red rectangle around each contour as we ask user for input
+                cv::rectangle(frame, boundingRect, cv::Scalar(0, 0, 255), 2);      
+
+                // get ROI image of bounding rect
+                cv::Mat matROI = frameContext.matThresh(boundingRect);          
+                cv::imshow("ROI", matROI);     
+
+                // resize image into the next flattened (20x30 to 1 row) row of the batch, this will be more
+                // consistent for recognition and storage, the classifier compares uint8 pixels so no float conversion
+                frameContext.glyphBatch.add(frameContext.matThresh, boundingRect);
             }
+
+            // classify every glyph of the capture in one call, the chars come back in reading order
+            frameContext.glyphBatch.classify(charClassifier, frameContext.vecChars, frameContext.strText);
+
+            // show the ASCII chars
+            std::cout << "\n\n" << "numbers read = " << frameContext.strText << "\n\n";
+            std::cerr << "frame " << pRingFrame->seq << " read " << frameRing.recordResult(*pRingFrame) << " ms after its capture\n";
         }
 
         // reset the key variable 
         key = 0;
     }
 
+    frameRing.release(pRingFrame);
+    frameRing.stop();
+    cap.release();
     cv::destroyAllWindows();
 
+    // corrections of this session go into the model file rather than waiting for the next compaction
+    if (sampleLog.samples() > 0) {
+        compactModel(sampleLog, charClassifier);
+    }
+
     return 0;
 }
 
@@ -8,6 +8,9 @@
 //              The images for the training characters are provided in the traing_chars.png. The program will detect each char in 
 //              the image file and present it to the user for classification of the char (labeling). Then the classification data 
 //              and the training/referencing char are saved into XML files for matching program on the K Nearest Neighbors logic  
+//              With --headless the labels come from a ground truth file instead, many images are cut and augmented on
+//              all cores and the binary model file is written block by block, see TrainingSet.h. --descriptor stores
+//              the model rows as a descriptor of the glyphs instead of their pixels, see FeatureDescriptor.h
 // 
 // ########################################################################################################################### 
 
@@ -18,7 +21,20 @@
 #include<opencv2/imgproc/imgproc.hpp>
 #include<opencv2/ml/ml.hpp>
 
+#include "../Common/CharClassifier.h"
+#include "../Common/CharPreprocess.h"
+#include "../Common/GlyphSegmenter.h"
+#include "../Common/KnnIndex.h"
+#include "../Common/ModelFile.h"
+#include "../Common/TrainingSet.h"
+#include "../Common/WorkStealingPool.h"
+
+#include<cctype>
+#include<cerrno>
+#include<climits>
+#include<cstdlib>
 #include<iostream>
+#include<string>
 #include<vector>
 
 // global variables ///////////////////////////////////////////////////////////////////////////////
@@ -26,6 +42,137 @@ const int MIN_CONTOUR_AREA = 100;
 const int RESIZED_IMAGE_WIDTH = 20;
 const int RESIZED_IMAGE_HEIGHT = 30;
 
+const std::string MODEL_FILE_NAME = "model.bin";                    // binary model file, loaded by CharMatch in place of the XML files
+const std::string INDEX_FILE_NAME = "model.idx";                    // search index over the rows of the model file, see KnnIndex.h
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// build the search index over the rows of a model file and write it next to it, CharMatch reads it on startup
+bool writeModelIndex(const std::string& strModel, KnnIndexType indexType) {
+
+    MappedModelFile modelFile;
+    if (!modelFile.open(strModel)) {
+        std::cout << "error, unable to open model file " << strModel << "\n\n";
+        return false;
+    }
+
+    CharClassifier charClassifier;
+    if (!charClassifier.train(modelFile.features(), modelFile.classifications())) {
+        return false;
+    }
+    charClassifier.setDescriptor(modelFile.descriptor());
+
+    int64_t t0 = cv::getTickCount();
+    KnnIndex knnIndex;
+    if (!knnIndex.build(charClassifier, indexType) || !knnIndex.write(INDEX_FILE_NAME)) {
+        return false;
+    }
+    double dblMs = (cv::getTickCount() - t0) / (cv::getTickFrequency() / 1000.0);
+
+    std::cout << KnnIndex::typeName(indexType) << " index over " << charClassifier.rows() << " rows written to " << INDEX_FILE_NAME
+              << ", " << knnIndex.bytes() / 1024 << " KB, built in " << dblMs << " ms\n\n";
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// the value of a numeric headless option, the whole string has to be a number; reports a bad value
+bool parseOptionNumber(const std::string& strOption, const char* pValue, unsigned long long maxValue, unsigned long long& value) {
+
+    char* pEnd = nullptr;
+    errno = 0;
+    value = std::strtoull(pValue, &pEnd, 10);
+    if (!std::isdigit((unsigned char)*pValue) || *pEnd != '\0' || errno == ERANGE || value > maxValue) {
+        std::cout << "error, " << strOption << " needs a number from 0 to " << maxValue << ", not " << pValue << "\n\n";
+        return false;
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// headless mode: CharTrain --headless (--truth FILE | --image PATH --chars TEXT) [--augment N] [--threads N]
+//                                     [--seed N] [--model PATH] [--index TYPE] [--descriptor NAME]
+// labels the glyphs from a ground truth file, or from the chars of one image in reading order, instead of asking
+// for a key per glyph, and writes only the binary model file; see TrainingSet.h
+int runHeadlessTraining(int argc, char** argv, bool blnIndex, KnnIndexType indexType, FeatureDescriptor descriptor) {
+
+    std::vector<TrainingImage> vecImages;
+    TrainingImage singleImage;
+    std::string strTruth;
+    std::string strModel = MODEL_FILE_NAME;
+    AugmentOptions augmentOptions;
+    int intThreads = 0;
+    unsigned long long value = 0;
+
+    for (int i = 2; i < argc; i += 2) {
+        std::string strOption = argv[i];
+        if (strOption != "--truth" && strOption != "--image" && strOption != "--chars" && strOption != "--augment" &&
+            strOption != "--threads" && strOption != "--seed" && strOption != "--model" && strOption != "--index" &&
+            strOption != "--descriptor") {
+            std::cout << "error, unknown option " << strOption << "\n\n";
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            std::cout << "error, " << strOption << " needs a value\n\n";
+            return 0;
+        }
+
+        if (strOption == "--truth") strTruth = argv[i + 1];
+        else if (strOption == "--image") singleImage.strPath = argv[i + 1];
+        else if (strOption == "--chars") singleImage.strChars = argv[i + 1];
+        else if (strOption == "--model") strModel = argv[i + 1];
+        else if (strOption == "--augment") {
+            if (!parseOptionNumber(strOption, argv[i + 1], INT_MAX, value)) return 0;
+            augmentOptions.intVariants = (int)value;
+        }
+        else if (strOption == "--threads") {
+            if (!parseOptionNumber(strOption, argv[i + 1], INT_MAX, value)) return 0;
+            intThreads = (int)value;
+        }
+        else if (strOption == "--seed") {
+            if (!parseOptionNumber(strOption, argv[i + 1], ULLONG_MAX, value)) return 0;
+            augmentOptions.seed = value;
+        }
+    }
+
+    if (!strTruth.empty()) {
+        if (!readGroundTruth(strTruth, vecImages)) {
+            return 0;
+        }
+    }
+    else if (!singleImage.strPath.empty() && !singleImage.strChars.empty()) {
+        vecImages.push_back(singleImage);
+    }
+    else {
+        std::cout << "error, --headless needs --truth FILE or --image PATH --chars TEXT\n\n";
+        return 0;
+    }
+
+    WorkStealingPool pool(intThreads);
+    TrainingStats stats;
+
+    int64_t t0 = cv::getTickCount();
+    std::vector<TrainingGlyph> vecGlyphs;
+    stats.intImages = cutTrainingGlyphs(pool, vecImages, MIN_CONTOUR_AREA, vecGlyphs);
+    stats.intSkippedImages = (int)vecImages.size() - stats.intImages;
+    stats.dblCutMs = (cv::getTickCount() - t0) / (cv::getTickFrequency() / 1000.0);
+
+    if (!writeTrainingModel(pool, vecGlyphs, augmentOptions, cv::Size(RESIZED_IMAGE_WIDTH, RESIZED_IMAGE_HEIGHT), descriptor, strModel, stats)) {
+        return 0;
+    }
+
+    double dblTotalMs = stats.dblCutMs + stats.dblWriteMs;
+    std::cout << stats.intImages << " images (" << stats.intSkippedImages << " skipped), " << stats.intGlyphs << " glyphs, "
+              << stats.intSamples << " " << FeatureExtractor::name(descriptor) << " samples written to " << strModel << " on " << pool.threads() << " threads\n"
+              << "cut " << stats.dblCutMs << " ms, render and write " << stats.dblWriteMs << " ms, "
+              << stats.intSamples / (dblTotalMs / 1000.0) << " samples/s\n\n";
+
+    // the index is built from the written file so it hashes the same rows CharMatch loads
+    if (blnIndex) {
+        writeModelIndex(strModel, indexType);
+    }
+
+    return 0;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 using namespace std;
 using namespace cv;
@@ -33,14 +180,64 @@ using namespace cv;
 
 int main(int argc, char** argv)
 {
+    // index mode: CharTrain --build-index brute|vptree|pq [model.bin]
+    // builds the search index of an existing model file, see KnnIndex.h
+    if (argc > 2 && std::string(argv[1]) == "--build-index") {
+        KnnIndexType indexType;
+        if (!KnnIndex::parseType(argv[2], indexType)) {
+            std::cout << "error, unknown index " << argv[2] << ", use brute, vptree or pq\n\n";
+            return 0;
+        }
+        writeModelIndex(argc > 3 ? argv[3] : MODEL_FILE_NAME, indexType);
+        return 0;
+    }
+
+    // CharTrain --index brute|vptree|pq also writes the search index of the model after training
+    KnnIndexType indexType = KNN_INDEX_BRUTE;
+    bool blnIndex = false;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::string(argv[i]) == "--index") {
+            blnIndex = KnnIndex::parseType(argv[i + 1], indexType);
+            if (!blnIndex) {
+                std::cout << "error, unknown index " << argv[i + 1] << ", use brute, vptree or pq\n\n";
+                return 0;
+            }
+        }
+    }
+
+    // CharTrain --descriptor pixels|zoning|hog|bits writes the model rows as that descriptor, see FeatureDescriptor.h;
+    // the XML files keep the pixels
+    FeatureDescriptor descriptor = DESCRIPTOR_PIXELS;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::string(argv[i]) == "--descriptor" && !FeatureExtractor::parse(argv[i + 1], descriptor)) {
+            std::cout << "error, unknown descriptor " << argv[i + 1] << ", use pixels, zoning, hog or bits\n\n";
+            return 0;
+        }
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "--headless") {
+        return runHeadlessTraining(argc, argv, blnIndex, indexType, descriptor);
+    }
+
+    // convert mode: CharTrain --convert [images.xml] [classifications.xml] [model.bin]
+    // turns an existing XML training set into the binary model file without retraining
+    if (argc > 1 && std::string(argv[1]) == "--convert") {
+        std::string strImages = argc > 2 ? argv[2] : "images.xml";
+        std::string strClassifications = argc > 3 ? argv[3] : "classifications.xml";
+        std::string strModel = argc > 4 ? argv[4] : MODEL_FILE_NAME;
+
+        if (!convertXmlModel(strImages, strClassifications, strModel, MODEL_FEATURE_U8, RESIZED_IMAGE_WIDTH, RESIZED_IMAGE_HEIGHT)) {
+            return 0;
+        }
+
+        std::cout << "converted " << strImages << " and " << strClassifications << " into " << strModel << "\n\n";
+        return 0;
+    }
+
     cv::Mat imgTrainingNumbers;         // input image
-    cv::Mat imgGrayscale;               // 
-    cv::Mat imgBlurred;                 // declare various images
-    cv::Mat imgThresh;                  //
-    cv::Mat imgThreshCopy;              //
+    cv::Mat imgThresh;                  // declare various images
 
-    std::vector<std::vector<cv::Point> > ptContours;        // declare contours vector
-    std::vector<cv::Vec4i> v4iHierarchy;                    // declare contours hierarchy
+    std::vector<cv::Rect> vecRects;                         // bounding rects of the chars on the sheet
 
     // these our training classifications
     cv::Mat matClassificationInts;      
@@ -64,82 +261,67 @@ int main(int argc, char** argv)
         return 0;
     }
 
-    // convert the source image to grayscale
-    cv::cvtColor(imgTrainingNumbers, imgGrayscale, COLOR_BGR2GRAY);        
-
-    // blur the image
-    cv::GaussianBlur(imgGrayscale,              // input image
-        imgBlurred,                             // output image
-        cv::Size(5, 5),                         // smoothing window width and height in pixels
-        0);                                     // sigma value, determines how much the image will be blurred, zero makes function choose the sigma value
+    // convert the source image to grayscale, blur it and filter it to black and white, with the same
+    // preprocessing CharMatch runs on every capture so the training chars look like the matched ones
+    WorkStealingPool preprocessPool;
+    CharPreprocessor charPreprocessor(&preprocessPool);
+    charPreprocessor.process(imgTrainingNumbers, imgThresh);
 
-    // filter the source image from grayscale to black and white
-    cv::adaptiveThreshold(imgBlurred,           // input image
-        imgThresh,                              // output image
-        255,                                    // make pixels that pass the threshold full white
-        cv::ADAPTIVE_THRESH_GAUSSIAN_C,         // use gaussian rather than mean, seems to give better results
-        cv::THRESH_BINARY_INV,                  // invert so foreground will be white, background will be black
-        11,                                     // size of a pixel neighborhood used to calculate threshold value
-        2);                                     // constant subtracted from the mean or weighted mean
+    // bounding rects of every glyph big enough to consider, ignore noises
+    GlyphSegmenter glyphSegmenter(&preprocessPool);
+    glyphSegmenter.findRects(imgThresh, MIN_CONTOUR_AREA, vecRects);
 
-    // make a copy of the thresh image, this in necessary because findContours modifies the image
-    imgThreshCopy = imgThresh.clone();          
+    // reserve a row for every char, so push_back below copies every image once instead of reallocating the whole
+    // training Mat as it grows
+    matClassificationInts.reserve((int)vecRects.size());
+    matTrainingImagesAsFlattenedFloats.reserve((int)vecRects.size());
 
-    // find all contours in the source image file and store in a vector 
-    cv::findContours(imgThreshCopy,             // input image, make sure to use a copy since the function will modify this image in the course of finding contours
-        ptContours,                             // output contours
-        v4iHierarchy,                           // output hierarchy
-        cv::RETR_EXTERNAL,                      // retrieve the outermost contours only
-        cv::CHAIN_APPROX_SIMPLE);               // compress horizontal, vertical, and diagonal segments and leave only their end points
+    // resized and float images of the current char, reused for every rect
+    cv::Mat matROIResized;
+    cv::Mat matImageFloat;
 
-    // go through all contours in the vector
-    for (int i = 0; i < ptContours.size(); i++) {
+    // go through all chars
+    for (size_t i = 0; i < vecRects.size(); i++) {
 
-        // process only the contour is big enough to consider, ignore noises
-        if (cv::contourArea(ptContours[i]) > MIN_CONTOUR_AREA) {
+        // bounding rect of the char
+        cv::Rect boundingRect = vecRects[i];
 
-            // get the bounding rect of the contour
-            cv::Rect boundingRect = cv::boundingRect(ptContours[i]);                
+        // draw red rectangle around each contour as we ask user for input
+        cv::rectangle(imgTrainingNumbers, boundingRect, cv::Scalar(0, 0, 255), 2);      
 
-            // draw red rectangle around each contour as we ask user for input
-            cv::rectangle(imgTrainingNumbers, boundingRect, cv::Scalar(0, 0, 255), 2);      
+        // get region of interest (ROI) image of bounding rect
+        cv::Mat matROI = imgThresh(boundingRect);           
 
-            // get region of interest (ROI) image of bounding rect
-            cv::Mat matROI = imgThresh(boundingRect);           
+        // resize image to make it more consistent for recognition and storage
+        cv::resize(matROI, matROIResized, cv::Size(RESIZED_IMAGE_WIDTH, RESIZED_IMAGE_HEIGHT));     
 
-            // resize image to make it more consistent for recognition and storage
-            cv::Mat matROIResized;
-            cv::resize(matROI, matROIResized, cv::Size(RESIZED_IMAGE_WIDTH, RESIZED_IMAGE_HEIGHT));     
+        // display the images for user's input 
+        cv::imshow("matROI", matROI);                               // show ROI image for reference
+        cv::imshow("matROIResized", matROIResized);                 // show resized ROI image for reference
+        cv::imshow("imgTrainingNumbers", imgTrainingNumbers);       // show training numbers image, this will now have red rectangles drawn on it
 
-            // display the images for user's input 
-            cv::imshow("matROI", matROI);                               // show ROI image for reference
-            cv::imshow("matROIResized", matROIResized);                 // show resized ROI image for reference
-            cv::imshow("imgTrainingNumbers", imgTrainingNumbers);       // show training numbers image, this will now have red rectangles drawn on it
+        int intChar = cv::waitKey(0);           // get key press
 
-            int intChar = cv::waitKey(0);           // get key press
+        // if esc key was pressed, then exit program
+        if (intChar == 27) {     
+            return 0;
+        }
+        // else if the char entered by the user is in the list of chars we are looking for . . .
+        else if (std::find(intValidChars.begin(), intValidChars.end(), intChar) != intValidChars.end()) {     
 
-            // if esc key was pressed, then exit program
-            if (intChar == 27) {     
-                return 0;
-            }
-            // else if the char entered by the user is in the list of chars we are looking for . . .
-            else if (std::find(intValidChars.begin(), intValidChars.end(), intChar) != intValidChars.end()) {     
+            // append classification char to integer list of chars
+            matClassificationInts.push_back(intChar);       
 
-                // append classification char to integer list of chars
-                matClassificationInts.push_back(intChar);       
+            // now add the training image after converting Mat to float due to KNearest data types being float
+            matROIResized.convertTo(matImageFloat, CV_32FC1);       
 
-                // now add the training image after converting Mat to float due to KNearest data types being float
-                cv::Mat matImageFloat;                          
-                matROIResized.convertTo(matImageFloat, CV_32FC1);       
+            // flatten the source array (20x30) to 1x1 row
+            cv::Mat matImageFlattenedFloat = matImageFloat.reshape(1, 1);       
 
-                // flatten the source array (20x30) to 1x1 row
-                cv::Mat matImageFlattenedFloat = matImageFloat.reshape(1, 1);       
-
-                // add to Mat as though it was a vector, this is necessary due to the
-                // data types that KNearest.train accepts
-                matTrainingImagesAsFlattenedFloats.push_back(matImageFlattenedFloat);       
-                                                                                            
-            }   
+            // add to Mat as though it was a vector, this is necessary due to the
+            // data types that KNearest.train accepts
+            matTrainingImagesAsFlattenedFloats.push_back(matImageFlattenedFloat);       
+                                                                                        
         }   
     }   
 
@@ -182,6 +364,26 @@ int main(int argc, char** argv)
     // close the training images file
     fsTrainingImages.release();                                                 
 
+    //*********************************************************************************************************
+    // save the same training data as a binary model file, CharMatch maps this instead of parsing the XML
+    //
+    // resized threshold pixels are whole numbers 0..255, so uint8 storage loses nothing
+    cv::Mat matModelRows = matTrainingImagesAsFlattenedFloats;
+    if (descriptor != DESCRIPTOR_PIXELS) {
+        cv::Mat matPixels;
+        matTrainingImagesAsFlattenedFloats.convertTo(matPixels, CV_8U);
+        FeatureExtractor featureExtractor(descriptor, RESIZED_IMAGE_WIDTH, RESIZED_IMAGE_HEIGHT);
+        featureExtractor.extract(matPixels, matModelRows);
+    }
+    if (!writeModelFile(MODEL_FILE_NAME, matModelRows, matClassificationInts, MODEL_FEATURE_U8, RESIZED_IMAGE_WIDTH, RESIZED_IMAGE_HEIGHT, descriptor)) {
+        return 0;
+    }
+
+    // and the search index over it, built from the written file so it hashes the same rows CharMatch loads
+    if (blnIndex) {
+        writeModelIndex(MODEL_FILE_NAME, indexType);
+    }
+
     return 0;
 }
 
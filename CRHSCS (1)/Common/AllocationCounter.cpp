@@ -0,0 +1,117 @@
+// ###########################################################################################################################
+// AllocationCounter.cpp :
+//
+// Description: Counting operator new replacements and cv::Mat allocator, see AllocationCounter.h
+//
+// ###########################################################################################################################
+
+#include "AllocationCounter.h"
+
+#include<opencv2/core/core.hpp>
+
+#include<atomic>
+#include<cstdlib>
+#include<new>
+
+// global variables ///////////////////////////////////////////////////////////////////////////////
+static std::atomic<uint64_t> newCalls(0);
+static std::atomic<uint64_t> matBuffers(0);
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void* operator new(std::size_t size) {
+
+    newCalls.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0) {
+        size = 1;
+    }
+    for (;;) {
+        void* p = std::malloc(size);
+        if (p != nullptr) {
+            return p;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return operator new(size);
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return operator new(size);
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// counts the buffers and leaves the work to the standard allocator, which also frees them again
+class CountingMatAllocator : public cv::MatAllocator {
+public:
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override {
+        if (data == nullptr) {
+            matBuffers.fetch_add(1, std::memory_order_relaxed);
+        }
+        return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+    }
+
+    bool allocate(cv::UMatData* u, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override {
+        return cv::Mat::getStdAllocator()->allocate(u, accessFlags, usageFlags);
+    }
+
+    void deallocate(cv::UMatData* u) const override {
+        cv::Mat::getStdAllocator()->deallocate(u);
+    }
+};
+
+void installMatAllocationCounter() {
+    static CountingMatAllocator allocator;
+    cv::Mat::setDefaultAllocator(&allocator);
+}
+
+AllocationCounts allocationCounts() {
+    AllocationCounts counts;
+    counts.newCalls = newCalls.load(std::memory_order_relaxed);
+    counts.matBuffers = matBuffers.load(std::memory_order_relaxed);
+    return counts;
+}
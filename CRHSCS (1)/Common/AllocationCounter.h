@@ -0,0 +1,28 @@
+// ###########################################################################################################################
+// AllocationCounter.h :
+//
+// Description: Heap allocation counts for the allocation check of the benchmark. AllocationCounter.cpp replaces the
+//              global operator new of the program it is linked into, so it only belongs into the benchmark, and
+//              installMatAllocationCounter puts a counting allocator in front of the default cv::Mat allocator.
+//
+//              Not counted: memory OpenCV takes with malloc for its own scratch (AutoBuffer, IPP buffers), and on
+//              Windows the operator new calls inside the OpenCV DLL, which keeps the one of its own runtime. The
+//              cv::Mat buffers OpenCV allocates are counted everywhere.
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include<cstdint>
+
+struct AllocationCounts {
+    uint64_t newCalls;                              // operator new and new[]
+    uint64_t matBuffers;                            // cv::Mat data allocated through the default allocator
+
+    uint64_t total() const { return newCalls + matBuffers; }
+};
+
+// count the cv::Mat buffers from now on, operator new is counted from the start of the program
+void installMatAllocationCounter();
+
+AllocationCounts allocationCounts();
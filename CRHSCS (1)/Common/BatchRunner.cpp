@@ -0,0 +1,174 @@
+// ###########################################################################################################################
+// BatchRunner.cpp :
+//
+// Description: Batch planning, ordered parallel processing and the scaling report, see BatchRunner.h
+//
+// ###########################################################################################################################
+
+#include "BatchRunner.h"
+
+#include<opencv2/core/core.hpp>
+
+#include<atomic>
+#include<iomanip>
+#include<iostream>
+#include<mutex>
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool planBatch(const std::vector<std::string>& vecInputs, uint64_t segmentFrames, std::vector<BatchItem>& vecItems) {
+
+    vecItems.clear();
+
+    for (const std::string& strInput : vecInputs) {
+        FrameSource frameSource;
+        if (!frameSource.open(strInput)) {
+            return false;
+        }
+
+        BatchItem item;
+
+        switch (frameSource.type()) {
+        case SOURCE_IMAGE:
+            item.strSpec = strInput;
+            vecItems.push_back(item);
+            break;
+
+        case SOURCE_DIRECTORY: {
+            // every image is its own item, so a slow image only holds up one worker
+            std::vector<std::string> vecFiles;
+            FrameSource::listImages(strInput.compare(0, 4, "dir:") == 0 ? strInput.substr(4) : strInput, vecFiles);
+            for (const std::string& strFile : vecFiles) {
+                item.strSpec = strFile;
+                vecItems.push_back(item);
+            }
+            break;
+        }
+
+        case SOURCE_VIDEO: {
+            // the frame count is the container's estimate, the last segment reads to the real end
+            int64_t intFrames = frameSource.frameCount();
+            item.strSpec = strInput;
+            if (segmentFrames == 0 || intFrames <= (int64_t)segmentFrames) {
+                vecItems.push_back(item);
+                break;
+            }
+            for (uint64_t start = 0; start < (uint64_t)intFrames; start += segmentFrames) {
+                item.startFrame = start;
+                item.frameCount = start + segmentFrames < (uint64_t)intFrames ? segmentFrames : 0;
+                vecItems.push_back(item);
+            }
+            break;
+        }
+
+        default:
+            std::cerr << "error, " << strInput << " is a live input and cannot be processed as a batch\n";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool openBatchItem(const BatchItem& item, FrameSource& frameSource) {
+
+    if (!frameSource.open(item.strSpec)) {
+        return false;
+    }
+    if (item.startFrame > 0 && !frameSource.seekFrame(item.startFrame)) {
+        std::cerr << "error, unable to seek " << item.strSpec << " to frame " << item.startFrame << "\n";
+        return false;
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+BatchResult runBatch(WorkStealingPool& pool, const std::vector<BatchItem>& vecItems, const BatchProcessFn& fnProcess, ResultWriter* pWriter) {
+
+    size_t intItems = vecItems.size();
+
+    // lines of finished items wait here until every item before them is written
+    std::vector<std::vector<std::string>> vecPending(intItems);
+    std::vector<char> vecFinished(intItems, 0);
+    size_t nextToWrite = 0;
+    std::mutex mutexOrder;
+
+    std::atomic<uint64_t> frames(0);
+    uint64_t stealsBefore = pool.steals();
+    int64_t startTick = cv::getTickCount();
+
+    pool.parallelFor(intItems, [&](size_t i, int intWorker) {
+
+        std::vector<std::string> vecLines;
+        frames += fnProcess(vecItems[i], intWorker, vecLines);
+
+        if (pWriter == nullptr) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutexOrder);
+        vecPending[i].swap(vecLines);
+        vecFinished[i] = 1;
+
+        while (nextToWrite < intItems && vecFinished[nextToWrite]) {
+            for (const std::string& strLine : vecPending[nextToWrite]) {
+                pWriter->writeLine(strLine);
+            }
+            std::vector<std::string>().swap(vecPending[nextToWrite]);
+            nextToWrite++;
+        }
+    });
+
+    BatchResult batchResult;
+    batchResult.dblSeconds = (cv::getTickCount() - startTick) / cv::getTickFrequency();
+    batchResult.frames = frames;
+    batchResult.steals = pool.steals() - stealsBefore;
+    return batchResult;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void reportBatchScaling(const std::vector<BatchItem>& vecItems, int intMaxThreads, const BatchProcessFn& fnProcess) {
+
+    if (intMaxThreads <= 0) {
+        intMaxThreads = WorkStealingPool::hardwareThreads();
+    }
+
+    std::vector<int> vecThreadCounts;
+    for (int intThreads = 1; intThreads < intMaxThreads; intThreads *= 2) {
+        vecThreadCounts.push_back(intThreads);
+    }
+    vecThreadCounts.push_back(intMaxThreads);
+
+    // one untimed run first, so the files are in the OS cache for every timed run and not only for the later ones
+    {
+        WorkStealingPool pool(intMaxThreads);
+        runBatch(pool, vecItems, fnProcess, nullptr);
+    }
+
+    std::cout << "batch scaling, " << vecItems.size() << " items\n";
+    std::cout << std::setw(8) << "threads" << std::setw(12) << "seconds" << std::setw(12) << "frames/s"
+        << std::setw(10) << "speedup" << std::setw(12) << "efficiency" << std::setw(8) << "steals" << "\n";
+
+    double dblBaseSeconds = 0;
+    std::streamsize oldPrecision = std::cout.precision();
+
+    for (int intThreads : vecThreadCounts) {
+        WorkStealingPool pool(intThreads);
+        BatchResult batchResult = runBatch(pool, vecItems, fnProcess, nullptr);
+
+        if (intThreads == 1) {
+            dblBaseSeconds = batchResult.dblSeconds;
+        }
+        double dblSpeedup = batchResult.dblSeconds > 0 ? dblBaseSeconds / batchResult.dblSeconds : 0.0;
+
+        std::cout << std::fixed << std::setprecision(3)
+            << std::setw(8) << intThreads
+            << std::setw(12) << batchResult.dblSeconds
+            << std::setw(12) << (batchResult.dblSeconds > 0 ? batchResult.frames / batchResult.dblSeconds : 0.0)
+            << std::setw(10) << dblSpeedup
+            << std::setw(12) << dblSpeedup / intThreads
+            << std::setw(8) << batchResult.steals << "\n";
+    }
+
+    std::cout.unsetf(std::ios::fixed);
+    std::cout.precision(oldPrecision);
+}
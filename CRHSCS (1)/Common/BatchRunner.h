@@ -0,0 +1,52 @@
+// ###########################################################################################################################
+// BatchRunner.h :
+//
+// Description: Batch processing of many recorded inputs on a WorkStealingPool. The inputs are split into independent
+//              items (one per image, fixed length segments of every video), the items are processed in parallel and
+//              their JSON lines are written in item order, so the output of a batch does not depend on the number of
+//              threads or on scheduling. reportBatchScaling runs the same batch with 1 .. N threads and prints the
+//              speedup and parallel efficiency of each.
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include "FrameSource.h"
+#include "JsonLines.h"
+#include "WorkStealingPool.h"
+
+#include<cstdint>
+#include<functional>
+#include<string>
+#include<vector>
+
+// one independent unit of a batch
+struct BatchItem {
+    std::string strSpec;                            // FrameSource spec of the image or video
+    uint64_t startFrame = 0;                        // first frame of the segment
+    uint64_t frameCount = 0;                        // frames in the segment, 0 reads to the end of the input
+};
+
+// processes one item on worker intWorker, appends one JSON line per frame to vecLines and returns the frames processed
+typedef std::function<uint64_t(const BatchItem& item, int intWorker, std::vector<std::string>& vecLines)> BatchProcessFn;
+
+struct BatchResult {
+    double dblSeconds = 0;
+    uint64_t frames = 0;
+    uint64_t steals = 0;                            // items a worker took from another worker's range
+};
+
+// split the inputs into items: every image of a directory, single images, and videos in segments of segmentFrames
+// (0 keeps a video in one piece); cameras and stdin cannot be split and are rejected
+bool planBatch(const std::vector<std::string>& vecInputs, uint64_t segmentFrames, std::vector<BatchItem>& vecItems);
+
+// open the input of an item positioned at its first frame
+bool openBatchItem(const BatchItem& item, FrameSource& frameSource);
+
+// process every item on the pool, the lines go to pWriter (nullptr discards them) in item order as soon as
+// every earlier item is finished
+BatchResult runBatch(WorkStealingPool& pool, const std::vector<BatchItem>& vecItems, const BatchProcessFn& fnProcess, ResultWriter* pWriter);
+
+// run the batch with 1, 2, 4 .. intMaxThreads workers without writing anything and print time, throughput,
+// speedup and efficiency (speedup / threads); worker indices stay below intMaxThreads
+void reportBatchScaling(const std::vector<BatchItem>& vecItems, int intMaxThreads, const BatchProcessFn& fnProcess);
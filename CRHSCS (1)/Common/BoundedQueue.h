@@ -0,0 +1,132 @@
+// ###########################################################################################################################
+// BoundedQueue.h :
+//
+// Description: Fixed capacity lock free queue connecting the stages of the streaming pipelines. It is the bounded
+//              multi producer / multi consumer ring of Dmitry Vyukov: every cell carries a sequence number, so producers
+//              and consumers only ever compare-and-swap their own position and never take a lock.
+//
+//              pushDropOldest never blocks a producer: when the queue is full the oldest entries are popped and thrown
+//              away, so a slow stage sees the newest frames and the latency through the pipeline stays bounded.
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include<atomic>
+#include<cstddef>
+#include<cstdint>
+#include<memory>
+#include<utility>
+
+template<typename T>
+class BoundedQueue {
+public:
+    // capacity is rounded up to a power of two
+    explicit BoundedQueue(size_t intCapacity) {
+        size_t size = 2;
+        while (size < intCapacity) {
+            size *= 2;
+        }
+
+        mask = size - 1;
+        cells.reset(new Cell[size]);
+        for (size_t i = 0; i < size; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        enqueuePos.store(0, std::memory_order_relaxed);
+        dequeuePos.store(0, std::memory_order_relaxed);
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // move value into the queue, false (and value untouched) when the queue is full
+    bool tryPush(T& value) {
+        Cell* cell;
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+
+        for (;;) {
+            cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+
+            if (dif == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else if (dif < 0) {
+                return false;
+            }
+            else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->data = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // move the oldest entry out of the queue, false when the queue is empty
+    bool tryPop(T& value) {
+        Cell* cell;
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+
+        for (;;) {
+            cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+
+            if (dif == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else if (dif < 0) {
+                return false;
+            }
+            else {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        value = std::move(cell->data);
+        cell->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // push, throwing away the oldest entries while the queue is full, returns how many were thrown away
+    size_t pushDropOldest(T& value) {
+        size_t intDropped = 0;
+        while (!tryPush(value)) {
+            T old;
+            if (tryPop(old)) {
+                intDropped++;
+            }
+        }
+        return intDropped;
+    }
+
+    // number of entries, only a snapshot while other threads are pushing or popping
+    size_t size() const {
+        size_t enq = enqueuePos.load(std::memory_order_relaxed);
+        size_t deq = dequeuePos.load(std::memory_order_relaxed);
+        return enq > deq ? enq - deq : 0;
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+
+    // producers and consumers each get their own cache line
+    alignas(64) std::atomic<size_t> enqueuePos;
+    alignas(64) std::atomic<size_t> dequeuePos;
+};
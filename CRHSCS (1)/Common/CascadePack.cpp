@@ -0,0 +1,332 @@
+// ###########################################################################################################################
+// CascadePack.cpp :
+//
+// Description: Writing, memory mapping and loading of the cascade pack described in CascadePack.h
+//
+// ###########################################################################################################################
+
+#include "CascadePack.h"
+
+#include<cstdio>
+#include<cstring>
+#include<fstream>
+#include<iostream>
+#include<mutex>
+#include<sstream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include<windows.h>
+#else
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+#endif
+
+// global variables ///////////////////////////////////////////////////////////////////////////////
+const std::string CASCADE_PACK_NAME = "cascades.pack";
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+static bool readTextFile(const std::string& strPath, std::string& strText) {
+    std::ifstream file(strPath, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::ostringstream text;
+    text << file.rdbuf();
+    strText = text.str();
+    return true;
+}
+
+// the XML without its comments and without the whitespace around every line, the values stay as they are
+static std::string compactXml(const std::string& strXml) {
+
+    std::string strUncommented;
+    strUncommented.reserve(strXml.size());
+    size_t pos = 0;
+    while (pos < strXml.size()) {
+        size_t begin = strXml.find("<!--", pos);
+        size_t end = begin == std::string::npos ? std::string::npos : strXml.find("-->", begin + 4);
+        if (end == std::string::npos) {
+            strUncommented.append(strXml, pos, std::string::npos);
+            break;
+        }
+        strUncommented.append(strXml, pos, begin - pos);
+        pos = end + 3;
+    }
+
+    std::string strCompact;
+    strCompact.reserve(strUncommented.size());
+    pos = 0;
+    while (pos < strUncommented.size()) {
+        size_t end = strUncommented.find('\n', pos);
+        if (end == std::string::npos) {
+            end = strUncommented.size();
+        }
+        size_t first = strUncommented.find_first_not_of(" \t\r", pos);
+        if (first != std::string::npos && first < end) {
+            size_t last = strUncommented.find_last_not_of(" \t\r", end - 1);
+            strCompact.append(strUncommented, first, last + 1 - first);
+            strCompact += '\n';
+        }
+        pos = end + 1;
+    }
+    return strCompact;
+}
+
+bool readCascade(const char* pText, size_t size, cv::CascadeClassifier& cascade) {
+
+    // a damaged text makes the parser throw rather than fail
+    try {
+        cv::FileStorage fs(std::string(pText, size), cv::FileStorage::READ | cv::FileStorage::MEMORY);
+        return fs.isOpened() && cascade.read(fs.getFirstTopLevelNode());
+    }
+    catch (const cv::Exception&) {
+        return false;
+    }
+}
+
+bool writeCascadePack(const std::string& strPath, const std::vector<std::string>& vecCascades) {
+
+    std::vector<std::string> vecTexts;
+    std::string strConverted = strPath + ".convert.xml";
+    uint64_t xmlBytes = 0;
+
+    for (const std::string& strName : vecCascades) {
+
+        // trap for a name the entry cannot hold
+        if (strName.size() >= (size_t)CASCADE_PACK_NAME_SIZE) {
+            std::cout << "error, cascade name " << strName << " is too long for the pack\n\n";
+            return false;
+        }
+
+        std::string strXml;
+        if (!readTextFile(strName, strXml)) {
+            std::cout << "error, unable to read cascade " << strName << "\n\n";
+            return false;
+        }
+
+        // old format cascades are converted once here instead of on every load, current ones are taken as they are
+        std::string strText;
+        bool blnConverted = cv::CascadeClassifier::convert(strName, strConverted) && readTextFile(strConverted, strText);
+        std::remove(strConverted.c_str());
+        strText = compactXml(blnConverted ? strText : strXml);
+
+        // trap for a cascade that does not survive the trip
+        cv::CascadeClassifier cascade;
+        if (!readCascade(strText.data(), strText.size(), cascade) || cascade.empty()) {
+            std::cout << "error, cascade " << strName << " does not load after packing\n\n";
+            return false;
+        }
+
+        std::cout << strName << ": " << strXml.size() << " -> " << strText.size() << " bytes"
+                  << (blnConverted ? ", converted from the old format" : "") << "\n";
+        xmlBytes += strXml.size();
+        vecTexts.push_back(strText);
+    }
+
+    CascadePackHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, CASCADE_PACK_MAGIC, sizeof(header.magic));
+    header.version = CASCADE_PACK_VERSION;
+    header.count = (uint32_t)vecCascades.size();
+
+    std::vector<CascadePackEntry> vecEntries(vecCascades.size());
+    uint64_t offset = sizeof(CascadePackHeader) + vecEntries.size() * sizeof(CascadePackEntry);
+    for (size_t i = 0; i < vecEntries.size(); i++) {
+        std::memset(&vecEntries[i], 0, sizeof(CascadePackEntry));
+        std::memcpy(vecEntries[i].name, vecCascades[i].c_str(), vecCascades[i].size());
+        vecEntries[i].offset = offset;
+        vecEntries[i].size = vecTexts[i].size();
+        offset += vecTexts[i].size();
+    }
+    header.fileSize = offset;
+
+    // written next to the pack and renamed, a process mapping the old pack keeps it until it is done
+    std::string strTemp = strPath + ".tmp";
+    {
+        std::ofstream file(strTemp, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(vecEntries.data()), (std::streamsize)(vecEntries.size() * sizeof(CascadePackEntry)));
+        for (const std::string& strText : vecTexts) {
+            file.write(strText.data(), (std::streamsize)strText.size());
+        }
+
+        if (!file.good()) {
+            std::cout << "error, unable to write cascade pack " << strTemp << "\n\n";
+            return false;
+        }
+    }
+
+#ifdef _WIN32
+    // rename does not replace an existing file on Windows, elsewhere it does in one step and a detector starting
+    // meanwhile never finds the pack missing
+    std::remove(strPath.c_str());
+#endif
+    if (std::rename(strTemp.c_str(), strPath.c_str()) != 0) {
+        std::cout << "error, unable to replace cascade pack " << strPath << "\n\n";
+        return false;
+    }
+
+    std::cout << "wrote " << vecCascades.size() << " cascades to " << strPath << ", " << xmlBytes << " -> " << header.fileSize << " bytes\n";
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+CascadePack::CascadePack() : pData(nullptr), sizeData(0), hFile(nullptr), hMapping(nullptr) {
+}
+
+CascadePack::~CascadePack() {
+    close();
+}
+
+bool CascadePack::open(const std::string& strPath) {
+
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(strPath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (view == nullptr) {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        std::cout << "error, unable to map cascade pack " << strPath << "\n\n";
+        return false;
+    }
+
+    hFile = file;
+    hMapping = mapping;
+    pData = static_cast<const uint8_t*>(view);
+    sizeData = (size_t)fileSize.QuadPart;
+#else
+    int fd = ::open(strPath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        std::cout << "error, cascade pack " << strPath << " is empty\n\n";
+        return false;
+    }
+
+    void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    // the mapping keeps its own reference to the file
+    ::close(fd);
+
+    if (view == MAP_FAILED) {
+        std::cout << "error, unable to map cascade pack " << strPath << "\n\n";
+        return false;
+    }
+
+    pData = static_cast<const uint8_t*>(view);
+    sizeData = (size_t)st.st_size;
+#endif
+
+    // validate the header and every entry before anybody reads through them
+    bool valid = sizeData >= sizeof(CascadePackHeader);
+    if (valid) {
+        const CascadePackHeader& header = *reinterpret_cast<const CascadePackHeader*>(pData);
+        uint64_t textOffset = sizeof(CascadePackHeader) + (uint64_t)header.count * sizeof(CascadePackEntry);
+
+        valid = std::memcmp(header.magic, CASCADE_PACK_MAGIC, sizeof(header.magic)) == 0
+            && header.version == CASCADE_PACK_VERSION
+            && header.fileSize == sizeData
+            && textOffset <= header.fileSize;
+
+        const CascadePackEntry* pEntries = reinterpret_cast<const CascadePackEntry*>(pData + sizeof(CascadePackHeader));
+        for (uint32_t i = 0; valid && i < header.count; i++) {
+            valid = pEntries[i].offset >= textOffset
+                && pEntries[i].size <= header.fileSize
+                && pEntries[i].offset <= header.fileSize - pEntries[i].size
+                && std::memchr(pEntries[i].name, 0, CASCADE_PACK_NAME_SIZE) != nullptr;
+        }
+    }
+
+    if (!valid) {
+        std::cout << "error, " << strPath << " is not a valid version " << CASCADE_PACK_VERSION << " cascade pack\n\n";
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void CascadePack::close() {
+
+    if (pData == nullptr) {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(pData);
+    CloseHandle((HANDLE)hMapping);
+    CloseHandle((HANDLE)hFile);
+#else
+    munmap(const_cast<uint8_t*>(pData), sizeData);
+#endif
+
+    pData = nullptr;
+    sizeData = 0;
+    hFile = nullptr;
+    hMapping = nullptr;
+}
+
+bool CascadePack::find(const std::string& strName, const char*& pText, size_t& size) const {
+
+    if (pData == nullptr) {
+        return false;
+    }
+
+    const CascadePackHeader& header = *reinterpret_cast<const CascadePackHeader*>(pData);
+    const CascadePackEntry* pEntries = reinterpret_cast<const CascadePackEntry*>(pData + sizeof(CascadePackHeader));
+    for (uint32_t i = 0; i < header.count; i++) {
+        if (strName == pEntries[i].name) {
+            pText = reinterpret_cast<const char*>(pData + pEntries[i].offset);
+            size = (size_t)pEntries[i].size;
+            return true;
+        }
+    }
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const CascadePack* sharedCascadePack() {
+    static CascadePack cascadePack;
+    static std::once_flag onceOpen;
+    std::call_once(onceOpen, [] { cascadePack.open(CASCADE_PACK_NAME); });
+    return cascadePack.isOpen() ? &cascadePack : nullptr;
+}
+
+bool loadCascade(const std::string& strName, cv::CascadeClassifier& cascade, const CascadePack* pPack) {
+
+    const char* pText = nullptr;
+    size_t size = 0;
+    if (pPack != nullptr && pPack->find(strName, pText, size)) {
+        return readCascade(pText, size, cascade);
+    }
+    return cascade.load(strName);
+}
+
+bool cascadeAvailable(const std::string& strName, const CascadePack* pPack) {
+
+    const char* pText = nullptr;
+    size_t size = 0;
+    if (pPack != nullptr && pPack->find(strName, pText, size)) {
+        return true;
+    }
+    return std::ifstream(strName).is_open();
+}
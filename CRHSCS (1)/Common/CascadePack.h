@@ -0,0 +1,97 @@
+// ###########################################################################################################################
+// CascadePack.h :
+//
+// Description: The Haar cascades of FacialDetection preconverted into one pack file. The mouth and nose cascades ship
+//              in the old OpenCV format, which CascadeClassifier::load converts on every load and which takes about
+//              three times as long to load as the same cascade in the current format. The pack holds every cascade
+//              converted once into the current format, with the comments and the indentation taken out, and is
+//              memory mapped read only, so all detectors and threads of a process and all processes on the machine
+//              share one copy of it in the page cache.
+//
+//              layout:  [CascadePackHeader][count x CascadePackEntry][XML text of every cascade]
+//
+//              CascadeClassifier has no other way in than a FileNode, so a cascade is still parsed from the text of
+//              the pack into every classifier; FaceDetector does that when a cascade is first needed, so cascades
+//              that are never used are never parsed. Without a pack the XML files are loaded as before.
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include<opencv2/core/core.hpp>
+#include<opencv2/objdetect/objdetect.hpp>
+
+#include<cstdint>
+#include<string>
+#include<vector>
+
+// cascade pack constants /////////////////////////////////////////////////////////////////////////
+const char CASCADE_PACK_MAGIC[4] = { 'C', 'R', 'H', 'C' };
+const uint32_t CASCADE_PACK_VERSION = 1;
+const int CASCADE_PACK_NAME_SIZE = 64;              // bytes of the zero terminated cascade file name of an entry
+
+// pack file, next to the executable like the cascades
+extern const std::string CASCADE_PACK_NAME;
+
+// fixed 32 byte header at the start of a pack
+struct CascadePackHeader {
+    char     magic[4];                              // CASCADE_PACK_MAGIC
+    uint32_t version;                               // CASCADE_PACK_VERSION
+    uint32_t count;                                 // number of cascades
+    uint32_t reserved;                              // zero
+    uint64_t fileSize;                              // total file size, used to detect truncated files
+    uint8_t  reserved2[8];                          // zero
+};
+
+// one cascade of the pack
+struct CascadePackEntry {
+    char     name[CASCADE_PACK_NAME_SIZE];          // file name of the XML cascade it was made from
+    uint64_t offset;                                // byte offset of its text
+    uint64_t size;                                  // bytes of its text
+};
+
+static_assert(sizeof(CascadePackHeader) == 32, "cascade pack header must stay 32 bytes");
+static_assert(sizeof(CascadePackEntry) == 80, "cascade pack entry must stay 80 bytes");
+
+// convert the XML cascades into a pack at strPath, prints the size of every cascade before and after
+bool writeCascadePack(const std::string& strPath, const std::vector<std::string>& vecCascades);
+
+// parse a cascade from its XML text
+bool readCascade(const char* pText, size_t size, cv::CascadeClassifier& cascade);
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// read only memory mapping of a cascade pack
+class CascadePack {
+public:
+    CascadePack();
+    ~CascadePack();
+
+    CascadePack(const CascadePack&) = delete;
+    CascadePack& operator=(const CascadePack&) = delete;
+
+    // map the pack and validate it, false without a word when there is no pack, prints the reason when it is invalid
+    bool open(const std::string& strPath);
+    void close();
+
+    bool isOpen() const { return pData != nullptr; }
+    size_t bytes() const { return sizeData; }
+
+    // text of the cascade made from the XML file strName, false when the pack does not hold it
+    bool find(const std::string& strName, const char*& pText, size_t& size) const;
+
+private:
+    const uint8_t* pData;                           // start of the mapping
+    size_t sizeData;                                // size of the mapping in bytes
+    void* hFile;                                    // platform file handle (Windows only)
+    void* hMapping;                                 // platform mapping handle (Windows only)
+};
+
+// the pack next to the executable, mapped on first use and shared by every detector and thread of the process;
+// nullptr when there is none
+const CascadePack* sharedCascadePack();
+
+// parse a cascade from the pack when pPack holds it, from its XML file otherwise
+bool loadCascade(const std::string& strName, cv::CascadeClassifier& cascade, const CascadePack* pPack);
+
+// the cascade is in the pack or its XML file exists, without parsing it
+bool cascadeAvailable(const std::string& strName, const CascadePack* pPack);
@@ -0,0 +1,355 @@
+// ###########################################################################################################################
+// CharClassifier.cpp :
+//
+// Description: Brute force K Nearest Neighbors classifier, see CharClassifier.h
+//
+// ###########################################################################################################################
+
+#include "CharClassifier.h"
+#include "KnnIndex.h"
+
+#include<algorithm>
+#include<cmath>
+#include<iostream>
+
+// global variables ///////////////////////////////////////////////////////////////////////////////
+const size_t ROW_ALIGNMENT = 64;                    // training rows start on a cache line
+const int MAX_STACK_WORDS = 64;                     // up to 4096 sample bits are packed on the stack
+const int TRAINING_BLOCK_ROWS = 64;                 // training rows compared against the whole batch at a time, 64 x 640 bytes fits in L1/L2
+const int ADDED_ROWS_INITIAL = 16;                  // rows allocated by the first addSample
+const float VOTE_WEIGHT_EPSILON = 0.01f;            // a neighbor votes with 1 / (epsilon + normalized distance)
+const int MAX_VOTE_NEIGHBORS = 64;                  // neighbors classifyBatch votes with at most, their weights sit on the stack
+
+// keep the k best neighbors of one sample sorted nearest first. the list starts filled with empty
+// entries at UINT32_MAX, which no real distance reaches. an equal distance goes after the rows already
+// kept, so with rows visited in order the lower training row wins a tie, like KNearest
+static inline void insertNeighbor(Neighbor* pNeighbors, int k, int intIndex, uint32_t uintDistance) {
+
+    if (uintDistance >= pNeighbors[k - 1].uintDistance) {
+        return;
+    }
+
+    int pos = k - 1;
+    while (pos > 0 && pNeighbors[pos - 1].uintDistance > uintDistance) {
+        pNeighbors[pos] = pNeighbors[pos - 1];
+        pos--;
+    }
+
+    pNeighbors[pos].intIndex = intIndex;
+    pNeighbors[pos].uintDistance = uintDistance;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+CharClassifier::CharClassifier()
+    : pRows(nullptr), rowStride(0), intRows(0), intBaseRows(0), intCols(0),
+    distanceMetric(DISTANCE_L2), featureDescriptor(DESCRIPTOR_PIXELS), intWordsPerRow(0), pIndex(nullptr), uintGeneration(0) {
+    setSimdLevel(detectSimdLevel());
+}
+
+bool CharClassifier::train(const cv::Mat& matFeatures, const cv::Mat& matClassifications) {
+
+    // trap for mismatched training data
+    if (matFeatures.empty() || matFeatures.channels() != 1 || matFeatures.rows != (int)matClassifications.total()) {
+        std::cout << "error, training images and classifications do not match\n\n";
+        return false;
+    }
+    uintGeneration++;
+
+    intRows = matFeatures.rows;
+    intBaseRows = intRows;
+    intCols = matFeatures.cols;
+
+    // an index of the old rows does not fit the new ones, and the samples added to them are gone
+    pIndex = nullptr;
+    matAddedRows.release();
+
+    // labels as int32, whatever type they were stored in
+    cv::Mat matLabels;
+    matClassifications.reshape(1, intRows).convertTo(matLabels, CV_32S);
+    vecLabels.assign(matLabels.ptr<int32_t>(0), matLabels.ptr<int32_t>(0) + intRows);
+
+    bool aligned = matFeatures.type() == CV_8UC1
+        && matFeatures.step[0] % ROW_ALIGNMENT == 0
+        && reinterpret_cast<uintptr_t>(matFeatures.data) % ROW_ALIGNMENT == 0;
+
+    if (aligned) {
+        // already aligned uint8 rows (a mapped model file), use them where they are
+        matOwnedRows.release();
+        pRows = matFeatures.data;
+        rowStride = matFeatures.step[0];
+    }
+    else {
+        // copy into aligned, zero padded rows, float values of 0..255 convert exactly
+        rowStride = (intCols + ROW_ALIGNMENT - 1) / ROW_ALIGNMENT * ROW_ALIGNMENT;
+        matOwnedRows.create(intRows, (int)rowStride, CV_8UC1);
+        matOwnedRows.setTo(cv::Scalar(0));
+
+        cv::Mat matOwnedFeatures = matOwnedRows.colRange(0, intCols);
+        matFeatures.convertTo(matOwnedFeatures, CV_8U);
+
+        pRows = matOwnedRows.data;
+    }
+
+    if (distanceMetric == DISTANCE_HAMMING) {
+        packBits();
+    }
+
+    return true;
+}
+
+void CharClassifier::setMetric(DistanceMetric metric) {
+    distanceMetric = metric;
+    uintGeneration++;
+    if (distanceMetric == DISTANCE_HAMMING && intRows > 0) {
+        packBits();
+    }
+}
+
+void CharClassifier::setDescriptor(FeatureDescriptor descriptor) {
+    featureDescriptor = descriptor;
+    uintGeneration++;
+
+    // the metric follows the descriptor, a Hamming distance left over from bit rows would compare float rows by
+    // their bits
+    setMetric(featureDescriptor == DESCRIPTOR_BITS ? DISTANCE_HAMMING : DISTANCE_L2);
+}
+
+void CharClassifier::setSimdLevel(SimdLevel level) {
+    l2Kernel = getL2DistanceKernel(level);
+    hammingKernel = getHammingDistanceKernel(level);
+    kernelLevel = level > detectSimdLevel() ? detectSimdLevel() : level;
+}
+
+bool CharClassifier::addSample(const uint8_t* pSample, int intLabel) {
+
+    // trap for an untrained classifier, the width of the rows is not known yet
+    if (intCols == 0) {
+        std::cout << "error, samples can only be added to a trained classifier\n\n";
+        return false;
+    }
+    uintGeneration++;
+
+    // out of rows, double the block and keep the rows already added
+    int intAdded = intRows - intBaseRows;
+    if (intAdded == matAddedRows.rows) {
+        cv::Mat matGrown(std::max(ADDED_ROWS_INITIAL, matAddedRows.rows * 2), (int)rowStride, CV_8UC1, cv::Scalar(0));
+        if (intAdded > 0) {
+            matAddedRows.copyTo(matGrown.rowRange(0, intAdded));
+        }
+        matAddedRows = matGrown;
+    }
+
+    std::copy(pSample, pSample + intCols, matAddedRows.ptr(intAdded));
+    vecLabels.push_back(intLabel);
+    intRows++;
+
+    // the packed rows of DISTANCE_HAMMING grow with it
+    if (distanceMetric == DISTANCE_HAMMING) {
+        vecBits.resize((size_t)intRows * intWordsPerRow);
+        packRowBits(pSample, intCols, &vecBits[(size_t)(intRows - 1) * intWordsPerRow]);
+    }
+
+    return true;
+}
+
+void CharClassifier::packBits() {
+    intWordsPerRow = wordsForBits(intCols);
+    vecBits.assign((size_t)intRows * intWordsPerRow, 0);
+    for (int i = 0; i < intRows; i++) {
+        packRowBits(rowPtr(i), intCols, &vecBits[(size_t)i * intWordsPerRow]);
+    }
+}
+
+void CharClassifier::searchBatch(const uint8_t* pSamples, size_t sampleStride, int intCount, int k, Neighbor* pNeighbors) const {
+
+    Neighbor empty = { -1, UINT32_MAX };
+    std::fill(pNeighbors, pNeighbors + (size_t)intCount * k, empty);
+
+    // an index answers one sample at a time for the trained rows, the added ones are scanned after it; they come
+    // after every trained row, so a tie still goes to the lower row
+    if (pIndex != nullptr && pIndex->type() != KNN_INDEX_BRUTE && distanceMetric == DISTANCE_L2 && intBaseRows > 0) {
+        int intIndexK = std::min(k, intBaseRows);
+        for (int s = 0; s < intCount; s++) {
+            const uint8_t* pSample = pSamples + s * sampleStride;
+            Neighbor* pSampleNeighbors = pNeighbors + (size_t)s * k;
+            pIndex->search(*this, pSample, intIndexK, pSampleNeighbors);
+            for (int i = intBaseRows; i < intRows; i++) {
+                insertNeighbor(pSampleNeighbors, k, i, l2Kernel(pSample, rowPtr(i), intCols));
+            }
+        }
+        return;
+    }
+
+    if (distanceMetric == DISTANCE_HAMMING) {
+
+        // pack the samples the same way as the training rows
+        uint64_t arrStackWords[MAX_STACK_WORDS];
+        std::vector<uint64_t> vecHeapWords;
+        uint64_t* pSampleWords = arrStackWords;
+        if ((size_t)intCount * intWordsPerRow > (size_t)MAX_STACK_WORDS) {
+            vecHeapWords.resize((size_t)intCount * intWordsPerRow);
+            pSampleWords = vecHeapWords.data();
+        }
+        for (int s = 0; s < intCount; s++) {
+            packRowBits(pSamples + s * sampleStride, intCols, pSampleWords + (size_t)s * intWordsPerRow);
+        }
+
+        // one block of training rows at a time against every sample, so the block stays in cache
+        for (int intBlock = 0; intBlock < intRows; intBlock += TRAINING_BLOCK_ROWS) {
+            int intBlockEnd = std::min(intBlock + TRAINING_BLOCK_ROWS, intRows);
+            for (int s = 0; s < intCount; s++) {
+                const uint64_t* pSampleRow = pSampleWords + (size_t)s * intWordsPerRow;
+                const uint64_t* pWords = vecBits.data() + (size_t)intBlock * intWordsPerRow;
+                for (int i = intBlock; i < intBlockEnd; i++, pWords += intWordsPerRow) {
+                    insertNeighbor(pNeighbors + (size_t)s * k, k, i, hammingKernel(pSampleRow, pWords, intWordsPerRow));
+                }
+            }
+        }
+    }
+    else {
+        // the trained and the added rows are two runs of rows, a block never spans both
+        for (int intBlock = 0; intBlock < intRows; ) {
+            int intRunEnd = intBlock < intBaseRows ? intBaseRows : intRows;
+            int intBlockEnd = std::min(intBlock + TRAINING_BLOCK_ROWS, intRunEnd);
+            for (int s = 0; s < intCount; s++) {
+                const uint8_t* pSample = pSamples + s * sampleStride;
+                const uint8_t* pRow = rowPtr(intBlock);
+                for (int i = intBlock; i < intBlockEnd; i++, pRow += rowStride) {
+                    insertNeighbor(pNeighbors + (size_t)s * k, k, i, l2Kernel(pSample, pRow, intCols));
+                }
+            }
+            intBlock = intBlockEnd;
+        }
+    }
+}
+
+int CharClassifier::findNearest(const uint8_t* pSample, int k, std::vector<Neighbor>& vecNeighbors) const {
+
+    if (intRows == 0 || k <= 0) {
+        vecNeighbors.clear();
+        return -1;
+    }
+    k = std::min(k, intRows);
+
+    vecNeighbors.resize(k);
+    searchBatch(pSample, 0, 1, k, vecNeighbors.data());
+
+    return vecLabels[vecNeighbors[0].intIndex];
+}
+
+void CharClassifier::findNearestBatch(const cv::Mat& matSamples, int k, std::vector<int>& vecResults, std::vector<Neighbor>& vecNeighbors) const {
+
+    vecResults.clear();
+    vecNeighbors.clear();
+
+    // trap for an untrained classifier or samples of the wrong width
+    if (intRows == 0 || k <= 0 || matSamples.empty() || matSamples.cols != intCols || matSamples.type() != CV_8UC1) {
+        return;
+    }
+    k = std::min(k, intRows);
+
+    vecNeighbors.resize((size_t)matSamples.rows * k);
+    searchBatch(matSamples.data, matSamples.step[0], matSamples.rows, k, vecNeighbors.data());
+
+    vecResults.resize(matSamples.rows);
+    for (int s = 0; s < matSamples.rows; s++) {
+        vecResults[s] = vecLabels[vecNeighbors[(size_t)s * k].intIndex];
+    }
+}
+
+void CharClassifier::classifyBatch(const cv::Mat& matSamples, std::vector<Classification>& vecClassifications, std::vector<Neighbor>& vecNeighbors) const {
+
+    vecClassifications.clear();
+    vecNeighbors.clear();
+
+    // trap for an untrained classifier or samples of the wrong width
+    if (intRows == 0 || voteOptions.k <= 0 || matSamples.empty() || matSamples.cols != intCols || matSamples.type() != CV_8UC1) {
+        return;
+    }
+    int k = std::min(std::min(voteOptions.k, MAX_VOTE_NEIGHBORS), intRows);
+
+    vecNeighbors.resize((size_t)matSamples.rows * k);
+    searchBatch(matSamples.data, matSamples.step[0], matSamples.rows, k, vecNeighbors.data());
+
+    vecClassifications.resize(matSamples.rows);
+    for (int s = 0; s < matSamples.rows; s++) {
+        const Neighbor* pNeighbors = &vecNeighbors[(size_t)s * k];
+        Classification& classification = vecClassifications[s];
+
+        // the weight of every label is summed at its nearest neighbor, k is small enough for the quadratic loop; a
+        // tie goes to the label with the nearer neighbor. entries left empty by an index that found fewer rows are
+        // at UINT32_MAX and do not vote
+        float arrWeights[MAX_VOTE_NEIGHBORS];
+        float fltTotal = 0.0f;
+        for (int j = 0; j < k; j++) {
+            arrWeights[j] = 0.0f;
+            if (pNeighbors[j].uintDistance == UINT32_MAX) {
+                continue;
+            }
+            float fltWeight = 1.0f / (VOTE_WEIGHT_EPSILON + normalizedDistance(pNeighbors[j].uintDistance));
+            fltTotal += fltWeight;
+
+            int intFirst = j;
+            for (int i = 0; i < j; i++) {
+                if (pNeighbors[i].uintDistance != UINT32_MAX && vecLabels[pNeighbors[i].intIndex] == vecLabels[pNeighbors[j].intIndex]) {
+                    intFirst = i;
+                    break;
+                }
+            }
+            arrWeights[intFirst] += fltWeight;
+        }
+
+        int intBest = 0;
+        for (int j = 1; j < k; j++) {
+            if (arrWeights[j] > arrWeights[intBest]) {
+                intBest = j;
+            }
+        }
+
+        classification.intLabel = vecLabels[pNeighbors[intBest].intIndex];
+        classification.intVotes = 0;
+        classification.fltDistance = normalizedDistance(pNeighbors[0].uintDistance);
+        classification.fltOtherDistance = 1.0f;
+        for (int j = 0; j < k && pNeighbors[j].uintDistance != UINT32_MAX; j++) {
+            if (vecLabels[pNeighbors[j].intIndex] == classification.intLabel) {
+                classification.intVotes++;
+            }
+            else if (classification.fltOtherDistance == 1.0f) {
+                classification.fltOtherDistance = normalizedDistance(pNeighbors[j].uintDistance);
+            }
+        }
+        classification.fltConfidence = fltTotal > 0.0f ? arrWeights[intBest] / fltTotal : 0.0f;
+        classification.blnRejected = classification.fltConfidence < voteOptions.dblMinConfidence
+                                  || classification.fltDistance > voteOptions.dblMaxDistance;
+    }
+}
+
+float CharClassifier::normalizedDistance(uint32_t uintDistance) const {
+
+    if (intCols == 0 || uintDistance == UINT32_MAX) {
+        return 1.0f;
+    }
+    if (distanceMetric == DISTANCE_HAMMING) {
+        return (float)uintDistance / intCols;
+    }
+    return std::sqrt((float)uintDistance / intCols) / 255.0f;
+}
+
+float CharClassifier::findNearest(const cv::Mat& matSample, int k) const {
+
+    // trap for a sample of the wrong size
+    if ((int)matSample.total() != intCols || matSample.channels() != 1) {
+        return -1.0f;
+    }
+
+    std::vector<Neighbor> vecNeighbors;
+
+    // a continuous uint8 sample is read in place, anything else is converted once
+    if (matSample.type() == CV_8UC1 && matSample.isContinuous()) {
+        return (float)findNearest(matSample.data, k, vecNeighbors);
+    }
+
+    cv::Mat matSampleU8;
+    matSample.convertTo(matSampleU8, CV_8U);
+    return (float)findNearest(matSampleU8.reshape(1, 1).data, k, vecNeighbors);
+}
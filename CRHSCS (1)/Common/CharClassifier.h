@@ -0,0 +1,168 @@
+// ###########################################################################################################################
+// CharClassifier.h :
+//
+// Description: Brute force K Nearest Neighbors classifier for the flattened 20x30 char images, used by CharMatch in place of
+//              cv::ml::KNearest. Training rows are kept as aligned, contiguous uint8 rows (or used in place straight from a
+//              mapped model file) and compared with the runtime dispatched kernels from DistanceKernels.h. Distances are
+//              exact integers and ties go to the lower training row, so k = 1 gives the same label as KNearest.
+//
+//              DISTANCE_HAMMING bit packs the rows (pixel >= 128 is a 1) and compares them with popcount. For binary 0/255
+//              rows it ranks neighbors exactly like L2, for anti-aliased rows it is an approximation.
+//
+//              classifyBatch lets the k nearest rows vote, every row weighted by how near it is, and rejects a sample
+//              whose vote is not clear enough or whose nearest row is too far away (see VoteOptions), so a noise blob
+//              does not come out as a char. The vote is taken from the neighbors of the one search, nothing is scanned
+//              again.
+//
+//              Training sets too big to scan for every glyph are searched through a KnnIndex instead, see setIndex.
+//              Samples added after training (addSample) are kept in an owned block of rows after the trained ones and
+//              always scanned, the index only covers the trained rows until the samples are compacted into the model.
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include "DistanceKernels.h"
+#include "FeatureDescriptor.h"
+
+#include<opencv2/core/core.hpp>
+
+#include<cstdint>
+#include<vector>
+
+class KnnIndex;
+
+// distance used to compare a sample against the training rows
+enum DistanceMetric {
+    DISTANCE_L2,                                    // sum of squared pixel differences, exact
+    DISTANCE_HAMMING                                // number of differing bits of the binarized rows
+};
+
+// one neighbor found by findNearest
+struct Neighbor {
+    int intIndex;                                   // training row
+    uint32_t uintDistance;                          // squared L2 or Hamming distance
+};
+
+// how classifyBatch turns the k nearest rows of a sample into a label
+struct VoteOptions {
+    int k = 1;                                      // nearest rows that vote
+    double dblMinConfidence = 0.0;                  // reject when the winning label has less of the weighted vote
+    double dblMaxDistance = 1.0;                    // reject when the nearest row is further, see normalizedDistance
+};
+
+// the vote of the k nearest rows of one sample
+struct Classification {
+    int intLabel;                                   // label with the largest weighted vote, kept when rejected
+    bool blnRejected;                               // failed dblMinConfidence or dblMaxDistance
+    int intVotes;                                   // neighbors that voted for intLabel
+    float fltConfidence;                            // share of the weighted vote that went to intLabel, 0..1
+    float fltDistance;                              // normalized distance of the nearest row
+    float fltOtherDistance;                         // normalized distance of the nearest row with another label, 1 when
+                                                    // all k neighbors agree
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class CharClassifier {
+public:
+    CharClassifier();
+
+    // take the training rows (rows x cols, CV_8U or CV_32F) and the labels (rows x 1, CV_32S or CV_32F)
+    // an aligned CV_8U Mat is used in place, so a Mat from MappedModelFile::features() is never copied.
+    // the caller must keep that data alive for as long as the classifier is used
+    bool train(const cv::Mat& matFeatures, const cv::Mat& matClassifications);
+
+    // choose the distance, the bit packed rows for DISTANCE_HAMMING are built here
+    void setMetric(DistanceMetric metric);
+    DistanceMetric metric() const { return distanceMetric; }
+
+    // the descriptor the training rows were extracted with, samples have to be extracted the same way (GlyphBatch
+    // does that); DESCRIPTOR_BITS switches to DISTANCE_HAMMING, every other descriptor to DISTANCE_L2, so a Hamming
+    // distance on pixel rows is set with setMetric afterwards
+    void setDescriptor(FeatureDescriptor descriptor);
+    FeatureDescriptor descriptor() const { return featureDescriptor; }
+
+    // neighbors (up to 64), confidence and distance classifyBatch votes and rejects with, k = 1 without rejection by
+    // default
+    void setVoting(const VoteOptions& options) { voteOptions = options; uintGeneration++; }
+    const VoteOptions& voting() const { return voteOptions; }
+
+    // kernels default to the best level the CPU supports, a lower level can be forced for testing
+    void setSimdLevel(SimdLevel level);
+    SimdLevel simdLevel() const { return kernelLevel; }
+
+    // search the L2 neighbors through an index built on these rows instead of scanning every row, nullptr scans
+    // again; the index is not owned and must live as long as it is set. DISTANCE_HAMMING always scans
+    void setIndex(const KnnIndex* pKnnIndex) { pIndex = pKnnIndex; uintGeneration++; }
+    const KnnIndex* index() const { return pIndex; }
+
+    // add one labeled uint8 sample of cols() values after the trained rows, it is found by the next search. an index
+    // stays set and the added rows are scanned next to it. must not run while another thread searches
+    bool addSample(const uint8_t* pSample, int intLabel);
+
+    // find the k nearest training rows to one uint8 sample of cols() values
+    // vecNeighbors is filled nearest first, the label of the nearest row is returned (-1 when untrained)
+    int findNearest(const uint8_t* pSample, int k, std::vector<Neighbor>& vecNeighbors) const;
+
+    // same as above for a CV_8U or CV_32F Mat holding cols() values in any shape,
+    // returns the label of the nearest row as a float like KNearest::findNearest
+    float findNearest(const cv::Mat& matSample, int k = 1) const;
+
+    // classify every row of matSamples (N x cols(), CV_8U) in one pass over the training rows
+    // vecResults gets the label of each sample, vecNeighbors the min(k, rows()) nearest rows of each sample, nearest first
+    void findNearestBatch(const cv::Mat& matSamples, int k, std::vector<int>& vecResults, std::vector<Neighbor>& vecNeighbors) const;
+
+    // classify every row of matSamples (N x cols(), CV_8U) by the vote of its voting().k nearest rows, found in the
+    // same single pass as findNearestBatch; vecNeighbors gets the neighbors of each sample, nearest first
+    void classifyBatch(const cv::Mat& matSamples, std::vector<Classification>& vecClassifications, std::vector<Neighbor>& vecNeighbors) const;
+
+    // a distance of the metric in use as 0 for the same row up to 1 for the opposite one: the root mean square
+    // difference over 255 for L2, the fraction of differing bits for Hamming, so one threshold fits any row length
+    float normalizedDistance(uint32_t uintDistance) const;
+
+    // changes whenever a result of the classifier may change: training, an added sample, the metric, descriptor,
+    // vote or index; a result cached with another generation is stale, see GlyphCache
+    uint64_t generation() const { return uintGeneration; }
+
+    bool empty() const { return intRows == 0; }
+    int rows() const { return intRows; }                    // trained and added rows
+    int baseRows() const { return intBaseRows; }            // rows given to train, the ones an index covers
+    int addedRows() const { return intRows - intBaseRows; }
+    int cols() const { return intCols; }
+    size_t stride() const { return rowStride; }             // bytes between two trained or two added rows
+    int label(int intRow) const { return vecLabels[intRow]; }
+    const uint8_t* rowPtr(int intRow) const {
+        return intRow < intBaseRows ? pRows + (size_t)intRow * rowStride : matAddedRows.ptr(intRow - intBaseRows);
+    }
+
+    // squared L2 distance of a uint8 sample of cols() values to a training row, with the dispatched kernel
+    uint32_t distanceL2(const uint8_t* pSample, int intRow) const { return l2Kernel(pSample, rowPtr(intRow), intCols); }
+
+private:
+    void packBits();
+
+    // k nearest rows of intCount samples, sampleStride bytes apart, into pNeighbors[intCount * k]
+    void searchBatch(const uint8_t* pSamples, size_t sampleStride, int intCount, int k, Neighbor* pNeighbors) const;
+
+    const uint8_t* pRows;                           // first training row, either matOwnedRows or the caller's data
+    size_t rowStride;                               // bytes between training rows
+    int intRows;
+    int intBaseRows;
+    int intCols;
+    cv::Mat matOwnedRows;                           // aligned copy when the training data could not be used in place
+    cv::Mat matAddedRows;                           // rows added after training, capacity x rowStride, grown by doubling
+    std::vector<int32_t> vecLabels;
+
+    DistanceMetric distanceMetric;
+    FeatureDescriptor featureDescriptor;
+    VoteOptions voteOptions;
+    SimdLevel kernelLevel;
+    L2DistanceKernel l2Kernel;
+    HammingDistanceKernel hammingKernel;
+
+    std::vector<uint64_t> vecBits;                  // bit packed rows for DISTANCE_HAMMING
+    int intWordsPerRow;
+
+    const KnnIndex* pIndex;                         // not owned, see setIndex
+    uint64_t uintGeneration;
+};
@@ -0,0 +1,31 @@
+// ###########################################################################################################################
+// CharFrameContext.cpp :
+//
+// Description: Reusable per frame buffers of the char pipeline, see CharFrameContext.h
+//
+// ###########################################################################################################################
+
+#include "CharFrameContext.h"
+
+// global variables ///////////////////////////////////////////////////////////////////////////////
+const int RUNS_PER_ROW_RESERVED = 64;               // foreground runs reserved per row, a dense line of text crosses fewer
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+CharFrameContext::CharFrameContext(int intImageWidth, int intImageHeight, WorkStealingPool* pPool)
+    : preprocessor(pPool), segmenter(pPool), glyphBatch(intImageWidth, intImageHeight) {
+}
+
+void CharFrameContext::reserve(const cv::Size& frameSize, int intMaxGlyphs) {
+
+    preprocessor.reserve(frameSize.width);
+    matThresh.create(frameSize, CV_8UC1);
+
+    segmenter.reserve(frameSize, RUNS_PER_ROW_RESERVED);
+    vecRects.reserve(intMaxGlyphs);
+
+    glyphBatch.reserve(intMaxGlyphs);
+    vecChars.reserve(intMaxGlyphs);
+
+    // every glyph plus a newline per line at most
+    strText.reserve(2 * intMaxGlyphs);
+}
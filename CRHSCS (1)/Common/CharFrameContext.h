@@ -0,0 +1,44 @@
+// ###########################################################################################################################
+// CharFrameContext.h :
+//
+// Description: Every buffer the char pipeline touches while it processes a frame: the strip buffers of the
+//              CharPreprocessor and the threshold image, the run buffers of the GlyphSegmenter, the glyph rects, the
+//              pooled feature matrix of the GlyphBatch, the glyph cache and the result chars and text. The buffers only ever grow, so
+//              once the context has seen a frame of the usual size with the usual number of glyphs the next frames
+//              run without heap allocations of their own. reserve sizes the buffers up front for a known frame size
+//              and glyph count.
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include "CharPreprocess.h"
+#include "GlyphBatch.h"
+#include "GlyphSegmenter.h"
+
+#include<opencv2/core/core.hpp>
+
+#include<string>
+#include<vector>
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class CharFrameContext {
+public:
+    // intImageWidth x intImageHeight is the resized glyph size the classifier was trained on, pPool runs the
+    // preprocessing and segmentation strips in parallel, see CharPreprocessor and GlyphSegmenter
+    CharFrameContext(int intImageWidth, int intImageHeight, WorkStealingPool* pPool = nullptr);
+
+    // allocate the buffers for frames of frameSize with up to intMaxGlyphs glyphs
+    void reserve(const cv::Size& frameSize, int intMaxGlyphs);
+
+    CharPreprocessor preprocessor;                  // grayscale, blur and threshold in one pass
+    cv::Mat matThresh;
+
+    GlyphSegmenter segmenter;                       // connected components of the threshold image
+    std::vector<cv::Rect> vecRects;                 // glyph rects of the frame
+
+    GlyphBatch glyphBatch;                          // feature matrix, one row per glyph
+    GlyphCache glyphCache;                          // results of the previous frame, used when the batch is given it
+    std::vector<RecognizedChar> vecChars;           // classified glyphs in reading order
+    std::string strText;
+};
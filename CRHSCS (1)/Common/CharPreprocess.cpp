@@ -0,0 +1,366 @@
+// ###########################################################################################################################
+// CharPreprocess.cpp :
+//
+// Description: Image preprocessing and glyph segmentation, see CharPreprocess.h
+//
+// ###########################################################################################################################
+
+#include "CharPreprocess.h"
+#include "DistanceKernels.h"
+#include "Metrics.h"
+#include "WorkStealingPool.h"
+
+#include<opencv2/imgproc/imgproc.hpp>
+
+#include<algorithm>
+#include<cmath>
+#include<cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CHAR_PREPROCESS_X86 1
+#include<immintrin.h>
+#endif
+
+// GCC and Clang only emit AVX2 / FMA instructions inside functions marked for them, MSVC always can
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_FMA __attribute__((target("avx2,fma")))
+#else
+#define TARGET_FMA
+#endif
+
+// global variables ///////////////////////////////////////////////////////////////////////////////
+const int GRAY_SHIFT = 15;                          // cvtColor BGR2GRAY in fixed point, 0.114 B + 0.587 G + 0.299 R
+const int GRAY_B = 3735;                            // in 1 / 32768
+const int GRAY_G = 19235;
+const int GRAY_R = 9798;
+
+const int BLUR_RADIUS = 2;                          // GaussianBlur 5x5 with sigma 0 is the 1 4 6 4 1 / 16 kernel
+const int BLUR_SHIFT = 8;                           // both directions together sum to 256
+
+const int THRESH_BLOCK_SIZE = 11;                   // adaptiveThreshold neighborhood and constant
+const int THRESH_RADIUS = THRESH_BLOCK_SIZE / 2;
+const int THRESH_C = 2;
+
+const int STRIP_ROWS = 32;                          // output rows of one strip, the buffers of a 1080p strip take about 600 KB
+
+// gaussian mean kernels //////////////////////////////////////////////////////////////////////////
+// OpenCV's float sepFilter2D, which the GaussianBlur of adaptiveThreshold runs on: the row pass sums the taps from the
+// left, the column pass of the symmetric kernel starts at the center tap and adds the pair of rows on either side of
+// it. Its AVX2 code fuses every multiply add, its SSE2 and scalar code round the product first; the mean takes the
+// same path as OpenCV on the same CPU so the threshold comes out the same bits. pPadded has THRESH_RADIUS pixels on
+// either side, arrTaps holds the THRESH_BLOCK_SIZE row pass rows of an output row, top first
+typedef void(*MeanRowPass)(const float* pPadded, const float* pKernel, int intCols, float* pOut);
+typedef void(*MeanColumnPass)(const float* const* arrTaps, const float* pKernel, int intCols, float* pOut);
+
+// scalar kernels, from column x on
+static void meanRowPassScalar(const float* pPadded, const float* pKernel, int x, int intCols, float* pOut) {
+    for (; x < intCols; x++) {
+        float sum = pPadded[x] * pKernel[0];
+        for (int k = 1; k < THRESH_BLOCK_SIZE; k++) {
+            sum = sum + pPadded[x + k] * pKernel[k];
+        }
+        pOut[x] = sum;
+    }
+}
+
+static void meanColumnPassScalar(const float* const* arrTaps, const float* pKernel, int x, int intCols, float* pOut) {
+    for (; x < intCols; x++) {
+        float sum = arrTaps[THRESH_RADIUS][x] * pKernel[THRESH_RADIUS];
+        for (int k = 1; k <= THRESH_RADIUS; k++) {
+            sum = sum + (arrTaps[THRESH_RADIUS + k][x] + arrTaps[THRESH_RADIUS - k][x]) * pKernel[THRESH_RADIUS + k];
+        }
+        pOut[x] = sum;
+    }
+}
+
+#ifndef CHAR_PREPROCESS_X86
+
+static void meanRowPassDefault(const float* pPadded, const float* pKernel, int intCols, float* pOut) {
+    meanRowPassScalar(pPadded, pKernel, 0, intCols, pOut);
+}
+
+static void meanColumnPassDefault(const float* const* arrTaps, const float* pKernel, int intCols, float* pOut) {
+    meanColumnPassScalar(arrTaps, pKernel, 0, intCols, pOut);
+}
+
+#else
+
+// SSE2 kernels, 4 columns at a time ///////////////////////////////////////////////////////////////
+static void meanRowPassSse2(const float* pPadded, const float* pKernel, int intCols, float* pOut) {
+    int x = 0;
+    for (; x + 4 <= intCols; x += 4) {
+        __m128 sum = _mm_mul_ps(_mm_loadu_ps(pPadded + x), _mm_set1_ps(pKernel[0]));
+        for (int k = 1; k < THRESH_BLOCK_SIZE; k++) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(pPadded + x + k), _mm_set1_ps(pKernel[k])));
+        }
+        _mm_storeu_ps(pOut + x, sum);
+    }
+    meanRowPassScalar(pPadded, pKernel, x, intCols, pOut);
+}
+
+static void meanColumnPassSse2(const float* const* arrTaps, const float* pKernel, int intCols, float* pOut) {
+    int x = 0;
+    for (; x + 4 <= intCols; x += 4) {
+        __m128 sum = _mm_mul_ps(_mm_loadu_ps(arrTaps[THRESH_RADIUS] + x), _mm_set1_ps(pKernel[THRESH_RADIUS]));
+        for (int k = 1; k <= THRESH_RADIUS; k++) {
+            __m128 pair = _mm_add_ps(_mm_loadu_ps(arrTaps[THRESH_RADIUS + k] + x), _mm_loadu_ps(arrTaps[THRESH_RADIUS - k] + x));
+            sum = _mm_add_ps(sum, _mm_mul_ps(pair, _mm_set1_ps(pKernel[THRESH_RADIUS + k])));
+        }
+        _mm_storeu_ps(pOut + x, sum);
+    }
+    meanColumnPassScalar(arrTaps, pKernel, x, intCols, pOut);
+}
+
+// AVX2 kernels, 8 columns at a time with fused multiply adds, the columns left over fused as well ////////////////
+TARGET_FMA static void meanRowPassAvx2(const float* pPadded, const float* pKernel, int intCols, float* pOut) {
+    int x = 0;
+    for (; x + 8 <= intCols; x += 8) {
+        __m256 sum = _mm256_mul_ps(_mm256_loadu_ps(pPadded + x), _mm256_set1_ps(pKernel[0]));
+        for (int k = 1; k < THRESH_BLOCK_SIZE; k++) {
+            sum = _mm256_fmadd_ps(_mm256_loadu_ps(pPadded + x + k), _mm256_set1_ps(pKernel[k]), sum);
+        }
+        _mm256_storeu_ps(pOut + x, sum);
+    }
+    for (; x < intCols; x++) {
+        float sum = pPadded[x] * pKernel[0];
+        for (int k = 1; k < THRESH_BLOCK_SIZE; k++) {
+            sum = std::fma(pPadded[x + k], pKernel[k], sum);
+        }
+        pOut[x] = sum;
+    }
+}
+
+TARGET_FMA static void meanColumnPassAvx2(const float* const* arrTaps, const float* pKernel, int intCols, float* pOut) {
+    int x = 0;
+    for (; x + 8 <= intCols; x += 8) {
+        __m256 sum = _mm256_mul_ps(_mm256_loadu_ps(arrTaps[THRESH_RADIUS] + x), _mm256_set1_ps(pKernel[THRESH_RADIUS]));
+        for (int k = 1; k <= THRESH_RADIUS; k++) {
+            __m256 pair = _mm256_add_ps(_mm256_loadu_ps(arrTaps[THRESH_RADIUS + k] + x), _mm256_loadu_ps(arrTaps[THRESH_RADIUS - k] + x));
+            sum = _mm256_fmadd_ps(pair, _mm256_set1_ps(pKernel[THRESH_RADIUS + k]), sum);
+        }
+        _mm256_storeu_ps(pOut + x, sum);
+    }
+    for (; x < intCols; x++) {
+        float sum = arrTaps[THRESH_RADIUS][x] * pKernel[THRESH_RADIUS];
+        for (int k = 1; k <= THRESH_RADIUS; k++) {
+            sum = std::fma(arrTaps[THRESH_RADIUS + k][x] + arrTaps[THRESH_RADIUS - k][x], pKernel[THRESH_RADIUS + k], sum);
+        }
+        pOut[x] = sum;
+    }
+}
+
+#endif  // CHAR_PREPROCESS_X86
+
+// kernels for the running CPU; every CPU with AVX2 has FMA as well, OpenCV dispatches both together
+static MeanRowPass meanRowPass() {
+#ifdef CHAR_PREPROCESS_X86
+    static const MeanRowPass kernel = detectSimdLevel() >= SIMD_AVX2 ? meanRowPassAvx2 : meanRowPassSse2;
+    return kernel;
+#else
+    return meanRowPassDefault;
+#endif
+}
+
+static MeanColumnPass meanColumnPass() {
+#ifdef CHAR_PREPROCESS_X86
+    static const MeanColumnPass kernel = detectSimdLevel() >= SIMD_AVX2 ? meanColumnPassAvx2 : meanColumnPassSse2;
+    return kernel;
+#else
+    return meanColumnPassDefault;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void preprocessCharImageReference(const cv::Mat& matImage, cv::Mat& matGrayscale, cv::Mat& matBlurred, cv::Mat& matThresh) {
+
+    // convert to grayscale
+    {
+        ScopedTimer timer(METRIC_CVTCOLOR);
+        cv::cvtColor(matImage, matGrayscale, cv::COLOR_BGR2GRAY);
+    }
+
+    // blur
+    {
+        ScopedTimer timer(METRIC_BLUR);
+        cv::GaussianBlur(matGrayscale,         // input image
+            matBlurred,                        // output image
+            cv::Size(5, 5),                    // smoothing window width and height in pixels
+            0);                                // sigma value, determines how much the image will be blurred, zero makes function choose the sigma value
+    }
+
+    // filter image from grayscale to black and white
+    ScopedTimer timer(METRIC_THRESHOLD);
+    cv::adaptiveThreshold(matBlurred,          // input image
+        matThresh,                             // output image
+        255,                                   // make pixels that pass the threshold full white
+        cv::ADAPTIVE_THRESH_GAUSSIAN_C,        // use gaussian rather than mean, seems to give better results
+        cv::THRESH_BINARY_INV,                 // invert so foreground will be white, background will be black
+        11,                                    // size of a pixel neighborhood used to calculate threshold value
+        2);                                    // constant subtracted from the mean or weighted mean
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+CharPreprocessor::CharPreprocessor(WorkStealingPool* pPool)
+    : pPool(pPool), vecScratch(pPool != nullptr ? pPool->threads() : 1) {
+
+    // the kernel GaussianBlur builds for the block with sigma 0
+    cv::Mat matKernel = cv::getGaussianKernel(THRESH_BLOCK_SIZE, 0, CV_32F);
+    vecMeanKernel.assign(matKernel.ptr<float>(), matKernel.ptr<float>() + THRESH_BLOCK_SIZE);
+}
+
+void CharPreprocessor::allocate(StripScratch& scratch, int intCols) {
+    scratch.matGrayRow.create(1, intCols + 2 * BLUR_RADIUS, CV_8UC1);
+    scratch.matRowSums.create(STRIP_ROWS + 2 * (THRESH_RADIUS + BLUR_RADIUS), intCols, CV_16UC1);
+    scratch.matBlurred.create(STRIP_ROWS + 2 * THRESH_RADIUS, intCols, CV_8UC1);
+    scratch.matPaddedRow.create(1, intCols + 2 * THRESH_RADIUS, CV_32FC1);
+    scratch.matRowMeans.create(STRIP_ROWS + 2 * THRESH_RADIUS, intCols, CV_32FC1);
+    scratch.matMeanRow.create(1, intCols, CV_32FC1);
+}
+
+void CharPreprocessor::reserve(int intFrameWidth) {
+    for (StripScratch& scratch : vecScratch) {
+        allocate(scratch, intFrameWidth);
+    }
+}
+
+size_t CharPreprocessor::scratchBytes() const {
+    size_t bytes = 0;
+    for (const StripScratch& scratch : vecScratch) {
+        bytes += scratch.matGrayRow.total() * scratch.matGrayRow.elemSize() + scratch.matRowSums.total() * scratch.matRowSums.elemSize() +
+                 scratch.matBlurred.total() * scratch.matBlurred.elemSize() + scratch.matPaddedRow.total() * scratch.matPaddedRow.elemSize() +
+                 scratch.matRowMeans.total() * scratch.matRowMeans.elemSize() + scratch.matMeanRow.total() * scratch.matMeanRow.elemSize();
+    }
+    return bytes;
+}
+
+void CharPreprocessor::process(const cv::Mat& matImage, cv::Mat& matThresh) {
+
+    if (matImage.empty() || matImage.depth() != CV_8U || (matImage.channels() != 3 && matImage.channels() != 4)) {
+        preprocessCharImageReference(matImage, matReferenceGray, matReferenceBlurred, matThresh);
+        return;
+    }
+
+    ScopedTimer timer(METRIC_PREPROCESS);
+
+    matThresh.create(matImage.size(), CV_8UC1);
+
+    int intStrips = (matImage.rows + STRIP_ROWS - 1) / STRIP_ROWS;
+    if (pPool == nullptr || intStrips == 1) {
+        for (int i = 0; i < intStrips; i++) {
+            processStrip(matImage, matThresh, i, vecScratch[0]);
+        }
+        return;
+    }
+
+    pPool->parallelFor((size_t)intStrips, [&](size_t strip, int intWorker) {
+        processStrip(matImage, matThresh, (int)strip, vecScratch[intWorker]);
+    });
+}
+
+// every value below is an exact integer until the gaussian mean, so the order of the sums does not matter and the
+// grayscale and blurred pixels are the ones of the full image calls; the mean follows OpenCV's float GaussianBlur,
+// see the gaussian mean kernels, and the THRESH_RADIUS rows above and below the strip make it see the same pixels as
+// on the full image
+void CharPreprocessor::processStrip(const cv::Mat& matImage, cv::Mat& matThresh, int intStrip, StripScratch& scratch) {
+
+    int intRows = matImage.rows;
+    int intCols = matImage.cols;
+    int intChannels = matImage.channels();
+
+    // output rows, the blurred rows their mean needs, and the grayscale rows the blur of those needs
+    int y0 = intStrip * STRIP_ROWS;
+    int y1 = std::min(intRows, y0 + STRIP_ROWS);
+    int b0 = std::max(0, y0 - THRESH_RADIUS);
+    int b1 = std::min(intRows, y1 + THRESH_RADIUS);
+    int g0 = std::max(0, b0 - BLUR_RADIUS);
+    int g1 = std::min(intRows, b1 + BLUR_RADIUS);
+
+    allocate(scratch, intCols);
+
+    // grayscale and the horizontal blur, the blur reflects at the image border (BORDER_REFLECT_101)
+    uchar* pGray = scratch.matGrayRow.ptr<uchar>() + BLUR_RADIUS;
+    for (int y = g0; y < g1; y++) {
+        const uchar* pPixel = matImage.ptr<uchar>(y);
+        for (int x = 0; x < intCols; x++, pPixel += intChannels) {
+            pGray[x] = (uchar)((pPixel[0] * GRAY_B + pPixel[1] * GRAY_G + pPixel[2] * GRAY_R + (1 << (GRAY_SHIFT - 1))) >> GRAY_SHIFT);
+        }
+        for (int d = 1; d <= BLUR_RADIUS; d++) {
+            pGray[-d] = pGray[cv::borderInterpolate(-d, intCols, cv::BORDER_REFLECT_101)];
+            pGray[intCols - 1 + d] = pGray[cv::borderInterpolate(intCols - 1 + d, intCols, cv::BORDER_REFLECT_101)];
+        }
+
+        uint16_t* pSums = scratch.matRowSums.ptr<uint16_t>(y - g0);
+        for (int x = 0; x < intCols; x++) {
+            pSums[x] = (uint16_t)(pGray[x - 2] + pGray[x + 2] + 4 * (pGray[x - 1] + pGray[x + 1]) + 6 * pGray[x]);
+        }
+    }
+
+    MeanRowPass rowPass = meanRowPass();
+    MeanColumnPass columnPass = meanColumnPass();
+
+    // vertical blur, rounded like OpenCV's fixed point GaussianBlur, and the row pass of the mean, which replicates
+    // the border like adaptiveThreshold does
+    float* pPadded = scratch.matPaddedRow.ptr<float>() + THRESH_RADIUS;
+    for (int y = b0; y < b1; y++) {
+        const uint16_t* arrTaps[2 * BLUR_RADIUS + 1];
+        for (int d = -BLUR_RADIUS; d <= BLUR_RADIUS; d++) {
+            arrTaps[d + BLUR_RADIUS] = scratch.matRowSums.ptr<uint16_t>(cv::borderInterpolate(y + d, intRows, cv::BORDER_REFLECT_101) - g0);
+        }
+
+        uchar* pBlurred = scratch.matBlurred.ptr<uchar>(y - b0);
+        for (int x = 0; x < intCols; x++) {
+            uint32_t sum = (uint32_t)arrTaps[0][x] + arrTaps[4][x] + 4 * ((uint32_t)arrTaps[1][x] + arrTaps[3][x]) + 6 * (uint32_t)arrTaps[2][x];
+            pBlurred[x] = (uchar)((sum + (1 << (BLUR_SHIFT - 1))) >> BLUR_SHIFT);
+            pPadded[x] = (float)pBlurred[x];
+        }
+        for (int d = 1; d <= THRESH_RADIUS; d++) {
+            pPadded[-d] = pPadded[0];
+            pPadded[intCols - 1 + d] = pPadded[intCols - 1];
+        }
+        rowPass(pPadded - THRESH_RADIUS, vecMeanKernel.data(), intCols, scratch.matRowMeans.ptr<float>(y - b0));
+    }
+
+    // column pass of the mean and THRESH_BINARY_INV: white where the pixel is at least THRESH_C under its rounded
+    // mean; the rows above and below the image are replicated, the ones of the strip borders are there
+    float* pMean = scratch.matMeanRow.ptr<float>();
+    for (int y = y0; y < y1; y++) {
+        const float* arrTaps[THRESH_BLOCK_SIZE];
+        for (int d = -THRESH_RADIUS; d <= THRESH_RADIUS; d++) {
+            arrTaps[d + THRESH_RADIUS] = scratch.matRowMeans.ptr<float>(std::min(std::max(y + d, 0), intRows - 1) - b0);
+        }
+        columnPass(arrTaps, vecMeanKernel.data(), intCols, pMean);
+
+        const uchar* pBlurred = scratch.matBlurred.ptr<uchar>(y - b0);
+        uchar* pThresh = matThresh.ptr<uchar>(y);
+        for (int x = 0; x < intCols; x++) {
+            pThresh[x] = (int)pBlurred[x] - (int)cv::saturate_cast<uchar>(pMean[x]) <= -THRESH_C ? 255 : 0;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void findCharRectsReference(const cv::Mat& matThresh, cv::Mat& matThreshCopy, double dblMinArea, std::vector<cv::Rect>& vecRects) {
+
+    ScopedTimer timer(METRIC_CONTOURS);
+
+    std::vector<std::vector<cv::Point> > ptContours;        // declare a vector for the contours
+    std::vector<cv::Vec4i> v4iHierarchy;                    // declare a vector for the hierarchy
+
+    vecRects.clear();
+
+    // make a copy of the thresh image, this in necessary because findContours modifies the image
+    matThresh.copyTo(matThreshCopy);
+
+    cv::findContours(matThreshCopy,            // input image, make sure to use a copy since the function will modify this image in the course of finding contours
+        ptContours,                            // output contours
+        v4iHierarchy,                          // output hierarchy
+        cv::RETR_EXTERNAL,                     // retrieve the outermost contours only
+        cv::CHAIN_APPROX_SIMPLE);              // compress horizontal, vertical, and diagonal segments and leave only their end points
+
+    // keep only the contours big enough to consider, ignore noises
+    for (size_t i = 0; i < ptContours.size(); i++) {
+        if (cv::contourArea(ptContours[i]) > dblMinArea) {
+            vecRects.push_back(cv::boundingRect(ptContours[i]));
+        }
+    }
+}
@@ -0,0 +1,73 @@
+// ###########################################################################################################################
+// CharPreprocess.h :
+//
+// Description: Image preprocessing and glyph segmentation for the char recognition programs: grayscale, blur and
+//              adaptive threshold, then the outer contours big enough to be a char (see GlyphSegmenter). Kept in one place so every caller
+//              prepares its images exactly the way the training images were prepared.
+//
+//              CharPreprocessor runs grayscale, 5x5 blur and adaptive threshold in one pass over strips of rows, so
+//              the grayscale, blurred and float images of the three OpenCV calls never exist at full size; a strip
+//              stays in cache from the color pixels to the threshold bits. The strips run in parallel on a
+//              WorkStealingPool. Its output is bit for bit the one of preprocessCharImageReference: the grayscale
+//              and the blur use the integer arithmetic of OpenCV's bit exact cvtColor and GaussianBlur, and the
+//              float gaussian mean of the threshold takes the float operations of OpenCV's separable filter in their
+//              order, fused multiply adds where OpenCV's AVX2 code uses them, into buffers allocated once, so a warm
+//              preprocessor does not allocate.
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include<opencv2/core/core.hpp>
+
+#include<cstddef>
+#include<vector>
+
+class WorkStealingPool;
+
+// convert to grayscale, blur and filter to black and white (foreground white) with three full image OpenCV calls,
+// the chain CharPreprocessor reproduces; matGrayscale and matBlurred are the intermediate images
+void preprocessCharImageReference(const cv::Mat& matImage, cv::Mat& matGrayscale, cv::Mat& matBlurred, cv::Mat& matThresh);
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// the same grayscale, blur and threshold fused into one pass over strips of rows
+class CharPreprocessor {
+public:
+    // strips run on pPool when there is one and on the calling thread otherwise; the pool is not owned and must
+    // not run anything else while process runs
+    explicit CharPreprocessor(WorkStealingPool* pPool = nullptr);
+
+    // 8 bit BGR or BGRA in, threshold image out; any other image goes through preprocessCharImageReference
+    void process(const cv::Mat& matImage, cv::Mat& matThresh);
+
+    // allocate the strip buffers for frames frameWidth pixels wide
+    void reserve(int intFrameWidth);
+
+    // bytes of the strip buffers of all workers
+    size_t scratchBytes() const;
+
+private:
+    // buffers of one worker, sized for one strip and its border rows
+    struct StripScratch {
+        cv::Mat matGrayRow;                         // one grayscale row with 2 reflected pixels on either side
+        cv::Mat matRowSums;                         // horizontal 1 4 6 4 1 sums of the grayscale rows, 16 bit
+        cv::Mat matBlurred;                         // blurred rows of the strip and the mean border
+        cv::Mat matPaddedRow;                       // one blurred row as float with THRESH_RADIUS replicated pixels on either side
+        cv::Mat matRowMeans;                        // row pass of the gaussian mean over the blurred rows, float
+        cv::Mat matMeanRow;                         // column pass, the gaussian mean of one output row
+    };
+
+    static void allocate(StripScratch& scratch, int intCols);
+    void processStrip(const cv::Mat& matImage, cv::Mat& matThresh, int intStrip, StripScratch& scratch);
+
+    WorkStealingPool* pPool;
+    std::vector<StripScratch> vecScratch;           // one per worker of the pool
+    std::vector<float> vecMeanKernel;               // getGaussianKernel of the threshold block
+    cv::Mat matReferenceGray;                       // used for the images the fused pass does not take
+    cv::Mat matReferenceBlurred;
+};
+
+// bounding rects of the outer contours whose area is bigger than dblMinArea, by findContours; the pipeline uses
+// GlyphSegmenter, which gives the same rects, this stays as the reference it is checked against
+// matThreshCopy is scratch space, findContours modifies the image it is given
+void findCharRectsReference(const cv::Mat& matThresh, cv::Mat& matThreshCopy, double dblMinArea, std::vector<cv::Rect>& vecRects);
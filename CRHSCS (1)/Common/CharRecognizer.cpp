@@ -0,0 +1,41 @@
+// ###########################################################################################################################
+// CharRecognizer.cpp :
+//
+// Description: Whole frame char recognition, see CharRecognizer.h
+//
+// ###########################################################################################################################
+
+#include "CharRecognizer.h"
+#include "CharPreprocess.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+CharRecognizer::CharRecognizer(const CharClassifier& charClassifier, int intImageWidth, int intImageHeight, double dblMinContourArea,
+                               WorkStealingPool* pPool)
+    : charClassifier(charClassifier), dblMinContourArea(dblMinContourArea), frameContext(intImageWidth, intImageHeight, pPool) {
+}
+
+void CharRecognizer::setCaching(bool blnCaching, double dblMaxDifference) {
+    frameContext.glyphCache.clear();
+    frameContext.glyphCache.setMaxDifference(dblMaxDifference);
+    frameContext.glyphBatch.setCache(blnCaching ? &frameContext.glyphCache : nullptr, charClassifier);
+}
+
+void CharRecognizer::segment(const cv::Mat& matImage, cv::Mat& matThreshOut, std::vector<cv::Rect>& vecRectsOut) {
+    frameContext.preprocessor.process(matImage, matThreshOut);
+    frameContext.segmenter.findRects(matThreshOut, dblMinContourArea, vecRectsOut);
+}
+
+const std::string& CharRecognizer::classify(const cv::Mat& matThreshIn, const std::vector<cv::Rect>& vecRectsIn, std::vector<RecognizedChar>& vecChars) {
+    GlyphBatch& glyphBatch = frameContext.glyphBatch;
+    glyphBatch.clear();
+    for (size_t i = 0; i < vecRectsIn.size(); i++) {
+        glyphBatch.add(matThreshIn, vecRectsIn[i]);
+    }
+    glyphBatch.classify(charClassifier, vecChars, frameContext.strText);
+    return frameContext.strText;
+}
+
+const std::string& CharRecognizer::recognize(const cv::Mat& matImage, std::vector<RecognizedChar>& vecChars) {
+    segment(matImage, frameContext.matThresh, frameContext.vecRects);
+    return classify(frameContext.matThresh, frameContext.vecRects, vecChars);
+}
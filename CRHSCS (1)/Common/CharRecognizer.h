@@ -0,0 +1,53 @@
+// ###########################################################################################################################
+// CharRecognizer.h :
+//
+// Description: Whole frame char recognition: preprocess, segment and batch classify, with every buffer in the
+//              recognizer's CharFrameContext so they are reused from frame to frame and the steady state does not
+//              allocate. One recognizer per thread; the CharClassifier it uses is only read and can be shared.
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include "CharClassifier.h"
+#include "CharFrameContext.h"
+#include "GlyphBatch.h"
+
+#include<opencv2/core/core.hpp>
+
+#include<string>
+#include<vector>
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class CharRecognizer {
+public:
+    // intImageWidth x intImageHeight is the resized glyph size the classifier was trained on,
+    // contours with an area of dblMinContourArea or less are noise, pPool runs the preprocessing strips in parallel
+    CharRecognizer(const CharClassifier& charClassifier, int intImageWidth, int intImageHeight, double dblMinContourArea,
+                   WorkStealingPool* pPool = nullptr);
+
+    // grayscale, blur and threshold the frame, then find the glyph rects
+    void segment(const cv::Mat& matImage, cv::Mat& matThresh, std::vector<cv::Rect>& vecRects);
+
+    // classify the glyphs found by segment, vecChars is filled in reading order and the text is returned,
+    // the text stays valid until the next call
+    const std::string& classify(const cv::Mat& matThresh, const std::vector<cv::Rect>& vecRects, std::vector<RecognizedChar>& vecChars);
+
+    // segment and classify in one call, the threshold image and rects of the frame stay available below
+    const std::string& recognize(const cv::Mat& matImage, std::vector<RecognizedChar>& vecChars);
+
+    const cv::Mat& thresh() const { return frameContext.matThresh; }
+    const std::vector<cv::Rect>& rects() const { return frameContext.vecRects; }
+
+    // reuse the results of glyphs unchanged since the previous frame, see GlyphCache; off by default
+    void setCaching(bool blnCaching, double dblMaxDifference = GLYPH_CACHE_MAX_DIFFERENCE);
+    const GlyphCache& cache() const { return frameContext.glyphCache; }
+
+    // size the buffers for frames of frameSize with up to intMaxGlyphs glyphs, see CharFrameContext::reserve
+    void reserve(const cv::Size& frameSize, int intMaxGlyphs) { frameContext.reserve(frameSize, intMaxGlyphs); }
+
+private:
+    const CharClassifier& charClassifier;
+    double dblMinContourArea;
+    CharFrameContext frameContext;
+};
@@ -0,0 +1,247 @@
+// ###########################################################################################################################
+// DistanceKernels.cpp :
+//
+// Description: Scalar, SSE2 and AVX2 distance kernels with runtime dispatch, see DistanceKernels.h
+//
+// ###########################################################################################################################
+
+#include "DistanceKernels.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DISTANCE_KERNELS_X86 1
+#include<immintrin.h>
+#ifdef _MSC_VER
+#include<intrin.h>
+#endif
+#endif
+
+// GCC and Clang only emit AVX2 / POPCNT instructions inside functions marked for them, MSVC always can
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_POPCNT __attribute__((target("popcnt")))
+#else
+#define TARGET_AVX2
+#define TARGET_POPCNT
+#endif
+
+// scalar kernels /////////////////////////////////////////////////////////////////////////////////
+static uint32_t l2DistanceScalar(const uint8_t* pA, const uint8_t* pB, int intCount) {
+    uint32_t uintSum = 0;
+    for (int i = 0; i < intCount; i++) {
+        int intDiff = (int)pA[i] - (int)pB[i];
+        uintSum += (uint32_t)(intDiff * intDiff);
+    }
+    return uintSum;
+}
+
+// software popcount, used when the CPU has no POPCNT instruction
+static inline uint32_t popcountSoftware(uint64_t x) {
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (uint32_t)((x * 0x0101010101010101ULL) >> 56);
+}
+
+static uint32_t hammingDistanceScalar(const uint64_t* pA, const uint64_t* pB, int intWords) {
+    uint32_t uintSum = 0;
+    for (int i = 0; i < intWords; i++) {
+        uintSum += popcountSoftware(pA[i] ^ pB[i]);
+    }
+    return uintSum;
+}
+
+#ifdef DISTANCE_KERNELS_X86
+
+// SSE2 kernels ///////////////////////////////////////////////////////////////////////////////////
+static uint32_t l2DistanceSse2(const uint8_t* pA, const uint8_t* pB, int intCount) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128();
+    int i = 0;
+
+    for (; i + 16 <= intCount; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pA + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pB + i));
+
+        // |a - b| in unsigned bytes, then widen to 16 bit and square-and-add pairs into 32 bit lanes
+        __m128i d = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+        __m128i lo = _mm_unpacklo_epi8(d, zero);
+        __m128i hi = _mm_unpackhi_epi8(d, zero);
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(lo, lo));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(hi, hi));
+    }
+
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    uint32_t uintSum = (uint32_t)_mm_cvtsi128_si32(acc);
+
+    return uintSum + l2DistanceScalar(pA + i, pB + i, intCount - i);
+}
+
+TARGET_POPCNT
+static uint32_t hammingDistancePopcnt(const uint64_t* pA, const uint64_t* pB, int intWords) {
+    uint32_t uintSum = 0;
+    for (int i = 0; i < intWords; i++) {
+#if defined(_MSC_VER) && defined(_M_X64)
+        uintSum += (uint32_t)__popcnt64(pA[i] ^ pB[i]);
+#elif defined(_MSC_VER)
+        uint64_t x = pA[i] ^ pB[i];
+        uintSum += __popcnt((uint32_t)x) + __popcnt((uint32_t)(x >> 32));
+#else
+        uintSum += (uint32_t)__builtin_popcountll(pA[i] ^ pB[i]);
+#endif
+    }
+    return uintSum;
+}
+
+// AVX2 kernels ///////////////////////////////////////////////////////////////////////////////////
+TARGET_AVX2
+static uint32_t l2DistanceAvx2(const uint8_t* pA, const uint8_t* pB, int intCount) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc = _mm256_setzero_si256();
+    int i = 0;
+
+    for (; i + 32 <= intCount; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pA + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pB + i));
+
+        __m256i d = _mm256_or_si256(_mm256_subs_epu8(a, b), _mm256_subs_epu8(b, a));
+        __m256i lo = _mm256_unpacklo_epi8(d, zero);
+        __m256i hi = _mm256_unpackhi_epi8(d, zero);
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(lo, lo));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(hi, hi));
+    }
+
+    __m128i acc128 = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    acc128 = _mm_add_epi32(acc128, _mm_shuffle_epi32(acc128, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc128 = _mm_add_epi32(acc128, _mm_shuffle_epi32(acc128, _MM_SHUFFLE(2, 3, 0, 1)));
+    uint32_t uintSum = (uint32_t)_mm_cvtsi128_si32(acc128);
+
+    return uintSum + l2DistanceScalar(pA + i, pB + i, intCount - i);
+}
+
+// popcount of 32 bytes at a time with the nibble lookup table trick, summed per 64 bit lane by sad_epu8
+TARGET_AVX2
+static uint32_t hammingDistanceAvx2(const uint64_t* pA, const uint64_t* pB, int intWords) {
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i lowMask = _mm256_set1_epi8(0x0F);
+    __m256i acc = _mm256_setzero_si256();
+    int i = 0;
+
+    for (; i + 4 <= intWords; i += 4) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pA + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pB + i));
+        __m256i x = _mm256_xor_si256(a, b);
+
+        __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(x, lowMask));
+        __m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(x, 4), lowMask));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256()));
+    }
+
+    __m128i acc128 = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    uint32_t uintSum = (uint32_t)(_mm_cvtsi128_si32(acc128) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(acc128, acc128)));
+
+    return uintSum + hammingDistancePopcnt(pA + i, pB + i, intWords - i);
+}
+
+// CPU feature detection //////////////////////////////////////////////////////////////////////////
+static void cpuid(int intLeaf, int intSubLeaf, int regs[4]) {
+#ifdef _MSC_VER
+    __cpuidex(regs, intLeaf, intSubLeaf);
+#else
+    __asm__ __volatile__("cpuid" : "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3]) : "a"(intLeaf), "c"(intSubLeaf));
+#endif
+}
+
+static bool cpuHasPopcnt() {
+    int regs[4];
+    cpuid(1, 0, regs);
+    return (regs[2] & (1 << 23)) != 0;
+}
+
+static bool cpuHasAvx2() {
+    int regs[4];
+    cpuid(0, 0, regs);
+    if (regs[0] < 7) {
+        return false;
+    }
+
+    // AVX needs OSXSAVE and the OS saving the YMM registers, otherwise AVX2 instructions fault
+    cpuid(1, 0, regs);
+    bool osxsave = (regs[2] & (1 << 27)) != 0;
+    bool avx = (regs[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx) {
+        return false;
+    }
+
+#ifdef _MSC_VER
+    unsigned long long xcr0 = _xgetbv(0);
+#else
+    unsigned int eax, edx;
+    __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    unsigned long long xcr0 = ((unsigned long long)edx << 32) | eax;
+#endif
+    if ((xcr0 & 6) != 6) {
+        return false;
+    }
+
+    cpuid(7, 0, regs);
+    return (regs[1] & (1 << 5)) != 0;
+}
+
+#endif  // DISTANCE_KERNELS_X86
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+SimdLevel detectSimdLevel() {
+#ifdef DISTANCE_KERNELS_X86
+    static const SimdLevel level = cpuHasAvx2() ? SIMD_AVX2 : SIMD_SSE2;
+    return level;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+    case SIMD_AVX2: return "avx2";
+    case SIMD_SSE2: return "sse2";
+    default:        return "scalar";
+    }
+}
+
+L2DistanceKernel getL2DistanceKernel(SimdLevel level) {
+    if (level > detectSimdLevel()) {
+        level = detectSimdLevel();
+    }
+#ifdef DISTANCE_KERNELS_X86
+    if (level == SIMD_AVX2) return l2DistanceAvx2;
+    if (level == SIMD_SSE2) return l2DistanceSse2;
+#endif
+    return l2DistanceScalar;
+}
+
+HammingDistanceKernel getHammingDistanceKernel(SimdLevel level) {
+    if (level > detectSimdLevel()) {
+        level = detectSimdLevel();
+    }
+#ifdef DISTANCE_KERNELS_X86
+    static const bool popcnt = cpuHasPopcnt();
+    if (level == SIMD_AVX2 && popcnt) return hammingDistanceAvx2;
+    if (level >= SIMD_SSE2 && popcnt) return hammingDistancePopcnt;
+#endif
+    return hammingDistanceScalar;
+}
+
+void packRowBits(const uint8_t* pRow, int intCount, uint64_t* pWords) {
+    int intWords = wordsForBits(intCount);
+    for (int w = 0; w < intWords; w++) {
+        uint64_t word = 0;
+        int intEnd = intCount - w * 64 < 64 ? intCount - w * 64 : 64;
+        for (int b = 0; b < intEnd; b++) {
+            if (pRow[w * 64 + b] >= 128) {
+                word |= 1ULL << b;
+            }
+        }
+        pWords[w] = word;
+    }
+}
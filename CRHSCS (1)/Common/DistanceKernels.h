@@ -0,0 +1,41 @@
+// ###########################################################################################################################
+// DistanceKernels.h :
+//
+// Description: Distance kernels between two feature rows: squared L2 over uint8 values and Hamming over bit packed words.
+//              Each kernel has a scalar, an SSE2 and an AVX2 version. The version is picked at runtime from what the CPU
+//              supports, so one binary runs everywhere and still uses the widest instructions available.
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include<cstdint>
+
+// instruction set used by the distance kernels
+enum SimdLevel {
+    SIMD_SCALAR = 0,
+    SIMD_SSE2 = 1,
+    SIMD_AVX2 = 2
+};
+
+// squared L2 distance between two rows of intCount uint8 values, exact for any row length up to 66000 values
+typedef uint32_t(*L2DistanceKernel)(const uint8_t* pA, const uint8_t* pB, int intCount);
+
+// number of differing bits between two rows of intWords bit packed words
+typedef uint32_t(*HammingDistanceKernel)(const uint64_t* pA, const uint64_t* pB, int intWords);
+
+// best level the running CPU (and OS) supports
+SimdLevel detectSimdLevel();
+
+const char* simdLevelName(SimdLevel level);
+
+// kernel for the requested level, a level the CPU does not support falls back to the best one it does
+L2DistanceKernel getL2DistanceKernel(SimdLevel level);
+HammingDistanceKernel getHammingDistanceKernel(SimdLevel level);
+
+// pack a row of uint8 values into bits, value >= 128 is a 1, unused bits of the last word are 0
+void packRowBits(const uint8_t* pRow, int intCount, uint64_t* pWords);
+
+inline int wordsForBits(int intCount) {
+    return (intCount + 63) / 64;
+}
@@ -0,0 +1,371 @@
+// ###########################################################################################################################
+// FaceDetector.cpp :
+//
+// Description: Face and facial feature detection with per stage timing, see FaceDetector.h
+//
+// ###########################################################################################################################
+
+#include "FaceDetector.h"
+#include "Metrics.h"
+
+#include<opencv2/imgproc/imgproc.hpp>
+
+#include<algorithm>
+#include<iostream>
+
+// global variables ///////////////////////////////////////////////////////////////////////////////
+const std::string FACE_CASCADE_NAME = "haarcascade_frontalface_alt.xml";
+const std::string EYES_CASCADE_NAME = "haarcascade_eye_tree_eyeglasses.xml";
+const std::string MOUTH_CASCADE_NAME = "haarcascade_mcs_mouth.xml";
+const std::string NOSE_CASCADE_NAME = "haarcascade_mcs_nose.xml";
+
+const int LEGACY_EYE_MIN_SIZE = 30;                 // eye minimum size of the full resolution search, in pixels
+
+// smallest feature as a fraction of the face width, used when the faces are size normalized
+const double EYE_MIN_FRACTION = 0.15;
+const double MOUTH_MIN_FRACTION = 0.25;
+const double NOSE_MIN_FRACTION = 0.15;
+
+// where each feature is searched, as x, y, width, height fractions of the face box
+const cv::Rect2d EYES_PART(0.0, 0.0, 1.0, 1.0);
+const cv::Rect2d EYES_UPPER_HALF_PART(0.0, 0.0, 1.0, 0.5);
+const cv::Rect2d MOUTH_PART(0.2, 0.6, 0.6, 0.4);
+const cv::Rect2d NOSE_PART(0.2, 0.3, 0.6, 0.45);
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void DetectedFace::move(const cv::Point& ptShift) {
+    face += ptShift;
+    for (cv::Rect& eye : eyes) {
+        eye += ptShift;
+    }
+    for (cv::Rect& mouth : mouths) {
+        mouth += ptShift;
+    }
+    for (cv::Rect& nose : noses) {
+        nose += ptShift;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void FaceStageTimes::clear() {
+    *this = FaceStageTimes();
+}
+
+void FaceStageTimes::merge(const FaceStageTimes& other) {
+    for (int i = 0; i < FACE_STAGE_COUNT; i++) {
+        arrTicks[i] += other.arrTicks[i];
+    }
+    featureWallTicks += other.featureWallTicks;
+    frames += other.frames;
+    faces += other.faces;
+}
+
+// gray, pyramid and faces, plus the time the frame waited for the features
+double FaceStageTimes::totalMs() const {
+    uint64_t ticks = featureWallTicks;
+    for (int i = 0; i < FACE_STAGE_EYES; i++) {
+        ticks += arrTicks[i];
+    }
+    return ticks * 1000.0 / cv::getTickFrequency();
+}
+
+const char* FaceStageTimes::stageName(int intStage) {
+    static const char* arrNames[FACE_STAGE_COUNT] = { "gray", "pyramid", "faces", "eyes", "mouth", "nose" };
+    return intStage >= 0 && intStage < FACE_STAGE_COUNT ? arrNames[intStage] : "?";
+}
+
+void FaceStageTimes::report(std::ostream& out, const std::string& strTitle) const {
+
+    double dblFrames = frames > 0 ? (double)frames : 1.0;
+    double dblTicksPerMs = cv::getTickFrequency() / 1000.0;
+
+    out << strTitle << ", ms per frame over " << frames << " frames, " << faces << " faces:";
+    for (int i = 0; i < FACE_STAGE_COUNT; i++) {
+        out << " " << stageName(i) << " " << arrTicks[i] / dblTicksPerMs / dblFrames;
+    }
+    out << " | features wall " << featureWallTicks / dblTicksPerMs / dblFrames << " | total " << totalMs() / dblFrames << "\n";
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+FaceDetector::FaceDetector(const FaceDetectOptions& options)
+    : detectOptions(options), pCascadePack(nullptr), pFeaturePool(nullptr) {
+}
+
+bool FaceDetector::load() {
+
+    pCascadePack = detectOptions.blnCascadePack ? sharedCascadePack() : nullptr;
+
+    // Load the cascades
+    if (!loadCascade(FACE_CASCADE_NAME, faceCascade, pCascadePack)) {
+        std::cout << "Error loading face cascade\n";
+        return false;
+    }
+
+    // the feature cascades wait for the first face, only check they are there
+    if (detectOptions.blnEyes && !cascadeAvailable(EYES_CASCADE_NAME, pCascadePack)) {
+        std::cout << "Error loading eyes cascade\n";
+        return false;
+    }
+
+    if (detectOptions.blnMouth && !cascadeAvailable(MOUTH_CASCADE_NAME, pCascadePack)) {
+        std::cout << "Error loading mouth cascade\n";
+        return false;
+    }
+
+    if (detectOptions.blnNose && !cascadeAvailable(NOSE_CASCADE_NAME, pCascadePack)) {
+        std::cout << "Error loading nose cascade\n";
+        return false;
+    }
+
+    mainWorker.blnLoaded = false;
+    return true;
+}
+
+bool FaceDetector::preload() {
+
+    if (!mainWorker.blnLoaded && !loadFeatureCascades(mainWorker)) {
+        return false;
+    }
+
+    for (std::unique_ptr<FeatureWorker>& pWorker : vecPoolWorkers) {
+        if (!pWorker->blnLoaded && !loadFeatureCascades(*pWorker)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FaceDetector::setFeaturePool(WorkStealingPool* pPool) {
+
+    pFeaturePool = pPool;
+    vecPoolWorkers.clear();
+
+    if (pPool == nullptr) {
+        return true;
+    }
+
+    // CascadeClassifier cannot be copied, every pool thread parses its own when it gets its first face
+    for (int i = 0; i < pPool->threads(); i++) {
+        vecPoolWorkers.emplace_back(new FeatureWorker());
+    }
+    return true;
+}
+
+bool FaceDetector::loadFeatureCascades(FeatureWorker& worker) {
+
+    // a cascade that fails is not tried again, its feature is then never found
+    worker.blnLoaded = true;
+
+    if (detectOptions.blnEyes && !loadCascade(EYES_CASCADE_NAME, worker.eyesCascade, pCascadePack)) {
+        std::cout << "Error loading eyes cascade\n";
+        return false;
+    }
+
+    if (detectOptions.blnMouth && !loadCascade(MOUTH_CASCADE_NAME, worker.mouthCascade, pCascadePack)) {
+        std::cout << "Error loading mouth cascade\n";
+        return false;
+    }
+
+    if (detectOptions.blnNose && !loadCascade(NOSE_CASCADE_NAME, worker.noseCascade, pCascadePack)) {
+        std::cout << "Error loading nose cascade\n";
+        return false;
+    }
+
+    return true;
+}
+
+void FaceDetector::prepareGray(const cv::Mat& frame, cv::Mat& matGray) {
+
+    int64_t t0 = cv::getTickCount();
+
+    // convert the input to grayscale
+    {
+        ScopedTimer timer(METRIC_CVTCOLOR);
+        cv::cvtColor(frame, matGray, cv::COLOR_BGR2GRAY);
+    }
+    {
+        ScopedTimer timer(METRIC_EQUALIZE);
+        cv::equalizeHist(matGray, matGray);
+    }
+
+    stageTimes.arrTicks[FACE_STAGE_GRAY] += (uint64_t)(cv::getTickCount() - t0);
+    stageTimes.frames++;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void FaceDetector::detectFaces(const cv::Mat& matGray, std::vector<cv::Rect>& vecFaces) {
+
+    int64_t t0 = cv::getTickCount();
+
+    // the face cascade searches a downscaled copy, its pyramid then starts that much smaller
+    double dblScale = detectOptions.dblDetectScale;
+    const cv::Mat* pSearch = &matGray;
+    if (dblScale > 0 && dblScale < 1) {
+        cv::resize(matGray, matSmall, cv::Size(), dblScale, dblScale, cv::INTER_AREA);
+        pSearch = &matSmall;
+    }
+    else {
+        dblScale = 1.0;
+    }
+
+    int64_t t1 = cv::getTickCount();
+
+    // the minimum face size scales with the frame, but never under the cascade's own window
+    cv::Size window = faceCascade.getOriginalWindowSize();
+    int intMinSize = cvRound(detectOptions.intMinFaceSize * dblScale);
+    cv::Size minSize(std::max(window.width, intMinSize), std::max(window.height, intMinSize));
+
+    {
+        ScopedTimer timer(METRIC_FACE_CASCADE);
+        faceCascade.detectMultiScale(*pSearch, vecFaces, detectOptions.dblScaleFactor, detectOptions.intMinNeighbors,
+                                     0 | cv::CASCADE_SCALE_IMAGE, minSize);
+    }
+
+    if (dblScale != 1.0) {
+        cv::Rect frameRect(0, 0, matGray.cols, matGray.rows);
+        for (cv::Rect& face : vecFaces) {
+            face = cv::Rect(cvRound(face.x / dblScale), cvRound(face.y / dblScale),
+                            cvRound(face.width / dblScale), cvRound(face.height / dblScale)) & frameRect;
+        }
+    }
+
+    int64_t t2 = cv::getTickCount();
+    stageTimes.arrTicks[FACE_STAGE_PYRAMID] += (uint64_t)(t1 - t0);
+    stageTimes.arrTicks[FACE_STAGE_FACES] += (uint64_t)(t2 - t1);
+}
+
+void FaceDetector::detectInFace(FeatureWorker& worker, cv::CascadeClassifier& cascade, const cv::Mat& matGray, const cv::Rect& face,
+                                const cv::Rect2d& part, double dblMinFraction, std::vector<cv::Rect>& vecFound) {
+
+    vecFound.clear();
+    if (cascade.empty()) {
+        return;
+    }
+
+    cv::Rect region(face.x + cvRound(part.x * face.width), face.y + cvRound(part.y * face.height),
+                    cvRound(part.width * face.width), cvRound(part.height * face.height));
+    region &= cv::Rect(0, 0, matGray.cols, matGray.rows);
+    if (region.empty()) {
+        return;
+    }
+
+    // size normalized faces: the part is resized so the whole face would be intFeatureWidth wide
+    double dblScale = detectOptions.intFeatureWidth > 0 ? (double)detectOptions.intFeatureWidth / face.width : 1.0;
+    cv::Mat matSearch = matGray(region);
+    if (dblScale != 1.0) {
+        cv::Size partSize(std::max(1, cvRound(region.width * dblScale)), std::max(1, cvRound(region.height * dblScale)));
+        cv::resize(matSearch, worker.matPart, partSize, 0, 0, dblScale < 1 ? cv::INTER_AREA : cv::INTER_LINEAR);
+        matSearch = worker.matPart;
+    }
+
+    // minimum size relative to the face, or the fixed size of the original full resolution search
+    cv::Size window = cascade.getOriginalWindowSize();
+    int intMinSize = dblMinFraction > 0 ? cvRound(dblMinFraction * face.width * dblScale) : LEGACY_EYE_MIN_SIZE;
+    cv::Size minSize(std::max(window.width, intMinSize), std::max(window.height, intMinSize * window.height / std::max(1, window.width)));
+    if (matSearch.cols < minSize.width || matSearch.rows < minSize.height) {
+        return;
+    }
+
+    {
+        ScopedTimer timer(METRIC_FEATURE_CASCADE);
+        cascade.detectMultiScale(matSearch, vecFound, 1.1, 2, 0 | cv::CASCADE_SCALE_IMAGE, minSize);
+    }
+
+    // back into frame coordinates
+    for (cv::Rect& found : vecFound) {
+        found = cv::Rect(region.x + cvRound(found.x / dblScale), region.y + cvRound(found.y / dblScale),
+                         cvRound(found.width / dblScale), cvRound(found.height / dblScale));
+    }
+}
+
+void FaceDetector::detectFeatures(const cv::Mat& matGray, DetectedFace& detectedFace) {
+
+    int64_t t0 = cv::getTickCount();
+    detectFeatures(mainWorker, matGray, detectedFace);
+    stageTimes.merge(mainWorker.stageTimes);
+    mainWorker.stageTimes.clear();
+    stageTimes.featureWallTicks += (uint64_t)(cv::getTickCount() - t0);
+}
+
+void FaceDetector::detectFeatures(FeatureWorker& worker, const cv::Mat& matGray, DetectedFace& detectedFace) {
+
+    // the first face this thread searches parses its cascades
+    if (!worker.blnLoaded) {
+        loadFeatureCascades(worker);
+    }
+
+    bool blnNormalized = detectOptions.intFeatureWidth > 0;
+    int64_t t0 = cv::getTickCount();
+
+    if (detectOptions.blnEyes) {
+        //-- In each face ROI, detect eyes
+        detectInFace(worker, worker.eyesCascade, matGray, detectedFace.face, detectOptions.blnEyesUpperHalf ? EYES_UPPER_HALF_PART : EYES_PART,
+                     blnNormalized ? EYE_MIN_FRACTION : 0.0, detectedFace.eyes);
+    }
+    else {
+        detectedFace.eyes.clear();
+    }
+
+    int64_t t1 = cv::getTickCount();
+
+    if (detectOptions.blnMouth) {
+        detectInFace(worker, worker.mouthCascade, matGray, detectedFace.face, MOUTH_PART, MOUTH_MIN_FRACTION, detectedFace.mouths);
+    }
+    else {
+        detectedFace.mouths.clear();
+    }
+
+    int64_t t2 = cv::getTickCount();
+
+    if (detectOptions.blnNose) {
+        detectInFace(worker, worker.noseCascade, matGray, detectedFace.face, NOSE_PART, NOSE_MIN_FRACTION, detectedFace.noses);
+    }
+    else {
+        detectedFace.noses.clear();
+    }
+
+    int64_t t3 = cv::getTickCount();
+    worker.stageTimes.arrTicks[FACE_STAGE_EYES] += (uint64_t)(t1 - t0);
+    worker.stageTimes.arrTicks[FACE_STAGE_MOUTH] += (uint64_t)(t2 - t1);
+    worker.stageTimes.arrTicks[FACE_STAGE_NOSE] += (uint64_t)(t3 - t2);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void FaceDetector::detect(const cv::Mat& matGray, std::vector<DetectedFace>& detectedFaces) {
+
+    detectFaces(matGray, vecFaces);
+
+    detectedFaces.resize(vecFaces.size());
+    for (size_t i = 0; i < vecFaces.size(); i++) {
+        detectedFaces[i].face = vecFaces[i];
+    }
+    stageTimes.faces += vecFaces.size();
+
+    int64_t t0 = cv::getTickCount();
+
+    // every face is independent, each pool thread works with its own cascades and writes only its own faces
+    if (pFeaturePool != nullptr && vecFaces.size() > 1) {
+        pFeaturePool->parallelFor(vecFaces.size(), [&](size_t i, int intWorker) {
+            detectFeatures(*vecPoolWorkers[intWorker], matGray, detectedFaces[i]);
+        });
+
+        for (std::unique_ptr<FeatureWorker>& pWorker : vecPoolWorkers) {
+            stageTimes.merge(pWorker->stageTimes);
+            pWorker->stageTimes.clear();
+        }
+    }
+    else {
+        for (size_t i = 0; i < vecFaces.size(); i++) {
+            detectFeatures(mainWorker, matGray, detectedFaces[i]);
+        }
+        stageTimes.merge(mainWorker.stageTimes);
+        mainWorker.stageTimes.clear();
+    }
+
+    stageTimes.featureWallTicks += (uint64_t)(cv::getTickCount() - t0);
+}
+
+void FaceDetector::detect(const cv::Mat& frame, cv::Mat& matGray, std::vector<DetectedFace>& detectedFaces) {
+    prepareGray(frame, matGray);
+    detect(matGray, detectedFaces);
+}
@@ -0,0 +1,162 @@
+// ###########################################################################################################################
+// FaceDetector.h :
+//
+// Description: Face and facial feature detection for FacialDetection as a configurable pipeline of timed stages:
+//
+//                  gray       grayscale + histogram equalization of the frame
+//                  pyramid    the frame downscaled by dblDetectScale for the face cascade
+//                  faces      face cascade on the downscaled frame, boxes mapped back to full resolution
+//                  eyes       eye cascade in the face, or only in its upper half
+//                  mouth      mouth cascade in the lower part of the face
+//                  nose       nose cascade in the middle of the face
+//
+//              With intFeatureWidth set every face is resized to that width before the feature cascades run, so they
+//              search a fixed number of pixels with minimum sizes relative to the face, however big the face is in
+//              the frame. The defaults reproduce the original full resolution detection of faces and eyes.
+//
+//              A FaceDetector owns its cascades and scratch images; detectMultiScale keeps working data inside the
+//              classifier, so a detector must not be shared between threads. Given a WorkStealingPool the features of
+//              the faces of a frame are searched in parallel, every pool thread with its own copy of the feature
+//              cascades, so a frame with many faces takes about as long as one with a few.
+//
+//              The cascades come from the shared CascadePack when there is one, from the XML files otherwise. Only the
+//              face cascade is parsed by load; the feature cascades of a thread are parsed the first time that thread
+//              searches a face, so features that are turned off, or pool threads that never get a face, cost nothing.
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include "CascadePack.h"
+#include "WorkStealingPool.h"
+
+#include<opencv2/core/core.hpp>
+#include<opencv2/objdetect/objdetect.hpp>
+
+#include<cstdint>
+#include<memory>
+#include<ostream>
+#include<string>
+#include<vector>
+
+// cascade files, next to the executable
+extern const std::string FACE_CASCADE_NAME;
+extern const std::string EYES_CASCADE_NAME;
+extern const std::string MOUTH_CASCADE_NAME;
+extern const std::string NOSE_CASCADE_NAME;
+
+// a detected face and its features, all in frame coordinates
+struct DetectedFace {
+    cv::Rect face;
+    std::vector<cv::Rect> eyes;
+    std::vector<cv::Rect> mouths;
+    std::vector<cv::Rect> noses;
+
+    // move the face and all of its features
+    void move(const cv::Point& ptShift);
+};
+
+struct FaceDetectOptions {
+    double dblDetectScale = 1.0;                    // face cascade runs on the frame resized by this, 0.5 halves both sides
+    double dblScaleFactor = 1.1;                    // detectMultiScale pyramid step of the face cascade
+    int intMinNeighbors = 2;
+    int intMinFaceSize = 30;                        // smallest face in full resolution pixels
+    int intFeatureWidth = 0;                        // faces are resized to this width for the feature cascades, 0 keeps them
+    bool blnEyes = true;
+    bool blnEyesUpperHalf = false;                  // search the eyes in the upper half of the face only
+    bool blnMouth = false;
+    bool blnNose = false;
+    bool blnCascadePack = true;                     // load the cascades from the CascadePack when there is one
+};
+
+enum FaceStage {
+    FACE_STAGE_GRAY,
+    FACE_STAGE_PYRAMID,
+    FACE_STAGE_FACES,
+    FACE_STAGE_EYES,
+    FACE_STAGE_MOUTH,
+    FACE_STAGE_NOSE,
+    FACE_STAGE_COUNT
+};
+
+// ticks spent in every stage, summed over frames
+// with parallel feature detection the feature stages add up the time of all threads, featureWallTicks is the
+// time the frame actually waited for them
+struct FaceStageTimes {
+    uint64_t arrTicks[FACE_STAGE_COUNT] = {};
+    uint64_t featureWallTicks = 0;
+    uint64_t frames = 0;
+    uint64_t faces = 0;
+
+    void clear();
+    void merge(const FaceStageTimes& other);
+    double totalMs() const;
+
+    // average ms per frame of every stage and in total
+    void report(std::ostream& out, const std::string& strTitle) const;
+
+    static const char* stageName(int intStage);
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class FaceDetector {
+public:
+    explicit FaceDetector(const FaceDetectOptions& options = FaceDetectOptions());
+
+    // load the face cascade and check the feature cascades the options need are there, prints the reason and
+    // returns false on error; the feature cascades are parsed when they are first needed
+    bool load();
+
+    // parse the feature cascades of every thread now rather than on the first face, for timings without the start
+    bool preload();
+
+    // search the features of the faces of a frame on pPool (nullptr turns it off again), every pool thread gets its
+    // own copy of the feature cascades; the pool must not be used by anyone else while detect runs
+    bool setFeaturePool(WorkStealingPool* pPool);
+
+    // equalized grayscale image every other stage works on
+    void prepareGray(const cv::Mat& frame, cv::Mat& matGray);
+
+    // face boxes of the grayscale frame, in full resolution
+    void detectFaces(const cv::Mat& matGray, std::vector<cv::Rect>& vecFaces);
+
+    // eyes, mouth and nose of the face in detectedFace.face, as enabled by the options
+    void detectFeatures(const cv::Mat& matGray, DetectedFace& detectedFace);
+
+    // faces and their features of a grayscale frame, and of a color frame (matGray is filled on the way)
+    void detect(const cv::Mat& matGray, std::vector<DetectedFace>& detectedFaces);
+    void detect(const cv::Mat& frame, cv::Mat& matGray, std::vector<DetectedFace>& detectedFaces);
+
+    const FaceDetectOptions& options() const { return detectOptions; }
+    FaceStageTimes& times() { return stageTimes; }
+
+private:
+    // feature cascades and scratch space of one thread
+    struct FeatureWorker {
+        cv::CascadeClassifier eyesCascade;
+        cv::CascadeClassifier mouthCascade;
+        cv::CascadeClassifier noseCascade;
+        cv::Mat matPart;                            // scratch, resized face part
+        bool blnLoaded = false;                     // the cascades were parsed, or failed to
+        FaceStageTimes stageTimes;                  // feature stages of this thread, merged after every frame
+    };
+
+    bool loadFeatureCascades(FeatureWorker& worker);
+    void detectFeatures(FeatureWorker& worker, const cv::Mat& matGray, DetectedFace& detectedFace);
+
+    // run a feature cascade in the part of the face given as fractions of its size
+    void detectInFace(FeatureWorker& worker, cv::CascadeClassifier& cascade, const cv::Mat& matGray, const cv::Rect& face,
+                      const cv::Rect2d& part, double dblMinFraction, std::vector<cv::Rect>& vecFound);
+
+    FaceDetectOptions detectOptions;
+    FaceStageTimes stageTimes;
+
+    const CascadePack* pCascadePack;                // nullptr loads the XML files
+    cv::CascadeClassifier faceCascade;
+    cv::Mat matSmall;                               // scratch, downscaled frame
+    std::vector<cv::Rect> vecFaces;                 // scratch, face boxes of the frame
+
+    FeatureWorker mainWorker;                       // features on the calling thread
+    WorkStealingPool* pFeaturePool;
+    std::vector<std::unique_ptr<FeatureWorker>> vecPoolWorkers;
+};
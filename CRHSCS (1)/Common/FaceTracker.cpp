@@ -0,0 +1,137 @@
+// ###########################################################################################################################
+// FaceTracker.cpp :
+//
+// Description: Periodic face detection with template tracking in between, see FaceTracker.h
+//
+// ###########################################################################################################################
+
+#include "FaceTracker.h"
+
+#include<opencv2/imgproc/imgproc.hpp>
+
+#include<algorithm>
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+FaceTracker::FaceTracker(const FaceTrackerOptions& options)
+    : options(options), intNextId(1), intFramesSinceDetect(options.intDetectInterval) {
+}
+
+void FaceTracker::reset() {
+    vecTracks.clear();
+    intFramesSinceDetect = options.intDetectInterval;
+}
+
+double FaceTracker::overlap(const cv::Rect& a, const cv::Rect& b) {
+    int intIntersection = (a & b).area();
+    int intUnion = a.area() + b.area() - intIntersection;
+    return intUnion > 0 ? (double)intIntersection / intUnion : 0.0;
+}
+
+bool FaceTracker::update(const cv::Mat& matGray, const FaceDetectFn& fnDetect) {
+
+    // the first frame, and every intDetectInterval frames after a detection, run the full detection
+    bool blnDetect = ++intFramesSinceDetect >= options.intDetectInterval;
+
+    // otherwise follow the faces, and fall back to the detection as soon as one of them is lost
+    if (!blnDetect && !track(matGray)) {
+        blnDetect = true;
+    }
+
+    if (blnDetect) {
+        detect(matGray, fnDetect);
+        intFramesSinceDetect = 0;
+    }
+
+    return blnDetect;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// full detection, then carry the ids over to the new boxes by greedy best overlap
+void FaceTracker::detect(const cv::Mat& matGray, const FaceDetectFn& fnDetect) {
+
+    fnDetect(matGray, vecDetected);
+
+    // every (track, detection) pair that overlaps enough, best overlap first
+    struct Candidate { double dblOverlap; size_t track; size_t detection; };
+    std::vector<Candidate> vecCandidates;
+    for (size_t t = 0; t < vecTracks.size(); t++) {
+        for (size_t d = 0; d < vecDetected.size(); d++) {
+            double dblOverlap = overlap(vecTracks[t].detected.face, vecDetected[d].face);
+            if (dblOverlap >= options.dblMatchOverlap) {
+                vecCandidates.push_back({ dblOverlap, t, d });
+            }
+        }
+    }
+    std::sort(vecCandidates.begin(), vecCandidates.end(),
+              [](const Candidate& a, const Candidate& b) { return a.dblOverlap > b.dblOverlap; });
+
+    std::vector<int> vecIds(vecDetected.size(), 0);
+    std::vector<char> vecTrackUsed(vecTracks.size(), 0);
+    for (const Candidate& candidate : vecCandidates) {
+        if (!vecTrackUsed[candidate.track] && vecIds[candidate.detection] == 0) {
+            vecTrackUsed[candidate.track] = 1;
+            vecIds[candidate.detection] = vecTracks[candidate.track].intId;
+        }
+    }
+
+    // faces that were not detected again are gone, new faces get new ids
+    std::vector<TrackedFace> vecNewTracks(vecDetected.size());
+    for (size_t d = 0; d < vecDetected.size(); d++) {
+        TrackedFace& trackedFace = vecNewTracks[d];
+        trackedFace.intId = vecIds[d] != 0 ? vecIds[d] : intNextId++;
+        trackedFace.detected = vecDetected[d];
+        trackedFace.dblScore = 1.0;
+        setTemplate(matGray, trackedFace);
+    }
+    vecTracks.swap(vecNewTracks);
+}
+
+void FaceTracker::setTemplate(const cv::Mat& matGray, TrackedFace& trackedFace) {
+
+    const cv::Rect& face = trackedFace.detected.face;
+    trackedFace.dblTemplateScale = std::min(1.0, (double)options.intTemplateWidth / std::max(1, face.width));
+
+    cv::Size templateSize(std::max(1, cvRound(face.width * trackedFace.dblTemplateScale)),
+                          std::max(1, cvRound(face.height * trackedFace.dblTemplateScale)));
+    cv::resize(matGray(face), trackedFace.matTemplate, templateSize, 0, 0, cv::INTER_AREA);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// move every face to the best match of its template inside the search window, false when one is lost
+bool FaceTracker::track(const cv::Mat& matGray) {
+
+    cv::Rect frameRect(0, 0, matGray.cols, matGray.rows);
+
+    for (TrackedFace& trackedFace : vecTracks) {
+        cv::Rect& face = trackedFace.detected.face;
+        int intMarginX = cvRound(face.width * options.dblSearchMargin);
+        int intMarginY = cvRound(face.height * options.dblSearchMargin);
+        cv::Rect window = cv::Rect(face.x - intMarginX, face.y - intMarginY, face.width + 2 * intMarginX, face.height + 2 * intMarginY) & frameRect;
+
+        // search at template scale, the window has to hold the template at least once
+        double dblScale = trackedFace.dblTemplateScale;
+        cv::Size windowSize(cvRound(window.width * dblScale), cvRound(window.height * dblScale));
+        if (windowSize.width < trackedFace.matTemplate.cols || windowSize.height < trackedFace.matTemplate.rows) {
+            trackedFace.dblScore = 0;
+            return false;
+        }
+        cv::resize(matGray(window), matWindow, windowSize, 0, 0, cv::INTER_AREA);
+
+        cv::matchTemplate(matWindow, trackedFace.matTemplate, matScores, cv::TM_CCOEFF_NORMED);
+        double dblBest = 0;
+        cv::Point ptBest;
+        cv::minMaxLoc(matScores, nullptr, &dblBest, nullptr, &ptBest);
+
+        trackedFace.dblScore = dblBest;
+        if (dblBest < options.dblMinScore) {
+            return false;
+        }
+
+        // the eyes, mouth and nose move with their face
+        cv::Point ptNew(window.x + cvRound(ptBest.x / dblScale), window.y + cvRound(ptBest.y / dblScale));
+        trackedFace.detected.move(ptNew - face.tl());
+        face &= frameRect;
+    }
+
+    return true;
+}
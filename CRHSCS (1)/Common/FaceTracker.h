@@ -0,0 +1,71 @@
+// ###########################################################################################################################
+// FaceTracker.h :
+//
+// Description: Detect-then-track for FacialDetection. The full frame face detection runs every intDetectInterval frames;
+//              on the frames in between every face is followed by normalized cross correlation of its (downscaled)
+//              template inside a search window around its previous box, which costs a fraction of a detectMultiScale
+//              pass. When a face's match score drops under dblMinScore the detection runs again on that frame.
+//
+//              Faces keep their id from frame to frame: on every detection frame the new boxes are matched to the
+//              tracked ones by overlap, and only faces without a match get a new id.
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include "FaceDetector.h"
+
+#include<opencv2/core/core.hpp>
+
+#include<functional>
+#include<vector>
+
+// a face followed from frame to frame
+struct TrackedFace {
+    int intId = 0;                                  // stable id, assigned when the face is first detected
+    DetectedFace detected;                          // current box and features
+    double dblScore = 1.0;                          // match score of the last tracking step, 1 on detection frames
+    cv::Mat matTemplate;                            // downscaled face image from the last detection
+    double dblTemplateScale = 1.0;                  // matTemplate size / face size
+};
+
+struct FaceTrackerOptions {
+    int intDetectInterval = 10;                     // frames from one full detection to the next
+    double dblMinScore = 0.6;                       // normalized correlation under which a face counts as lost
+    double dblSearchMargin = 0.5;                   // search window grows the previous box by this fraction on every side
+    double dblMatchOverlap = 0.3;                   // intersection over union needed to keep an id across a detection
+    int intTemplateWidth = 32;                      // faces are matched at this width, bigger faces are downscaled
+};
+
+// full frame detection on the grayscale frame, fills the faces and their features
+typedef std::function<void(const cv::Mat& matGray, std::vector<DetectedFace>& detectedFaces)> FaceDetectFn;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class FaceTracker {
+public:
+    explicit FaceTracker(const FaceTrackerOptions& options = FaceTrackerOptions());
+
+    // advance to the next frame, detecting or tracking as needed; returns true when the detection ran
+    bool update(const cv::Mat& matGray, const FaceDetectFn& fnDetect);
+
+    const std::vector<TrackedFace>& faces() const { return vecTracks; }
+
+    // forget every face, the next update detects
+    void reset();
+
+    // intersection over union of two boxes
+    static double overlap(const cv::Rect& a, const cv::Rect& b);
+
+private:
+    void detect(const cv::Mat& matGray, const FaceDetectFn& fnDetect);
+    bool track(const cv::Mat& matGray);
+    void setTemplate(const cv::Mat& matGray, TrackedFace& trackedFace);
+
+    FaceTrackerOptions options;
+    std::vector<TrackedFace> vecTracks;
+    std::vector<DetectedFace> vecDetected;          // scratch, reused between detections
+    cv::Mat matWindow;                              // scratch, downscaled search window
+    cv::Mat matScores;                              // scratch, matchTemplate result
+    int intNextId;
+    int intFramesSinceDetect;
+};
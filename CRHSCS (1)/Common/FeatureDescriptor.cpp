@@ -0,0 +1,218 @@
+// ###########################################################################################################################
+// FeatureDescriptor.cpp :
+//
+// Description: Descriptor extraction for the resized char images, see FeatureDescriptor.h
+//
+// ###########################################################################################################################
+
+#include "FeatureDescriptor.h"
+#include "DistanceKernels.h"
+
+#include<algorithm>
+#include<cmath>
+#include<cstdlib>
+#include<cstring>
+
+// SSE2 is part of every x64 CPU, and of x86 builds that ask for it
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define DESCRIPTOR_SSE2 1
+#include<emmintrin.h>
+#endif
+
+// global variables ///////////////////////////////////////////////////////////////////////////////
+const char* DESCRIPTOR_NAMES[DESCRIPTOR_COUNT] = { "pixels", "zoning", "hog", "bits" };
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// sum of intCount uint8 values
+static inline uint32_t sumRow(const uint8_t* pRow, int intCount) {
+    uint32_t uintSum = 0;
+    int i = 0;
+#ifdef DESCRIPTOR_SSE2
+    // sum of absolute differences against zero adds 8 bytes into each 64 bit half
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 16 <= intCount; i += 16) {
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow + i)), _mm_setzero_si128()));
+    }
+    uintSum = (uint32_t)_mm_cvtsi128_si32(acc) + (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#endif
+    for (; i < intCount; i++) {
+        uintSum += pRow[i];
+    }
+    return uintSum;
+}
+
+// add intCount uint8 values to as many uint16 sums
+static inline void addRow(const uint8_t* pRow, int intCount, uint16_t* pSums) {
+    int i = 0;
+#ifdef DESCRIPTOR_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= intCount; i += 16) {
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow + i));
+        __m128i* pLow = reinterpret_cast<__m128i*>(pSums + i);
+        __m128i* pHigh = reinterpret_cast<__m128i*>(pSums + i + 8);
+        _mm_storeu_si128(pLow, _mm_add_epi16(_mm_loadu_si128(pLow), _mm_unpacklo_epi8(pixels, zero)));
+        _mm_storeu_si128(pHigh, _mm_add_epi16(_mm_loadu_si128(pHigh), _mm_unpackhi_epi8(pixels, zero)));
+    }
+#endif
+    for (; i < intCount; i++) {
+        pSums[i] = (uint16_t)(pSums[i] + pRow[i]);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+FeatureExtractor::FeatureExtractor(FeatureDescriptor descriptor, int intImageWidth, int intImageHeight)
+    : featureDescriptor(descriptor), intWidth(intImageWidth), intHeight(intImageHeight),
+    intZonesX((intImageWidth + DESCRIPTOR_ZONE_SIZE - 1) / DESCRIPTOR_ZONE_SIZE),
+    intZonesY((intImageHeight + DESCRIPTOR_ZONE_SIZE - 1) / DESCRIPTOR_ZONE_SIZE) {
+
+    switch (featureDescriptor) {
+    case DESCRIPTOR_ZONING:
+        intCols = intZonesX * intZonesY + intHeight + intWidth;
+        vecColumnSums.resize(intWidth);
+        vecImageColumnSums.resize(intWidth);
+        break;
+    case DESCRIPTOR_HOG: {
+        int intCellsX = (intWidth + DESCRIPTOR_CELL_SIZE - 1) / DESCRIPTOR_CELL_SIZE;
+        int intCellsY = (intHeight + DESCRIPTOR_CELL_SIZE - 1) / DESCRIPTOR_CELL_SIZE;
+        intCols = intCellsX * intCellsY * DESCRIPTOR_HOG_BINS;
+        vecHistograms.resize(intCols);
+        break;
+    }
+    default:
+        intCols = intWidth * intHeight;
+        break;
+    }
+}
+
+int FeatureExtractor::bytesPerRow() const {
+    return featureDescriptor == DESCRIPTOR_BITS ? wordsForBits(intCols) * (int)sizeof(uint64_t) : intCols;
+}
+
+void FeatureExtractor::extractRow(const uint8_t* pPixels, uint8_t* pFeatures) {
+
+    switch (featureDescriptor) {
+    case DESCRIPTOR_ZONING:
+        extractZoning(pPixels, pFeatures);
+        break;
+    case DESCRIPTOR_HOG:
+        extractHog(pPixels, pFeatures);
+        break;
+    default:
+        std::memcpy(pFeatures, pPixels, (size_t)intCols);
+        break;
+    }
+}
+
+void FeatureExtractor::extract(const cv::Mat& matPixels, cv::Mat& matFeatures) {
+    matFeatures.create(matPixels.rows, intCols, CV_8UC1);
+    for (int i = 0; i < matPixels.rows; i++) {
+        extractRow(matPixels.ptr<uint8_t>(i), matFeatures.ptr<uint8_t>(i));
+    }
+}
+
+const char* FeatureExtractor::name(FeatureDescriptor descriptor) {
+    return descriptor < DESCRIPTOR_COUNT ? DESCRIPTOR_NAMES[descriptor] : "unknown";
+}
+
+bool FeatureExtractor::parse(const std::string& strName, FeatureDescriptor& descriptor) {
+    for (int i = 0; i < (int)DESCRIPTOR_COUNT; i++) {
+        if (strName == DESCRIPTOR_NAMES[i]) {
+            descriptor = (FeatureDescriptor)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void FeatureExtractor::extractZoning(const uint8_t* pPixels, uint8_t* pFeatures) {
+
+    uint8_t* pZones = pFeatures;
+    uint8_t* pRowMeans = pFeatures + intZonesX * intZonesY;
+    uint8_t* pColumnMeans = pRowMeans + intHeight;
+
+    std::fill(vecImageColumnSums.begin(), vecImageColumnSums.end(), 0u);
+
+    // one band of zones at a time: the column sums of its rows, at most 5 x 255 each, give its zones
+    for (int intZoneY = 0; intZoneY < intZonesY; intZoneY++) {
+        int y0 = intZoneY * DESCRIPTOR_ZONE_SIZE;
+        int y1 = std::min(y0 + DESCRIPTOR_ZONE_SIZE, intHeight);
+
+        std::fill(vecColumnSums.begin(), vecColumnSums.end(), (uint16_t)0);
+        for (int y = y0; y < y1; y++) {
+            const uint8_t* pRow = pPixels + (size_t)y * intWidth;
+            addRow(pRow, intWidth, vecColumnSums.data());
+            pRowMeans[y] = (uint8_t)((sumRow(pRow, intWidth) + intWidth / 2) / intWidth);
+        }
+
+        for (int intZoneX = 0; intZoneX < intZonesX; intZoneX++) {
+            int x0 = intZoneX * DESCRIPTOR_ZONE_SIZE;
+            int x1 = std::min(x0 + DESCRIPTOR_ZONE_SIZE, intWidth);
+            uint32_t uintSum = 0;
+            for (int x = x0; x < x1; x++) {
+                uintSum += vecColumnSums[x];
+            }
+            uint32_t uintArea = (uint32_t)((x1 - x0) * (y1 - y0));
+            pZones[intZoneY * intZonesX + intZoneX] = (uint8_t)((uintSum + uintArea / 2) / uintArea);
+        }
+
+        for (int x = 0; x < intWidth; x++) {
+            vecImageColumnSums[x] += vecColumnSums[x];
+        }
+    }
+
+    for (int x = 0; x < intWidth; x++) {
+        pColumnMeans[x] = (uint8_t)((vecImageColumnSums[x] + intHeight / 2) / intHeight);
+    }
+}
+
+void FeatureExtractor::extractHog(const uint8_t* pPixels, uint8_t* pFeatures) {
+
+    int intCellsX = (intWidth + DESCRIPTOR_CELL_SIZE - 1) / DESCRIPTOR_CELL_SIZE;
+    std::fill(vecHistograms.begin(), vecHistograms.end(), 0);
+
+    for (int y = 0; y < intHeight; y++) {
+        const uint8_t* pRow = pPixels + (size_t)y * intWidth;
+        const uint8_t* pUp = pPixels + (size_t)std::max(y - 1, 0) * intWidth;
+        const uint8_t* pDown = pPixels + (size_t)std::min(y + 1, intHeight - 1) * intWidth;
+        int32_t* pCellRow = vecHistograms.data() + (size_t)(y / DESCRIPTOR_CELL_SIZE) * intCellsX * DESCRIPTOR_HOG_BINS;
+
+        for (int x = 0; x < intWidth; x++) {
+            // centered differences, the border pixel repeated
+            int dx = (int)pRow[std::min(x + 1, intWidth - 1)] - (int)pRow[std::max(x - 1, 0)];
+            int dy = (int)pDown[x] - (int)pUp[x];
+            int intMagnitude = std::abs(dx) + std::abs(dy);
+            if (intMagnitude == 0) {
+                continue;
+            }
+
+            // unsigned orientation: fold into dy >= 0, then find the 22.5 degree sector of the first quadrant by
+            // comparing against tan(22.5) and tan(67.5) in thousandths. dx <= 0 is the mirror image, where the
+            // comparisons include the border so an angle on a border goes to the higher bin either way
+            if (dy < 0 || (dy == 0 && dx < 0)) {
+                dx = -dx;
+                dy = -dy;
+            }
+            int intBin;
+            if (dx > 0) {
+                intBin = dy * 1000 < dx * 414 ? 0 : dy < dx ? 1 : dy * 1000 < dx * 2414 ? 2 : 3;
+            }
+            else {
+                int ax = -dx;
+                intBin = DESCRIPTOR_HOG_BINS - 1 - (dy * 1000 <= ax * 414 ? 0 : dy <= ax ? 1 : dy * 1000 <= ax * 2414 ? 2 : 3);
+            }
+
+            pCellRow[(x / DESCRIPTOR_CELL_SIZE) * DESCRIPTOR_HOG_BINS + intBin] += intMagnitude;
+        }
+    }
+
+    // L2 normalize over the glyph so stroke contrast does not matter, then quantize with clipping
+    double dblSquares = 0.0;
+    for (int32_t intValue : vecHistograms) {
+        dblSquares += (double)intValue * intValue;
+    }
+    double dblScale = dblSquares > 0.0 ? DESCRIPTOR_HOG_SCALE / std::sqrt(dblSquares) : 0.0;
+    for (int i = 0; i < intCols; i++) {
+        pFeatures[i] = (uint8_t)std::min(255, (int)(vecHistograms[i] * dblScale + 0.5));
+    }
+}
@@ -0,0 +1,81 @@
+// ###########################################################################################################################
+// FeatureDescriptor.h :
+//
+// Description: Feature rows computed from the resized 20x30 char image, shared by CharTrain and CharMatch. The model
+//              file records the descriptor its rows were made with, the classifier carries it, and GlyphBatch extracts
+//              the same descriptor from every glyph before it is classified. Every descriptor is quantized to uint8 so
+//              the rows go through the same distance kernels and indexes as the pixels:
+//
+//                  pixels   the 600 resized threshold pixels, as before
+//                  zoning   mean ink of every 5x5 zone, then the mean of every row and of every column (projection
+//                           histograms), 74 values; the zones and projections move little when a glyph is cut a
+//                           pixel off
+//                  hog      histograms of gradient orientation, 8 unsigned bins in every 5x5 cell weighted by the L1
+//                           gradient magnitude, L2 normalized over the glyph and clipped, 192 values
+//                  bits     the pixels binarized at 128 and compared bit packed with DISTANCE_HAMMING, 75 bytes a row
+//
+//              The row and column sums of zoning use SSE2 where the CPU has it, which every x64 CPU does.
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include<opencv2/core/core.hpp>
+
+#include<cstdint>
+#include<string>
+#include<vector>
+
+// descriptor constants ///////////////////////////////////////////////////////////////////////////
+const int DESCRIPTOR_ZONE_SIZE = 5;                 // zoning: pixels on a side of a zone
+const int DESCRIPTOR_CELL_SIZE = 5;                 // hog: pixels on a side of a cell
+const int DESCRIPTOR_HOG_BINS = 8;                  // hog: unsigned orientations of 22.5 degrees
+const int DESCRIPTOR_HOG_SCALE = 1024;              // hog: normalized value 0.25 quantizes to 255, larger ones clip
+
+enum FeatureDescriptor : uint32_t {
+    DESCRIPTOR_PIXELS = 0,
+    DESCRIPTOR_ZONING = 1,
+    DESCRIPTOR_HOG = 2,
+    DESCRIPTOR_BITS = 3,
+    DESCRIPTOR_COUNT = 4
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// turns resized char images into descriptor rows; keeps scratch between rows, so one extractor per thread
+class FeatureExtractor {
+public:
+    explicit FeatureExtractor(FeatureDescriptor descriptor = DESCRIPTOR_PIXELS, int intImageWidth = 20, int intImageHeight = 30);
+
+    FeatureDescriptor descriptor() const { return featureDescriptor; }
+
+    // uint8 values in a row, and the bytes a search compares per training row (bits are packed)
+    int cols() const { return intCols; }
+    int bytesPerRow() const;
+
+    // pixels and bits rows are the resized pixels themselves, nothing to extract
+    bool isPixels() const { return featureDescriptor == DESCRIPTOR_PIXELS || featureDescriptor == DESCRIPTOR_BITS; }
+
+    // one image of width x height contiguous uint8 pixels into cols() values
+    void extractRow(const uint8_t* pPixels, uint8_t* pFeatures);
+
+    // every row of matPixels (N x width * height, CV_8U) into matFeatures (N x cols(), CV_8U)
+    void extract(const cv::Mat& matPixels, cv::Mat& matFeatures);
+
+    static const char* name(FeatureDescriptor descriptor);
+    static bool parse(const std::string& strName, FeatureDescriptor& descriptor);
+
+private:
+    void extractZoning(const uint8_t* pPixels, uint8_t* pFeatures);
+    void extractHog(const uint8_t* pPixels, uint8_t* pFeatures);
+
+    FeatureDescriptor featureDescriptor;
+    int intWidth;
+    int intHeight;
+    int intZonesX;
+    int intZonesY;
+    int intCols;
+
+    std::vector<uint16_t> vecColumnSums;            // zoning: column sums of the current band of zones and of the image
+    std::vector<uint32_t> vecImageColumnSums;
+    std::vector<int32_t> vecHistograms;             // hog: cells x bins
+};
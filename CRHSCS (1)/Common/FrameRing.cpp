@@ -0,0 +1,196 @@
+// ###########################################################################################################################
+// FrameRing.cpp :
+//
+// Description: Capture thread and ring of the newest frames, see FrameRing.h
+//
+// ###########################################################################################################################
+
+#include "FrameRing.h"
+
+#include<algorithm>
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+FrameRing::FrameRing(size_t intSlots)
+    : vecSlots(std::max(intSlots, FRAME_RING_SLOTS)), intNewest(-1), uintCaptured(0), uintTakenSeq(0), uintTaken(0),
+    uintSkipped(0), blnLossless(false), blnEnded(false), blnStop(false) {
+}
+
+FrameRing::~FrameRing() {
+    stop();
+}
+
+void FrameRing::start(FrameSource& frameSource) {
+    blnLossless = !frameSource.isLive();
+    captureThread = std::thread(&FrameRing::captureLoop, this, std::ref(frameSource));
+}
+
+void FrameRing::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutexRing);
+        blnStop = true;
+    }
+    cvSlot.notify_all();
+
+    if (captureThread.joinable()) {
+        captureThread.join();
+    }
+
+    // a ring that never started has ended as well
+    std::lock_guard<std::mutex> lock(mutexRing);
+    blnEnded = true;
+    cvFrame.notify_all();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// the slot the capture thread writes next: the oldest one nobody holds, -1 when every slot is held
+int FrameRing::freeSlot() const {
+    int intSlot = -1;
+    for (int i = 0; i < (int)vecSlots.size(); i++) {
+        const Slot& slot = vecSlots[i];
+        if (i == intNewest || slot.intPins > 0 || slot.blnWriting) {
+            continue;
+        }
+        if (intSlot < 0 || slot.ringFrame.seq < vecSlots[intSlot].ringFrame.seq) {
+            intSlot = i;
+        }
+    }
+    return intSlot;
+}
+
+void FrameRing::captureLoop(FrameSource& frameSource) {
+
+    while (true) {
+        int intSlot = -1;
+        {
+            std::unique_lock<std::mutex> lock(mutexRing);
+            cvSlot.wait(lock, [&] { return blnStop || (intSlot = freeSlot()) >= 0; });
+            if (blnStop) {
+                break;
+            }
+            vecSlots[intSlot].blnWriting = true;
+        }
+
+        // the read runs without the lock, no consumer can pin a slot that is being written
+        RingFrame& ringFrame = vecSlots[intSlot].ringFrame;
+        bool blnRead = frameSource.read(ringFrame.frame);
+        int64_t captureTick = cv::getTickCount();
+        if (blnRead) {
+            ringFrame.frameIndex = frameSource.frameIndex();
+            ringFrame.strName = frameSource.frameName();
+        }
+
+        std::unique_lock<std::mutex> lock(mutexRing);
+        vecSlots[intSlot].blnWriting = false;
+
+        // recorded input: the frame read ahead waits until processing has taken the one before it
+        if (blnRead && blnLossless) {
+            cvSlot.wait(lock, [&] { return blnStop || uintTakenSeq == uintCaptured; });
+        }
+        if (!blnRead || blnStop) {
+            break;
+        }
+
+        ringFrame.seq = ++uintCaptured;
+        ringFrame.captureTick = captureTick;
+        intNewest = intSlot;
+        cvFrame.notify_all();
+    }
+
+    std::lock_guard<std::mutex> lock(mutexRing);
+    blnEnded = true;
+    cvFrame.notify_all();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const RingFrame* FrameRing::acquireNewest() {
+
+    std::unique_lock<std::mutex> lock(mutexRing);
+    auto newFrame = [&] { return intNewest >= 0 && vecSlots[intNewest].ringFrame.seq > uintTakenSeq; };
+    cvFrame.wait(lock, [&] { return blnEnded || newFrame(); });
+
+    if (!newFrame()) {
+        return nullptr;
+    }
+
+    Slot& slot = vecSlots[intNewest];
+    uintSkipped += slot.ringFrame.seq - uintTakenSeq - 1;
+    uintTakenSeq = slot.ringFrame.seq;
+    uintTaken++;
+    slot.intPins++;
+
+    // a recorded source waits for this to publish the next frame
+    cvSlot.notify_all();
+    return &slot.ringFrame;
+}
+
+const RingFrame* FrameRing::peekNewest(uint64_t afterSeq) {
+
+    std::lock_guard<std::mutex> lock(mutexRing);
+    if (intNewest < 0 || vecSlots[intNewest].ringFrame.seq <= afterSeq) {
+        return nullptr;
+    }
+
+    vecSlots[intNewest].intPins++;
+    return &vecSlots[intNewest].ringFrame;
+}
+
+void FrameRing::release(const RingFrame* pRingFrame) {
+
+    if (pRingFrame == nullptr) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutexRing);
+        for (Slot& slot : vecSlots) {
+            if (&slot.ringFrame == pRingFrame) {
+                slot.intPins--;
+                break;
+            }
+        }
+    }
+    cvSlot.notify_all();
+}
+
+bool FrameRing::ended() const {
+    std::lock_guard<std::mutex> lock(mutexRing);
+    return blnEnded;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+double FrameRing::recordResult(const RingFrame& ringFrame) {
+
+    double dblMs = (cv::getTickCount() - ringFrame.captureTick) / (cv::getTickFrequency() / 1000.0);
+    uint64_t nanoseconds = (uint64_t)std::max(0.0, dblMs * 1e6);
+
+    captureToResult.record(nanoseconds);
+    if (metricsEnabled()) {
+        stageHistogram(METRIC_CAPTURE_TO_RESULT).record(nanoseconds);
+    }
+    return dblMs;
+}
+
+uint64_t FrameRing::captured() const {
+    std::lock_guard<std::mutex> lock(mutexRing);
+    return uintCaptured;
+}
+
+uint64_t FrameRing::taken() const {
+    std::lock_guard<std::mutex> lock(mutexRing);
+    return uintTaken;
+}
+
+uint64_t FrameRing::skipped() const {
+    std::lock_guard<std::mutex> lock(mutexRing);
+    return uintSkipped;
+}
+
+void FrameRing::report(std::ostream& out) const {
+
+    const double dblMsPerNs = 1e-6;
+
+    out << "captured " << captured() << " frames, processed " << taken() << ", skipped " << skipped()
+        << ", capture to result p50 " << captureToResult.quantile(0.5) * dblMsPerNs
+        << " ms, p99 " << captureToResult.quantile(0.99) * dblMsPerNs
+        << " ms, max " << captureToResult.maximum() * dblMsPerNs << " ms\n";
+}
@@ -0,0 +1,117 @@
+// ###########################################################################################################################
+// FrameRing.h :
+//
+// Description: Asynchronous capture for the camera loops of CharMatch and FacialDetection. A capture thread reads the
+//              FrameSource into a fixed ring of frames, each with a sequence number and the tick it was captured at,
+//              so a slow frame of processing or a long waitKey never keeps the driver waiting and the frames that do
+//              get processed are fresh.
+//
+//              Processing takes the newest frame with acquireNewest and skips the ones it was too slow for; a display
+//              can show the newest frame with peekNewest from another thread without taking it from processing. A
+//              consumer pins the frame it holds until release, the capture thread writes into the oldest slot that
+//              is neither pinned nor the newest, so with one frame held by processing and one by the display there
+//              is always a slot free. The slots keep their images, a camera fills the same memory frame after frame.
+//
+//              Recorded input (video, images, stdin) is never skipped: the capture thread waits until processing has
+//              taken the newest frame before it publishes the next, and only reads ahead by one frame.
+//
+//              recordResult measures the latency from the capture of a frame to its result, for the JSON lines, the
+//              summary of report and the capture_to_result stage of the metrics.
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include "FrameSource.h"
+#include "Metrics.h"
+
+#include<opencv2/core/core.hpp>
+
+#include<condition_variable>
+#include<cstdint>
+#include<mutex>
+#include<ostream>
+#include<string>
+#include<thread>
+#include<vector>
+
+// frame ring constants ///////////////////////////////////////////////////////////////////////////
+const size_t FRAME_RING_SLOTS = 4;                  // newest, processing, display and the one being written
+
+// one captured frame in the ring
+struct RingFrame {
+    uint64_t seq = 0;                               // capture sequence number from 1, gaps are frames never processed
+    int64_t captureTick = 0;                        // cv::getTickCount() when the read returned
+    uint64_t frameIndex = 0;                        // FrameSource::frameIndex and frameName of the frame
+    std::string strName;
+    cv::Mat frame;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class FrameRing {
+public:
+    explicit FrameRing(size_t intSlots = FRAME_RING_SLOTS);
+    ~FrameRing();
+
+    FrameRing(const FrameRing&) = delete;
+    FrameRing& operator=(const FrameRing&) = delete;
+
+    // start the capture thread on an opened source, which belongs to the thread until stop
+    void start(FrameSource& frameSource);
+
+    // end the capture and wait for the thread, frames still held stay valid until they are released
+    void stop();
+
+    // processing: pin the newest frame it has not taken yet, waiting for one; nullptr once the capture has ended
+    // and every frame was taken. Each consumer holds at most one frame at a time
+    const RingFrame* acquireNewest();
+
+    // display: pin the newest frame with a sequence number above afterSeq without waiting, nullptr when there is
+    // none; the frame stays available to processing
+    const RingFrame* peekNewest(uint64_t afterSeq);
+
+    void release(const RingFrame* pRingFrame);
+
+    // the capture has ended, at the end of the source, on a read error or after stop
+    bool ended() const;
+
+    // ms from the capture of a frame to now, called when its result is ready; also recorded into the summary and,
+    // while the metrics are on, into the capture_to_result stage
+    double recordResult(const RingFrame& ringFrame);
+
+    // frames captured, taken by processing and skipped over because processing was busy
+    uint64_t captured() const;
+    uint64_t taken() const;
+    uint64_t skipped() const;
+
+    // one line with the counters and p50, p99 and max of the capture to result latency
+    void report(std::ostream& out) const;
+
+private:
+    struct Slot {
+        RingFrame ringFrame;
+        int intPins = 0;                            // consumers holding the frame
+        bool blnWriting = false;                    // the capture thread is reading into it
+    };
+
+    void captureLoop(FrameSource& frameSource);
+    int freeSlot() const;
+
+    std::vector<Slot> vecSlots;
+    std::thread captureThread;
+
+    mutable std::mutex mutexRing;                   // guards the slots, the sequence numbers and the flags
+    std::condition_variable cvFrame;                // a frame was published or the capture ended
+    std::condition_variable cvSlot;                 // a frame was released or taken
+
+    int intNewest;                                  // slot of the newest frame, -1 before the first one
+    uint64_t uintCaptured;
+    uint64_t uintTakenSeq;                          // newest sequence number processing has taken
+    uint64_t uintTaken;
+    uint64_t uintSkipped;
+    bool blnLossless;
+    bool blnEnded;
+    bool blnStop;
+
+    LatencyHistogram captureToResult;
+};
@@ -0,0 +1,228 @@
+// ###########################################################################################################################
+// FrameSource.cpp :
+//
+// Description: Camera, video, image, directory and raw stdin input, see FrameSource.h
+//
+// ###########################################################################################################################
+
+#include "FrameSource.h"
+#include "Metrics.h"
+
+#include<opencv2/core/utils/filesystem.hpp>
+#include<opencv2/imgcodecs/imgcodecs.hpp>
+
+#include<algorithm>
+#include<cctype>
+#include<cstdio>
+#include<iostream>
+
+#ifdef _WIN32
+#include<fcntl.h>
+#include<io.h>
+#endif
+
+// file extensions read as images
+static const char* IMAGE_EXTENSIONS[] = { ".png", ".jpg", ".jpeg", ".bmp", ".tif", ".tiff", ".pgm", ".ppm", ".webp" };
+
+static bool startsWith(const std::string& str, const std::string& strPrefix) {
+    return str.compare(0, strPrefix.size(), strPrefix) == 0;
+}
+
+static bool isAllDigits(const std::string& str) {
+    return !str.empty() && std::all_of(str.begin(), str.end(), [](char c) { return std::isdigit((unsigned char)c) != 0; });
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+FrameSource::FrameSource()
+    : sourceType(SOURCE_NONE), intNextFile(0), intStdinWidth(0), intStdinHeight(0), intFramesRead(0) {
+}
+
+bool FrameSource::isImageFile(const std::string& strPath) {
+    std::string strLower = strPath;
+    std::transform(strLower.begin(), strLower.end(), strLower.begin(), [](char c) { return (char)std::tolower((unsigned char)c); });
+
+    for (const char* pExtension : IMAGE_EXTENSIONS) {
+        std::string strExtension = pExtension;
+        if (strLower.size() > strExtension.size() && strLower.compare(strLower.size() - strExtension.size(), strExtension.size(), strExtension) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FrameSource::listImages(const std::string& strDirectory, std::vector<std::string>& vecFiles) {
+    std::vector<cv::String> vecAll;
+    cv::glob(strDirectory, vecAll, false);
+
+    vecFiles.clear();
+    for (const cv::String& strFile : vecAll) {
+        if (isImageFile(strFile)) {
+            vecFiles.push_back(strFile);
+        }
+    }
+    std::sort(vecFiles.begin(), vecFiles.end());
+}
+
+bool FrameSource::open(const std::string& strSpecIn) {
+
+    release();
+    strSpec = strSpecIn;
+
+    // camera index
+    std::string strCamera = startsWith(strSpec, "camera:") ? strSpec.substr(7) : strSpec;
+    if (isAllDigits(strCamera)) {
+        if (!cap.open(std::stoi(strCamera))) {
+            std::cerr << "Unable to open the camera " << strCamera << "\n";
+            return false;
+        }
+        sourceType = SOURCE_CAMERA;
+        return true;
+    }
+
+    // raw BGR24 frames on stdin
+    if (startsWith(strSpec, "stdin:")) {
+        if (std::sscanf(strSpec.c_str() + 6, "%dx%d", &intStdinWidth, &intStdinHeight) != 2 || intStdinWidth <= 0 || intStdinHeight <= 0) {
+            std::cerr << "error, stdin input needs the frame size, e.g. stdin:640x480\n";
+            return false;
+        }
+#ifdef _WIN32
+        // stdin is opened in text mode on Windows, raw frames need binary mode
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        sourceType = SOURCE_STDIN;
+        return true;
+    }
+
+    // directory of images
+    std::string strDirectory = startsWith(strSpec, "dir:") ? strSpec.substr(4) : strSpec;
+    if (cv::utils::fs::isDirectory(strDirectory)) {
+        listImages(strDirectory, vecFiles);
+        if (vecFiles.empty()) {
+            std::cerr << "error, no images found in " << strDirectory << "\n";
+            return false;
+        }
+        sourceType = SOURCE_DIRECTORY;
+        return true;
+    }
+
+    // single image
+    if (isImageFile(strSpec)) {
+        if (!cv::utils::fs::exists(strSpec)) {
+            std::cerr << "error, image " << strSpec << " not found\n";
+            return false;
+        }
+        vecFiles.push_back(strSpec);
+        sourceType = SOURCE_IMAGE;
+        return true;
+    }
+
+    // anything else has to be a video file
+    if (!cap.open(strSpec)) {
+        std::cerr << "error, unable to open video " << strSpec << "\n";
+        return false;
+    }
+    sourceType = SOURCE_VIDEO;
+    return true;
+}
+
+void FrameSource::release() {
+    if (cap.isOpened()) {
+        cap.release();
+    }
+    vecFiles.clear();
+    intNextFile = 0;
+    intFramesRead = 0;
+    sourceType = SOURCE_NONE;
+}
+
+bool FrameSource::read(cv::Mat& frame) {
+
+    ScopedTimer timer(METRIC_CAPTURE);
+
+    bool blnRead = false;
+
+    switch (sourceType) {
+    case SOURCE_CAMERA:
+    case SOURCE_VIDEO:
+        blnRead = cap.read(frame) && !frame.empty();
+        break;
+
+    case SOURCE_IMAGE:
+    case SOURCE_DIRECTORY:
+        // skip files that do not decode instead of ending the whole run
+        while (!blnRead && intNextFile < vecFiles.size()) {
+            frame = cv::imread(vecFiles[intNextFile++], cv::IMREAD_COLOR);
+            blnRead = !frame.empty();
+            if (!blnRead) {
+                std::cerr << "warning, unable to read image " << vecFiles[intNextFile - 1] << "\n";
+            }
+        }
+        break;
+
+    case SOURCE_STDIN: {
+        frame.create(intStdinHeight, intStdinWidth, CV_8UC3);
+        size_t bytes = (size_t)intStdinWidth * intStdinHeight * 3;
+        blnRead = std::fread(frame.data, 1, bytes, stdin) == bytes;
+        break;
+    }
+
+    default:
+        break;
+    }
+
+    if (!blnRead) {
+        frame.release();
+        return false;
+    }
+
+    intFramesRead++;
+    return true;
+}
+
+int64_t FrameSource::frameCount() const {
+    switch (sourceType) {
+    case SOURCE_VIDEO:
+        return (int64_t)cap.get(cv::CAP_PROP_FRAME_COUNT);
+    case SOURCE_IMAGE:
+    case SOURCE_DIRECTORY:
+        return (int64_t)vecFiles.size();
+    default:
+        return -1;
+    }
+}
+
+bool FrameSource::seekFrame(uint64_t intFrame) {
+    switch (sourceType) {
+    case SOURCE_VIDEO:
+        // some codecs only seek to key frames, CAP_PROP_POS_FRAMES decodes forward from there to the exact frame
+        if (!cap.set(cv::CAP_PROP_POS_FRAMES, (double)intFrame)) {
+            return false;
+        }
+        break;
+    case SOURCE_IMAGE:
+    case SOURCE_DIRECTORY:
+        if (intFrame > vecFiles.size()) {
+            return false;
+        }
+        intNextFile = (size_t)intFrame;
+        break;
+    default:
+        return false;
+    }
+
+    // frameIndex() counts from the seek position
+    intFramesRead = intFrame;
+    return true;
+}
+
+FrameSource& FrameSource::operator>>(cv::Mat& frame) {
+    read(frame);
+    return *this;
+}
+
+std::string FrameSource::frameName() const {
+    if (sourceType == SOURCE_IMAGE || sourceType == SOURCE_DIRECTORY) {
+        return intNextFile > 0 ? vecFiles[intNextFile - 1] : std::string();
+    }
+    return strSpec + "#" + std::to_string(frameIndex());
+}
@@ -0,0 +1,78 @@
+// ###########################################################################################################################
+// FrameSource.h :
+//
+// Description: One input abstraction for CharMatch and FacialDetection, so both can run on recorded material and on
+//              machines without a camera. The source is picked from a spec string:
+//
+//                  "camera:N" or "N"       camera index N (the old cv::VideoCapture cap(0) is "0")
+//                  "dir:PATH" or PATH/      every image in a directory, in file name order
+//                  "stdin:WxH"              raw BGR24 frames of W x H pixels back to back on stdin
+//                                           (e.g. ffmpeg -i clip.mp4 -f rawvideo -pix_fmt bgr24 -)
+//                  PATH.png / .jpg / ...    a single image
+//                  any other PATH           a video file
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include<opencv2/core/core.hpp>
+#include<opencv2/videoio/videoio.hpp>
+
+#include<cstdint>
+#include<string>
+#include<vector>
+
+enum FrameSourceType {
+    SOURCE_NONE,
+    SOURCE_CAMERA,
+    SOURCE_VIDEO,
+    SOURCE_IMAGE,
+    SOURCE_DIRECTORY,
+    SOURCE_STDIN
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class FrameSource {
+public:
+    FrameSource();
+
+    // open the source described by strSpec, prints the reason and returns false on error
+    bool open(const std::string& strSpec);
+    void release();
+
+    bool isOpened() const { return sourceType != SOURCE_NONE; }
+    FrameSourceType type() const { return sourceType; }
+
+    // a camera produces frames at its own rate, everything else as fast as it can be read
+    bool isLive() const { return sourceType == SOURCE_CAMERA; }
+
+    // next frame, false at the end of the source
+    bool read(cv::Mat& frame);
+    FrameSource& operator>>(cv::Mat& frame);
+
+    // number of frames the source holds, -1 when unknown (camera, stdin); for videos this is the container's estimate
+    int64_t frameCount() const;
+
+    // continue reading at frame intFrame of a video, image or directory, false for a camera or stdin
+    bool seekFrame(uint64_t intFrame);
+
+    // index of the frame returned by the last read, and a name for it (the image path, or source#index)
+    uint64_t frameIndex() const { return intFramesRead > 0 ? intFramesRead - 1 : 0; }
+    std::string frameName() const;
+
+    const std::string& spec() const { return strSpec; }
+
+    // list the image files of a directory in file name order
+    static void listImages(const std::string& strDirectory, std::vector<std::string>& vecFiles);
+    static bool isImageFile(const std::string& strPath);
+
+private:
+    FrameSourceType sourceType;
+    std::string strSpec;
+    cv::VideoCapture cap;                           // camera and video
+    std::vector<std::string> vecFiles;              // single image and directory
+    size_t intNextFile;
+    int intStdinWidth;                              // raw frames on stdin
+    int intStdinHeight;
+    uint64_t intFramesRead;
+};
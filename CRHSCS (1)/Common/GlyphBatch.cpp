@@ -0,0 +1,221 @@
+// ###########################################################################################################################
+// GlyphBatch.cpp :
+//
+// Description: Per frame glyph batch and reading order, see GlyphBatch.h
+//
+// ###########################################################################################################################
+
+#include "GlyphBatch.h"
+#include "Metrics.h"
+
+#include<opencv2/imgproc/imgproc.hpp>
+
+#include<algorithm>
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GlyphBatch::GlyphBatch(int intImageWidth, int intImageHeight, int intInitialCapacity)
+    : intImageWidth(intImageWidth), intImageHeight(intImageHeight), intCount(0), intRejected(0),
+    featureExtractor(DESCRIPTOR_PIXELS, intImageWidth, intImageHeight),
+    pCache(nullptr), pCacheClassifier(nullptr), intCachedRejected(0) {
+    matFeatures.create(std::max(intInitialCapacity, 1), intImageWidth * intImageHeight, CV_8UC1);
+    vecRects.reserve(matFeatures.rows);
+}
+
+void GlyphBatch::setCache(GlyphCache* pGlyphCache, const CharClassifier& charClassifier) {
+    pCache = pGlyphCache;
+    pCacheClassifier = &charClassifier;
+}
+
+void GlyphBatch::clear() {
+    intCount = 0;
+    vecRects.clear();
+    vecCacheEntries.clear();
+    vecCachedChars.clear();
+    intCachedRejected = 0;
+
+    // the glyphs of the frame before become the ones a new glyph is compared against
+    if (pCache != nullptr) {
+        pCache->beginFrame(pCacheClassifier->generation());
+    }
+}
+
+void GlyphBatch::reserve(int intCapacity) {
+    if (intCapacity > matFeatures.rows) {
+        cv::Mat matGrown(intCapacity, matFeatures.cols, CV_8UC1);
+        matFeatures.rowRange(0, intCount).copyTo(matGrown.rowRange(0, intCount));
+        matFeatures = matGrown;
+    }
+    vecRects.reserve(intCapacity);
+    vecCacheEntries.reserve(intCapacity);
+    vecCachedChars.reserve(intCapacity);
+}
+
+void GlyphBatch::add(const cv::Mat& matThresh, const cv::Rect& rect) {
+
+    // an unchanged glyph keeps its result and is neither resized nor classified
+    if (pCache != nullptr) {
+        int intEntry = pCache->find(matThresh, rect);
+        if (intEntry >= 0) {
+            const CachedGlyph& cachedGlyph = pCache->result(intEntry);
+            if (cachedGlyph.blnRejected) {
+                intCachedRejected++;
+            }
+            else {
+                RecognizedChar recognizedChar = { rect, char(cachedGlyph.intLabel), cachedGlyph.fltConfidence, cachedGlyph.fltDistance };
+                vecCachedChars.push_back(recognizedChar);
+            }
+            pCache->keep(intEntry);
+            return;
+        }
+        vecCacheEntries.push_back(pCache->store(matThresh, rect));
+    }
+
+    // out of rows, double the matrix and keep the glyphs already added
+    if (intCount == matFeatures.rows) {
+        cv::Mat matGrown(matFeatures.rows * 2, matFeatures.cols, CV_8UC1);
+        matFeatures.copyTo(matGrown.rowRange(0, matFeatures.rows));
+        matFeatures = matGrown;
+    }
+
+    // view the next row as a height x width image and let resize write into it, no intermediate Mat
+    {
+        ScopedTimer timer(METRIC_RESIZE);
+        cv::Mat matROIResized = matFeatures.row(intCount).reshape(1, intImageHeight);
+        cv::resize(matThresh(rect), matROIResized, cv::Size(intImageWidth, intImageHeight));
+    }
+
+    vecRects.push_back(rect);
+    intCount++;
+}
+
+std::string GlyphBatch::classify(const CharClassifier& charClassifier, std::vector<RecognizedChar>& vecChars) {
+    std::string strText;
+    classify(charClassifier, vecChars, strText);
+    return strText;
+}
+
+void GlyphBatch::classify(const CharClassifier& charClassifier, std::vector<RecognizedChar>& vecChars, std::string& strText) {
+
+    vecChars.clear();
+    strText.clear();
+    intRejected = intCachedRejected;
+
+    if (intCount > 0) {
+        classifyRows(charClassifier, vecChars);
+    }
+
+    vecChars.insert(vecChars.end(), vecCachedChars.begin(), vecCachedChars.end());
+
+    if (!vecChars.empty()) {
+        readingOrder.sort(vecChars, strText);
+    }
+}
+
+void GlyphBatch::classifyRows(const CharClassifier& charClassifier, std::vector<RecognizedChar>& vecChars) {
+
+    ScopedTimer timer(METRIC_CLASSIFY);
+
+    // the classifier was trained on descriptor rows, extract the same from every resized glyph
+    cv::Mat matQuery = features();
+    if (featureExtractor.descriptor() != charClassifier.descriptor()) {
+        featureExtractor = FeatureExtractor(charClassifier.descriptor(), intImageWidth, intImageHeight);
+    }
+    if (!featureExtractor.isPixels()) {
+        if (matDescriptors.rows < matFeatures.rows || matDescriptors.cols != featureExtractor.cols()) {
+            matDescriptors.create(matFeatures.rows, featureExtractor.cols(), CV_8UC1);
+        }
+        for (int i = 0; i < intCount; i++) {
+            featureExtractor.extractRow(matFeatures.ptr<uint8_t>(i), matDescriptors.ptr<uint8_t>(i));
+        }
+        matQuery = matDescriptors.rowRange(0, intCount);
+    }
+
+    charClassifier.classifyBatch(matQuery, vecClassifications, vecNeighbors);
+
+    // a rejected glyph is most likely noise, it goes no further than here; the cache remembers it as rejected
+    for (int i = 0; i < (int)vecClassifications.size(); i++) {
+        const Classification& classification = vecClassifications[i];
+        if (pCache != nullptr) {
+            CachedGlyph cachedGlyph = { classification.intLabel, classification.blnRejected, classification.fltConfidence, classification.fltDistance };
+            pCache->setResult(vecCacheEntries[i], cachedGlyph);
+        }
+        if (classification.blnRejected) {
+            intRejected++;
+            continue;
+        }
+        RecognizedChar recognizedChar = { vecRects[i], char(classification.intLabel), classification.fltConfidence, classification.fltDistance };
+        vecChars.push_back(recognizedChar);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+std::string sortReadingOrder(std::vector<RecognizedChar>& vecChars) {
+    ReadingOrder readingOrder;
+    std::string strText;
+    readingOrder.sort(vecChars, strText);
+    return strText;
+}
+
+void ReadingOrder::sort(std::vector<RecognizedChar>& vecChars, std::string& strText) {
+
+    // top to bottom first, so lines are started in order
+    std::sort(vecChars.begin(), vecChars.end(), [](const RecognizedChar& a, const RecognizedChar& b) {
+        return a.rect.y < b.rect.y || (a.rect.y == b.rect.y && a.rect.x < b.rect.x);
+    });
+
+    // assign each char to the first line whose vertical extent contains its center
+    vecLineTop.clear();
+    vecLineBottom.clear();
+    vecLineOfChar.resize(vecChars.size());
+
+    for (size_t i = 0; i < vecChars.size(); i++) {
+        const cv::Rect& rect = vecChars[i].rect;
+        int intCenterY = rect.y + rect.height / 2;
+
+        int intLine = -1;
+        for (size_t l = 0; l < vecLineTop.size(); l++) {
+            if (intCenterY >= vecLineTop[l] && intCenterY < vecLineBottom[l]) {
+                intLine = (int)l;
+                break;
+            }
+        }
+
+        if (intLine < 0) {
+            intLine = (int)vecLineTop.size();
+            vecLineTop.push_back(rect.y);
+            vecLineBottom.push_back(rect.y + rect.height);
+        }
+        else {
+            vecLineTop[intLine] = std::min(vecLineTop[intLine], rect.y);
+            vecLineBottom[intLine] = std::max(vecLineBottom[intLine], rect.y + rect.height);
+        }
+
+        vecLineOfChar[i] = intLine;
+    }
+
+    // lines in the order they were started, left to right inside each line
+    vecOrder.resize(vecChars.size());
+    for (size_t i = 0; i < vecOrder.size(); i++) {
+        vecOrder[i] = i;
+    }
+    std::sort(vecOrder.begin(), vecOrder.end(), [&](size_t a, size_t b) {
+        if (vecLineOfChar[a] != vecLineOfChar[b]) {
+            return vecLineOfChar[a] < vecLineOfChar[b];
+        }
+        return vecChars[a].rect.x < vecChars[b].rect.x;
+    });
+
+    vecSorted.clear();
+    strText.clear();
+
+    for (size_t i = 0; i < vecOrder.size(); i++) {
+        if (i > 0 && vecLineOfChar[vecOrder[i]] != vecLineOfChar[vecOrder[i - 1]]) {
+            strText += '\n';
+        }
+        vecSorted.push_back(vecChars[vecOrder[i]]);
+        strText += vecChars[vecOrder[i]].chrLabel;
+    }
+
+    // the old order stays in vecSorted as the buffer of the next sort
+    vecChars.swap(vecSorted);
+}
@@ -0,0 +1,111 @@
+// ###########################################################################################################################
+// GlyphBatch.h :
+//
+// Description: Collects every glyph found in one frame into a single preallocated feature matrix, so the whole frame is
+//              classified by one CharClassifier::findNearestBatch call instead of one findNearest call (and a handful of
+//              Mat allocations) per glyph. The recognized chars are then put in reading order: lines top to bottom and
+//              left to right inside each line. With a GlyphCache the glyphs that have not changed since the previous
+//              frame skip the resize and the classifier.
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include "CharClassifier.h"
+#include "GlyphCache.h"
+
+#include<opencv2/core/core.hpp>
+
+#include<string>
+#include<vector>
+
+// one classified glyph
+struct RecognizedChar {
+    cv::Rect rect;                                  // bounding rect in the frame
+    char chrLabel;                                  // classification
+    float fltConfidence;                            // share of the weighted vote, see Classification
+    float fltDistance;                              // normalized distance of the nearest training row
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// sorts chars into reading order, a char starts a new line unless its vertical center falls inside the vertical
+// extent of a line already started; the working vectors are kept, so sorting as many chars as before allocates nothing
+class ReadingOrder {
+public:
+    // vecChars is reordered and strText gets the labels with a newline between lines
+    void sort(std::vector<RecognizedChar>& vecChars, std::string& strText);
+
+private:
+    std::vector<int> vecLineTop;
+    std::vector<int> vecLineBottom;
+    std::vector<int> vecLineOfChar;
+    std::vector<size_t> vecOrder;
+    std::vector<RecognizedChar> vecSorted;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class GlyphBatch {
+public:
+    // intImageWidth x intImageHeight is the resized glyph size the classifier was trained on
+    GlyphBatch(int intImageWidth, int intImageHeight, int intInitialCapacity = 128);
+
+    // forget the glyphs of the previous frame, the feature matrix is kept for reuse
+    void clear();
+
+    // make room for intCapacity glyphs up front instead of growing on the frame that needs them
+    void reserve(int intCapacity);
+
+    // reuse the results of unchanged glyphs of the previous frame from pCache, nullptr classifies every glyph; the
+    // cache is not owned and charClassifier is the one every classify call of this batch uses, see GlyphCache
+    void setCache(GlyphCache* pGlyphCache, const CharClassifier& charClassifier);
+
+    // resize the ROI of the threshold image straight into the next row of the feature matrix, or take the result
+    // from the cache when the glyph has not changed since the previous frame
+    void add(const cv::Mat& matThresh, const cv::Rect& rect);
+
+    int size() const { return intCount; }           // glyphs to classify, the cached ones are not counted
+    int cached() const { return (int)vecCachedChars.size() + intCachedRejected; }
+    int rejected() const { return intRejected; }    // glyphs left out by the last classify
+    bool empty() const { return intCount == 0; }
+    const cv::Rect& rect(int i) const { return vecRects[i]; }
+
+    // the filled rows, size() x (width * height) CV_8U
+    cv::Mat features() const { return matFeatures.rowRange(0, intCount); }
+
+    // resized glyph i as a height x width image, for display
+    cv::Mat glyph(int i) const { return matFeatures.row(i).reshape(1, intImageHeight); }
+
+    // classify every glyph in one call, vecChars is filled in reading order and the text is returned with a newline
+    // between lines; a classifier trained on descriptors gets the same descriptor of every glyph. glyphs the vote of
+    // the classifier rejects are left out, see CharClassifier::setVoting
+    std::string classify(const CharClassifier& charClassifier, std::vector<RecognizedChar>& vecChars);
+
+    // same as above into the caller's string, which keeps its capacity from frame to frame
+    void classify(const CharClassifier& charClassifier, std::vector<RecognizedChar>& vecChars, std::string& strText);
+
+private:
+    // classify the rows of the feature matrix, the chars that are not rejected are appended to vecChars
+    void classifyRows(const CharClassifier& charClassifier, std::vector<RecognizedChar>& vecChars);
+
+    int intImageWidth;
+    int intImageHeight;
+    int intCount;
+    int intRejected;
+    cv::Mat matFeatures;                            // capacity x (width * height), grows by doubling when a frame has more glyphs
+    std::vector<cv::Rect> vecRects;
+
+    FeatureExtractor featureExtractor;              // descriptor of the classifier, remade when it changes
+    cv::Mat matDescriptors;                         // capacity x descriptor cols, for descriptors other than the pixels
+    std::vector<Classification> vecClassifications; // scratch space for classify, kept between frames
+    std::vector<Neighbor> vecNeighbors;
+    ReadingOrder readingOrder;
+
+    GlyphCache* pCache;                             // not owned, see setCache
+    const CharClassifier* pCacheClassifier;
+    std::vector<int> vecCacheEntries;               // cache entry of every row, its result is set by classify
+    std::vector<RecognizedChar> vecCachedChars;     // glyphs of this frame taken from the cache
+    int intCachedRejected;
+};
+
+// sort chars into reading order and return them as text, see ReadingOrder
+std::string sortReadingOrder(std::vector<RecognizedChar>& vecChars);
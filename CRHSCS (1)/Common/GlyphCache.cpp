@@ -0,0 +1,166 @@
+// ###########################################################################################################################
+// GlyphCache.cpp :
+//
+// Description: Frame to frame cache of classified glyphs, see GlyphCache.h
+//
+// ###########################################################################################################################
+
+#include "GlyphCache.h"
+
+#include<algorithm>
+#include<cstring>
+
+// global variables ///////////////////////////////////////////////////////////////////////////////
+const size_t INITIAL_SLOTS = 256;                   // slots of a table before its first growth
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+size_t GlyphCache::slotOf(const cv::Rect& rect, size_t mask) {
+    uint64_t key = ((uint64_t)(uint16_t)rect.x << 48) | ((uint64_t)(uint16_t)rect.y << 32)
+                 | ((uint64_t)(uint16_t)rect.width << 16) | (uint64_t)(uint16_t)rect.height;
+
+    // the finalizer of splitmix64, neighbouring rects land in unrelated slots
+    key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    key = (key ^ (key >> 27)) * 0x94D049BB133111EBULL;
+    key ^= key >> 31;
+    return (size_t)key & mask;
+}
+
+void GlyphCache::Table::clear() {
+    vecEntries.clear();
+    vecPixels.clear();
+    if (vecSlots.empty()) {
+        vecSlots.resize(INITIAL_SLOTS);
+    }
+    std::fill(vecSlots.begin(), vecSlots.end(), -1);
+}
+
+int GlyphCache::Table::find(const cv::Rect& rect) const {
+
+    if (vecSlots.empty()) {
+        return -1;
+    }
+
+    size_t mask = vecSlots.size() - 1;
+    for (size_t slot = slotOf(rect, mask); vecSlots[slot] >= 0; slot = (slot + 1) & mask) {
+        if (vecEntries[vecSlots[slot]].rect == rect) {
+            return vecSlots[slot];
+        }
+    }
+    return -1;
+}
+
+int GlyphCache::Table::insert(const cv::Rect& rect, const uint8_t* pPixels, size_t pixelStride) {
+
+    // keep the table at most half full, the entries are placed again in a table twice the size
+    if ((vecEntries.size() + 1) * 2 > vecSlots.size()) {
+        vecSlots.assign(std::max(vecSlots.size() * 2, INITIAL_SLOTS), -1);
+        size_t mask = vecSlots.size() - 1;
+        for (size_t i = 0; i < vecEntries.size(); i++) {
+            size_t slot = slotOf(vecEntries[i].rect, mask);
+            while (vecSlots[slot] >= 0) {
+                slot = (slot + 1) & mask;
+            }
+            vecSlots[slot] = (int32_t)i;
+        }
+    }
+
+    Entry entry;
+    entry.rect = rect;
+    entry.offset = vecPixels.size();
+    entry.blnValid = false;
+    entry.glyph = CachedGlyph();
+
+    vecPixels.resize(entry.offset + (size_t)rect.area());
+    for (int y = 0; y < rect.height; y++) {
+        std::memcpy(&vecPixels[entry.offset + (size_t)y * rect.width], pPixels + (size_t)y * pixelStride, (size_t)rect.width);
+    }
+
+    int intEntry = (int)vecEntries.size();
+    vecEntries.push_back(entry);
+
+    size_t mask = vecSlots.size() - 1;
+    size_t slot = slotOf(rect, mask);
+    while (vecSlots[slot] >= 0) {
+        slot = (slot + 1) & mask;
+    }
+    vecSlots[slot] = intEntry;
+
+    return intEntry;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GlyphCache::GlyphCache(double dblMaxDifference)
+    : intCurrent(0), dblMaxDiff(dblMaxDifference), uintLookups(0), uintHits(0) {
+    tables[0].clear();
+    tables[1].clear();
+}
+
+void GlyphCache::beginFrame(uint64_t classifierGeneration) {
+
+    intCurrent = 1 - intCurrent;
+
+    // the results of another classifier would be wrong, not just old
+    Table& previous = tables[1 - intCurrent];
+    if (previous.generation != classifierGeneration) {
+        previous.clear();
+    }
+
+    tables[intCurrent].clear();
+    tables[intCurrent].generation = classifierGeneration;
+}
+
+int GlyphCache::find(const cv::Mat& matThresh, const cv::Rect& rect) {
+
+    uintLookups++;
+
+    const Table& previous = tables[1 - intCurrent];
+    int intEntry = previous.find(rect);
+    if (intEntry < 0 || !previous.vecEntries[intEntry].blnValid) {
+        return -1;
+    }
+
+    // whole rows first, most rows of an unchanged glyph are the same byte for byte
+    const uint8_t* pStored = &previous.vecPixels[previous.vecEntries[intEntry].offset];
+    int intMaxDifferent = (int)(dblMaxDiff * rect.area());
+    int intDifferent = 0;
+
+    for (int y = 0; y < rect.height; y++) {
+        const uint8_t* pRow = matThresh.ptr<uint8_t>(rect.y + y) + rect.x;
+        const uint8_t* pStoredRow = pStored + (size_t)y * rect.width;
+        if (std::memcmp(pRow, pStoredRow, (size_t)rect.width) == 0) {
+            continue;
+        }
+        for (int x = 0; x < rect.width; x++) {
+            intDifferent += pRow[x] != pStoredRow[x] ? 1 : 0;
+        }
+        if (intDifferent > intMaxDifferent) {
+            return -1;
+        }
+    }
+
+    uintHits++;
+    return intEntry;
+}
+
+void GlyphCache::keep(int intEntry) {
+    const Table& previous = tables[1 - intCurrent];
+    const Entry& entry = previous.vecEntries[intEntry];
+
+    int intKept = tables[intCurrent].insert(entry.rect, &previous.vecPixels[entry.offset], (size_t)entry.rect.width);
+    setResult(intKept, entry.glyph);
+}
+
+int GlyphCache::store(const cv::Mat& matThresh, const cv::Rect& rect) {
+    return tables[intCurrent].insert(rect, matThresh.ptr<uint8_t>(rect.y) + rect.x, matThresh.step[0]);
+}
+
+void GlyphCache::setResult(int intEntry, const CachedGlyph& glyph) {
+    Entry& entry = tables[intCurrent].vecEntries[intEntry];
+    entry.glyph = glyph;
+    entry.blnValid = true;
+}
+
+void GlyphCache::clear() {
+    tables[0].clear();
+    tables[1].clear();
+}
@@ -0,0 +1,96 @@
+// ###########################################################################################################################
+// GlyphCache.h :
+//
+// Description: Frame to frame cache of classified glyphs for continuous recognition. A camera pointed at static text
+//              finds the same glyphs at the same rects frame after frame, so a glyph whose rect is the same as in the
+//              previous frame and whose threshold pixels differ in no more than a small fraction of the pixels takes
+//              the result of the previous frame instead of being resized and classified again. The comparison is a
+//              memcmp per row with a pixel count only on the rows that differ, much cheaper than a resize and a
+//              search over the training rows.
+//
+//              The cache keeps the pixels a result was classified from, not the ones of the latest hit, so a glyph
+//              that changes slowly is classified again once it has drifted far enough. A result is only reused with
+//              the classifier it came from, see CharClassifier::generation.
+//
+//              Two tables, the previous frame and the current one, swap at the start of every frame; their entries,
+//              slots and pixels are kept, so a steady scene does not allocate.
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include<opencv2/core/core.hpp>
+
+#include<cstdint>
+#include<vector>
+
+// glyph cache constants //////////////////////////////////////////////////////////////////////////
+const double GLYPH_CACHE_MAX_DIFFERENCE = 0.02;     // fraction of the pixels of a rect that may differ for a hit
+
+// the result reused for an unchanged glyph
+struct CachedGlyph {
+    int intLabel;
+    bool blnRejected;
+    float fltConfidence;
+    float fltDistance;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class GlyphCache {
+public:
+    // dblMaxDifference is the fraction of the pixels of a rect that may differ, 0 only reuses identical glyphs
+    explicit GlyphCache(double dblMaxDifference = GLYPH_CACHE_MAX_DIFFERENCE);
+
+    void setMaxDifference(double dblMaxDifference) { dblMaxDiff = dblMaxDifference; }
+
+    // the glyphs stored so far become the previous frame; they are dropped when the classifier has changed since
+    void beginFrame(uint64_t classifierGeneration);
+
+    // the entry of the previous frame with the same rect and nearly the same pixels, -1 when there is none
+    int find(const cv::Mat& matThresh, const cv::Rect& rect);
+    const CachedGlyph& result(int intEntry) const { return tables[1 - intCurrent].vecEntries[intEntry].glyph; }
+
+    // carry a hit of find over into the current frame, with the pixels it was classified from
+    void keep(int intEntry);
+
+    // a glyph of the current frame that has to be classified, its pixels are copied now and the result is set
+    // with setResult once it is known; returns the entry
+    int store(const cv::Mat& matThresh, const cv::Rect& rect);
+    void setResult(int intEntry, const CachedGlyph& glyph);
+
+    // forget every glyph, the next frame classifies everything again; the counters go on
+    void clear();
+
+    // glyphs looked up and found since the cache was made
+    uint64_t lookups() const { return uintLookups; }
+    uint64_t hits() const { return uintHits; }
+    double hitRate() const { return uintLookups > 0 ? (double)uintHits / uintLookups : 0.0; }
+
+private:
+    struct Entry {
+        cv::Rect rect;
+        size_t offset;                              // first pixel in vecPixels, rect.width x rect.height
+        bool blnValid;                              // the result is set
+        CachedGlyph glyph;
+    };
+
+    // the glyphs of one frame, an open addressing table over the rects
+    struct Table {
+        std::vector<Entry> vecEntries;
+        std::vector<int32_t> vecSlots;              // entry or -1, a power of two at least twice the entries
+        std::vector<uint8_t> vecPixels;
+        uint64_t generation = 0;
+
+        void clear();
+        int find(const cv::Rect& rect) const;
+        int insert(const cv::Rect& rect, const uint8_t* pPixels, size_t pixelStride);
+    };
+
+    static size_t slotOf(const cv::Rect& rect, size_t mask);
+
+    Table tables[2];
+    int intCurrent;
+    double dblMaxDiff;
+    uint64_t uintLookups;
+    uint64_t uintHits;
+};
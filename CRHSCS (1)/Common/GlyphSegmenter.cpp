@@ -0,0 +1,354 @@
+// ###########################################################################################################################
+// GlyphSegmenter.cpp :
+//
+// Description: Connected component glyph segmentation on runs, see GlyphSegmenter.h
+//
+// ###########################################################################################################################
+
+#include "GlyphSegmenter.h"
+#include "Metrics.h"
+#include "WorkStealingPool.h"
+
+#include<algorithm>
+#include<cstring>
+
+// global variables ///////////////////////////////////////////////////////////////////////////////
+const int SEGMENT_STRIP_ROWS = 64;                  // rows cut into runs by one job
+const int MIN_PARALLEL_CANDIDATES = 32;             // fewer glyphs are traced on the calling thread
+
+// the 8 neighbors clockwise on screen (y down), starting east, the order findContours follows a border in
+static const int NEIGHBOR_DX[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+static const int NEIGHBOR_DY[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+static const int NEIGHBOR_WEST = 4;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GlyphSegmenter::GlyphSegmenter(WorkStealingPool* pPool) : pPool(pPool) {
+}
+
+void GlyphSegmenter::reserve(const cv::Size& frameSize, int intRunsPerRow) {
+
+    int intStrips = (frameSize.height + SEGMENT_STRIP_ROWS - 1) / SEGMENT_STRIP_ROWS;
+    if ((int)vecStrips.size() < intStrips) {
+        vecStrips.resize(intStrips);
+    }
+    for (StripRuns& strip : vecStrips) {
+        strip.vecForeground.reserve(SEGMENT_STRIP_ROWS * intRunsPerRow);
+        strip.vecBackground.reserve(SEGMENT_STRIP_ROWS * (intRunsPerRow + 1));
+        strip.vecLeftBackground.reserve(SEGMENT_STRIP_ROWS * intRunsPerRow);
+        strip.vecForegroundRows.reserve(SEGMENT_STRIP_ROWS);
+        strip.vecBackgroundRows.reserve(SEGMENT_STRIP_ROWS);
+    }
+
+    size_t runs = (size_t)frameSize.height * intRunsPerRow;
+    vecForeground.reserve(runs);
+    vecBackground.reserve(runs + frameSize.height);
+    vecLeftBackground.reserve(runs);
+    vecForegroundRows.reserve(frameSize.height + 1);
+    vecBackgroundRows.reserve(frameSize.height + 1);
+    vecReachesBorder.reserve(runs + frameSize.height);
+    vecBoxes.reserve(runs);
+    vecCandidates.reserve(runs);
+    vecAreas2.reserve(runs);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+int GlyphSegmenter::findRoot(std::vector<Run>& vecRuns, int intRun) {
+
+    // path halving, every link still points to an earlier run
+    while (vecRuns[intRun].intParent != intRun) {
+        int intParent = vecRuns[intRun].intParent;
+        vecRuns[intRun].intParent = vecRuns[intParent].intParent;
+        intRun = intParent;
+    }
+    return intRun;
+}
+
+void GlyphSegmenter::unite(std::vector<Run>& vecRuns, int intA, int intB) {
+
+    int intRootA = findRoot(vecRuns, intA);
+    int intRootB = findRoot(vecRuns, intB);
+    if (intRootA < intRootB) {
+        vecRuns[intRootB].intParent = intRootA;
+    }
+    else if (intRootB < intRootA) {
+        vecRuns[intRootA].intParent = intRootB;
+    }
+}
+
+// unite the runs of the row starting at intUpper with the ones of the next row, [intLower, intLowerEnd); runs touch
+// when they overlap, or for intSlack 1 also when they only meet at a corner (8-connectivity)
+void GlyphSegmenter::joinRows(std::vector<Run>& vecRuns, int intUpper, int intLower, int intLowerEnd, int intSlack) {
+
+    int i = intUpper;
+    int j = intLower;
+    while (i < intLower && j < intLowerEnd) {
+        if (vecRuns[i].x1 + intSlack < vecRuns[j].x0) {
+            i++;
+        }
+        else if (vecRuns[j].x1 + intSlack < vecRuns[i].x0) {
+            j++;
+        }
+        else {
+            unite(vecRuns, i, j);
+            if (vecRuns[i].x1 < vecRuns[j].x1) {
+                i++;
+            }
+            else {
+                j++;
+            }
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void GlyphSegmenter::cutStrip(const cv::Mat& matThresh, int intStrip, StripRuns& strip) {
+
+    int y0 = intStrip * SEGMENT_STRIP_ROWS;
+    int y1 = std::min(matThresh.rows, y0 + SEGMENT_STRIP_ROWS);
+    int intCols = matThresh.cols;
+
+    strip.vecForeground.clear();
+    strip.vecBackground.clear();
+    strip.vecLeftBackground.clear();
+    strip.vecForegroundRows.clear();
+    strip.vecBackgroundRows.clear();
+
+    for (int y = y0; y < y1; y++) {
+        int intForegroundRow = (int)strip.vecForeground.size();
+        int intBackgroundRow = (int)strip.vecBackground.size();
+        strip.vecForegroundRows.push_back(intForegroundRow);
+        strip.vecBackgroundRows.push_back(intBackgroundRow);
+
+        const uchar* pRow = matThresh.ptr<uchar>(y);
+        int x = 0;
+        while (x < intCols) {
+            int intStart = x;
+            if (pRow[x] == 0) {
+                // the background between glyphs is long, skip it 8 pixels at a time
+                uint64_t word = 0;
+                while (x + 8 <= intCols && (std::memcpy(&word, pRow + x, 8), word == 0)) {
+                    x += 8;
+                }
+                while (x < intCols && pRow[x] == 0) {
+                    x++;
+                }
+                Run run = { intStart, x - 1, y, (int)strip.vecBackground.size() };
+                strip.vecBackground.push_back(run);
+            }
+            else {
+                while (x < intCols && pRow[x] != 0) {
+                    x++;
+                }
+                Run run = { intStart, x - 1, y, (int)strip.vecForeground.size() };
+                strip.vecForeground.push_back(run);
+                strip.vecLeftBackground.push_back(intStart == 0 ? -1 : (int)strip.vecBackground.size() - 1);
+            }
+        }
+
+        if (y > y0) {
+            joinRows(strip.vecForeground, strip.vecForegroundRows[y - y0 - 1], intForegroundRow, (int)strip.vecForeground.size(), 1);
+            joinRows(strip.vecBackground, strip.vecBackgroundRows[y - y0 - 1], intBackgroundRow, (int)strip.vecBackground.size(), 0);
+        }
+    }
+}
+
+// copy the runs of the strips behind each other, move their links and unite across the strip borders
+void GlyphSegmenter::joinStrips(int intRows, int intStrips) {
+
+    vecForeground.clear();
+    vecBackground.clear();
+    vecLeftBackground.clear();
+    vecForegroundRows.resize(intRows + 1);
+    vecBackgroundRows.resize(intRows + 1);
+
+    for (int s = 0; s < intStrips; s++) {
+        const StripRuns& strip = vecStrips[s];
+        int intForegroundOffset = (int)vecForeground.size();
+        int intBackgroundOffset = (int)vecBackground.size();
+
+        for (Run run : strip.vecForeground) {
+            run.intParent += intForegroundOffset;
+            vecForeground.push_back(run);
+        }
+        for (Run run : strip.vecBackground) {
+            run.intParent += intBackgroundOffset;
+            vecBackground.push_back(run);
+        }
+        for (int intLeft : strip.vecLeftBackground) {
+            vecLeftBackground.push_back(intLeft < 0 ? -1 : intLeft + intBackgroundOffset);
+        }
+
+        int y0 = s * SEGMENT_STRIP_ROWS;
+        for (size_t r = 0; r < strip.vecForegroundRows.size(); r++) {
+            vecForegroundRows[y0 + r] = strip.vecForegroundRows[r] + intForegroundOffset;
+            vecBackgroundRows[y0 + r] = strip.vecBackgroundRows[r] + intBackgroundOffset;
+        }
+    }
+    vecForegroundRows[intRows] = (int)vecForeground.size();
+    vecBackgroundRows[intRows] = (int)vecBackground.size();
+
+    for (int y = SEGMENT_STRIP_ROWS; y < intRows; y += SEGMENT_STRIP_ROWS) {
+        joinRows(vecForeground, vecForegroundRows[y - 1], vecForegroundRows[y], vecForegroundRows[y + 1], 1);
+        joinRows(vecBackground, vecBackgroundRows[y - 1], vecBackgroundRows[y], vecBackgroundRows[y + 1], 0);
+    }
+
+    // every link points to an earlier run, so one pass in order leaves every run pointing at its root
+    for (Run& run : vecForeground) {
+        run.intParent = vecForeground[run.intParent].intParent;
+    }
+    for (Run& run : vecBackground) {
+        run.intParent = vecBackground[run.intParent].intParent;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// follows the outer border from its first pixel (x, y) the way findContours does, counterclockwise with the
+// 8-connected foreground, and returns twice the area of the polygon through the border pixels
+int64_t GlyphSegmenter::outerContourArea2(const cv::Mat& matThresh, int x, int y) {
+
+    auto isSet = [&matThresh](int px, int py) {
+        return px >= 0 && py >= 0 && px < matThresh.cols && py < matThresh.rows && matThresh.ptr<uchar>(py)[px] != 0;
+    };
+
+    // the first neighbor clockwise from the west one, which is background; none is a single pixel
+    int k1 = -1;
+    for (int t = 0; t < 8 && k1 < 0; t++) {
+        int k = (NEIGHBOR_WEST + t) & 7;
+        if (isSet(x + NEIGHBOR_DX[k], y + NEIGHBOR_DY[k])) {
+            k1 = k;
+        }
+    }
+    if (k1 < 0) {
+        return 0;
+    }
+
+    int x1 = x + NEIGHBOR_DX[k1];
+    int y1 = y + NEIGHBOR_DY[k1];
+    int x3 = x;
+    int y3 = y;
+    int k2 = k1;                                    // direction from the current pixel back to the previous one
+    int64_t area2 = 0;
+
+    while (true) {
+        // the next border pixel is the first one counterclockwise after the previous one
+        int k4 = k2;
+        for (int t = 1; t <= 8; t++) {
+            k4 = (k2 - t) & 7;
+            if (isSet(x3 + NEIGHBOR_DX[k4], y3 + NEIGHBOR_DY[k4])) {
+                break;
+            }
+        }
+        int x4 = x3 + NEIGHBOR_DX[k4];
+        int y4 = y3 + NEIGHBOR_DY[k4];
+
+        area2 += (int64_t)x3 * y4 - (int64_t)x4 * y3;
+
+        // back at the start, about to take the first step again
+        if (x4 == x && y4 == y && x3 == x1 && y3 == y1) {
+            break;
+        }
+        x3 = x4;
+        y3 = y4;
+        k2 = (k4 + 4) & 7;
+    }
+
+    return area2 < 0 ? -area2 : area2;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void GlyphSegmenter::findRects(const cv::Mat& matThresh, double dblMinArea, std::vector<cv::Rect>& vecRects) {
+
+    ScopedTimer timer(METRIC_CONTOURS);
+
+    vecRects.clear();
+    if (matThresh.empty()) {
+        return;
+    }
+
+    int intRows = matThresh.rows;
+    int intCols = matThresh.cols;
+
+    // runs of every strip, united within the strip
+    int intStrips = (intRows + SEGMENT_STRIP_ROWS - 1) / SEGMENT_STRIP_ROWS;
+    if ((int)vecStrips.size() < intStrips) {
+        vecStrips.resize(intStrips);
+    }
+    if (pPool == nullptr || intStrips == 1) {
+        for (int s = 0; s < intStrips; s++) {
+            cutStrip(matThresh, s, vecStrips[s]);
+        }
+    }
+    else {
+        pPool->parallelFor((size_t)intStrips, [&](size_t strip, int) {
+            cutStrip(matThresh, (int)strip, vecStrips[strip]);
+        });
+    }
+
+    joinStrips(intRows, intStrips);
+
+    // background regions that reach the image border, the others are holes of a glyph
+    vecReachesBorder.assign(vecBackground.size(), 0);
+    for (const Run& run : vecBackground) {
+        if (run.y == 0 || run.y == intRows - 1 || run.x0 == 0 || run.x1 == intCols - 1) {
+            vecReachesBorder[run.intParent] = 1;
+        }
+    }
+
+    // boxes, the root is the first run of a glyph so its row is the top one
+    vecBoxes.resize(vecForeground.size());
+    for (size_t i = 0; i < vecForeground.size(); i++) {
+        const Run& run = vecForeground[i];
+        GlyphBox& box = vecBoxes[run.intParent];
+        if (run.intParent == (int)i) {
+            box.x0 = run.x0;
+            box.y0 = run.y;
+            box.x1 = run.x1;
+            box.y1 = run.y;
+        }
+        else {
+            box.x0 = std::min(box.x0, run.x0);
+            box.x1 = std::max(box.x1, run.x1);
+            box.y1 = run.y;
+        }
+    }
+
+    // outer glyphs whose box could hold the area, the border polygon never encloses more than the box of the
+    // pixel centers
+    vecCandidates.clear();
+    for (size_t i = 0; i < vecForeground.size(); i++) {
+        if (vecForeground[i].intParent != (int)i) {
+            continue;
+        }
+        int intLeft = vecLeftBackground[i];
+        if (intLeft >= 0 && !vecReachesBorder[vecBackground[intLeft].intParent]) {
+            continue;
+        }
+        const GlyphBox& box = vecBoxes[i];
+        if ((double)(box.x1 - box.x0) * (box.y1 - box.y0) <= dblMinArea) {
+            continue;
+        }
+        vecCandidates.push_back((int)i);
+    }
+
+    vecAreas2.resize(vecCandidates.size());
+    if (pPool == nullptr || vecCandidates.size() < (size_t)MIN_PARALLEL_CANDIDATES) {
+        for (size_t c = 0; c < vecCandidates.size(); c++) {
+            const Run& run = vecForeground[vecCandidates[c]];
+            vecAreas2[c] = outerContourArea2(matThresh, run.x0, run.y);
+        }
+    }
+    else {
+        pPool->parallelFor(vecCandidates.size(), [&](size_t c, int) {
+            const Run& run = vecForeground[vecCandidates[c]];
+            vecAreas2[c] = outerContourArea2(matThresh, run.x0, run.y);
+        });
+    }
+
+    // last found first, like findContours
+    for (size_t c = vecCandidates.size(); c-- > 0;) {
+        if (vecAreas2[c] * 0.5 > dblMinArea) {
+            const GlyphBox& box = vecBoxes[vecCandidates[c]];
+            vecRects.push_back(cv::Rect(box.x0, box.y0, box.x1 - box.x0 + 1, box.y1 - box.y0 + 1));
+        }
+    }
+}
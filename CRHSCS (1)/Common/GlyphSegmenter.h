@@ -0,0 +1,90 @@
+// ###########################################################################################################################
+// GlyphSegmenter.h :
+//
+// Description: Glyph segmentation by connected component labeling, in place of findContours(RETR_EXTERNAL) with a
+//              contourArea filter and a boundingRect per contour. Strips of rows are cut into runs of foreground and
+//              background pixels in parallel; a union find joins the runs into 8-connected glyphs and 4-connected
+//              background regions, across the strip borders too, and gives the bounding box of every glyph in one
+//              pass over the runs.
+//
+//              The rects are the ones of findCharRectsReference, in the same order:
+//                  - a glyph counts only when its surrounding background reaches the image border, the glyphs in a
+//                    hole of another glyph have no outer contour of their own under RETR_EXTERNAL
+//                  - the area is the one contourArea gives for the outer contour, the polygon through the centers of
+//                    the border pixels; the border is only traced for the glyphs whose box could hold more than the
+//                    minimum area
+//                  - findContours returns the contours last found first, so the rects come bottom up
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include<opencv2/core/core.hpp>
+
+#include<cstdint>
+#include<vector>
+
+class WorkStealingPool;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class GlyphSegmenter {
+public:
+    // the strips run on pPool when there is one and on the calling thread otherwise; the pool is not owned and must
+    // not run anything else while findRects runs
+    explicit GlyphSegmenter(WorkStealingPool* pPool = nullptr);
+
+    // bounding rects of the glyphs of the 8 bit matThresh (foreground non zero) whose outer contour encloses more than
+    // dblMinArea
+    void findRects(const cv::Mat& matThresh, double dblMinArea, std::vector<cv::Rect>& vecRects);
+
+    // allocate the run buffers for frames of frameSize with up to intRunsPerRow foreground runs in a row
+    void reserve(const cv::Size& frameSize, int intRunsPerRow);
+
+private:
+    // a run of foreground or background pixels in one row, x1 inclusive; parent is the union find link, always to an
+    // earlier run, so the root of a set is its first run in raster order
+    struct Run {
+        int x0;
+        int x1;
+        int y;
+        int intParent;
+    };
+
+    // runs of one strip, the parents local to the strip until they are joined
+    struct StripRuns {
+        std::vector<Run> vecForeground;
+        std::vector<Run> vecBackground;
+        std::vector<int> vecLeftBackground;         // background run left of every foreground run, -1 at x = 0
+        std::vector<int> vecForegroundRows;         // first run of every row of the strip
+        std::vector<int> vecBackgroundRows;
+    };
+
+    // bounding box of a glyph, kept at its root run
+    struct GlyphBox {
+        int x0;
+        int y0;
+        int x1;
+        int y1;
+    };
+
+    void cutStrip(const cv::Mat& matThresh, int intStrip, StripRuns& strip);
+    void joinStrips(int intRows, int intStrips);
+
+    static int findRoot(std::vector<Run>& vecRuns, int intRun);
+    static void unite(std::vector<Run>& vecRuns, int intA, int intB);
+    static void joinRows(std::vector<Run>& vecRuns, int intUpper, int intLower, int intLowerEnd, int intSlack);
+    static int64_t outerContourArea2(const cv::Mat& matThresh, int x, int y);
+
+    WorkStealingPool* pPool;
+    std::vector<StripRuns> vecStrips;
+
+    std::vector<Run> vecForeground;                 // runs of all strips, in raster order
+    std::vector<Run> vecBackground;
+    std::vector<int> vecLeftBackground;
+    std::vector<int> vecForegroundRows;             // first run of every row and one past the last row
+    std::vector<int> vecBackgroundRows;
+    std::vector<uint8_t> vecReachesBorder;          // per background root
+    std::vector<GlyphBox> vecBoxes;                 // per foreground root
+    std::vector<int> vecCandidates;                 // outer glyphs whose box is big enough, by root run
+    std::vector<int64_t> vecAreas2;                 // twice the contour area of every candidate
+};
@@ -0,0 +1,169 @@
+// ###########################################################################################################################
+// JsonLines.cpp :
+//
+// Description: JSON lines output, see JsonLines.h
+//
+// ###########################################################################################################################
+
+#include "JsonLines.h"
+
+#include<cstdio>
+#include<iostream>
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+JsonLine::JsonLine() : strText("{") {
+    vecFirst.push_back(true);
+    vecClose.push_back('}');
+}
+
+void JsonLine::separator(const char* pKey) {
+    if (!vecFirst.back()) {
+        strText += ',';
+    }
+    vecFirst.back() = false;
+
+    if (pKey != nullptr) {
+        strText += '"';
+        strText += escape(pKey);
+        strText += "\":";
+    }
+}
+
+JsonLine& JsonLine::add(const char* pKey, const std::string& strValue) {
+    separator(pKey);
+    strText += '"';
+    strText += escape(strValue);
+    strText += '"';
+    return *this;
+}
+
+JsonLine& JsonLine::add(const char* pKey, const char* pValue) {
+    return add(pKey, std::string(pValue));
+}
+
+JsonLine& JsonLine::add(const char* pKey, int intValue) {
+    separator(pKey);
+    strText += std::to_string(intValue);
+    return *this;
+}
+
+JsonLine& JsonLine::add(const char* pKey, long long value) {
+    separator(pKey);
+    strText += std::to_string(value);
+    return *this;
+}
+
+JsonLine& JsonLine::add(const char* pKey, unsigned long long value) {
+    separator(pKey);
+    strText += std::to_string(value);
+    return *this;
+}
+
+JsonLine& JsonLine::add(const char* pKey, double dblValue) {
+    separator(pKey);
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.4g", dblValue);
+    strText += buffer;
+    return *this;
+}
+
+JsonLine& JsonLine::addBool(const char* pKey, bool blnValue) {
+    separator(pKey);
+    strText += blnValue ? "true" : "false";
+    return *this;
+}
+
+JsonLine& JsonLine::addRect(const cv::Rect& rect) {
+    return add("x", rect.x).add("y", rect.y).add("w", rect.width).add("h", rect.height);
+}
+
+JsonLine& JsonLine::beginArray(const char* pKey) {
+    separator(pKey);
+    strText += '[';
+    vecFirst.push_back(true);
+    vecClose.push_back(']');
+    return *this;
+}
+
+JsonLine& JsonLine::beginObject(const char* pKey) {
+    separator(pKey);
+    strText += '{';
+    vecFirst.push_back(true);
+    vecClose.push_back('}');
+    return *this;
+}
+
+JsonLine& JsonLine::endArray() {
+    return endObject();
+}
+
+JsonLine& JsonLine::endObject() {
+    // the outermost object is only closed by str()
+    if (vecClose.size() > 1) {
+        strText += vecClose.back();
+        vecClose.pop_back();
+        vecFirst.pop_back();
+    }
+    return *this;
+}
+
+std::string JsonLine::str() const {
+    std::string strResult = strText;
+    for (size_t i = vecClose.size(); i > 0; i--) {
+        strResult += vecClose[i - 1];
+    }
+    return strResult;
+}
+
+std::string JsonLine::escape(const std::string& str) {
+    std::string strEscaped;
+    strEscaped.reserve(str.size());
+
+    for (char c : str) {
+        switch (c) {
+        case '"':  strEscaped += "\\\""; break;
+        case '\\': strEscaped += "\\\\"; break;
+        case '\n': strEscaped += "\\n"; break;
+        case '\r': strEscaped += "\\r"; break;
+        case '\t': strEscaped += "\\t"; break;
+        default:
+            if ((unsigned char)c < 0x20) {
+                char buffer[8];
+                std::snprintf(buffer, sizeof(buffer), "\\u%04x", (unsigned char)c);
+                strEscaped += buffer;
+            }
+            else {
+                strEscaped += c;
+            }
+        }
+    }
+    return strEscaped;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool ResultWriter::open(const std::string& strPath) {
+
+    blnStdout = strPath.empty() || strPath == "-";
+    if (blnStdout) {
+        return true;
+    }
+
+    file.open(strPath, std::ios::trunc);
+
+    // trap for error
+    if (!file.is_open()) {
+        std::cerr << "error, unable to open output file " << strPath << "\n";
+        return false;
+    }
+    return true;
+}
+
+void ResultWriter::write(const JsonLine& jsonLine) {
+    writeLine(jsonLine.str());
+}
+
+void ResultWriter::writeLine(const std::string& strLine) {
+    std::lock_guard<std::mutex> lock(mutexWrite);
+    std::ostream& out = blnStdout ? std::cout : file;
+    out << strLine << '\n';
+}
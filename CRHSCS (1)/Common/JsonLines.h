@@ -0,0 +1,66 @@
+// ###########################################################################################################################
+// JsonLines.h :
+//
+// Description: Structured output of the headless modes as JSON lines, one JSON object per processed frame. JsonLine builds
+//              one object, ResultWriter writes finished lines to a file or stdout.
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include<opencv2/core/core.hpp>
+
+#include<fstream>
+#include<mutex>
+#include<string>
+#include<vector>
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// builder for one JSON object written on a single line
+class JsonLine {
+public:
+    JsonLine();
+
+    JsonLine& add(const char* pKey, const std::string& strValue);
+    JsonLine& add(const char* pKey, const char* pValue);
+    JsonLine& add(const char* pKey, int intValue);
+    JsonLine& add(const char* pKey, long long value);
+    JsonLine& add(const char* pKey, unsigned long long value);
+    JsonLine& add(const char* pKey, double dblValue);
+    JsonLine& addBool(const char* pKey, bool blnValue);
+
+    // "x", "y", "w" and "h" of a rect as fields of the current object
+    JsonLine& addRect(const cv::Rect& rect);
+
+    // nested arrays and objects, pKey is nullptr for an object inside an array
+    JsonLine& beginArray(const char* pKey);
+    JsonLine& endArray();
+    JsonLine& beginObject(const char* pKey = nullptr);
+    JsonLine& endObject();
+
+    // the finished object, any still open arrays and objects are closed
+    std::string str() const;
+
+    static std::string escape(const std::string& str);
+
+private:
+    void separator(const char* pKey);
+
+    std::string strText;
+    std::vector<bool> vecFirst;                     // per open array / object, nothing written into it yet
+    std::vector<char> vecClose;                     // closing bracket per open array / object
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// writes JSON lines to a file, or to stdout for "-" or an empty path; safe to share between threads
+class ResultWriter {
+public:
+    bool open(const std::string& strPath);
+    void write(const JsonLine& jsonLine);
+    void writeLine(const std::string& strLine);
+
+private:
+    std::ofstream file;
+    bool blnStdout = true;
+    std::mutex mutexWrite;
+};
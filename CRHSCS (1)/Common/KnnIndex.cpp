@@ -0,0 +1,485 @@
+// ###########################################################################################################################
+// KnnIndex.cpp :
+//
+// Description: Brute force, vantage point tree and product quantization search over the training rows, see KnnIndex.h
+//
+// ###########################################################################################################################
+
+#include "KnnIndex.h"
+
+#include<algorithm>
+#include<cmath>
+#include<cstring>
+#include<fstream>
+#include<iostream>
+#include<limits>
+
+// global variables ///////////////////////////////////////////////////////////////////////////////
+const uint64_t INDEX_SEED = 12345;                  // vantage points and pq training rows are picked the same on every build
+const int KMEANS_ITERATIONS = 20;
+const double KMEANS_EPSILON = 0.01;
+const double TREE_MARGIN = 1e-6;                    // sqrt rounding, a branch at exactly the k-th distance may hold a tie
+
+// keep the k best neighbors of one sample sorted nearest first, by distance and then by row, so the result does not
+// depend on the order the rows are visited in and equals the one of the brute force scan. the list starts filled
+// with empty entries at UINT32_MAX, which no real distance reaches
+static inline void insertNeighbor(Neighbor* pNeighbors, int k, int intIndex, uint32_t uintDistance) {
+
+    const Neighbor& last = pNeighbors[k - 1];
+    if (uintDistance > last.uintDistance || (uintDistance == last.uintDistance && intIndex > last.intIndex)) {
+        return;
+    }
+
+    int pos = k - 1;
+    while (pos > 0 && (pNeighbors[pos - 1].uintDistance > uintDistance ||
+                       (pNeighbors[pos - 1].uintDistance == uintDistance && pNeighbors[pos - 1].intIndex > intIndex))) {
+        pNeighbors[pos] = pNeighbors[pos - 1];
+        pos--;
+    }
+
+    pNeighbors[pos].intIndex = intIndex;
+    pNeighbors[pos].uintDistance = uintDistance;
+}
+
+// L2 distance of the k-th neighbor found so far, infinite while the list is not full
+static inline double kthDistance(const Neighbor* pNeighbors, int k) {
+    uint32_t uintDistance = pNeighbors[k - 1].uintDistance;
+    return uintDistance == UINT32_MAX ? std::numeric_limits<double>::infinity() : std::sqrt((double)uintDistance);
+}
+
+static void fillEmpty(Neighbor* pNeighbors, int k) {
+    Neighbor empty = { -1, UINT32_MAX };
+    std::fill(pNeighbors, pNeighbors + k, empty);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+KnnIndex::KnnIndex()
+    : indexType(KNN_INDEX_BRUTE), intRows(0), intCols(0), rowsHash(0), intSubspaces(0), intCentroids(0) {
+}
+
+const char* KnnIndex::typeName(KnnIndexType type) {
+    switch (type) {
+    case KNN_INDEX_VPTREE: return "vptree";
+    case KNN_INDEX_PQ: return "pq";
+    default: return "brute";
+    }
+}
+
+bool KnnIndex::parseType(const std::string& strName, KnnIndexType& type) {
+    KnnIndexType arrTypes[] = { KNN_INDEX_BRUTE, KNN_INDEX_VPTREE, KNN_INDEX_PQ };
+    for (KnnIndexType candidate : arrTypes) {
+        if (strName == typeName(candidate)) {
+            type = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t KnnIndex::hashRows(const CharClassifier& charClassifier) {
+
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = 0; i < charClassifier.baseRows(); i++) {
+        const uint8_t* pRow = charClassifier.rowPtr(i);
+        for (int j = 0; j < charClassifier.cols(); j++) {
+            hash = (hash ^ pRow[j]) * 1099511628211ULL;
+        }
+        int32_t intLabel = charClassifier.label(i);
+        for (size_t b = 0; b < sizeof(intLabel); b++) {
+            hash = (hash ^ (uint8_t)(intLabel >> (8 * b))) * 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+void KnnIndex::setCandidates(int intCandidates) {
+    options.intCandidates = std::max(1, std::min(intCandidates, KNN_INDEX_MAX_CANDIDATES));
+}
+
+size_t KnnIndex::bytes() const {
+    return vecNodes.size() * sizeof(VpNode) + vecOrder.size() * sizeof(int32_t)
+        + vecCentroids.size() * sizeof(float) + vecCodes.size();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool KnnIndex::build(const CharClassifier& charClassifier, KnnIndexType type, const KnnIndexOptions& indexOptions) {
+
+    // trap for an untrained classifier
+    if (charClassifier.empty()) {
+        std::cout << "error, the index needs a trained classifier\n\n";
+        return false;
+    }
+
+    indexType = type;
+    options = indexOptions;
+    setCandidates(options.intCandidates);
+    intRows = charClassifier.baseRows();
+    intCols = charClassifier.cols();
+    rowsHash = hashRows(charClassifier);
+
+    vecNodes.clear();
+    vecOrder.clear();
+    vecCentroids.clear();
+    vecCodes.clear();
+    intSubspaces = 0;
+    intCentroids = 0;
+
+    if (indexType == KNN_INDEX_VPTREE) {
+        options.intLeafRows = std::max(1, options.intLeafRows);
+        vecOrder.resize(intRows);
+        for (int i = 0; i < intRows; i++) {
+            vecOrder[i] = i;
+        }
+        cv::RNG rng(INDEX_SEED);
+        std::vector<std::pair<double, int>> vecDistances;
+        buildVpTree(charClassifier, 0, intRows, rng, vecDistances);
+    }
+    else if (indexType == KNN_INDEX_PQ) {
+        buildPq(charClassifier);
+    }
+
+    return true;
+}
+
+// node for vecOrder[intBegin, intEnd): a random vantage row, the closer half of the other rows inside, the rest outside
+int KnnIndex::buildVpTree(const CharClassifier& charClassifier, int intBegin, int intEnd, cv::RNG& rng,
+                          std::vector<std::pair<double, int>>& vecDistances) {
+
+    int intNode = (int)vecNodes.size();
+    VpNode node = { -1, -1, -1, intBegin, intEnd, 0, 0.0 };
+    vecNodes.push_back(node);
+
+    if (intEnd - intBegin <= options.intLeafRows) {
+        return intNode;
+    }
+
+    std::swap(vecOrder[intBegin], vecOrder[intBegin + rng.uniform(0, intEnd - intBegin)]);
+    int intVantage = vecOrder[intBegin];
+    const uint8_t* pVantage = charClassifier.rowPtr(intVantage);
+
+    vecDistances.clear();
+    for (int i = intBegin + 1; i < intEnd; i++) {
+        vecDistances.push_back(std::make_pair(std::sqrt((double)charClassifier.distanceL2(pVantage, vecOrder[i])), vecOrder[i]));
+    }
+
+    // rows up to the median distance inside, the ones from it on outside; equal distances may fall on either side,
+    // the search treats the radius as belonging to both
+    size_t median = vecDistances.size() / 2;
+    std::nth_element(vecDistances.begin(), vecDistances.begin() + median, vecDistances.end());
+    for (size_t i = 0; i < vecDistances.size(); i++) {
+        vecOrder[intBegin + 1 + i] = vecDistances[i].second;
+    }
+    double dblRadius = vecDistances[median].first;
+    int intMiddle = intBegin + 1 + (int)median;
+
+    // the children are built after the distances of this node are used up, they reuse the same vector
+    int intInside = buildVpTree(charClassifier, intBegin + 1, intMiddle, rng, vecDistances);
+    int intOutside = buildVpTree(charClassifier, intMiddle, intEnd, rng, vecDistances);
+
+    VpNode& built = vecNodes[intNode];
+    built.intVantage = intVantage;
+    built.dblRadius = dblRadius;
+    built.intInside = intInside;
+    built.intOutside = intOutside;
+    return intNode;
+}
+
+void KnnIndex::buildPq(const CharClassifier& charClassifier) {
+
+    intSubspaces = std::max(1, std::min(std::min(options.intSubspaces, KNN_INDEX_MAX_SUBSPACES), intCols));
+    intCentroids = std::max(1, std::min(std::min(options.intCentroids, KNN_INDEX_MAX_CENTROIDS), intRows));
+    options.intSubspaces = intSubspaces;
+    options.intCentroids = intCentroids;
+
+    // the centroids are fitted on a random subset of the rows, k-means on every row of a big set takes minutes
+    cv::RNG rng(INDEX_SEED);
+    std::vector<int> vecTraining(intRows);
+    for (int i = 0; i < intRows; i++) {
+        vecTraining[i] = i;
+    }
+    int intTrainingRows = std::max(intCentroids, std::min(options.intTrainingRows, intRows));
+    for (int i = 0; i < intTrainingRows; i++) {
+        std::swap(vecTraining[i], vecTraining[i + rng.uniform(0, intRows - i)]);
+    }
+
+    vecCentroids.assign((size_t)intCentroids * intCols, 0.0f);
+    vecCodes.assign((size_t)intRows * intSubspaces, 0);
+
+    for (int m = 0; m < intSubspaces; m++) {
+        int intDimBegin = subspaceBegin(m);
+        int intDims = subspaceBegin(m + 1) - intDimBegin;
+
+        cv::Mat matSubspace(intTrainingRows, intDims, CV_32FC1);
+        for (int i = 0; i < intTrainingRows; i++) {
+            const uint8_t* pRow = charClassifier.rowPtr(vecTraining[i]) + intDimBegin;
+            float* pValues = matSubspace.ptr<float>(i);
+            for (int d = 0; d < intDims; d++) {
+                pValues[d] = pRow[d];
+            }
+        }
+
+        cv::Mat matLabels, matCenters;
+        cv::kmeans(matSubspace, intCentroids, matLabels,
+                   cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, KMEANS_ITERATIONS, KMEANS_EPSILON),
+                   1, cv::KMEANS_PP_CENTERS, matCenters);
+
+        float* pCentroids = &vecCentroids[(size_t)intCentroids * intDimBegin];
+        for (int c = 0; c < intCentroids; c++) {
+            std::memcpy(pCentroids + (size_t)c * intDims, matCenters.ptr<float>(c), intDims * sizeof(float));
+        }
+
+        // every row gets the index of its nearest centroid in this subspace
+        for (int i = 0; i < intRows; i++) {
+            const uint8_t* pRow = charClassifier.rowPtr(i) + intDimBegin;
+            float fltBest = std::numeric_limits<float>::max();
+            int intBest = 0;
+            for (int c = 0; c < intCentroids; c++) {
+                const float* pCentroid = pCentroids + (size_t)c * intDims;
+                float fltDistance = 0.0f;
+                for (int d = 0; d < intDims; d++) {
+                    float fltDiff = pRow[d] - pCentroid[d];
+                    fltDistance += fltDiff * fltDiff;
+                }
+                if (fltDistance < fltBest) {
+                    fltBest = fltDistance;
+                    intBest = c;
+                }
+            }
+            vecCodes[(size_t)i * intSubspaces + m] = (uint8_t)intBest;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void KnnIndex::search(const CharClassifier& charClassifier, const uint8_t* pSample, int k, Neighbor* pNeighbors) const {
+
+    fillEmpty(pNeighbors, k);
+
+    switch (indexType) {
+    case KNN_INDEX_VPTREE:
+        searchVpTree(charClassifier, 0, pSample, k, pNeighbors);
+        break;
+    case KNN_INDEX_PQ:
+        searchPq(charClassifier, pSample, k, pNeighbors);
+        break;
+    default:
+        searchBrute(charClassifier, pSample, k, pNeighbors);
+        break;
+    }
+}
+
+void KnnIndex::searchBrute(const CharClassifier& charClassifier, const uint8_t* pSample, int k, Neighbor* pNeighbors) const {
+    for (int i = 0; i < intRows; i++) {
+        insertNeighbor(pNeighbors, k, i, charClassifier.distanceL2(pSample, i));
+    }
+}
+
+// a row inside is at most dblRadius from the vantage row, so at least distance - radius from the sample, a row
+// outside at least radius - distance; a side is searched when that bound does not exceed the k-th distance found
+void KnnIndex::searchVpTree(const CharClassifier& charClassifier, int intNode, const uint8_t* pSample, int k, Neighbor* pNeighbors) const {
+
+    const VpNode& node = vecNodes[intNode];
+
+    if (node.intInside < 0) {
+        for (int i = node.intBegin; i < node.intEnd; i++) {
+            insertNeighbor(pNeighbors, k, vecOrder[i], charClassifier.distanceL2(pSample, vecOrder[i]));
+        }
+        return;
+    }
+
+    uint32_t uintDistance = charClassifier.distanceL2(pSample, node.intVantage);
+    insertNeighbor(pNeighbors, k, node.intVantage, uintDistance);
+
+    double dblDistance = std::sqrt((double)uintDistance);
+    double dblShrink = 1.0 / (1.0 + options.dblSlack);
+
+    // the side the sample falls on first, it most likely holds the nearest rows and shrinks the k-th distance
+    bool blnInsideFirst = dblDistance < node.dblRadius;
+    for (int side = 0; side < 2; side++) {
+        bool blnInside = (side == 0) == blnInsideFirst;
+        double dblBound = blnInside ? dblDistance - node.dblRadius : node.dblRadius - dblDistance;
+        if (dblBound <= kthDistance(pNeighbors, k) * dblShrink + TREE_MARGIN) {
+            searchVpTree(charClassifier, blnInside ? node.intInside : node.intOutside, pSample, k, pNeighbors);
+        }
+    }
+}
+
+// asymmetric distance: the sample stays exact, the rows are their centroids; the candidates with the smallest
+// estimate are then measured on their real rows
+void KnnIndex::searchPq(const CharClassifier& charClassifier, const uint8_t* pSample, int k, Neighbor* pNeighbors) const {
+
+    float arrTable[KNN_INDEX_MAX_SUBSPACES * KNN_INDEX_MAX_CENTROIDS];
+    for (int m = 0; m < intSubspaces; m++) {
+        int intDimBegin = subspaceBegin(m);
+        int intDims = subspaceBegin(m + 1) - intDimBegin;
+        const float* pCentroids = &vecCentroids[(size_t)intCentroids * intDimBegin];
+        for (int c = 0; c < intCentroids; c++) {
+            const float* pCentroid = pCentroids + (size_t)c * intDims;
+            float fltDistance = 0.0f;
+            for (int d = 0; d < intDims; d++) {
+                float fltDiff = pSample[intDimBegin + d] - pCentroid[d];
+                fltDistance += fltDiff * fltDiff;
+            }
+            arrTable[m * intCentroids + c] = fltDistance;
+        }
+    }
+
+    // the candidates sorted by estimate, the worst last
+    struct Candidate {
+        float fltEstimate;
+        int intIndex;
+    };
+    Candidate arrCandidates[KNN_INDEX_MAX_CANDIDATES];
+    int intCandidates = std::min(std::max(k, options.intCandidates), std::min(intRows, KNN_INDEX_MAX_CANDIDATES));
+    int intFilled = 0;
+
+    const uint8_t* pCodes = vecCodes.data();
+    for (int i = 0; i < intRows; i++, pCodes += intSubspaces) {
+        float fltEstimate = 0.0f;
+        for (int m = 0; m < intSubspaces; m++) {
+            fltEstimate += arrTable[m * intCentroids + pCodes[m]];
+        }
+        if (intFilled == intCandidates && fltEstimate >= arrCandidates[intFilled - 1].fltEstimate) {
+            continue;
+        }
+        int pos = intFilled < intCandidates ? intFilled++ : intFilled - 1;
+        while (pos > 0 && arrCandidates[pos - 1].fltEstimate > fltEstimate) {
+            arrCandidates[pos] = arrCandidates[pos - 1];
+            pos--;
+        }
+        arrCandidates[pos].fltEstimate = fltEstimate;
+        arrCandidates[pos].intIndex = i;
+    }
+
+    for (int c = 0; c < intFilled; c++) {
+        int intIndex = arrCandidates[c].intIndex;
+        insertNeighbor(pNeighbors, k, intIndex, charClassifier.distanceL2(pSample, intIndex));
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool KnnIndex::write(const std::string& strPath) const {
+
+    KnnIndexHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, KNN_INDEX_MAGIC, sizeof(header.magic));
+    header.version = KNN_INDEX_VERSION;
+    header.indexType = indexType;
+    header.rows = (uint32_t)intRows;
+    header.cols = (uint32_t)intCols;
+    header.leafRows = (uint32_t)options.intLeafRows;
+    header.nodes = (uint32_t)vecNodes.size();
+    header.subspaces = (uint32_t)intSubspaces;
+    header.centroids = (uint32_t)intCentroids;
+    header.rowsHash = rowsHash;
+    header.fileSize = sizeof(header) + bytes();
+
+    std::ofstream file(strPath, std::ios::binary | std::ios::trunc);
+
+    // trap for error
+    if (!file.is_open()) {
+        std::cout << "error, unable to open index file " << strPath << " for writing\n\n";
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(vecNodes.data()), (std::streamsize)(vecNodes.size() * sizeof(VpNode)));
+    file.write(reinterpret_cast<const char*>(vecOrder.data()), (std::streamsize)(vecOrder.size() * sizeof(int32_t)));
+    file.write(reinterpret_cast<const char*>(vecCentroids.data()), (std::streamsize)(vecCentroids.size() * sizeof(float)));
+    file.write(reinterpret_cast<const char*>(vecCodes.data()), (std::streamsize)vecCodes.size());
+
+    if (!file.good()) {
+        std::cout << "error, failed while writing index file " << strPath << "\n\n";
+        return false;
+    }
+
+    return true;
+}
+
+bool KnnIndex::read(const std::string& strPath, const CharClassifier& charClassifier) {
+
+    std::ifstream file(strPath, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    file.seekg(0, std::ios::end);
+    uint64_t fileSize = (uint64_t)file.tellg();
+    file.seekg(0, std::ios::beg);
+
+    KnnIndexHeader header;
+    std::memset(&header, 0, sizeof(header));
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    // the sections the header announces, checked before anything is allocated for them
+    uint64_t rows = header.rows;
+    uint64_t vpBytes = header.indexType == KNN_INDEX_VPTREE ? header.nodes * sizeof(VpNode) + rows * sizeof(int32_t) : 0;
+    uint64_t pqBytes = header.indexType == KNN_INDEX_PQ ? (uint64_t)header.centroids * header.cols * sizeof(float) + rows * header.subspaces : 0;
+
+    bool valid = file.good()
+        && std::memcmp(header.magic, KNN_INDEX_MAGIC, sizeof(header.magic)) == 0
+        && header.version == KNN_INDEX_VERSION
+        && header.indexType <= KNN_INDEX_PQ
+        && header.fileSize == fileSize
+        && header.fileSize == sizeof(header) + vpBytes + pqBytes
+        && (header.indexType != KNN_INDEX_VPTREE || header.nodes > 0)
+        && (header.indexType != KNN_INDEX_PQ || (header.subspaces >= 1 && header.subspaces <= (uint32_t)KNN_INDEX_MAX_SUBSPACES
+                                                 && header.subspaces <= header.cols && header.centroids >= 1
+                                                 && header.centroids <= (uint32_t)KNN_INDEX_MAX_CENTROIDS));
+    if (!valid) {
+        std::cout << "error, " << strPath << " is not a valid version " << KNN_INDEX_VERSION << " index file\n\n";
+        return false;
+    }
+
+    // trap for an index of another training set
+    if ((int)header.rows != charClassifier.baseRows() || (int)header.cols != charClassifier.cols() || header.rowsHash != hashRows(charClassifier)) {
+        std::cout << "error, " << strPath << " was built on other training rows, rebuild it with CharTrain\n\n";
+        return false;
+    }
+
+    indexType = (KnnIndexType)header.indexType;
+    intRows = (int)header.rows;
+    intCols = (int)header.cols;
+    rowsHash = header.rowsHash;
+    options.intLeafRows = (int)header.leafRows;
+    intSubspaces = (int)header.subspaces;
+    intCentroids = (int)header.centroids;
+    options.intSubspaces = intSubspaces;
+    options.intCentroids = intCentroids;
+
+    vecNodes.resize(header.indexType == KNN_INDEX_VPTREE ? header.nodes : 0);
+    vecOrder.resize(header.indexType == KNN_INDEX_VPTREE ? intRows : 0);
+    vecCentroids.resize(header.indexType == KNN_INDEX_PQ ? (size_t)intCentroids * intCols : 0);
+    vecCodes.resize(header.indexType == KNN_INDEX_PQ ? (size_t)intRows * intSubspaces : 0);
+
+    file.read(reinterpret_cast<char*>(vecNodes.data()), (std::streamsize)(vecNodes.size() * sizeof(VpNode)));
+    file.read(reinterpret_cast<char*>(vecOrder.data()), (std::streamsize)(vecOrder.size() * sizeof(int32_t)));
+    file.read(reinterpret_cast<char*>(vecCentroids.data()), (std::streamsize)(vecCentroids.size() * sizeof(float)));
+    file.read(reinterpret_cast<char*>(vecCodes.data()), (std::streamsize)vecCodes.size());
+
+    // every link of the tree has to point forward and stay inside the file, a damaged one would send the search
+    // anywhere or around in circles
+    for (int i = 0; i < (int)vecNodes.size(); i++) {
+        const VpNode& node = vecNodes[i];
+        bool blnLeaf = node.intInside < 0;
+        valid = valid && (blnLeaf ? node.intBegin >= 0 && node.intBegin <= node.intEnd && node.intEnd <= intRows
+                                  : node.intVantage >= 0 && node.intVantage < intRows
+                                    && node.intInside > i && node.intInside < (int)vecNodes.size()
+                                    && node.intOutside > i && node.intOutside < (int)vecNodes.size());
+    }
+    for (int32_t intRow : vecOrder) {
+        valid = valid && intRow >= 0 && intRow < intRows;
+    }
+    for (uint8_t code : vecCodes) {
+        valid = valid && code < intCentroids;
+    }
+
+    if (!file.good() || !valid) {
+        std::cout << "error, " << strPath << " is damaged\n\n";
+        indexType = KNN_INDEX_BRUTE;
+        intRows = 0;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,144 @@
+// ###########################################################################################################################
+// KnnIndex.h :
+//
+// Description: Search structures over the training rows of a CharClassifier, for training sets of tens of thousands of
+//              samples where the brute force scan of every row per glyph gets too slow. The index is built once by
+//              CharTrain, written next to the model file and read back by CharMatch, which hands it to the classifier
+//              with CharClassifier::setIndex. Every index returns squared L2 distances of the real rows, nearest first,
+//              ties to the lower row like the brute force scan.
+//
+//                  brute    every row, the reference the others are measured against
+//                  vptree   vantage point tree on the L2 distance, exact; with a slack above 0 a branch is skipped when
+//                           it can only hold rows closer than the k-th by less than that factor, which is approximate
+//                  pq       product quantization: the row is cut into subspaces and every subspace stored as the index
+//                           of its nearest of up to 256 centroids, one byte. A sample is compared against the codes
+//                           through a table of its distances to every centroid, and the best candidates are ranked
+//                           again on their real rows; approximate, a row missing from the candidates is not found
+//
+//              layout:  [KnnIndexHeader][vptree: nodes, row order | pq: centroids, codes]
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include "CharClassifier.h"
+
+#include<opencv2/core/core.hpp>
+
+#include<cstdint>
+#include<string>
+#include<vector>
+
+// index file constants ///////////////////////////////////////////////////////////////////////////
+const char KNN_INDEX_MAGIC[4] = { 'C', 'R', 'H', 'I' };
+const uint32_t KNN_INDEX_VERSION = 1;
+const int KNN_INDEX_MAX_SUBSPACES = 32;             // the distance table of a pq search lives on the stack
+const int KNN_INDEX_MAX_CENTROIDS = 256;            // one byte per code
+const int KNN_INDEX_MAX_CANDIDATES = 256;           // pq candidates ranked on their real rows
+
+enum KnnIndexType : uint32_t {
+    KNN_INDEX_BRUTE = 0,
+    KNN_INDEX_VPTREE = 1,
+    KNN_INDEX_PQ = 2
+};
+
+// build and search settings, the build settings are stored in the index file
+struct KnnIndexOptions {
+    int intLeafRows = 16;                           // vptree: rows scanned together at the bottom of the tree
+    double dblSlack = 0.0;                          // vptree: 0 exact, 0.5 skips branches that cannot beat the k-th by 1.5x
+    int intSubspaces = 20;                          // pq: 600 pixels in 20 subspaces of 30
+    int intCentroids = 256;                         // pq: centroids per subspace
+    int intTrainingRows = 4096;                     // pq: rows the centroids are fitted on, a random subset of bigger sets
+    int intCandidates = 32;                         // pq: candidates ranked on their real rows, at least k
+};
+
+// fixed 64 byte header at the start of every index file
+struct KnnIndexHeader {
+    char     magic[4];                              // KNN_INDEX_MAGIC
+    uint32_t version;                               // KNN_INDEX_VERSION
+    uint32_t indexType;                             // KnnIndexType
+    uint32_t rows;                                  // training rows of the classifier the index was built on
+    uint32_t cols;
+    uint32_t leafRows;                              // vptree
+    uint32_t nodes;                                 // vptree
+    uint32_t subspaces;                             // pq
+    uint32_t centroids;                             // pq
+    uint32_t reserved0;                             // zero
+    uint64_t rowsHash;                              // hash of the training rows and labels, see KnnIndex::hashRows
+    uint64_t fileSize;                              // total file size, used to detect truncated files
+    uint8_t  reserved[8];                           // zero
+};
+
+static_assert(sizeof(KnnIndexHeader) == 64, "index file header must stay 64 bytes");
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class KnnIndex {
+public:
+    KnnIndex();
+
+    // build over the trained rows of a classifier (baseRows, not the samples added since), which must keep the same
+    // rows while the index is used
+    bool build(const CharClassifier& charClassifier, KnnIndexType type, const KnnIndexOptions& options = KnnIndexOptions());
+
+    // write the index file, or read one and check it was built on the rows of charClassifier;
+    // prints the reason and returns false on any error
+    bool write(const std::string& strPath) const;
+    bool read(const std::string& strPath, const CharClassifier& charClassifier);
+
+    // the k nearest rows to one uint8 sample of cols() values into pNeighbors[k], nearest first, k <= baseRows()
+    // the classifier is the one the index was built on
+    void search(const CharClassifier& charClassifier, const uint8_t* pSample, int k, Neighbor* pNeighbors) const;
+
+    // search settings, which can differ from the ones the index was built with
+    void setSlack(double dblSlack) { options.dblSlack = dblSlack; }
+    void setCandidates(int intCandidates);
+
+    // the options it was built or read with and the search settings, to build it again the same way
+    const KnnIndexOptions& indexOptions() const { return options; }
+
+    KnnIndexType type() const { return indexType; }
+    bool empty() const { return intRows == 0; }
+    size_t bytes() const;                           // memory of the index itself, without the training rows
+
+    static const char* typeName(KnnIndexType type);
+    static bool parseType(const std::string& strName, KnnIndexType& type);
+
+    // FNV-1a over the trained rows and labels, so an index is never used with other rows than its own
+    static uint64_t hashRows(const CharClassifier& charClassifier);
+
+private:
+    // vptree node: rows within dblRadius of the vantage row are in the inside subtree, the others in the outside one;
+    // a leaf has no children and holds vecOrder[intBegin, intEnd). children always come after their parent
+    struct VpNode {
+        int32_t intVantage;
+        int32_t intInside;
+        int32_t intOutside;
+        int32_t intBegin;
+        int32_t intEnd;
+        int32_t intReserved;                        // zero
+        double dblRadius;                           // a float radius could round past the rows on its border
+    };
+
+    int buildVpTree(const CharClassifier& charClassifier, int intBegin, int intEnd, cv::RNG& rng, std::vector<std::pair<double, int>>& vecDistances);
+    void buildPq(const CharClassifier& charClassifier);
+
+    void searchBrute(const CharClassifier& charClassifier, const uint8_t* pSample, int k, Neighbor* pNeighbors) const;
+    void searchVpTree(const CharClassifier& charClassifier, int intNode, const uint8_t* pSample, int k, Neighbor* pNeighbors) const;
+    void searchPq(const CharClassifier& charClassifier, const uint8_t* pSample, int k, Neighbor* pNeighbors) const;
+
+    int subspaceBegin(int intSubspace) const { return intSubspace * intCols / intSubspaces; }
+
+    KnnIndexType indexType;
+    KnnIndexOptions options;
+    int intRows;
+    int intCols;
+    uint64_t rowsHash;
+
+    std::vector<VpNode> vecNodes;                   // vptree, the root is node 0
+    std::vector<int32_t> vecOrder;                  // vptree, training rows in leaf order
+
+    int intSubspaces;                               // pq
+    int intCentroids;
+    std::vector<float> vecCentroids;                // pq, the centroids of a subspace next to each other, intCentroids x cols floats
+    std::vector<uint8_t> vecCodes;                  // pq, rows x intSubspaces centroid indices
+};
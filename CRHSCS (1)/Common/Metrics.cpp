@@ -0,0 +1,230 @@
+// ###########################################################################################################################
+// Metrics.cpp :
+//
+// Description: Stage latency histograms and their Prometheus text output, see Metrics.h
+//
+// ###########################################################################################################################
+
+#include "Metrics.h"
+
+#include<cstdio>
+#include<fstream>
+#include<iostream>
+
+#ifdef _MSC_VER
+#include<intrin.h>
+#endif
+
+// global variables ///////////////////////////////////////////////////////////////////////////////
+std::atomic<bool> blnMetricsEnabled(false);
+
+static LatencyHistogram arrStageHistograms[METRIC_STAGE_COUNT];
+
+// index of the highest set bit, value must not be 0
+static int highestBit(uint64_t value) {
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return (int)index;
+#elif defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(value);
+#else
+    int intBit = 0;
+    while (value >>= 1) {
+        intBit++;
+    }
+    return intBit;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+LatencyHistogram::LatencyHistogram() {
+    clear();
+}
+
+void LatencyHistogram::clear() {
+    for (std::atomic<uint64_t>& bucket : arrBuckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    totalCount.store(0, std::memory_order_relaxed);
+    totalSum.store(0, std::memory_order_relaxed);
+    maxValue.store(0, std::memory_order_relaxed);
+}
+
+int LatencyHistogram::bucketIndex(uint64_t value) {
+    if (value < (uint64_t)LINEAR_BUCKETS) {
+        return (int)value;
+    }
+    // the bits under the highest one pick one of the sub buckets of its power of two
+    int intBit = highestBit(value);
+    int intSub = (int)(value >> (intBit - SUB_BUCKET_BITS)) & ((1 << SUB_BUCKET_BITS) - 1);
+    return LINEAR_BUCKETS + (intBit - SUB_BUCKET_BITS - 1) * (1 << SUB_BUCKET_BITS) + intSub;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(int intBucket) {
+    if (intBucket < LINEAR_BUCKETS) {
+        return (uint64_t)intBucket;
+    }
+    int intBit = (intBucket - LINEAR_BUCKETS) / (1 << SUB_BUCKET_BITS) + SUB_BUCKET_BITS + 1;
+    int intSub = (intBucket - LINEAR_BUCKETS) % (1 << SUB_BUCKET_BITS);
+    uint64_t width = (uint64_t)1 << (intBit - SUB_BUCKET_BITS);
+    return (((uint64_t)(1 << SUB_BUCKET_BITS) + intSub) << (intBit - SUB_BUCKET_BITS)) + width - 1;
+}
+
+void LatencyHistogram::record(uint64_t nanoseconds) {
+
+    arrBuckets[bucketIndex(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    totalCount.fetch_add(1, std::memory_order_relaxed);
+    totalSum.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+    uint64_t previous = maxValue.load(std::memory_order_relaxed);
+    while (nanoseconds > previous && !maxValue.compare_exchange_weak(previous, nanoseconds, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t LatencyHistogram::quantile(double dblQuantile) const {
+
+    // read while other threads record, so the buckets may add up to a little more than count()
+    uint64_t total = count();
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(dblQuantile * total + 0.5);
+    rank = rank < 1 ? 1 : rank;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        seen += arrBuckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t upper = bucketUpperBound(i);
+            return upper < maximum() ? upper : maximum();
+        }
+    }
+    return maximum();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void setMetricsEnabled(bool blnEnabled) {
+    blnMetricsEnabled.store(blnEnabled, std::memory_order_relaxed);
+}
+
+LatencyHistogram& stageHistogram(MetricStage stage) {
+    return arrStageHistograms[stage];
+}
+
+const char* metricStageName(int intStage) {
+    static const char* arrNames[METRIC_STAGE_COUNT] = { "capture", "cvtcolor", "blur", "equalize", "threshold", "preprocess", "contours",
+                                                        "resize", "classify", "face_cascade", "feature_cascade", "capture_to_result" };
+    return intStage >= 0 && intStage < METRIC_STAGE_COUNT ? arrNames[intStage] : "?";
+}
+
+void writePrometheusMetrics(std::ostream& out) {
+
+    const double dblSecondsPerNs = 1e-9;
+
+    out << "# HELP crhscs_stage_latency_seconds Latency of one pipeline stage.\n";
+    out << "# TYPE crhscs_stage_latency_seconds summary\n";
+    for (int i = 0; i < METRIC_STAGE_COUNT; i++) {
+        const LatencyHistogram& histogram = arrStageHistograms[i];
+        if (histogram.count() == 0) {
+            continue;
+        }
+        const char* pStage = metricStageName(i);
+        out << "crhscs_stage_latency_seconds{stage=\"" << pStage << "\",quantile=\"0.5\"} " << histogram.quantile(0.5) * dblSecondsPerNs << "\n";
+        out << "crhscs_stage_latency_seconds{stage=\"" << pStage << "\",quantile=\"0.99\"} " << histogram.quantile(0.99) * dblSecondsPerNs << "\n";
+        out << "crhscs_stage_latency_seconds_sum{stage=\"" << pStage << "\"} " << histogram.sum() * dblSecondsPerNs << "\n";
+        out << "crhscs_stage_latency_seconds_count{stage=\"" << pStage << "\"} " << histogram.count() << "\n";
+    }
+
+    out << "# HELP crhscs_stage_latency_max_seconds Longest latency of one pipeline stage.\n";
+    out << "# TYPE crhscs_stage_latency_max_seconds gauge\n";
+    for (int i = 0; i < METRIC_STAGE_COUNT; i++) {
+        const LatencyHistogram& histogram = arrStageHistograms[i];
+        if (histogram.count() > 0) {
+            out << "crhscs_stage_latency_max_seconds{stage=\"" << metricStageName(i) << "\"} " << histogram.maximum() * dblSecondsPerNs << "\n";
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+MetricsReporter::MetricsReporter() : interval(0), blnStop(false) {
+}
+
+MetricsReporter::~MetricsReporter() {
+    stop();
+}
+
+bool MetricsReporter::start(const std::string& strPathIn, double dblIntervalSeconds) {
+
+    if (reporterThread.joinable()) {
+        return false;
+    }
+
+    // trap for an interval that would make the reporter spin, NaN included
+    if (!(dblIntervalSeconds >= METRICS_MIN_INTERVAL)) {
+        std::cerr << "error, the metrics interval must be at least " << METRICS_MIN_INTERVAL << " seconds\n";
+        return false;
+    }
+
+    strPath = strPathIn;
+    interval = std::chrono::milliseconds((long long)(dblIntervalSeconds * 1000.0));
+    blnStop = false;
+
+    setMetricsEnabled(true);
+    reporterThread = std::thread(&MetricsReporter::run, this);
+    return true;
+}
+
+void MetricsReporter::stop() {
+
+    if (!reporterThread.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutexStop);
+        blnStop = true;
+    }
+    conditionStop.notify_one();
+    reporterThread.join();
+
+    dump();
+}
+
+void MetricsReporter::run() {
+
+    std::unique_lock<std::mutex> lock(mutexStop);
+    while (!conditionStop.wait_for(lock, interval, [this] { return blnStop; })) {
+        lock.unlock();
+        dump();
+        lock.lock();
+    }
+}
+
+void MetricsReporter::dump() {
+
+    if (strPath.empty() || strPath == "-") {
+        writePrometheusMetrics(std::cout);
+        std::cout.flush();
+        return;
+    }
+
+    // write a temporary file and move it over the old one
+    std::string strTemp = strPath + ".tmp";
+    {
+        std::ofstream file(strTemp, std::ios::trunc);
+        if (!file) {
+            std::cerr << "error, unable to write metrics to " << strTemp << "\n";
+            return;
+        }
+        writePrometheusMetrics(file);
+    }
+#ifdef _WIN32
+    // rename does not replace an existing file on Windows, elsewhere it does in one step and a scrape never finds
+    // the file missing
+    std::remove(strPath.c_str());
+#endif
+    if (std::rename(strTemp.c_str(), strPath.c_str()) != 0) {
+        std::cerr << "error, unable to write metrics to " << strPath << "\n";
+    }
+}
@@ -0,0 +1,138 @@
+// ###########################################################################################################################
+// Metrics.h :
+//
+// Description: Latency metrics of the hot path of CharMatch and FacialDetection. Every stage (capture, cvtColor, blur,
+//              equalizeHist, threshold, the fused char preprocessing, findContours, glyph resize, classify and the
+//              detectMultiScale calls) is wrapped in a ScopedTimer that records its duration into the lock-free
+//              LatencyHistogram of the stage, from any thread. A MetricsReporter writes p50, p99, max, sum and count of every stage in the Prometheus text
+//              format to a file or stdout at a fixed interval. The camera loops add the latency from the capture of
+//              every processed frame to its result.
+//
+//              The metrics are off until setMetricsEnabled(true); while they are off a ScopedTimer costs one relaxed
+//              atomic load and a branch, so the timers stay compiled into the release builds.
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include<atomic>
+#include<chrono>
+#include<condition_variable>
+#include<cstdint>
+#include<mutex>
+#include<ostream>
+#include<string>
+#include<thread>
+
+const double METRICS_MIN_INTERVAL = 0.1;           // seconds, a shorter interval would keep a core busy rewriting
+
+enum MetricStage {
+    METRIC_CAPTURE,                                 // FrameSource::read
+    METRIC_CVTCOLOR,
+    METRIC_BLUR,                                    // GaussianBlur of the char image
+    METRIC_EQUALIZE,                                // equalizeHist of the face image
+    METRIC_THRESHOLD,
+    METRIC_PREPROCESS,                              // CharPreprocessor, grayscale, blur and threshold in one pass
+    METRIC_CONTOURS,
+    METRIC_RESIZE,                                  // one glyph resized into the feature matrix
+    METRIC_CLASSIFY,                                // all glyphs of a frame
+    METRIC_FACE_CASCADE,                            // detectMultiScale of the face cascade
+    METRIC_FEATURE_CASCADE,                         // detectMultiScale of an eyes, mouth or nose cascade
+    METRIC_CAPTURE_TO_RESULT,                       // capture of a frame to its result, see FrameRing
+    METRIC_STAGE_COUNT
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// log linear histogram of durations in nanoseconds: exact below 16 ns, above that 8 buckets per power of two, so a
+// quantile is off by at most 12.5%. record only does relaxed atomic adds and can be called from any thread
+class LatencyHistogram {
+public:
+    static const int SUB_BUCKET_BITS = 3;
+    static const int LINEAR_BUCKETS = 2 << SUB_BUCKET_BITS;
+    static const int BUCKET_COUNT = LINEAR_BUCKETS + (64 - SUB_BUCKET_BITS - 1) * (1 << SUB_BUCKET_BITS);
+
+    LatencyHistogram();
+
+    void record(uint64_t nanoseconds);
+    void clear();
+
+    uint64_t count() const { return totalCount.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return totalSum.load(std::memory_order_relaxed); }
+    uint64_t maximum() const { return maxValue.load(std::memory_order_relaxed); }
+
+    // value under which the fraction dblQuantile of the recorded durations fall, the upper end of its bucket
+    uint64_t quantile(double dblQuantile) const;
+
+private:
+    static int bucketIndex(uint64_t value);
+    static uint64_t bucketUpperBound(int intBucket);
+
+    std::atomic<uint64_t> arrBuckets[BUCKET_COUNT];
+    std::atomic<uint64_t> totalCount;
+    std::atomic<uint64_t> totalSum;
+    std::atomic<uint64_t> maxValue;
+};
+
+extern std::atomic<bool> blnMetricsEnabled;
+
+inline bool metricsEnabled() {
+    return blnMetricsEnabled.load(std::memory_order_relaxed);
+}
+
+void setMetricsEnabled(bool blnEnabled);
+
+LatencyHistogram& stageHistogram(MetricStage stage);
+const char* metricStageName(int intStage);
+
+// p50, p99, max, sum and count of every stage that recorded anything, in the Prometheus text format
+void writePrometheusMetrics(std::ostream& out);
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// times the enclosing scope into the histogram of a stage while the metrics are enabled
+class ScopedTimer {
+public:
+    explicit ScopedTimer(MetricStage stage) : stage(stage), blnActive(metricsEnabled()) {
+        if (blnActive) {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ScopedTimer() {
+        if (blnActive) {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            stageHistogram(stage).record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    MetricStage stage;
+    bool blnActive;
+    std::chrono::steady_clock::time_point start;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// writes the metrics every few seconds from a background thread, and once more on stop
+class MetricsReporter {
+public:
+    MetricsReporter();
+    ~MetricsReporter();
+
+    // enable the metrics and write them to strPath ("-" is stdout) every dblIntervalSeconds; a file is rewritten
+    // as a whole each time, so a scraper never sees half of it. false for an interval below METRICS_MIN_INTERVAL
+    bool start(const std::string& strPath, double dblIntervalSeconds);
+    void stop();
+
+private:
+    void run();
+    void dump();
+
+    std::string strPath;
+    std::chrono::milliseconds interval;
+    std::thread reporterThread;
+    std::mutex mutexStop;
+    std::condition_variable conditionStop;
+    bool blnStop;
+};
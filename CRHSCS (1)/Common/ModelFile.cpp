@@ -0,0 +1,316 @@
+// ###########################################################################################################################
+// ModelFile.cpp :
+//
+// Description: Writing, memory mapping and XML conversion of the binary model file described in ModelFile.h
+//
+// ###########################################################################################################################
+
+#include "ModelFile.h"
+
+#include<cstring>
+#include<fstream>
+#include<iostream>
+#include<vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include<windows.h>
+#else
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+#endif
+
+// round a byte count up to the row alignment
+static uint64_t alignUp(uint64_t value) {
+    return (value + MODEL_ROW_ALIGNMENT - 1) / MODEL_ROW_ALIGNMENT * MODEL_ROW_ALIGNMENT;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool writeModelFile(const std::string& strPath,
+    const cv::Mat& matFeatures,
+    const cv::Mat& matClassifications,
+    ModelFeatureType featureType,
+    int intImageWidth,
+    int intImageHeight,
+    FeatureDescriptor descriptor) {
+
+    // trap for mismatched training data
+    if (matFeatures.empty() || matFeatures.rows != (int)matClassifications.total()) {
+        std::cout << "error, training images and classifications do not match, model not written\n\n";
+        return false;
+    }
+
+    ModelFileWriter writer;
+    return writer.open(strPath, matClassifications, matFeatures.cols, featureType, intImageWidth, intImageHeight, descriptor)
+        && writer.append(matFeatures)
+        && writer.close();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+ModelFileWriter::ModelFileWriter() : intRowsWritten(0), vecPadding(MODEL_ROW_ALIGNMENT, 0) {
+    std::memset(&header, 0, sizeof(header));
+}
+
+bool ModelFileWriter::open(const std::string& strModelPath,
+    const cv::Mat& matClassifications,
+    int intCols,
+    ModelFeatureType featureType,
+    int intImageWidth,
+    int intImageHeight,
+    FeatureDescriptor descriptor) {
+
+    strPath = strModelPath;
+    intRowsWritten = 0;
+
+    // classifications are stored as int32 whatever type they were collected in
+    cv::Mat matLabels;
+    matClassifications.reshape(1, (int)matClassifications.total()).convertTo(matLabels, CV_32S);
+
+    size_t elemSize = featureType == MODEL_FEATURE_U8 ? 1 : sizeof(float);
+
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MODEL_FILE_MAGIC, sizeof(header.magic));
+    header.version = MODEL_FILE_VERSION;
+    header.featureType = featureType;
+    header.rows = (uint32_t)matLabels.rows;
+    header.cols = (uint32_t)intCols;
+    header.rowStride = (uint32_t)alignUp(intCols * elemSize);
+    header.imageWidth = (uint32_t)intImageWidth;
+    header.imageHeight = (uint32_t)intImageHeight;
+    header.labelsOffset = alignUp(sizeof(ModelFileHeader));
+    header.featuresOffset = alignUp(header.labelsOffset + (uint64_t)header.rows * sizeof(int32_t));
+    header.fileSize = header.featuresOffset + (uint64_t)header.rows * header.rowStride;
+    header.descriptor = descriptor;
+
+    file.open(strPath, std::ios::binary | std::ios::trunc);
+
+    // trap for error
+    if (!file.is_open()) {
+        std::cout << "error, unable to open model file " << strPath << " for writing\n\n";
+        return false;
+    }
+
+    // header, then labels padded up to the feature section
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(vecPadding.data(), (std::streamsize)(header.labelsOffset - sizeof(header)));
+    for (int i = 0; i < matLabels.rows; i++) {
+        int32_t intLabel = matLabels.at<int32_t>(i, 0);
+        file.write(reinterpret_cast<const char*>(&intLabel), sizeof(intLabel));
+    }
+    file.write(vecPadding.data(), (std::streamsize)(header.featuresOffset - header.labelsOffset - (uint64_t)header.rows * sizeof(int32_t)));
+
+    return file.good();
+}
+
+bool ModelFileWriter::append(const cv::Mat& matRows) {
+
+    // trap for rows of another width or more rows than the labels
+    if (!file.is_open() || matRows.cols != (int)header.cols || intRowsWritten + matRows.rows > (int)header.rows) {
+        std::cout << "error, rows do not fit model file " << strPath << "\n\n";
+        return false;
+    }
+
+    // bring the features into the stored type, uint8 saturates which is lossless for threshold pixels
+    matRows.convertTo(matStored, header.featureType == MODEL_FEATURE_U8 ? CV_8U : CV_32F);
+
+    // one padded row at a time so every row starts on an aligned boundary
+    size_t rowBytes = matStored.cols * matStored.elemSize();
+    for (int i = 0; i < matStored.rows; i++) {
+        file.write(reinterpret_cast<const char*>(matStored.ptr(i)), (std::streamsize)rowBytes);
+        file.write(vecPadding.data(), (std::streamsize)(header.rowStride - rowBytes));
+    }
+    intRowsWritten += matStored.rows;
+
+    return file.good();
+}
+
+bool ModelFileWriter::close() {
+
+    bool blnComplete = intRowsWritten == (int)header.rows;
+    file.close();
+
+    if (!blnComplete || file.fail()) {
+        std::cout << "error, failed while writing model file " << strPath << "\n\n";
+        return false;
+    }
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool readXmlModel(const std::string& strImagesPath,
+    const std::string& strClassificationsPath,
+    cv::Mat& matFeatures,
+    cv::Mat& matClassifications) {
+
+    // open the classifications file
+    cv::FileStorage fsClassifications(strClassificationsPath, cv::FileStorage::READ);
+
+    // trap for file errors
+    if (fsClassifications.isOpened() == false) {
+        std::cout << "error, unable to open training classifications file " << strClassificationsPath << "\n\n";
+        return false;
+    }
+
+    // read classifications section into Mat classifications variable
+    fsClassifications["classifications"] >> matClassifications;
+    fsClassifications.release();
+
+    // open the training images file
+    cv::FileStorage fsTrainingImages(strImagesPath, cv::FileStorage::READ);
+
+    // trap for file error
+    if (fsTrainingImages.isOpened() == false) {
+        std::cout << "error, unable to open training images file " << strImagesPath << "\n\n";
+        return false;
+    }
+
+    // read images section into Mat training images variable
+    fsTrainingImages["images"] >> matFeatures;
+    fsTrainingImages.release();
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool convertXmlModel(const std::string& strImagesPath,
+    const std::string& strClassificationsPath,
+    const std::string& strModelPath,
+    ModelFeatureType featureType,
+    int intImageWidth,
+    int intImageHeight) {
+
+    cv::Mat matFeatures;
+    cv::Mat matClassifications;
+
+    if (!readXmlModel(strImagesPath, strClassificationsPath, matFeatures, matClassifications)) {
+        return false;
+    }
+
+    return writeModelFile(strModelPath, matFeatures, matClassifications, featureType, intImageWidth, intImageHeight);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+MappedModelFile::MappedModelFile() : pData(nullptr), sizeData(0), hFile(nullptr), hMapping(nullptr) {
+}
+
+MappedModelFile::~MappedModelFile() {
+    close();
+}
+
+bool MappedModelFile::open(const std::string& strPath) {
+
+    close();
+
+#ifdef _WIN32
+    // FILE_SHARE_DELETE lets SampleLog::compact move the mapped file aside and put a new model in its place
+    HANDLE file = CreateFileA(strPath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (view == nullptr) {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        std::cout << "error, unable to map model file " << strPath << "\n\n";
+        return false;
+    }
+
+    hFile = file;
+    hMapping = mapping;
+    pData = static_cast<const uint8_t*>(view);
+    sizeData = (size_t)fileSize.QuadPart;
+#else
+    int fd = ::open(strPath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        std::cout << "error, model file " << strPath << " is empty\n\n";
+        return false;
+    }
+
+    void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    // the mapping keeps its own reference to the file
+    ::close(fd);
+
+    if (view == MAP_FAILED) {
+        std::cout << "error, unable to map model file " << strPath << "\n\n";
+        return false;
+    }
+
+    pData = static_cast<const uint8_t*>(view);
+    sizeData = (size_t)st.st_size;
+#endif
+
+    // validate the header before anybody reads through it
+    bool valid = sizeData >= sizeof(ModelFileHeader);
+    if (valid) {
+        const ModelFileHeader& h = header();
+        size_t elemSize = h.featureType == MODEL_FEATURE_U8 ? 1 : 4;
+
+        valid = std::memcmp(h.magic, MODEL_FILE_MAGIC, sizeof(h.magic)) == 0
+            && h.version == MODEL_FILE_VERSION
+            && (h.featureType == MODEL_FEATURE_U8 || h.featureType == MODEL_FEATURE_F32)
+            && h.rowStride >= h.cols * elemSize
+            && h.rowStride % MODEL_ROW_ALIGNMENT == 0
+            && h.labelsOffset + (uint64_t)h.rows * sizeof(int32_t) <= h.featuresOffset
+            && h.featuresOffset % MODEL_ROW_ALIGNMENT == 0
+            && h.featuresOffset + (uint64_t)h.rows * h.rowStride <= h.fileSize
+            && h.fileSize == sizeData
+            && h.descriptor < DESCRIPTOR_COUNT;
+    }
+
+    if (!valid) {
+        std::cout << "error, " << strPath << " is not a valid version " << MODEL_FILE_VERSION << " model file\n\n";
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void MappedModelFile::close() {
+
+    if (pData == nullptr) {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(pData);
+    CloseHandle((HANDLE)hMapping);
+    CloseHandle((HANDLE)hFile);
+#else
+    munmap(const_cast<uint8_t*>(pData), sizeData);
+#endif
+
+    pData = nullptr;
+    sizeData = 0;
+    hFile = nullptr;
+    hMapping = nullptr;
+}
+
+cv::Mat MappedModelFile::features() const {
+
+    int type = header().featureType == MODEL_FEATURE_U8 ? CV_8UC1 : CV_32FC1;
+
+    // the mapping is read only, callers must treat the returned Mat as const
+    return cv::Mat(rows(), cols(), type, const_cast<uint8_t*>(rowPtr(0)), header().rowStride);
+}
+
+cv::Mat MappedModelFile::classifications() const {
+    return cv::Mat(rows(), 1, CV_32SC1, const_cast<int32_t*>(labels()));
+}
@@ -0,0 +1,149 @@
+// ###########################################################################################################################
+// ModelFile.h :
+//
+// Description: Compact binary model file shared by CharTrain and CharMatch. The file holds a fixed size header, the int32
+//              classification labels and the packed training feature rows (uint8 or float). Every section and every row is
+//              aligned, so the file can be memory mapped and the features used in place without any parsing or copying.
+//
+//              layout:  [ModelFileHeader][labels: rows x int32][pad][features: rows x rowStride bytes]
+//
+//              The header names the FeatureDescriptor the rows were extracted with; files written before there was a
+//              choice hold zero there, which is DESCRIPTOR_PIXELS.
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include "FeatureDescriptor.h"
+
+#include<opencv2/core/core.hpp>
+
+#include<cstdint>
+#include<fstream>
+#include<string>
+#include<vector>
+
+// model file constants ///////////////////////////////////////////////////////////////////////////
+const char MODEL_FILE_MAGIC[4] = { 'C', 'R', 'H', 'M' };
+const uint32_t MODEL_FILE_VERSION = 1;
+const uint32_t MODEL_ROW_ALIGNMENT = 64;            // one cache line, also wide enough for any SIMD load
+
+// type of the values stored in the feature rows
+enum ModelFeatureType : uint32_t {
+    MODEL_FEATURE_U8 = 1,                           // one byte per feature, resized threshold pixels are 0..255 so this is lossless
+    MODEL_FEATURE_F32 = 2                           // one float per feature, same layout KNearest expects
+};
+
+// fixed 64 byte header at the start of every model file
+struct ModelFileHeader {
+    char     magic[4];                              // MODEL_FILE_MAGIC
+    uint32_t version;                               // MODEL_FILE_VERSION
+    uint32_t featureType;                           // ModelFeatureType
+    uint32_t rows;                                  // number of training samples
+    uint32_t cols;                                  // number of features per sample (20 x 30 = 600)
+    uint32_t rowStride;                             // bytes from one feature row to the next, multiple of MODEL_ROW_ALIGNMENT
+    uint32_t imageWidth;                            // width of the resized char image the features came from
+    uint32_t imageHeight;                           // height of the resized char image the features came from
+    uint64_t labelsOffset;                          // byte offset of the int32 labels
+    uint64_t featuresOffset;                        // byte offset of the first feature row
+    uint64_t fileSize;                              // total file size, used to detect truncated files
+    uint32_t descriptor;                            // FeatureDescriptor of the rows
+    uint8_t  reserved[4];                           // zero
+};
+
+static_assert(sizeof(ModelFileHeader) == 64, "model file header must stay 64 bytes");
+
+// write the training data into a binary model file
+// matFeatures is rows x cols (CV_8U or CV_32F), matClassifications is rows x 1 (CV_32S or CV_32F)
+bool writeModelFile(const std::string& strPath,
+    const cv::Mat& matFeatures,
+    const cv::Mat& matClassifications,
+    ModelFeatureType featureType,
+    int intImageWidth,
+    int intImageHeight,
+    FeatureDescriptor descriptor = DESCRIPTOR_PIXELS);
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// writes a model file a block of rows at a time, so a training set too big to hold in memory as a whole can be
+// written while it is generated. the labels come first in the file, so all of them are given to open; the feature
+// rows follow in order. a file whose writer never got to close holds fewer rows than its header promises and is
+// rejected by MappedModelFile::open
+class ModelFileWriter {
+public:
+    ModelFileWriter();
+
+    // matClassifications is rows x 1 (CV_32S or CV_32F), every row written later has intCols features
+    bool open(const std::string& strPath,
+        const cv::Mat& matClassifications,
+        int intCols,
+        ModelFeatureType featureType,
+        int intImageWidth,
+        int intImageHeight,
+        FeatureDescriptor descriptor = DESCRIPTOR_PIXELS);
+
+    // the next matRows.rows feature rows (CV_8U or CV_32F)
+    bool append(const cv::Mat& matRows);
+
+    // check every row promised to open was written, prints the reason and returns false otherwise
+    bool close();
+
+    int rowsWritten() const { return intRowsWritten; }
+
+private:
+    std::ofstream file;
+    std::string strPath;
+    ModelFileHeader header;
+    int intRowsWritten;
+    cv::Mat matStored;                              // rows in the stored type, kept between blocks
+    std::vector<char> vecPadding;
+};
+
+// read the classifications.xml / images.xml pair written by older versions of CharTrain
+bool readXmlModel(const std::string& strImagesPath,
+    const std::string& strClassificationsPath,
+    cv::Mat& matFeatures,
+    cv::Mat& matClassifications);
+
+// convert an existing XML pair into a binary model file
+bool convertXmlModel(const std::string& strImagesPath,
+    const std::string& strClassificationsPath,
+    const std::string& strModelPath,
+    ModelFeatureType featureType,
+    int intImageWidth,
+    int intImageHeight);
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// read only memory mapping of a model file. the Mats handed out point straight into the mapping,
+// so they are only valid while the MappedModelFile is open
+class MappedModelFile {
+public:
+    MappedModelFile();
+    ~MappedModelFile();
+
+    MappedModelFile(const MappedModelFile&) = delete;
+    MappedModelFile& operator=(const MappedModelFile&) = delete;
+
+    // map the file and validate the header, prints the reason and returns false on any error
+    bool open(const std::string& strPath);
+    void close();
+
+    bool isOpen() const { return pData != nullptr; }
+    const ModelFileHeader& header() const { return *reinterpret_cast<const ModelFileHeader*>(pData); }
+
+    int rows() const { return (int)header().rows; }
+    int cols() const { return (int)header().cols; }
+    FeatureDescriptor descriptor() const { return (FeatureDescriptor)header().descriptor; }
+
+    const int32_t* labels() const { return reinterpret_cast<const int32_t*>(pData + header().labelsOffset); }
+    const uint8_t* rowPtr(int intRow) const { return pData + header().featuresOffset + (size_t)intRow * header().rowStride; }
+
+    // zero copy views into the mapping
+    cv::Mat features() const;                       // rows x cols, CV_8U or CV_32F, step = rowStride
+    cv::Mat classifications() const;                // rows x 1, CV_32S
+
+private:
+    const uint8_t* pData;                           // start of the mapping
+    size_t sizeData;                                // size of the mapping in bytes
+    void* hFile;                                    // platform file handle (Windows only)
+    void* hMapping;                                 // platform mapping handle (Windows only)
+};
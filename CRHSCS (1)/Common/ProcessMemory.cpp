@@ -0,0 +1,62 @@
+// ###########################################################################################################################
+// ProcessMemory.cpp :
+//
+// Description: Resident memory of the running process, see ProcessMemory.h
+//
+// ###########################################################################################################################
+
+#include "ProcessMemory.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include<windows.h>
+#include<psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include<fstream>
+#include<sys/resource.h>
+#include<unistd.h>
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+uint64_t peakResidentBytes() {
+
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return (uint64_t)usage.ru_maxrss;               // bytes on macOS
+#else
+    return (uint64_t)usage.ru_maxrss * 1024;        // kilobytes on Linux
+#endif
+#endif
+}
+
+uint64_t residentBytes() {
+
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return counters.WorkingSetSize;
+#else
+    // second field of statm is the resident size in pages, there is no statm on macOS
+    std::ifstream statm("/proc/self/statm");
+    uint64_t totalPages = 0, residentPages = 0;
+    if (!(statm >> totalPages >> residentPages)) {
+        return 0;
+    }
+    return residentPages * (uint64_t)sysconf(_SC_PAGESIZE);
+#endif
+}
@@ -0,0 +1,17 @@
+// ###########################################################################################################################
+// ProcessMemory.h :
+//
+// Description: Resident memory of the running process as reported by the OS, the working set on Windows and the
+//              resident set on Linux and macOS. Used by the benchmarks to report how much memory a pipeline needed.
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include<cstdint>
+
+// highest resident memory of the process since it started, in bytes, 0 when the OS does not report it
+uint64_t peakResidentBytes();
+
+// resident memory of the process right now, in bytes, 0 when the OS does not report it
+uint64_t residentBytes();
@@ -0,0 +1,247 @@
+// ###########################################################################################################################
+// SampleLog.cpp :
+//
+// Description: Append only log of added samples and its compaction into the model file, see SampleLog.h
+//
+// ###########################################################################################################################
+
+#include "SampleLog.h"
+#include "CharClassifier.h"
+#include "ModelFile.h"
+
+#include<opencv2/core/core.hpp>
+
+#include<cstdio>
+#include<cstring>
+#include<iostream>
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+SampleLog::SampleLog() : intCols(0), intModelRows(0), intSamples(0) {
+}
+
+uint32_t SampleLog::checksum(int32_t intLabel, const uint8_t* pSample, int intCols) {
+
+    // FNV-1a over the label and the pixels
+    uint32_t hash = 2166136261u;
+    for (size_t b = 0; b < sizeof(intLabel); b++) {
+        hash = (hash ^ (uint8_t)(intLabel >> (8 * b))) * 16777619u;
+    }
+    for (int i = 0; i < intCols; i++) {
+        hash = (hash ^ pSample[i]) * 16777619u;
+    }
+    return hash;
+}
+
+bool SampleLog::create() {
+
+    SampleLogHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, SAMPLE_LOG_MAGIC, sizeof(header.magic));
+    header.version = SAMPLE_LOG_VERSION;
+    header.cols = (uint32_t)intCols;
+    header.modelRows = (uint32_t)intModelRows;
+
+    std::ofstream newFile(strPath, std::ios::binary | std::ios::trunc);
+    newFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    return newFile.good();
+}
+
+bool SampleLog::open(const std::string& strLogPath, CharClassifier& charClassifier) {
+
+    file.close();
+    strPath = strLogPath;
+    intCols = charClassifier.cols();
+    intModelRows = charClassifier.baseRows();
+    intSamples = 0;
+
+    // trap for an untrained classifier
+    if (intCols == 0) {
+        std::cout << "error, the sample log needs a trained classifier\n\n";
+        return false;
+    }
+
+    // no log yet, append creates it with the first sample
+    std::ifstream existing(strPath, std::ios::binary);
+    if (!existing.is_open()) {
+        return true;
+    }
+
+    // replay the samples already logged, the good records are kept to write them again after a torn tail
+    std::vector<char> vecGood;
+    SampleLogHeader header;
+    existing.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    // trap for a log of another model, it is left alone
+    if (!existing
+        || std::memcmp(header.magic, SAMPLE_LOG_MAGIC, sizeof(header.magic)) != 0
+        || header.version != SAMPLE_LOG_VERSION
+        || header.cols != (uint32_t)intCols) {
+        std::cout << "error, " << strPath << " is not a version " << SAMPLE_LOG_VERSION << " sample log of "
+                  << intCols << " pixel samples\n\n";
+        return false;
+    }
+
+    size_t recordBytes = 2 * sizeof(int32_t) + (size_t)intCols;
+    std::vector<char> vecRecord(recordBytes);
+    int intRecords = 0;
+    int intInModel = 0;
+
+    while (existing.read(vecRecord.data(), (std::streamsize)recordBytes)) {
+        int32_t intLabel;
+        uint32_t uintChecksum;
+        std::memcpy(&intLabel, vecRecord.data(), sizeof(intLabel));
+        std::memcpy(&uintChecksum, vecRecord.data() + sizeof(intLabel), sizeof(uintChecksum));
+        const uint8_t* pSample = reinterpret_cast<const uint8_t*>(vecRecord.data() + 2 * sizeof(int32_t));
+
+        if (uintChecksum != checksum(intLabel, pSample, intCols)) {
+            break;
+        }
+
+        // a compaction that crashed before it emptied the log left the leading records in the model rows as well
+        int intRow = (int)header.modelRows + intRecords++;
+        if (intInModel == intRecords - 1 && intRow < intModelRows && charClassifier.label(intRow) == intLabel
+            && std::memcmp(charClassifier.rowPtr(intRow), pSample, (size_t)intCols) == 0) {
+            intInModel++;
+            continue;
+        }
+
+        charClassifier.addSample(pSample, intLabel);
+        vecGood.insert(vecGood.end(), vecRecord.begin(), vecRecord.end());
+        intSamples++;
+    }
+
+    // anything after the last good record is dropped, so new records do not follow garbage
+    existing.clear();
+    existing.seekg(0, std::ios::end);
+    bool blnDamaged = (size_t)existing.tellg() != sizeof(SampleLogHeader) + (size_t)intRecords * recordBytes;
+    existing.close();
+
+    if (blnDamaged) {
+        std::cout << "sample log " << strPath << " ends in a damaged record, kept the " << intRecords << " samples before it\n";
+    }
+    if (intInModel > 0) {
+        std::cout << "sample log " << strPath << ": " << intInModel << " samples are in the model already, dropped them from the log\n";
+    }
+
+    // the log is written again on top of the model it was replayed on, a retrained model included
+    if (blnDamaged || intInModel > 0 || header.modelRows != (uint32_t)intModelRows) {
+
+        if (!create()) {
+            std::cout << "error, unable to write sample log " << strPath << "\n\n";
+            return false;
+        }
+        std::ofstream rewrite(strPath, std::ios::binary | std::ios::app);
+        rewrite.write(vecGood.data(), (std::streamsize)vecGood.size());
+    }
+
+    file.open(strPath, std::ios::binary | std::ios::app);
+
+    // trap for error
+    if (!file.is_open()) {
+        std::cout << "error, unable to open sample log " << strPath << " for writing\n\n";
+        return false;
+    }
+
+    return true;
+}
+
+bool SampleLog::append(const uint8_t* pSample, int intLabel) {
+
+    // trap for a log that was never opened
+    if (intCols == 0) {
+        return false;
+    }
+
+    // the first sample creates the log
+    if (!file.is_open()) {
+        if (!create()) {
+            std::cout << "error, unable to write sample log " << strPath << "\n\n";
+            return false;
+        }
+        file.open(strPath, std::ios::binary | std::ios::app);
+    }
+
+    int32_t intLabel32 = intLabel;
+    uint32_t uintChecksum = checksum(intLabel32, pSample, intCols);
+    file.write(reinterpret_cast<const char*>(&intLabel32), sizeof(intLabel32));
+    file.write(reinterpret_cast<const char*>(&uintChecksum), sizeof(uintChecksum));
+    file.write(reinterpret_cast<const char*>(pSample), intCols);
+
+    // hand the record to the operating system now, a crash of the program then loses nothing
+    file.flush();
+
+    if (!file.good()) {
+        std::cout << "error, failed while writing sample log " << strPath << "\n\n";
+        return false;
+    }
+
+    intSamples++;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool SampleLog::compact(const CharClassifier& charClassifier, const std::string& strModel, int intImageWidth, int intImageHeight) {
+
+    // trap for an untrained classifier
+    if (charClassifier.empty()) {
+        std::cout << "error, nothing to compact into " << strModel << "\n\n";
+        return false;
+    }
+
+    cv::Mat matLabels(charClassifier.rows(), 1, CV_32S);
+    for (int i = 0; i < charClassifier.rows(); i++) {
+        matLabels.at<int32_t>(i, 0) = charClassifier.label(i);
+    }
+
+    // the trained and the added rows are two blocks of rows, written one after the other
+    std::string strTemp = strModel + ".tmp";
+    ModelFileWriter writer;
+    if (!writer.open(strTemp, matLabels, charClassifier.cols(), MODEL_FEATURE_U8, intImageWidth, intImageHeight,
+        charClassifier.descriptor())) {
+        return false;
+    }
+    if (charClassifier.baseRows() > 0) {
+        cv::Mat matBase(charClassifier.baseRows(), charClassifier.cols(), CV_8UC1,
+            const_cast<uint8_t*>(charClassifier.rowPtr(0)), charClassifier.stride());
+        if (!writer.append(matBase)) {
+            return false;
+        }
+    }
+    if (charClassifier.addedRows() > 0) {
+        cv::Mat matAdded(charClassifier.addedRows(), charClassifier.cols(), CV_8UC1,
+            const_cast<uint8_t*>(charClassifier.rowPtr(charClassifier.baseRows())), charClassifier.stride());
+        if (!writer.append(matAdded)) {
+            return false;
+        }
+    }
+    if (!writer.close()) {
+        return false;
+    }
+
+    // a mapped model can be moved aside where it cannot be replaced, windows keeps it open until it is unmapped;
+    // the old file is removed here when nothing maps it any more, or by the next compaction
+    std::string strOld = strModel + ".old";
+    std::remove(strOld.c_str());
+    bool blnMoved = std::rename(strModel.c_str(), strOld.c_str()) == 0;
+
+    if (std::rename(strTemp.c_str(), strModel.c_str()) != 0) {
+        if (blnMoved) {
+            std::rename(strOld.c_str(), strModel.c_str());
+        }
+        std::cout << "error, unable to replace model file " << strModel << "\n\n";
+        return false;
+    }
+    std::remove(strOld.c_str());
+
+    // the samples are in the model now, start the log again on top of all of its rows
+    file.close();
+    intModelRows = charClassifier.rows();
+    intSamples = 0;
+    if (!create()) {
+        std::cout << "error, unable to write sample log " << strPath << "\n\n";
+        return false;
+    }
+    file.open(strPath, std::ios::binary | std::ios::app);
+
+    return file.is_open();
+}
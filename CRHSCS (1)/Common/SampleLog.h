@@ -0,0 +1,75 @@
+// ###########################################################################################################################
+// SampleLog.h :
+//
+// Description: Append only log of labeled samples added to a running CharMatch, so an operator can correct a misread
+//              char without retraining and restarting. Every sample is added to the live classifier with
+//              CharClassifier::addSample and appended to the log; on the next start the log is replayed over the
+//              model. Compaction writes the model rows and the logged samples into a new model file and empties the
+//              log, so the log stays short and the samples end up in the rows an index is built on.
+//
+//              layout:  [SampleLogHeader][record]...    record: int32 label, uint32 checksum, cols values of the
+//                                                        descriptor of the model
+//
+//              A record is flushed as it is written. A record cut short by a crash, or one whose checksum does not
+//              match, ends the log: the records before it are kept and the rest is dropped on open.
+//
+//              The header holds the rows of the model the log was started on, so record i belongs at row
+//              modelRows + i. Compaction replaces the model before it empties the log; after a crash between the two
+//              the model already holds the logged samples at those rows, open finds them there and drops them from
+//              the log instead of adding them a second time.
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include<cstdint>
+#include<fstream>
+#include<string>
+#include<vector>
+
+class CharClassifier;
+
+// sample log constants ///////////////////////////////////////////////////////////////////////////
+const char SAMPLE_LOG_MAGIC[4] = { 'C', 'R', 'H', 'L' };
+const uint32_t SAMPLE_LOG_VERSION = 2;
+
+// fixed 16 byte header at the start of every log
+struct SampleLogHeader {
+    char     magic[4];                              // SAMPLE_LOG_MAGIC
+    uint32_t version;                               // SAMPLE_LOG_VERSION
+    uint32_t cols;                                  // pixels of every sample
+    uint32_t modelRows;                             // rows of the model the first record follows
+};
+
+static_assert(sizeof(SampleLogHeader) == 16, "sample log header must stay 16 bytes");
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class SampleLog {
+public:
+    SampleLog();
+
+    // open the log at strPath for samples of charClassifier.cols() pixels, the first append creates it when it does
+    // not exist; the samples already in it are added to charClassifier, except those a compaction already wrote into
+    // its trained rows. prints the reason and returns false on any error
+    bool open(const std::string& strPath, CharClassifier& charClassifier);
+
+    // append one sample, added to the classifier by the caller
+    bool append(const uint8_t* pSample, int intLabel);
+
+    // write the rows of charClassifier, trained and added, into a new model file at strModel that replaces the old
+    // one, and empty the log. the old model stays valid for a classifier still using its mapping
+    bool compact(const CharClassifier& charClassifier, const std::string& strModel, int intImageWidth, int intImageHeight);
+
+    bool isOpen() const { return file.is_open(); }
+    int samples() const { return intSamples; }      // samples in the log, not yet in the model file
+
+private:
+    bool create();
+    static uint32_t checksum(int32_t intLabel, const uint8_t* pSample, int intCols);
+
+    std::string strPath;
+    std::ofstream file;
+    int intCols;
+    int intModelRows;                               // modelRows of the header
+    int intSamples;
+};
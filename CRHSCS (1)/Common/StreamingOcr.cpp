@@ -0,0 +1,237 @@
+// ###########################################################################################################################
+// StreamingOcr.cpp :
+//
+// Description: Multi threaded capture / preprocess / classify pipeline, see StreamingOcr.h
+//
+// ###########################################################################################################################
+
+#include "StreamingOcr.h"
+#include "CharRecognizer.h"
+
+#include<chrono>
+#include<iostream>
+#include<thread>
+
+// global variables ///////////////////////////////////////////////////////////////////////////////
+const int IDLE_SPINS_BEFORE_SLEEP = 64;             // yields an idle stage makes before it starts sleeping
+const int IDLE_SLEEP_MICROSECONDS = 200;            // sleep of an idle stage, well under one frame at 60 fps
+
+// wait a little for the upstream queue, spinning first because a frame is usually close
+static void idleWait(int& intSpins) {
+    if (++intSpins < IDLE_SPINS_BEFORE_SLEEP) {
+        std::this_thread::yield();
+    }
+    else {
+        std::this_thread::sleep_for(std::chrono::microseconds(IDLE_SLEEP_MICROSECONDS));
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// hand a frame to the next stage. frames from a camera drop the oldest queued frame when the next stage
+// is behind, recorded input must not lose frames so the stage waits for room instead
+void StreamingOcr::pushFrame(BoundedQueue<OcrFrame>& queue, OcrFrame& ocrFrame, StageStats& stats) {
+
+    if (!blnLossless) {
+        stats.dropped += queue.pushDropOldest(ocrFrame);
+        return;
+    }
+
+    int intSpins = 0;
+    while (!queue.tryPush(ocrFrame)) {
+        idleWait(intSpins);
+    }
+}
+
+StreamingOcr::StreamingOcr(const CharClassifier& charClassifier, const StreamingOcrOptions& options)
+    : charClassifier(charClassifier), options(options),
+    queueCaptured(options.queueCapacity), queuePreprocessed(options.queueCapacity), queueResults(options.queueCapacity),
+    blnLossless(false), blnStop(false), blnCaptureDone(false), blnPreprocessDone(false), blnClassifyDone(false),
+    latencyTicks(0), delivered(0), cacheLookups(0), cacheHits(0), lastLatencyTicks(0), lastDelivered(0),
+    lastCacheLookups(0), lastCacheHits(0) {
+    for (int i = 0; i < 3; i++) {
+        arrLastFrames[i] = 0;
+        arrLastBusy[i] = 0;
+    }
+}
+
+void StreamingOcr::run(FrameSource& frameSource, const std::function<void(const OcrFrame&)>& onResult) {
+
+    blnLossless = !frameSource.isLive();
+
+    std::thread threadCapture(&StreamingOcr::captureStage, this, std::ref(frameSource));
+    std::thread threadPreprocess(&StreamingOcr::preprocessStage, this);
+    std::thread threadClassify(&StreamingOcr::classifyStage, this);
+
+    double dblTicksPerSecond = cv::getTickFrequency();
+    int64_t lastReportTick = cv::getTickCount();
+    OcrFrame ocrFrame;
+    int intSpins = 0;
+
+    // deliver results on this thread until the last stage has finished and its queue is drained
+    while (true) {
+        if (queueResults.tryPop(ocrFrame)) {
+            intSpins = 0;
+            latencyTicks += (uint64_t)(cv::getTickCount() - ocrFrame.captureTick);
+            delivered++;
+            onResult(ocrFrame);
+        }
+        else if (blnClassifyDone && queueResults.size() == 0) {
+            break;
+        }
+        else {
+            idleWait(intSpins);
+        }
+
+        int64_t now = cv::getTickCount();
+        if (options.dblReportSeconds > 0 && (now - lastReportTick) / dblTicksPerSecond >= options.dblReportSeconds) {
+            report((now - lastReportTick) / dblTicksPerSecond);
+            lastReportTick = now;
+        }
+    }
+
+    threadCapture.join();
+    threadPreprocess.join();
+    threadClassify.join();
+
+    // final report covers whatever happened since the last one
+    if (options.dblReportSeconds > 0) {
+        report((cv::getTickCount() - lastReportTick) / dblTicksPerSecond);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void StreamingOcr::captureStage(FrameSource& frameSource) {
+
+    uint64_t seq = 0;
+
+    while (!blnStop && (options.maxFrames == 0 || seq < options.maxFrames)) {
+        OcrFrame ocrFrame;
+
+        int64_t t0 = cv::getTickCount();
+        // end of the input, or the camera went away
+        if (!frameSource.read(ocrFrame.frame)) {
+            break;
+        }
+
+        ocrFrame.seq = seq++;
+        ocrFrame.captureTick = cv::getTickCount();
+        statsCapture.busyTicks += (uint64_t)(ocrFrame.captureTick - t0);
+        statsCapture.frames++;
+
+        pushFrame(queueCaptured, ocrFrame, statsCapture);
+    }
+
+    blnCaptureDone = true;
+}
+
+void StreamingOcr::preprocessStage() {
+
+    // scratch images owned by this stage, reused for every frame
+    CharRecognizer charRecognizer(charClassifier, options.intImageWidth, options.intImageHeight, options.dblMinContourArea);
+
+    OcrFrame ocrFrame;
+    int intSpins = 0;
+
+    while (true) {
+        if (!queueCaptured.tryPop(ocrFrame)) {
+            if (blnCaptureDone && queueCaptured.size() == 0) {
+                break;
+            }
+            idleWait(intSpins);
+            continue;
+        }
+        intSpins = 0;
+
+        int64_t t0 = cv::getTickCount();
+        charRecognizer.segment(ocrFrame.frame, ocrFrame.matThresh, ocrFrame.vecRects);
+        ocrFrame.processTicks = cv::getTickCount() - t0;
+        statsPreprocess.busyTicks += (uint64_t)ocrFrame.processTicks;
+        statsPreprocess.frames++;
+
+        pushFrame(queuePreprocessed, ocrFrame, statsPreprocess);
+    }
+
+    blnPreprocessDone = true;
+}
+
+void StreamingOcr::classifyStage() {
+
+    CharRecognizer charRecognizer(charClassifier, options.intImageWidth, options.intImageHeight, options.dblMinContourArea);
+    charRecognizer.setCaching(options.blnGlyphCache, options.dblCacheMaxDifference);
+
+    OcrFrame ocrFrame;
+    int intSpins = 0;
+
+    while (true) {
+        if (!queuePreprocessed.tryPop(ocrFrame)) {
+            if (blnPreprocessDone && queuePreprocessed.size() == 0) {
+                break;
+            }
+            idleWait(intSpins);
+            continue;
+        }
+        intSpins = 0;
+
+        int64_t t0 = cv::getTickCount();
+        ocrFrame.strText = charRecognizer.classify(ocrFrame.matThresh, ocrFrame.vecRects, ocrFrame.vecChars);
+        int64_t classifyTicks = cv::getTickCount() - t0;
+        ocrFrame.processTicks += classifyTicks;
+        statsClassify.busyTicks += (uint64_t)classifyTicks;
+        statsClassify.frames++;
+        cacheLookups = charRecognizer.cache().lookups();
+        cacheHits = charRecognizer.cache().hits();
+
+        pushFrame(queueResults, ocrFrame, statsClassify);
+    }
+
+    blnClassifyDone = true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void StreamingOcr::report(double dblSeconds) {
+
+    if (dblSeconds <= 0) {
+        return;
+    }
+
+    const char* arrNames[3] = { "capture", "preprocess", "classify" };
+    StageStats* arrStats[3] = { &statsCapture, &statsPreprocess, &statsClassify };
+    double dblTicksPerMs = cv::getTickFrequency() / 1000.0;
+
+    std::cout << "stream";
+    for (int i = 0; i < 3; i++) {
+        uint64_t frames = arrStats[i]->frames;
+        uint64_t busy = arrStats[i]->busyTicks;
+        uint64_t intervalFrames = frames - arrLastFrames[i];
+        uint64_t intervalBusy = busy - arrLastBusy[i];
+
+        std::cout << " | " << arrNames[i] << " " << intervalFrames / dblSeconds << " fps "
+            << (intervalFrames ? intervalBusy / dblTicksPerMs / intervalFrames : 0.0) << " ms"
+            << " dropped " << arrStats[i]->dropped;
+
+        arrLastFrames[i] = frames;
+        arrLastBusy[i] = busy;
+    }
+
+    uint64_t totalLatency = latencyTicks;
+    uint64_t totalDelivered = delivered;
+    uint64_t intervalDelivered = totalDelivered - lastDelivered;
+
+    std::cout << " | queues " << queueCaptured.size() << "/" << queueCaptured.capacity()
+        << " " << queuePreprocessed.size() << "/" << queuePreprocessed.capacity()
+        << " " << queueResults.size() << "/" << queueResults.capacity()
+        << " | latency " << (intervalDelivered ? (totalLatency - lastLatencyTicks) / dblTicksPerMs / intervalDelivered : 0.0) << " ms";
+
+    if (options.blnGlyphCache) {
+        uint64_t totalLookups = cacheLookups;
+        uint64_t totalHits = cacheHits;
+        uint64_t intervalLookups = totalLookups - lastCacheLookups;
+        std::cout << " | cache hits " << (intervalLookups ? 100.0 * (totalHits - lastCacheHits) / intervalLookups : 0.0) << "%";
+        lastCacheLookups = totalLookups;
+        lastCacheHits = totalHits;
+    }
+    std::cout << "\n";
+
+    lastLatencyTicks = totalLatency;
+    lastDelivered = totalDelivered;
+}
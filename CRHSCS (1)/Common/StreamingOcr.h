@@ -0,0 +1,110 @@
+// ###########################################################################################################################
+// StreamingOcr.h :
+//
+// Description: Continuous, headless char recognition. Every captured frame goes through three pipeline stages, each on
+//              its own thread:
+//
+//                  capture  ->  [queue]  ->  preprocess + segment  ->  [queue]  ->  classify  ->  [queue]  ->  caller
+//
+//              The stages are connected by lock free BoundedQueues. With a camera a full queue drops its oldest frame,
+//              so a slow stage never stalls the camera and the latency from capture to result stays bounded; recorded
+//              input (video, images, stdin) is never dropped and runs as fast as the slowest stage. Throughput, busy
+//              time and drops of every stage and the depth of every queue are reported periodically. With the glyph
+//              cache on, the classify stage reuses the results of unchanged glyphs and the report adds its hit rate.
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include "BoundedQueue.h"
+#include "CharClassifier.h"
+#include "FrameSource.h"
+#include "GlyphBatch.h"
+
+#include<opencv2/core/core.hpp>
+
+#include<atomic>
+#include<cstdint>
+#include<functional>
+#include<string>
+#include<vector>
+
+// one frame travelling through the pipeline
+struct OcrFrame {
+    uint64_t seq = 0;                               // capture sequence number, gaps mean frames were dropped
+    int64_t captureTick = 0;                        // cv::getTickCount() when the frame was captured
+    int64_t processTicks = 0;                       // ticks spent in the preprocess and classify stages, without queueing
+    cv::Mat frame;                                  // captured image
+    cv::Mat matThresh;                              // threshold image, filled by the preprocess stage
+    std::vector<cv::Rect> vecRects;                 // glyph rects, filled by the preprocess stage
+    std::vector<RecognizedChar> vecChars;           // classified glyphs in reading order, filled by the classify stage
+    std::string strText;                            // recognized text, filled by the classify stage
+};
+
+struct StreamingOcrOptions {
+    int intImageWidth = 20;                         // resized glyph size the classifier was trained on
+    int intImageHeight = 30;
+    double dblMinContourArea = 100;                 // smaller contours are noise
+    size_t queueCapacity = 4;                       // frames each queue holds before dropping the oldest
+    double dblReportSeconds = 1.0;                  // seconds between stats reports, 0 turns them off
+    uint64_t maxFrames = 0;                         // stop after this many captured frames, 0 runs until the capture ends
+    bool blnGlyphCache = false;                     // reuse the results of unchanged glyphs, see GlyphCache
+    double dblCacheMaxDifference = GLYPH_CACHE_MAX_DIFFERENCE;
+};
+
+// counters of one stage, written by the stage thread and read by the reporter
+struct StageStats {
+    std::atomic<uint64_t> frames{ 0 };              // frames the stage finished
+    std::atomic<uint64_t> busyTicks{ 0 };           // ticks spent working (not waiting on a queue)
+    std::atomic<uint64_t> dropped{ 0 };             // frames thrown away because the next queue was full
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class StreamingOcr {
+public:
+    StreamingOcr(const CharClassifier& charClassifier, const StreamingOcrOptions& options);
+
+    // run the pipeline until the capture ends, maxFrames were captured or stop() is called
+    // onResult is called on the calling thread for every frame that made it through
+    void run(FrameSource& frameSource, const std::function<void(const OcrFrame&)>& onResult);
+
+    // ask the pipeline to finish, safe to call from any thread (or from onResult)
+    void stop() { blnStop = true; }
+
+private:
+    void captureStage(FrameSource& frameSource);
+    void preprocessStage();
+    void classifyStage();
+    void report(double dblSeconds);
+    void pushFrame(BoundedQueue<OcrFrame>& queue, OcrFrame& ocrFrame, StageStats& stats);
+
+    const CharClassifier& charClassifier;
+    StreamingOcrOptions options;
+
+    BoundedQueue<OcrFrame> queueCaptured;
+    BoundedQueue<OcrFrame> queuePreprocessed;
+    BoundedQueue<OcrFrame> queueResults;
+
+    StageStats statsCapture;
+    StageStats statsPreprocess;
+    StageStats statsClassify;
+
+    bool blnLossless;                               // recorded input, wait for room instead of dropping frames
+    std::atomic<bool> blnStop;
+    std::atomic<bool> blnCaptureDone;
+    std::atomic<bool> blnPreprocessDone;
+    std::atomic<bool> blnClassifyDone;
+
+    std::atomic<uint64_t> latencyTicks;             // capture to result, summed over delivered frames
+    std::atomic<uint64_t> delivered;
+    std::atomic<uint64_t> cacheLookups;             // glyph cache of the classify stage, copied after every frame
+    std::atomic<uint64_t> cacheHits;
+
+    // snapshot of the counters at the previous report, so each report covers one interval
+    uint64_t arrLastFrames[3];
+    uint64_t arrLastBusy[3];
+    uint64_t lastLatencyTicks;
+    uint64_t lastDelivered;
+    uint64_t lastCacheLookups;
+    uint64_t lastCacheHits;
+};
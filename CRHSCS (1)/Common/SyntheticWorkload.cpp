@@ -0,0 +1,181 @@
+// ###########################################################################################################################
+// SyntheticWorkload.cpp :
+//
+// Description: Synthetic text and face frames for the benchmarks, see SyntheticWorkload.h
+//
+// ###########################################################################################################################
+
+#include "SyntheticWorkload.h"
+
+#include<algorithm>
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+SyntheticWorkload::SyntheticWorkload(uint64_t seed) : rng(seed) {
+}
+
+void SyntheticWorkload::renderText(const cv::Size& frameSize, const SyntheticTextOptions& options, cv::Mat& matFrame, std::string& strText) {
+
+    // light paper, dark ink, one font, size and stroke width per frame
+    matFrame.create(frameSize, CV_8UC3);
+    matFrame.setTo(cv::Scalar::all(rng.uniform(200, 256)));
+    cv::Scalar ink = cv::Scalar::all(rng.uniform(0, 60));
+
+    int intFont = SYNTHETIC_FONTS[rng.uniform(0, SYNTHETIC_FONT_COUNT)];
+    double dblScale = rng.uniform(options.dblMinScale, options.dblMaxScale);
+    int intThickness = rng.uniform(options.intMinThickness, options.intMaxThickness + 1);
+
+    int intBaseline = 0;
+    cv::Size charSize = cv::getTextSize("W", intFont, dblScale, intThickness, &intBaseline);
+    int intMargin = charSize.width;
+    int intLineHeight = charSize.height * 2 + intBaseline;
+
+    strText.clear();
+
+    // chars are drawn one at a time with a gap, so every char is its own contour like on the training sheet
+    int y = intMargin + charSize.height;
+    for (int line = 0; line < options.intLines && y + intBaseline < frameSize.height - intMargin; line++) {
+
+        std::string strLine;
+        int x = intMargin + rng.uniform(0, charSize.width);
+
+        while ((int)strLine.size() < options.intCharsPerLine) {
+            std::string strChar(1, SYNTHETIC_CHARSET[rng.uniform(0, (int)SYNTHETIC_CHARSET.size())]);
+            cv::Size size = cv::getTextSize(strChar, intFont, dblScale, intThickness, &intBaseline);
+            if (x + size.width >= frameSize.width - intMargin) {
+                break;
+            }
+            cv::putText(matFrame, strChar, cv::Point(x, y), intFont, dblScale, ink, intThickness, cv::LINE_AA);
+            strLine += strChar;
+            x += size.width + intThickness + rng.uniform(charSize.width / 4, charSize.width / 2 + 1);
+        }
+
+        if (!strLine.empty()) {
+            if (!strText.empty()) {
+                strText += '\n';
+            }
+            strText += strLine;
+        }
+        y += intLineHeight;
+    }
+
+    addNoise(matFrame, options.dblNoiseSigma, options.dblSaltFraction);
+}
+
+void SyntheticWorkload::renderGlyph(char chrGlyph, int intFont, double dblScale, int intThickness, cv::Mat& matImage) {
+
+    std::string strChar(1, chrGlyph);
+    int intBaseline = 0;
+    cv::Size size = cv::getTextSize(strChar, intFont, dblScale, intThickness, &intBaseline);
+    int intMargin = std::max(size.width, size.height) / 2 + intThickness;
+
+    matImage.create(size.height + intBaseline + 2 * intMargin, size.width + 2 * intMargin, CV_8UC3);
+    matImage.setTo(cv::Scalar::all(255));
+    cv::putText(matImage, strChar, cv::Point(intMargin, intMargin + size.height), intFont, dblScale, cv::Scalar::all(0), intThickness, cv::LINE_AA);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void SyntheticWorkload::renderFaces(const cv::Size& frameSize, const std::vector<cv::Mat>& vecCrops, const SyntheticFaceOptions& options,
+                                    cv::Mat& matFrame, std::vector<cv::Rect>& vecFaces) {
+
+    // vertical gradient background
+    matFrame.create(frameSize, CV_8UC3);
+    cv::Scalar top(rng.uniform(40, 220), rng.uniform(40, 220), rng.uniform(40, 220));
+    cv::Scalar bottom(rng.uniform(40, 220), rng.uniform(40, 220), rng.uniform(40, 220));
+    for (int y = 0; y < frameSize.height; y++) {
+        double dblWeight = (double)y / std::max(1, frameSize.height - 1);
+        matFrame.row(y).setTo(top * (1.0 - dblWeight) + bottom * dblWeight);
+    }
+
+    // some clutter the face cascade has to reject
+    int intClutter = rng.uniform(4, 12);
+    for (int i = 0; i < intClutter; i++) {
+        cv::Point pt(rng.uniform(0, frameSize.width), rng.uniform(0, frameSize.height));
+        cv::Size size(rng.uniform(10, frameSize.width / 4 + 11), rng.uniform(10, frameSize.height / 4 + 11));
+        cv::Scalar color(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256));
+        if (rng.uniform(0, 2) == 0) {
+            cv::rectangle(matFrame, cv::Rect(pt, size), color, cv::FILLED);
+        }
+        else {
+            cv::ellipse(matFrame, pt, size / 2, rng.uniform(0.0, 180.0), 0, 360, color, cv::FILLED, cv::LINE_AA);
+        }
+    }
+
+    // faces at random places, without overlapping each other
+    vecFaces.clear();
+    int intFaces = rng.uniform(options.intMinFaces, options.intMaxFaces + 1);
+    for (int attempt = 0; (int)vecFaces.size() < intFaces && attempt < intFaces * 20; attempt++) {
+
+        const cv::Mat* pCrop = vecCrops.empty() ? nullptr : &vecCrops[rng.uniform(0, (int)vecCrops.size())];
+        int intWidth = rng.uniform(options.intMinFaceSize, options.intMaxFaceSize + 1);
+        int intHeight = pCrop != nullptr ? std::max(1, cvRound((double)intWidth * pCrop->rows / pCrop->cols)) : intWidth;
+        if (intWidth >= frameSize.width || intHeight >= frameSize.height) {
+            continue;
+        }
+
+        cv::Rect rect(rng.uniform(0, frameSize.width - intWidth + 1), rng.uniform(0, frameSize.height - intHeight + 1), intWidth, intHeight);
+        bool blnFree = true;
+        for (const cv::Rect& face : vecFaces) {
+            if ((rect & face).area() > 0) {
+                blnFree = false;
+                break;
+            }
+        }
+        if (!blnFree) {
+            continue;
+        }
+
+        if (pCrop != nullptr) {
+            cv::Mat matFace = matFrame(rect);
+            cv::resize(*pCrop, matFace, rect.size(), 0, 0, cv::INTER_AREA);
+        }
+        else {
+            drawFace(matFrame, rect);
+        }
+        vecFaces.push_back(rect);
+    }
+
+    addNoise(matFrame, options.dblNoiseSigma, 0.0);
+}
+
+// a plain frontal face: skin oval, darker eyes, brows, nose and mouth at the usual proportions
+void SyntheticWorkload::drawFace(cv::Mat& matFrame, const cv::Rect& rect) {
+
+    cv::Scalar skin(rng.uniform(90, 200), rng.uniform(110, 210), rng.uniform(150, 240));
+    cv::Scalar dark = skin * 0.3;
+    int w = rect.width;
+    int h = rect.height;
+    int intStroke = std::max(1, w / 30);
+    cv::Point center(rect.x + w / 2, rect.y + h / 2);
+
+    cv::ellipse(matFrame, center, cv::Size(w * 42 / 100, h / 2), 0, 0, 360, skin, cv::FILLED, cv::LINE_AA);
+
+    for (int side = -1; side <= 1; side += 2) {
+        cv::Point ptEye(center.x + side * w / 5, rect.y + h * 2 / 5);
+        cv::ellipse(matFrame, ptEye, cv::Size(w / 10, h / 20), 0, 0, 360, dark, cv::FILLED, cv::LINE_AA);
+        cv::line(matFrame, cv::Point(ptEye.x - w / 9, ptEye.y - h / 10), cv::Point(ptEye.x + w / 9, ptEye.y - h / 9), dark, intStroke, cv::LINE_AA);
+    }
+
+    cv::line(matFrame, cv::Point(center.x, rect.y + h * 45 / 100), cv::Point(center.x - w / 25, rect.y + h * 62 / 100), dark, intStroke, cv::LINE_AA);
+    cv::line(matFrame, cv::Point(center.x - w / 25, rect.y + h * 62 / 100), cv::Point(center.x + w / 25, rect.y + h * 62 / 100), dark, intStroke, cv::LINE_AA);
+    cv::ellipse(matFrame, cv::Point(center.x, rect.y + h * 3 / 4), cv::Size(w * 18 / 100, h * 6 / 100), 0, 0, 180, dark, intStroke, cv::LINE_AA);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void SyntheticWorkload::addNoise(cv::Mat& matImage, double dblSigma, double dblSaltFraction) {
+
+    // gaussian noise added in 16 bit and saturated back to 8 bit
+    if (dblSigma > 0) {
+        matNoise.create(matImage.size(), CV_16SC(matImage.channels()));
+        rng.fill(matNoise, cv::RNG::NORMAL, 0, dblSigma);
+        matImage.convertTo(matWide, matNoise.type());
+        matWide += matNoise;
+        matWide.convertTo(matImage, matImage.type());
+    }
+
+    // single black or white pixels, too small for any glyph contour
+    int intSalt = cvRound(matImage.total() * dblSaltFraction);
+    for (int i = 0; i < intSalt; i++) {
+        cv::Rect pixel(rng.uniform(0, matImage.cols), rng.uniform(0, matImage.rows), 1, 1);
+        matImage(pixel).setTo(cv::Scalar::all(rng.uniform(0, 2) * 255));
+    }
+}
@@ -0,0 +1,70 @@
+// ###########################################################################################################################
+// SyntheticWorkload.h :
+//
+// Description: Reproducible synthetic input for the benchmarks. From a seed it renders frames of random text (the chars
+//              CharTrain knows, in several Hershey fonts, sizes and stroke widths, with gaussian and salt and pepper
+//              noise) together with the text they show, and frames with faces pasted at random places and sizes
+//              together with the face boxes. The same seed gives the same frames on every machine and build.
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include<opencv2/core/core.hpp>
+#include<opencv2/imgproc/imgproc.hpp>
+
+#include<cstdint>
+#include<string>
+#include<vector>
+
+// chars rendered into the text frames, the ones CharTrain is trained on
+const std::string SYNTHETIC_CHARSET = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+// fonts rendered into the text frames, the script fonts join their letters and are left out
+const int SYNTHETIC_FONTS[] = { cv::FONT_HERSHEY_SIMPLEX, cv::FONT_HERSHEY_DUPLEX, cv::FONT_HERSHEY_COMPLEX, cv::FONT_HERSHEY_TRIPLEX };
+const int SYNTHETIC_FONT_COUNT = 4;
+
+struct SyntheticTextOptions {
+    int intLines = 4;                               // lines of text, fewer when the frame is too small
+    int intCharsPerLine = 14;                       // chars per line, fewer when the line is too short
+    double dblMinScale = 1.0;                       // putText font scale, picked per frame
+    double dblMaxScale = 2.0;
+    int intMinThickness = 1;                        // stroke width, picked per frame
+    int intMaxThickness = 3;
+    double dblNoiseSigma = 8.0;                     // gaussian noise in gray levels
+    double dblSaltFraction = 0.002;                 // fraction of pixels set to black or white
+};
+
+struct SyntheticFaceOptions {
+    int intMinFaces = 1;                            // faces per frame, fewer when they do not fit
+    int intMaxFaces = 4;
+    int intMinFaceSize = 60;                        // face width in pixels
+    int intMaxFaceSize = 180;
+    double dblNoiseSigma = 6.0;                     // gaussian noise in gray levels
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class SyntheticWorkload {
+public:
+    explicit SyntheticWorkload(uint64_t seed);
+
+    // dark text on a light CV_8UC3 frame, strText is the text shown with a newline between lines,
+    // the way GlyphBatch::classify returns it
+    void renderText(const cv::Size& frameSize, const SyntheticTextOptions& options, cv::Mat& matFrame, std::string& strText);
+
+    // faces on a cluttered CV_8UC3 frame, vecFaces gets their boxes; the faces are the CV_8UC3 images of vecCrops
+    // resized to a random width, or drawn faces when vecCrops is empty
+    void renderFaces(const cv::Size& frameSize, const std::vector<cv::Mat>& vecCrops, const SyntheticFaceOptions& options,
+                     cv::Mat& matFrame, std::vector<cv::Rect>& vecFaces);
+
+    // one char dark on a white CV_8UC3 image with a margin around it, for training on the fonts of the text frames
+    static void renderGlyph(char chrGlyph, int intFont, double dblScale, int intThickness, cv::Mat& matImage);
+
+private:
+    void drawFace(cv::Mat& matFrame, const cv::Rect& rect);
+    void addNoise(cv::Mat& matImage, double dblSigma, double dblSaltFraction);
+
+    cv::RNG rng;
+    cv::Mat matNoise;                               // scratch, 16 bit noise and frame
+    cv::Mat matWide;
+};
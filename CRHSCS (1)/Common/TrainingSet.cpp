@@ -0,0 +1,325 @@
+// ###########################################################################################################################
+// TrainingSet.cpp :
+//
+// Description: Headless training set, see TrainingSet.h
+//
+// ###########################################################################################################################
+
+#include "TrainingSet.h"
+#include "CharPreprocess.h"
+#include "GlyphBatch.h"
+#include "GlyphSegmenter.h"
+#include "WorkStealingPool.h"
+
+#include<opencv2/highgui/highgui.hpp>
+#include<opencv2/imgproc/imgproc.hpp>
+
+#include<algorithm>
+#include<cctype>
+#include<fstream>
+#include<iostream>
+#include<sstream>
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// directory of a path with its trailing separator, empty for a bare file name
+static std::string directoryOf(const std::string& strPath) {
+    size_t pos = strPath.find_last_of("/\\");
+    return pos == std::string::npos ? std::string() : strPath.substr(0, pos + 1);
+}
+
+static bool isAbsolutePath(const std::string& strPath) {
+    return !strPath.empty() && (strPath[0] == '/' || strPath[0] == '\\' || (strPath.size() > 1 && strPath[1] == ':'));
+}
+
+bool readGroundTruth(const std::string& strPath, std::vector<TrainingImage>& vecImages) {
+
+    std::ifstream file(strPath);
+
+    // trap for error
+    if (!file.is_open()) {
+        std::cout << "error, unable to open ground truth file " << strPath << "\n\n";
+        return false;
+    }
+
+    std::string strDirectory = directoryOf(strPath);
+    std::string strLine;
+    int intLine = 0;
+
+    while (std::getline(file, strLine)) {
+        intLine++;
+
+        // files written on windows keep their carriage return
+        if (!strLine.empty() && strLine.back() == '\r') {
+            strLine.pop_back();
+        }
+
+        size_t begin = strLine.find_first_not_of(" \t");
+        if (begin == std::string::npos || strLine[begin] == '#') {
+            continue;
+        }
+
+        // the path ends at the first tab, or at the first space when there is no tab
+        size_t end = strLine.find('\t', begin);
+        if (end == std::string::npos) {
+            end = strLine.find(' ', begin);
+        }
+
+        TrainingImage trainingImage;
+        trainingImage.strPath = strLine.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+        if (!isAbsolutePath(trainingImage.strPath)) {
+            trainingImage.strPath = strDirectory + trainingImage.strPath;
+        }
+
+        if (end != std::string::npos) {
+            for (size_t i = end; i < strLine.size(); i++) {
+                if (!std::isspace((unsigned char)strLine[i])) {
+                    trainingImage.strChars.push_back(strLine[i]);
+                }
+            }
+        }
+
+        if (trainingImage.strChars.empty()) {
+            std::cout << "error, no chars for " << trainingImage.strPath << " on line " << intLine << " of " << strPath << "\n\n";
+            return false;
+        }
+
+        vecImages.push_back(trainingImage);
+    }
+
+    if (vecImages.empty()) {
+        std::cout << "error, no images in ground truth file " << strPath << "\n\n";
+        return false;
+    }
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+int cutTrainingGlyphs(WorkStealingPool& pool,
+    const std::vector<TrainingImage>& vecImages,
+    double dblMinArea,
+    std::vector<TrainingGlyph>& vecGlyphs) {
+
+    // every worker preprocesses and segments a whole image on its own thread, so its preprocessor and segmenter run
+    // without a pool; the pool is busy with the images and cannot be entered again
+    struct Worker {
+        CharPreprocessor charPreprocessor;
+        GlyphSegmenter glyphSegmenter;
+        ReadingOrder readingOrder;
+        cv::Mat matThresh;
+        std::vector<cv::Rect> vecRects;
+        std::vector<RecognizedChar> vecChars;
+        std::string strText;
+    };
+    std::vector<Worker> vecWorkers(pool.threads());
+
+    // results per image, joined in image order below so the model does not depend on the thread count
+    std::vector<std::vector<TrainingGlyph>> vecImageGlyphs(vecImages.size());
+    std::vector<std::string> vecMessages(vecImages.size());
+
+    pool.parallelFor(vecImages.size(), [&](size_t index, int intWorker) {
+        Worker& worker = vecWorkers[intWorker];
+        const TrainingImage& trainingImage = vecImages[index];
+
+        cv::Mat matImage = cv::imread(trainingImage.strPath);
+
+        // trap for missing source image file
+        if (matImage.empty()) {
+            vecMessages[index] = "error, image " + trainingImage.strPath + " not read, skipped";
+            return;
+        }
+
+        worker.charPreprocessor.process(matImage, worker.matThresh);
+        worker.glyphSegmenter.findRects(worker.matThresh, dblMinArea, worker.vecRects);
+
+        // the chars of the ground truth are in reading order, bring the glyphs into the same order
+        worker.vecChars.clear();
+        for (const cv::Rect& rect : worker.vecRects) {
+            RecognizedChar recognizedChar = { rect, ' ', 0.0f, 0.0f };
+            worker.vecChars.push_back(recognizedChar);
+        }
+        worker.readingOrder.sort(worker.vecChars, worker.strText);
+
+        // a glyph too many or too few shifts every label after it, so the whole image is left out
+        if (worker.vecChars.size() != trainingImage.strChars.size()) {
+            std::ostringstream message;
+            message << "error, image " << trainingImage.strPath << " has " << worker.vecChars.size() << " glyphs for "
+                    << trainingImage.strChars.size() << " chars, skipped";
+            vecMessages[index] = message.str();
+            return;
+        }
+
+        std::vector<TrainingGlyph>& vecImageGlyph = vecImageGlyphs[index];
+        vecImageGlyph.resize(worker.vecChars.size());
+
+        for (size_t i = 0; i < worker.vecChars.size(); i++) {
+            const cv::Rect& rect = worker.vecChars[i].rect;
+            TrainingGlyph& glyph = vecImageGlyph[i];
+
+            // only the pixels of the bounding rect, on a background margin
+            glyph.matCrop = cv::Mat::zeros(rect.height + 2 * TRAINING_CROP_MARGIN, rect.width + 2 * TRAINING_CROP_MARGIN, CV_8UC1);
+            glyph.rect = cv::Rect(TRAINING_CROP_MARGIN, TRAINING_CROP_MARGIN, rect.width, rect.height);
+            worker.matThresh(rect).copyTo(glyph.matCrop(glyph.rect));
+            glyph.intLabel = (unsigned char)trainingImage.strChars[i];
+        }
+    });
+
+    int intImages = 0;
+    for (size_t i = 0; i < vecImages.size(); i++) {
+        if (!vecMessages[i].empty()) {
+            std::cout << vecMessages[i] << "\n";
+            continue;
+        }
+
+        intImages++;
+        for (TrainingGlyph& glyph : vecImageGlyphs[i]) {
+            vecGlyphs.push_back(std::move(glyph));
+        }
+    }
+
+    return intImages;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void renderTrainingSample(const TrainingGlyph& glyph,
+    int intGlyph,
+    int intVariant,
+    const AugmentOptions& options,
+    const cv::Size& sampleSize,
+    AugmentScratch& scratch,
+    cv::Mat& matSample) {
+
+    // the plain sample, the same pixels the interactive CharTrain resizes
+    if (intVariant == 0) {
+        cv::resize(glyph.matCrop(glyph.rect), matSample, sampleSize);
+        return;
+    }
+
+    // one generator per sample, seeded by what the sample is rather than by the order it is rendered in
+    cv::RNG rng(options.seed ^ ((uint64_t)intGlyph * 0x9E3779B97F4A7C15ULL + (uint64_t)intVariant * 0xBF58476D1CE4E5B9ULL));
+
+    const cv::Mat* pSource = &glyph.matCrop;
+
+    // rotate about the center of the glyph and bring the interpolated edge back to black and white
+    if (options.dblMaxRotation > 0.0) {
+        double dblAngle = rng.uniform(-options.dblMaxRotation, options.dblMaxRotation);
+        cv::Point2f center(glyph.rect.x + glyph.rect.width * 0.5f, glyph.rect.y + glyph.rect.height * 0.5f);
+        cv::Mat matRotation = cv::getRotationMatrix2D(center, dblAngle, 1.0);
+        cv::warpAffine(glyph.matCrop, scratch.matRotated, matRotation, glyph.matCrop.size(), cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar(0));
+        cv::threshold(scratch.matRotated, scratch.matRotated, 127, 255, cv::THRESH_BINARY);
+        pSource = &scratch.matRotated;
+    }
+
+    // thinner or thicker stroke by one pixel
+    if (rng.uniform(0.0, 1.0) < options.dblStrokeChance) {
+        if (rng.uniform(0, 2) == 0) {
+            cv::erode(*pSource, scratch.matStroke, cv::Mat());
+        }
+        else {
+            cv::dilate(*pSource, scratch.matStroke, cv::Mat());
+        }
+        pSource = &scratch.matStroke;
+    }
+
+    // the glyph may have moved or grown, take its new bounding rect; a thin glyph eroded away falls back to the plain one
+    cv::Rect rect = cv::boundingRect(*pSource);
+    if (rect.area() == 0) {
+        pSource = &glyph.matCrop;
+        rect = glyph.rect;
+    }
+
+    // move every edge of the rect on its own, as a segmenter with a slightly different threshold would
+    if (options.intMaxShift > 0) {
+        int x0 = rect.x + rng.uniform(-options.intMaxShift, options.intMaxShift + 1);
+        int y0 = rect.y + rng.uniform(-options.intMaxShift, options.intMaxShift + 1);
+        int x1 = rect.x + rect.width + rng.uniform(-options.intMaxShift, options.intMaxShift + 1);
+        int y1 = rect.y + rect.height + rng.uniform(-options.intMaxShift, options.intMaxShift + 1);
+
+        x0 = std::max(x0, 0);
+        y0 = std::max(y0, 0);
+        x1 = std::min(x1, pSource->cols);
+        y1 = std::min(y1, pSource->rows);
+
+        if (x1 > x0 && y1 > y0) {
+            rect = cv::Rect(x0, y0, x1 - x0, y1 - y0);
+        }
+    }
+
+    cv::resize((*pSource)(rect), matSample, sampleSize);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool writeTrainingModel(WorkStealingPool& pool,
+    const std::vector<TrainingGlyph>& vecGlyphs,
+    const AugmentOptions& options,
+    const cv::Size& sampleSize,
+    FeatureDescriptor descriptor,
+    const std::string& strModel,
+    TrainingStats& stats) {
+
+    int intPerGlyph = 1 + std::max(options.intVariants, 0);
+    int intSamples = (int)vecGlyphs.size() * intPerGlyph;
+
+    // trap for an empty training set
+    if (intSamples == 0) {
+        std::cout << "error, no training glyphs, model not written\n\n";
+        return false;
+    }
+
+    int64_t t0 = cv::getTickCount();
+
+    // the labels go first in the file, and the label of every sample is known before any of them is rendered
+    cv::Mat matLabels(intSamples, 1, CV_32S);
+    for (int i = 0; i < intSamples; i++) {
+        matLabels.at<int32_t>(i, 0) = vecGlyphs[i / intPerGlyph].intLabel;
+    }
+
+    // one extractor per worker, it keeps scratch between rows
+    std::vector<FeatureExtractor> vecExtractors(pool.threads(), FeatureExtractor(descriptor, sampleSize.width, sampleSize.height));
+    int intCols = vecExtractors[0].cols();
+
+    ModelFileWriter writer;
+    if (!writer.open(strModel, matLabels, intCols, MODEL_FEATURE_U8, sampleSize.width, sampleSize.height, descriptor)) {
+        return false;
+    }
+
+    std::vector<AugmentScratch> vecScratch(pool.threads());
+    cv::Mat matBlock(std::min(intSamples, TRAINING_BLOCK_SAMPLES), intCols, CV_8UC1);
+
+    for (int intBegin = 0; intBegin < intSamples; intBegin += matBlock.rows) {
+        int intCount = std::min(matBlock.rows, intSamples - intBegin);
+
+        // every sample is resized straight into its row of the block, viewed as a height x width image, or into the
+        // scratch of the worker when its descriptor goes into the row
+        pool.parallelFor((size_t)intCount, [&](size_t index, int intWorker) {
+            int intSample = intBegin + (int)index;
+            AugmentScratch& scratch = vecScratch[intWorker];
+            FeatureExtractor& featureExtractor = vecExtractors[intWorker];
+
+            if (featureExtractor.isPixels()) {
+                cv::Mat matSample = matBlock.row((int)index).reshape(1, sampleSize.height);
+                renderTrainingSample(vecGlyphs[intSample / intPerGlyph], intSample / intPerGlyph, intSample % intPerGlyph,
+                    options, sampleSize, scratch, matSample);
+            }
+            else {
+                scratch.matSample.create(sampleSize, CV_8UC1);
+                renderTrainingSample(vecGlyphs[intSample / intPerGlyph], intSample / intPerGlyph, intSample % intPerGlyph,
+                    options, sampleSize, scratch, scratch.matSample);
+                featureExtractor.extractRow(scratch.matSample.data, matBlock.ptr<uint8_t>((int)index));
+            }
+        });
+
+        if (!writer.append(matBlock.rowRange(0, intCount))) {
+            return false;
+        }
+    }
+
+    if (!writer.close()) {
+        return false;
+    }
+
+    stats.intGlyphs = (int)vecGlyphs.size();
+    stats.intSamples = intSamples;
+    stats.dblWriteMs = (cv::getTickCount() - t0) / (cv::getTickFrequency() / 1000.0);
+    return true;
+}
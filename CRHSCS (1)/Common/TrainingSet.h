@@ -0,0 +1,106 @@
+// ###########################################################################################################################
+// TrainingSet.h :
+//
+// Description: Headless training for CharTrain. The labels come from a ground truth file or from the known order of the
+//              chars on a training image instead of a key press per glyph: the glyphs of every image are cut in
+//              reading order on the worker threads of a pool and matched one to one with the chars of its line in the
+//              ground truth file, an image whose glyph count differs is reported and skipped.
+//
+//              Every glyph gives one plain sample, resized like the interactive CharTrain does, and optionally a
+//              number of augmented ones: rotated, thinner or thicker strokes and the bounding rect shifted edge by
+//              edge. The samples are rendered on the workers in blocks and every block is appended to the model file
+//              as soon as it is done, so the whole set is never held in memory.
+//
+//              ground truth file, one image per line, # starts a comment:
+//
+//                  PATH<tab or space>CHARS         relative paths are taken from the directory of the ground truth
+//                                                  file, the white space inside CHARS is ignored
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include "ModelFile.h"
+
+#include<opencv2/core/core.hpp>
+
+#include<cstdint>
+#include<string>
+#include<vector>
+
+class WorkStealingPool;
+
+// training set constants /////////////////////////////////////////////////////////////////////////
+const int TRAINING_CROP_MARGIN = 8;                 // pixels kept around a glyph for the rotations and shifts
+const int TRAINING_BLOCK_SAMPLES = 4096;            // samples rendered before they are appended to the model file
+
+// one training image and the chars on it in reading order
+struct TrainingImage {
+    std::string strPath;
+    std::string strChars;
+};
+
+// one labeled glyph: the threshold pixels of its bounding rect with TRAINING_CROP_MARGIN background pixels around
+// them, so a rotated or shifted sample never takes in a piece of a neighbouring glyph
+struct TrainingGlyph {
+    cv::Mat matCrop;
+    cv::Rect rect;
+    int intLabel;
+};
+
+// augmented samples per glyph and how far they may depart from it
+struct AugmentOptions {
+    int intVariants = 0;                            // augmented samples per glyph besides the plain one
+    int intMaxShift = 2;                            // pixels every edge of the bounding rect moves at most
+    double dblMaxRotation = 8.0;                    // degrees either way
+    double dblStrokeChance = 0.5;                   // chance of a thinner or thicker stroke, 3x3 erode or dilate
+    uint64_t seed = 0x12345;                        // the same seed renders the same samples on any thread count
+};
+
+// what a training run did, for the report
+struct TrainingStats {
+    int intImages = 0;
+    int intSkippedImages = 0;
+    int intGlyphs = 0;
+    int intSamples = 0;
+    double dblCutMs = 0.0;                          // reading, preprocessing and segmenting the images
+    double dblWriteMs = 0.0;                        // rendering the samples and writing the model file
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// read a ground truth file, prints the reason and returns false on any error
+bool readGroundTruth(const std::string& strPath, std::vector<TrainingImage>& vecImages);
+
+// cut the glyphs of every image on the pool, in image order and reading order within an image; glyphs smaller than
+// dblMinArea are noise like in CharTrain. returns the images used
+int cutTrainingGlyphs(WorkStealingPool& pool,
+    const std::vector<TrainingImage>& vecImages,
+    double dblMinArea,
+    std::vector<TrainingGlyph>& vecGlyphs);
+
+// scratch images of one worker, kept between samples
+struct AugmentScratch {
+    cv::Mat matRotated;
+    cv::Mat matStroke;
+    cv::Mat matSample;                              // the resized sample when the model rows are descriptors
+};
+
+// sample intVariant of a glyph into matSample (height x width, 8 bit, may be a view of a model row), variant 0 is the
+// plain one; the augmentation is drawn from the seed, the glyph and the variant, never from the thread that renders it
+void renderTrainingSample(const TrainingGlyph& glyph,
+    int intGlyph,
+    int intVariant,
+    const AugmentOptions& options,
+    const cv::Size& sampleSize,
+    AugmentScratch& scratch,
+    cv::Mat& matSample);
+
+// render the plain and augmented samples of every glyph on the pool and write them to the model file block by block,
+// as rows of the given descriptor
+bool writeTrainingModel(WorkStealingPool& pool,
+    const std::vector<TrainingGlyph>& vecGlyphs,
+    const AugmentOptions& options,
+    const cv::Size& sampleSize,
+    FeatureDescriptor descriptor,
+    const std::string& strModel,
+    TrainingStats& stats);
@@ -0,0 +1,125 @@
+// ###########################################################################################################################
+// WorkStealingPool.cpp :
+//
+// Description: Worker threads with per worker index ranges and stealing, see WorkStealingPool.h
+//
+// ###########################################################################################################################
+
+#include "WorkStealingPool.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+int WorkStealingPool::hardwareThreads() {
+    unsigned int intThreads = std::thread::hardware_concurrency();
+    return intThreads > 0 ? (int)intThreads : 1;
+}
+
+WorkStealingPool::WorkStealingPool(int intThreads)
+    : generation(0), blnShutdown(false), fnJob(nullptr), pJobContext(nullptr), intBusyWorkers(0), intSteals(0) {
+
+    if (intThreads <= 0) {
+        intThreads = hardwareThreads();
+    }
+
+    arrRanges.reset(new WorkerRange[intThreads]);
+    for (int i = 0; i < intThreads; i++) {
+        arrRanges[i].next = 0;
+        arrRanges[i].end = 0;
+    }
+    for (int i = 0; i < intThreads; i++) {
+        vecThreads.emplace_back(&WorkStealingPool::workerLoop, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutexWake);
+        blnShutdown = true;
+    }
+    cvWake.notify_all();
+
+    for (std::thread& thread : vecThreads) {
+        thread.join();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void WorkStealingPool::run(size_t count, JobFn fnRun, const void* pContext) {
+
+    if (count == 0) {
+        return;
+    }
+
+    // all workers are idle between two calls, they see the job and the ranges once they take mutexWake below
+    fnJob = fnRun;
+    pJobContext = pContext;
+
+    // neighbouring indices stay on one worker as long as nobody has to steal them
+    size_t intWorkers = vecThreads.size();
+    for (size_t w = 0; w < intWorkers; w++) {
+        arrRanges[w].next = count * w / intWorkers;
+        arrRanges[w].end = count * (w + 1) / intWorkers;
+    }
+
+    // done once every worker ran out of indices, by then every index it took has finished; a worker still looking
+    // at the ranges would race with the ranges of the next call
+    std::unique_lock<std::mutex> lock(mutexWake);
+    intBusyWorkers = intWorkers;
+    generation++;
+    cvWake.notify_all();
+    cvDone.wait(lock, [this] { return intBusyWorkers == 0; });
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// owner and thieves take indices from the same cursor, so every index is handed out exactly once; a cursor past the
+// end of its range just means the range is used up
+bool WorkStealingPool::takeJob(int intWorker, size_t& index) {
+
+    WorkerRange& own = arrRanges[intWorker];
+    if (own.next.load(std::memory_order_relaxed) < own.end) {
+        index = own.next.fetch_add(1);
+        if (index < own.end) {
+            return true;
+        }
+    }
+
+    size_t intWorkers = vecThreads.size();
+    for (size_t i = 1; i < intWorkers; i++) {
+        WorkerRange& victim = arrRanges[(intWorker + i) % intWorkers];
+        if (victim.next.load(std::memory_order_relaxed) < victim.end) {
+            index = victim.next.fetch_add(1);
+            if (index < victim.end) {
+                intSteals++;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void WorkStealingPool::workerLoop(int intWorker) {
+
+    uint64_t seenGeneration = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutexWake);
+            cvWake.wait(lock, [&] { return blnShutdown || generation != seenGeneration; });
+            if (blnShutdown) {
+                return;
+            }
+            seenGeneration = generation;
+        }
+
+        size_t index;
+        while (takeJob(intWorker, index)) {
+            fnJob(pJobContext, index, intWorker);
+        }
+
+        // the last worker wakes parallelFor
+        std::lock_guard<std::mutex> lock(mutexWake);
+        if (--intBusyWorkers == 0) {
+            cvDone.notify_all();
+        }
+    }
+}
@@ -0,0 +1,85 @@
+// ###########################################################################################################################
+// WorkStealingPool.h :
+//
+// Description: Fixed set of worker threads for independent jobs of uneven size (images, video segments, faces). Every
+//              parallelFor splits its indices into one contiguous range per worker, and each worker takes the indices
+//              of its own range through an atomic cursor; a worker that runs dry takes indices from the cursor of
+//              another worker's range, so a few slow jobs do not leave the other cores idle.
+//
+//              Jobs get the index of the worker running them, so callers can keep per worker state (classifiers,
+//              scratch images) in a vector indexed by worker and never share it between threads.
+//
+//              The pool holds the job by reference and hands out indices without queues, so a parallelFor does not
+//              allocate; the per frame preprocessing and segmentation call it for every frame.
+//
+// ###########################################################################################################################
+
+#pragma once
+
+#include<atomic>
+#include<condition_variable>
+#include<cstddef>
+#include<cstdint>
+#include<memory>
+#include<mutex>
+#include<thread>
+#include<vector>
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class WorkStealingPool {
+public:
+    // intThreads of 0 uses one worker per hardware thread
+    explicit WorkStealingPool(int intThreads = 0);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    int threads() const { return (int)vecThreads.size(); }
+
+    // run job(index, worker) for every index in [0, count) and return when all of them finished
+    // the indices start out split into contiguous blocks, one per worker; not reentrant
+    // job is any callable taking (size_t, int), it is called through a reference and never copied
+    template<typename Job>
+    void parallelFor(size_t count, const Job& job) {
+        run(count, &invokeJob<Job>, &job);
+    }
+
+    // indices taken from another worker's range since the pool was created
+    uint64_t steals() const { return intSteals; }
+
+    static int hardwareThreads();
+
+private:
+    typedef void (*JobFn)(const void* pContext, size_t index, int intWorker);
+
+    template<typename Job>
+    static void invokeJob(const void* pContext, size_t index, int intWorker) {
+        (*static_cast<const Job*>(pContext))(index, intWorker);
+    }
+
+    // the range of one worker, padded to a cache line so the cursors of two workers do not share one
+    struct WorkerRange {
+        std::atomic<size_t> next;
+        size_t end;
+        char arrPadding[64 - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+    };
+
+    void run(size_t count, JobFn fnJob, const void* pContext);
+    void workerLoop(int intWorker);
+    bool takeJob(int intWorker, size_t& index);
+
+    std::unique_ptr<WorkerRange[]> arrRanges;
+    std::vector<std::thread> vecThreads;
+
+    std::mutex mutexWake;                           // guards generation, blnShutdown and intBusyWorkers
+    std::condition_variable cvWake;                 // workers wait here for the next parallelFor
+    std::condition_variable cvDone;                 // parallelFor waits here for the last worker
+    uint64_t generation;
+    bool blnShutdown;
+
+    JobFn fnJob;
+    const void* pJobContext;
+    size_t intBusyWorkers;                          // workers still taking indices of the current parallelFor
+    std::atomic<uint64_t> intSteals;
+};
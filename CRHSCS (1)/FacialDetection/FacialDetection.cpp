@@ -5,123 +5,986 @@
 // Date:    3 / 1 / 2023
 // 
 // Description: This program detects facial features (face and eye) from webcam feed utilizing pre-trained Haar-Cascade files
+//              The webcam is read on its own thread and detection on another, so the feed is shown at the rate of the
+//              camera and detection always works on the newest frame, see FrameRing
+//              --pack-cascades converts the cascades once into cascades.pack, which is mapped and loaded from then on,
+//              see CascadePack.h
 // 
 // ########################################################################################################################### 
 
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 
 #include "opencv2/objdetect.hpp"
 #include "opencv2/highgui.hpp"
 #include "opencv2/imgproc.hpp"
 #include "opencv2/video/background_segm.hpp"
 
+#include "../Common/BatchRunner.h"
+#include "../Common/CascadePack.h"
+#include "../Common/FaceDetector.h"
+#include "../Common/FaceTracker.h"
+#include "../Common/FrameRing.h"
+#include "../Common/FrameSource.h"
+#include "../Common/JsonLines.h"
+#include "../Common/Metrics.h"
+#include "../Common/ProcessMemory.h"
+
 using namespace std;
 using namespace cv;
 
 
-int main(int argc, char** argv)
+// global variables ///////////////////////////////////////////////////////////////////////////////
+const uint64_t DEFAULT_SEGMENT_FRAMES = 300;		// video frames per batch item, see --segment-frames
+const int DEFAULT_DETECT_INTERVAL = 10;				// frames between full detections with --track
+const double BENCHMARK_MATCH_OVERLAP = 0.5;			// overlap a tracked face needs with a detected one to count as found
+const int FACE_BENCHMARK_REPEATS = 5;				// detections averaged per face count by --bench-faces
+const double FACE_BENCHMARK_MARGIN = 0.25;			// context kept around the face pasted into the --bench-faces frames
+const double DEFAULT_METRICS_INTERVAL = 10.0;		// seconds between two writes of --metrics
+const int CASCADE_BENCHMARK_RUNS = 5;				// loads of every cascade averaged by --bench-cascades
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// faces and ids of the tracked faces, in the form the output functions take
+void splitTrackedFaces(const std::vector<TrackedFace>& trackedFaces, std::vector<DetectedFace>& detectedFaces, std::vector<int>& vecIds)
 {
-	CascadeClassifier face_cascade, eyes_cascade, mouth_cascade, nose_cascade, ears_cascade;
-	String face_cascade_name = "haarcascade_frontalface_alt.xml";
-	String eyes_cascade_name = "haarcascade_eye_tree_eyeglasses.xml";
-	String mouth_cascade_name = "haarcascade_mcs_mouth.xml";
-	String nose_cascade_name = "haarcascade_mcs_nose.xml";
-	std::vector<Rect> faces;
-	cv::Mat frame;
-	cv::Mat frame_gray;
+	detectedFaces.resize(trackedFaces.size());
+	vecIds.resize(trackedFaces.size());
+	for (size_t i = 0; i < trackedFaces.size(); i++)
+	{
+		detectedFaces[i] = trackedFaces[i].detected;
+		vecIds[i] = trackedFaces[i].intId;
+	}
+}
+
+// draw a rectangle for every face, a circle for every eye, rectangles for mouths and noses, and the face ids when there are any
+void drawFaces(Mat& frame, const std::vector<DetectedFace>& detectedFaces, const std::vector<int>& vecIds)
+{
+	for (size_t i = 0; i < detectedFaces.size(); i++)
+	{
+		const Rect& face = detectedFaces[i].face;
 
-	// Open the default camera
-	cv::VideoCapture cap(0);
+		//	Point center(face.x + face.width / 2, face.y + face.height / 2);
+		//	ellipse(frame, center, Size(face.width / 2, face.height / 2), 0, 0, 360, Scalar(255, 0, 255), 4, 8, 0);
 
-	// trap for stream errors
-	if (!cap.isOpened())
+		// draw a rectangle for a detected face
+		Point pt1(face.x, face.y);
+		Point pt2(face.x + face.width, face.y + face.height);
+		rectangle(frame, pt1, pt2, Scalar(255, 0, 255), 4, 8, 0);
+
+		if (i < vecIds.size())
+		{
+			putText(frame, std::to_string(vecIds[i]), Point(face.x, face.y - 8), FONT_HERSHEY_SIMPLEX, 1.0, Scalar(255, 0, 255), 2);
+		}
+
+		for (const Rect& eye : detectedFaces[i].eyes)
+		{
+			Point eye_center(eye.x + eye.width / 2, eye.y + eye.height / 2);
+			int radius = cvRound((eye.width + eye.height) * 0.25);
+			circle(frame, eye_center, radius, Scalar(255, 0, 0), 4, 8, 0);
+		}
+
+		for (const Rect& mouth : detectedFaces[i].mouths)
+		{
+			rectangle(frame, mouth, Scalar(0, 255, 0), 2, 8, 0);
+		}
+
+		for (const Rect& nose : detectedFaces[i].noses)
+		{
+			rectangle(frame, nose, Scalar(0, 255, 255), 2, 8, 0);
+		}
+	}
+}
+
+// boxes as an array of x, y, w, h objects
+void addRects(JsonLine& jsonLine, const char* pKey, const std::vector<Rect>& rects)
+{
+	jsonLine.beginArray(pKey);
+	for (const Rect& rect : rects)
+	{
+		jsonLine.beginObject().addRect(rect).endObject();
+	}
+	jsonLine.endArray();
+}
+
+// one JSON line with the faces and features of a frame, with the face ids when there are any
+// mouths and noses are only written when they were searched and found
+JsonLine faceResultJson(const std::string& strSource, uint64_t frameIndex, const std::string& strName, const Size& size,
+						double dblMs, const std::vector<DetectedFace>& detectedFaces, const std::vector<int>& vecIds)
+{
+	JsonLine jsonLine;
+	jsonLine.add("source", strSource)
+		.add("frame", (unsigned long long)frameIndex)
+		.add("name", strName)
+		.add("width", size.width)
+		.add("height", size.height)
+		.add("ms", dblMs);
+
+	jsonLine.beginArray("faces");
+	for (size_t i = 0; i < detectedFaces.size(); i++)
+	{
+		const DetectedFace& detectedFace = detectedFaces[i];
+		jsonLine.beginObject();
+		if (i < vecIds.size())
+		{
+			jsonLine.add("id", vecIds[i]);
+		}
+		jsonLine.addRect(detectedFace.face);
+		addRects(jsonLine, "eyes", detectedFace.eyes);
+		if (!detectedFace.mouths.empty())
+		{
+			addRects(jsonLine, "mouths", detectedFace.mouths);
+		}
+		if (!detectedFace.noses.empty())
+		{
+			addRects(jsonLine, "noses", detectedFace.noses);
+		}
+		jsonLine.endObject();
+	}
+	jsonLine.endArray();
+
+	return jsonLine;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// detect faces in all images and videos of the inputs on a work stealing pool, the JSON lines come out in input
+// order whatever the number of threads; with blnScaling the batch is timed for 1 .. intThreads threads instead
+int runBatchMode(const std::vector<std::string>& vecInputs, const FaceDetectOptions& detectOptions, const std::string& strOutput,
+				 int intThreads, uint64_t segmentFrames, bool blnScaling, bool blnStageTimes)
+{
+	std::vector<BatchItem> vecItems;
+	if (!planBatch(vecInputs, segmentFrames, vecItems))
 	{
-		std::cerr << "Unable to open the camera\n";
 		return -1;
 	}
 
+	if (intThreads <= 0)
+	{
+		intThreads = WorkStealingPool::hardwareThreads();
+	}
 
-	// Load the cascades
-	if (!face_cascade.load(face_cascade_name))
+	// one detector (cascades and scratch images) per worker
+	std::vector<std::unique_ptr<FaceDetector>> vecDetectors;
+	for (int i = 0; i < intThreads; i++)
 	{
-		std::cout << "Error loading face cascade\n";
-		return 0;
+		vecDetectors.emplace_back(new FaceDetector(detectOptions));
+		if (!vecDetectors.back()->load())
+		{
+			return 0;
+		}
 	}
 
-	if (!eyes_cascade.load(eyes_cascade_name))
+	double dblTicksPerMs = cv::getTickFrequency() / 1000.0;
+
+	BatchProcessFn fnProcess = [&](const BatchItem& item, int intWorker, std::vector<std::string>& vecLines) -> uint64_t
 	{
-		std::cout << "Error loading eyes cascade\n";
+		FrameSource frameSource;
+		if (!openBatchItem(item, frameSource))
+		{
+			return 0;
+		}
+
+		FaceDetector& faceDetector = *vecDetectors[intWorker];
+		Mat frame;
+		Mat frame_gray;
+		std::vector<DetectedFace> detectedFaces;
+		uint64_t frames = 0;
+
+		while ((item.frameCount == 0 || frames < item.frameCount) && frameSource.read(frame))
+		{
+			int64_t t0 = cv::getTickCount();
+			faceDetector.detect(frame, frame_gray, detectedFaces);
+			double dblMs = (cv::getTickCount() - t0) / dblTicksPerMs;
+
+			vecLines.push_back(faceResultJson(item.strSpec, frameSource.frameIndex(), frameSource.frameName(),
+											  frame.size(), dblMs, detectedFaces, std::vector<int>()).str());
+			frames++;
+		}
+		return frames;
+	};
+
+	if (blnScaling)
+	{
+		reportBatchScaling(vecItems, intThreads, fnProcess);
 		return 0;
 	}
 
-	if (!mouth_cascade.load(mouth_cascade_name))
+	ResultWriter resultWriter;
+	if (!resultWriter.open(strOutput))
+	{
+		return -1;
+	}
+
+	WorkStealingPool pool(intThreads);
+	BatchResult batchResult = runBatch(pool, vecItems, fnProcess, &resultWriter);
+
+	// summary on stderr so it never mixes with the JSON lines on stdout
+	std::cerr << "batch of " << vecItems.size() << " items, " << batchResult.frames << " frames in " << batchResult.dblSeconds
+		<< " s (" << (batchResult.dblSeconds > 0 ? batchResult.frames / batchResult.dblSeconds : 0.0) << " fps) on "
+		<< intThreads << " threads, " << batchResult.steals << " items stolen\n";
+
+	if (blnStageTimes)
+	{
+		FaceStageTimes stageTimes;
+		for (const std::unique_ptr<FaceDetector>& pDetector : vecDetectors)
+		{
+			stageTimes.merge(pDetector->times());
+		}
+		stageTimes.report(std::cerr, "stages (summed over workers)");
+	}
+
+	return 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// decode a recorded clip up front, so the benchmarks time only the detection work
+bool readClip(const std::string& strInput, uint64_t maxFrames, std::vector<Mat>& vecFrames)
+{
+	FrameSource cap;
+	if (!cap.open(strInput))
+	{
+		return false;
+	}
+	if (cap.isLive())
+	{
+		std::cerr << "error, the benchmarks need a recorded clip, not a camera\n";
+		return false;
+	}
+
+	Mat frame;
+	while ((maxFrames == 0 || vecFrames.size() < maxFrames) && cap.read(frame))
+	{
+		vecFrames.push_back(frame.clone());
+	}
+	if (vecFrames.empty())
+	{
+		std::cerr << "error, no frames in " << strInput << "\n";
+		return false;
+	}
+	return true;
+}
+
+// how many reference boxes have a box of the same frame overlapping them enough, each box counts once
+size_t countMatchedFaces(const std::vector<std::vector<Rect>>& vecReference, const std::vector<std::vector<Rect>>& vecFound)
+{
+	size_t intMatched = 0;
+	for (size_t f = 0; f < vecReference.size() && f < vecFound.size(); f++)
+	{
+		std::vector<char> vecUsed(vecFound[f].size(), 0);
+		for (const Rect& face : vecReference[f])
+		{
+			for (size_t t = 0; t < vecFound[f].size(); t++)
+			{
+				if (!vecUsed[t] && FaceTracker::overlap(face, vecFound[f][t]) >= BENCHMARK_MATCH_OVERLAP)
+				{
+					vecUsed[t] = 1;
+					intMatched++;
+					break;
+				}
+			}
+		}
+	}
+	return intMatched;
+}
+
+// face boxes of every frame with full detection, and the number of faces, eyes, mouths and noses found
+void detectClip(FaceDetector& faceDetector, const std::vector<Mat>& vecFrames, std::vector<std::vector<Rect>>& vecFaces, size_t arrCounts[4])
+{
+	Mat frame_gray;
+	std::vector<DetectedFace> detectedFaces;
+
+	vecFaces.assign(vecFrames.size(), std::vector<Rect>());
+	for (int i = 0; i < 4; i++)
+	{
+		arrCounts[i] = 0;
+	}
+
+	for (size_t f = 0; f < vecFrames.size(); f++)
+	{
+		faceDetector.detect(vecFrames[f], frame_gray, detectedFaces);
+		for (const DetectedFace& detectedFace : detectedFaces)
+		{
+			vecFaces[f].push_back(detectedFace.face);
+			arrCounts[1] += detectedFace.eyes.size();
+			arrCounts[2] += detectedFace.mouths.size();
+			arrCounts[3] += detectedFace.noses.size();
+		}
+		arrCounts[0] += detectedFaces.size();
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// run a recorded clip with the original full resolution face and eye detection and with the configured pipeline,
+// and compare the time of every stage and how many of the original faces the configured pipeline still finds
+int runPipelineBenchmark(const std::string& strInput, const FaceDetectOptions& detectOptions, uint64_t maxFrames)
+{
+	std::vector<Mat> vecFrames;
+	if (!readClip(strInput, maxFrames, vecFrames))
+	{
+		return -1;
+	}
+
+	FaceDetector baselineDetector;
+	FaceDetector faceDetector(detectOptions);
+	if (!baselineDetector.load() || !faceDetector.load() || !baselineDetector.preload() || !faceDetector.preload())
 	{
-		std::cout << "Error loading mouth cascade\n";
 		return 0;
 	}
 
-	if (!nose_cascade.load(nose_cascade_name))
+	std::vector<std::vector<Rect>> vecBaseline;
+	std::vector<std::vector<Rect>> vecFaces;
+	size_t arrBaselineCounts[4];
+	size_t arrCounts[4];
+
+	detectClip(baselineDetector, vecFrames, vecBaseline, arrBaselineCounts);
+	detectClip(faceDetector, vecFrames, vecFaces, arrCounts);
+
+	size_t intMatched = countMatchedFaces(vecBaseline, vecFaces);
+	double dblBaselineMs = baselineDetector.times().totalMs() / vecFrames.size();
+	double dblMs = faceDetector.times().totalMs() / vecFrames.size();
+
+	std::cout << "pipeline benchmark, " << vecFrames.size() << " frames, detect scale " << detectOptions.dblDetectScale
+		<< ", feature width " << detectOptions.intFeatureWidth << (detectOptions.blnEyesUpperHalf ? ", eyes in upper half" : "")
+		<< (detectOptions.blnMouth ? ", mouth" : "") << (detectOptions.blnNose ? ", nose" : "") << "\n";
+	baselineDetector.times().report(std::cout, "  original  ");
+	faceDetector.times().report(std::cout, "  configured");
+	std::cout << "  original:   " << arrBaselineCounts[0] << " faces, " << arrBaselineCounts[1] << " eyes\n";
+	std::cout << "  configured: " << arrCounts[0] << " faces, " << arrCounts[1] << " eyes, "
+		<< arrCounts[2] << " mouths, " << arrCounts[3] << " noses\n";
+	std::cout << "  speedup " << (dblMs > 0 ? dblBaselineMs / dblMs : 0.0)
+		<< ", face recall " << (arrBaselineCounts[0] ? (double)intMatched / arrBaselineCounts[0] : 1.0)
+		<< ", face precision " << (arrCounts[0] ? (double)intMatched / arrCounts[0] : 1.0) << "\n";
+
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// time the detection of frames holding 1, 2, 4 .. 16 copies of the first face of the input, with the features of
+// the faces searched one after the other and in parallel on intFaceThreads threads
+int runFaceCountBenchmark(const std::string& strInput, const FaceDetectOptions& detectOptions, int intFaceThreads)
+{
+	std::vector<Mat> vecFrames;
+	if (!readClip(strInput, 1, vecFrames))
+	{
+		return -1;
+	}
+
+	FaceDetector serialDetector(detectOptions);
+	FaceDetector parallelDetector(detectOptions);
+	WorkStealingPool pool(intFaceThreads);
+	if (!serialDetector.load() || !parallelDetector.load() || !parallelDetector.setFeaturePool(&pool)
+		|| !serialDetector.preload() || !parallelDetector.preload())
 	{
-		std::cout << "Error loading nose cascade\n";
 		return 0;
 	}
 
-	// Capture frames continuously and display them in the window
-	while (true)
+	Mat frame_gray;
+	std::vector<DetectedFace> detectedFaces;
+	serialDetector.detect(vecFrames[0], frame_gray, detectedFaces);
+	if (detectedFaces.empty())
 	{
-		cap >> frame;
+		std::cerr << "error, no face found in the first frame of " << strInput << "\n";
+		return -1;
+	}
+
+	// the face with some context around it, so it is found again in the benchmark frames
+	Rect face = detectedFaces[0].face;
+	int intMarginX = cvRound(face.width * FACE_BENCHMARK_MARGIN);
+	int intMarginY = cvRound(face.height * FACE_BENCHMARK_MARGIN);
+	Rect crop = Rect(face.x - intMarginX, face.y - intMarginY, face.width + 2 * intMarginX, face.height + 2 * intMarginY)
+		& Rect(0, 0, vecFrames[0].cols, vecFrames[0].rows);
+	Mat matCrop = vecFrames[0](crop);
 
-		// Check if the frame is empty
-		if (frame.empty())
+	std::cout << "face count benchmark, " << pool.threads() << " feature threads, ms per frame\n";
+	std::cout << "  faces  found  serial total  serial features  parallel total  parallel features\n";
+
+	for (int intFaces = 1; intFaces <= 16; intFaces *= 2)
+	{
+		// the copies of the face on a grid
+		int intCols = (int)std::ceil(std::sqrt((double)intFaces));
+		int intRows = (intFaces + intCols - 1) / intCols;
+		Mat canvas(intRows * crop.height, intCols * crop.width, CV_8UC3, Scalar(128, 128, 128));
+		for (int k = 0; k < intFaces; k++)
 		{
-			std::cerr << "Unable to capture frame\n";
-			break;
+			matCrop.copyTo(canvas(Rect((k % intCols) * crop.width, (k / intCols) * crop.height, crop.width, crop.height)));
 		}
 
-		// Display the webcam feed
-		cv::imshow("Webcam Source Feed", frame);
+		FaceDetector* arrDetectors[2] = { &serialDetector, &parallelDetector };
+		double arrTotalMs[2];
+		double arrFeatureMs[2];
+		size_t intFound = 0;
+
+		for (int d = 0; d < 2; d++)
+		{
+			arrDetectors[d]->times().clear();
+			for (int r = 0; r < FACE_BENCHMARK_REPEATS; r++)
+			{
+				arrDetectors[d]->detect(canvas, frame_gray, detectedFaces);
+			}
+			const FaceStageTimes& stageTimes = arrDetectors[d]->times();
+			arrTotalMs[d] = stageTimes.totalMs() / FACE_BENCHMARK_REPEATS;
+			arrFeatureMs[d] = stageTimes.featureWallTicks * 1000.0 / cv::getTickFrequency() / FACE_BENCHMARK_REPEATS;
+			intFound = detectedFaces.size();
+		}
+
+		std::cout << "  " << intFaces << "  " << intFound << "  " << arrTotalMs[0] << "  " << arrFeatureMs[0]
+			<< "  " << arrTotalMs[1] << "  " << arrFeatureMs[1] << "\n";
+	}
+
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// time every cascade loaded from its XML file and from the cascade pack, then the start of a detector with eyes,
+// mouth and nose and intFaceThreads feature threads: every cascade parsed up front from the XML files, as before the
+// pack, against the pack with the feature cascades left for the first face; with the resident memory each start added
+int runCascadeBenchmark(int intFaceThreads)
+{
+	const CascadePack* pPack = sharedCascadePack();
+	if (pPack == nullptr)
+	{
+		std::cerr << "error, --bench-cascades needs " << CASCADE_PACK_NAME << ", write it with --pack-cascades\n";
+		return -1;
+	}
+
+	double dblTicksPerMs = cv::getTickFrequency() / 1000.0;
+	const double dblBytesPerMb = 1024.0 * 1024.0;
+
+	std::cout << "cascade load benchmark, ms per load over " << CASCADE_BENCHMARK_RUNS << " loads, " << pPack->bytes() << " byte pack\n";
+	std::cout << "  cascade  xml  pack\n";
+
+	const std::string arrNames[4] = { FACE_CASCADE_NAME, EYES_CASCADE_NAME, MOUTH_CASCADE_NAME, NOSE_CASCADE_NAME };
+	for (const std::string& strName : arrNames)
+	{
+		double arrMs[2];
+		for (int p = 0; p < 2; p++)
+		{
+			int64_t t0 = cv::getTickCount();
+			for (int r = 0; r < CASCADE_BENCHMARK_RUNS; r++)
+			{
+				CascadeClassifier cascade;
+				if (!loadCascade(strName, cascade, p == 0 ? nullptr : pPack))
+				{
+					std::cerr << "error, unable to load " << strName << "\n";
+					return -1;
+				}
+			}
+			arrMs[p] = (cv::getTickCount() - t0) / dblTicksPerMs / CASCADE_BENCHMARK_RUNS;
+		}
+		std::cout << "  " << strName << "  " << arrMs[0] << "  " << arrMs[1] << "\n";
+	}
+
+	// the pack starts first, so the XML start can only be helped by memory the pack start freed
+	FaceDetectOptions detectOptions;
+	detectOptions.blnMouth = true;
+	detectOptions.blnNose = true;
+	WorkStealingPool pool(intFaceThreads);
+	std::unique_ptr<FaceDetector> arrDetectors[2];
+	const char* arrLabels[2] = { "pack, features at the first face", "xml, every cascade up front" };
+
+	std::cout << "detector start with eyes, mouth and nose, " << pool.threads() << " feature threads\n";
+	for (int p = 0; p < 2; p++)
+	{
+		detectOptions.blnCascadePack = p == 0;
+		uint64_t residentBefore = residentBytes();
+		int64_t t0 = cv::getTickCount();
+
+		arrDetectors[p].reset(new FaceDetector(detectOptions));
+		if (!arrDetectors[p]->load() || !arrDetectors[p]->setFeaturePool(&pool) || (p == 1 && !arrDetectors[p]->preload()))
+		{
+			return -1;
+		}
+
+		double dblMs = (cv::getTickCount() - t0) / dblTicksPerMs;
+		double dblMb = ((double)residentBytes() - (double)residentBefore) / dblBytesPerMb;
+		std::cout << "  " << arrLabels[p] << "  " << dblMs << " ms  +" << dblMb << " MB resident\n";
+	}
+
+	// the most the pack can cost later, when every feature thread gets a face
+	uint64_t residentBefore = residentBytes();
+	int64_t t0 = cv::getTickCount();
+	arrDetectors[0]->preload();
+	std::cout << "  pack, features of every thread parsed later  " << (cv::getTickCount() - t0) / dblTicksPerMs << " ms  +"
+		<< ((double)residentBytes() - (double)residentBefore) / dblBytesPerMb << " MB resident\n";
+
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// run a recorded clip once with detection on every frame and once with detect-then-track, and compare
+// frames per second and how many of the faces detected on every frame the tracker also reports
+int runTrackingBenchmark(const std::string& strInput, const FaceDetectOptions& detectOptions, int intDetectInterval, uint64_t maxFrames)
+{
+	std::vector<Mat> vecFrames;
+	if (!readClip(strInput, maxFrames, vecFrames))
+	{
+		return -1;
+	}
+
+	FaceDetector faceDetector(detectOptions);
+	if (!faceDetector.load() || !faceDetector.preload())
+	{
+		return 0;
+	}
 
-		// convert the input to grayscale
-		cvtColor(frame, frame_gray, COLOR_BGR2GRAY);
-		equalizeHist(frame_gray, frame_gray);
+	// baseline, full detection on every frame
+	std::vector<std::vector<Rect>> vecBaseline;
+	size_t arrBaselineCounts[4];
+	int64_t startTick = cv::getTickCount();
+	detectClip(faceDetector, vecFrames, vecBaseline, arrBaselineCounts);
+	double dblBaselineSeconds = (cv::getTickCount() - startTick) / cv::getTickFrequency();
+	size_t intBaselineFaces = arrBaselineCounts[0];
 
-		// Detect faces
-		face_cascade.detectMultiScale(frame_gray, faces, 1.1, 2, 0 | CASCADE_SCALE_IMAGE, Size(30, 30));
+	// detect-then-track
+	FaceTrackerOptions trackerOptions;
+	trackerOptions.intDetectInterval = intDetectInterval;
+	FaceTracker faceTracker(trackerOptions);
+	FaceDetectFn fnDetect = [&](const Mat& matGray, std::vector<DetectedFace>& faces) { faceDetector.detect(matGray, faces); };
 
-		for (size_t i = 0; i < faces.size(); i++)
+	Mat frame_gray;
+	std::vector<std::vector<Rect>> vecTracked(vecFrames.size());
+	size_t intTrackedFaces = 0;
+	size_t intDetections = 0;
+	int intMaxId = 0;
+	startTick = cv::getTickCount();
+	for (size_t f = 0; f < vecFrames.size(); f++)
+	{
+		faceDetector.prepareGray(vecFrames[f], frame_gray);
+		intDetections += faceTracker.update(frame_gray, fnDetect) ? 1 : 0;
+		for (const TrackedFace& trackedFace : faceTracker.faces())
 		{
-			//	Point center(faces[i].x + faces[i].width / 2, faces[i].y + faces[i].height / 2);
-			//	ellipse(frame, center, Size(faces[i].width / 2, faces[i].height / 2), 0, 0, 360, Scalar(255, 0, 255), 4, 8, 0);
+			vecTracked[f].push_back(trackedFace.detected.face);
+			intMaxId = std::max(intMaxId, trackedFace.intId);
+		}
+		intTrackedFaces += faceTracker.faces().size();
+	}
+	double dblTrackedSeconds = (cv::getTickCount() - startTick) / cv::getTickFrequency();
+
+	// a baseline face is found when a tracked face of the same frame overlaps it enough
+	size_t intFound = countMatchedFaces(vecBaseline, vecTracked);
+
+	double dblFrames = (double)vecFrames.size();
+	std::cout << "tracking benchmark, " << vecFrames.size() << " frames, detect interval " << intDetectInterval << "\n";
+	std::cout << "  detect every frame: " << dblFrames / dblBaselineSeconds << " fps, " << intBaselineFaces << " faces\n";
+	std::cout << "  detect then track:  " << dblFrames / dblTrackedSeconds << " fps, " << intTrackedFaces << " faces, "
+		<< intDetections << " detections, " << intMaxId << " ids\n";
+	std::cout << "  speedup " << dblBaselineSeconds / dblTrackedSeconds
+		<< ", recall " << (intBaselineFaces ? (double)intFound / intBaselineFaces : 1.0)
+		<< ", precision " << (intTrackedFaces ? (double)intFound / intTrackedFaces : 1.0) << "\n";
+
+	return 0;
+}
+
+
+int main(int argc, char** argv)
+{
+	std::vector<DetectedFace> detectedFaces;
+	cv::Mat frame;
+	cv::Mat frame_gray;
+
+	// input sources (see FrameSource.h), default camera unless --input is given
+	std::vector<std::string> vecInputs;
+
+	// --headless runs without windows and writes one JSON line per frame to --output (stdout by default)
+	bool blnHeadless = false;
+	std::string strOutput = "-";
+	uint64_t maxFrames = 0;
+
+	// --batch processes every --input in parallel, --bench-scaling times the batch for 1 .. --threads threads
+	bool blnBatch = false;
+	bool blnBatchScaling = false;
+	int intThreads = 0;
+	uint64_t segmentFrames = DEFAULT_SEGMENT_FRAMES;
 
-			// draw a rectangle for a detected face
-			Point pt1(faces[i].x, faces[i].y);
-			Point pt2(faces[i].x + faces[i].width, faces[i].y + faces[i].height);
-			rectangle(frame, pt1, pt2, Scalar(255, 0, 255), 4, 8, 0);
+	// --track detects every --detect-interval frames and tracks the faces in between,
+	// --bench-tracking compares that against detecting on every frame of --input
+	bool blnTrack = false;
+	bool blnTrackingBenchmark = false;
+	int intDetectInterval = DEFAULT_DETECT_INTERVAL;
 
-			// finding region of interest
-			Mat faceROI = frame_gray(faces[i]);
+	// detection pipeline, the defaults are the original full resolution face and eye detection (see FaceDetector.h)
+	// --stage-times prints the time of every stage at the end, --bench-pipeline compares the options against the original
+	FaceDetectOptions detectOptions;
+	bool blnStageTimes = false;
+	bool blnPipelineBenchmark = false;
 
-			//-- In each face ROI, detect eyes
-			std::vector<Rect> eyes;
-			eyes_cascade.detectMultiScale(faceROI, eyes, 1.1, 2, 0 | CASCADE_SCALE_IMAGE, Size(30, 30));
-			for (size_t j = 0; j < eyes.size(); j++)
+	// --face-threads N searches the features of the faces of a frame on N threads (0 one per hardware thread,
+	// 1 one face after the other); --bench-faces times that for a growing number of faces
+	int intFaceThreads = 0;
+	bool blnFaceCountBenchmark = false;
+
+	// --bench-cascades times the cascades loaded from cascades.pack against the XML files
+	bool blnCascadeBenchmark = false;
+
+	// --metrics PATH writes the stage latency histograms to PATH ("-" stdout) every --metrics-interval seconds
+	std::string strMetrics;
+	double dblMetricsInterval = DEFAULT_METRICS_INTERVAL;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string strArg = argv[i];
+
+		if (strArg == "--input" && i + 1 < argc)
+		{
+			vecInputs.push_back(argv[++i]);
+		}
+		else if (strArg == "--headless")
+		{
+			blnHeadless = true;
+		}
+		else if (strArg == "--output" && i + 1 < argc)
+		{
+			strOutput = argv[++i];
+		}
+		else if (strArg == "--frames" && i + 1 < argc)
+		{
+			maxFrames = std::stoull(argv[++i]);
+		}
+		else if (strArg == "--batch")
+		{
+			blnBatch = true;
+		}
+		else if (strArg == "--bench-scaling")
+		{
+			blnBatch = true;
+			blnBatchScaling = true;
+		}
+		else if (strArg == "--threads" && i + 1 < argc)
+		{
+			intThreads = std::stoi(argv[++i]);
+		}
+		else if (strArg == "--segment-frames" && i + 1 < argc)
+		{
+			segmentFrames = std::stoull(argv[++i]);
+		}
+		else if (strArg == "--track")
+		{
+			blnTrack = true;
+		}
+		else if (strArg == "--bench-tracking")
+		{
+			blnTrackingBenchmark = true;
+		}
+		else if (strArg == "--detect-interval" && i + 1 < argc)
+		{
+			intDetectInterval = std::max(1, std::stoi(argv[++i]));
+		}
+		// --detect-scale S runs the face cascade on the frame downscaled by S (e.g. 0.5)
+		else if (strArg == "--detect-scale" && i + 1 < argc)
+		{
+			detectOptions.dblDetectScale = std::stod(argv[++i]);
+		}
+		// --feature-width W resizes every face to W pixels wide before the eye, mouth and nose cascades
+		else if (strArg == "--feature-width" && i + 1 < argc)
+		{
+			detectOptions.intFeatureWidth = std::stoi(argv[++i]);
+		}
+		else if (strArg == "--eyes-upper-half")
+		{
+			detectOptions.blnEyesUpperHalf = true;
+		}
+		else if (strArg == "--mouth")
+		{
+			detectOptions.blnMouth = true;
+		}
+		else if (strArg == "--nose")
+		{
+			detectOptions.blnNose = true;
+		}
+		// --fast is --detect-scale 0.5 --feature-width 96 --eyes-upper-half
+		else if (strArg == "--fast")
+		{
+			detectOptions.dblDetectScale = 0.5;
+			detectOptions.intFeatureWidth = 96;
+			detectOptions.blnEyesUpperHalf = true;
+		}
+		else if (strArg == "--stage-times")
+		{
+			blnStageTimes = true;
+		}
+		else if (strArg == "--bench-pipeline")
+		{
+			blnPipelineBenchmark = true;
+		}
+		else if (strArg == "--face-threads" && i + 1 < argc)
+		{
+			intFaceThreads = std::stoi(argv[++i]);
+		}
+		else if (strArg == "--bench-faces")
+		{
+			blnFaceCountBenchmark = true;
+		}
+		else if (strArg == "--metrics" && i + 1 < argc)
+		{
+			strMetrics = argv[++i];
+		}
+		// --pack-cascades converts the four cascades into cascades.pack and exits, --bench-cascades compares loading
+		// them from the pack and from the XML files, --no-cascade-pack loads the XML files even when there is a pack
+		else if (strArg == "--pack-cascades")
+		{
+			const std::vector<std::string> vecCascades = { FACE_CASCADE_NAME, EYES_CASCADE_NAME, MOUTH_CASCADE_NAME, NOSE_CASCADE_NAME };
+			return writeCascadePack(CASCADE_PACK_NAME, vecCascades) ? 0 : -1;
+		}
+		else if (strArg == "--bench-cascades")
+		{
+			blnCascadeBenchmark = true;
+		}
+		else if (strArg == "--no-cascade-pack")
+		{
+			detectOptions.blnCascadePack = false;
+		}
+		else if (strArg == "--metrics-interval" && i + 1 < argc)
+		{
+			dblMetricsInterval = std::stod(argv[++i]);
+			if (!(dblMetricsInterval >= METRICS_MIN_INTERVAL))
 			{
-				Point eye_center(faces[i].x + eyes[j].x + eyes[j].width / 2, faces[i].y + eyes[j].y + eyes[j].height / 2);
-				int radius = cvRound((eyes[j].width + eyes[j].height) * 0.25);
-				circle(frame, eye_center, radius, Scalar(255, 0, 0), 4, 8, 0);
+				std::cerr << "error, --metrics-interval must be at least " << METRICS_MIN_INTERVAL << " seconds\n";
+				return -1;
 			}
+		}
+	}
+
+	// the timers cost next to nothing until the reporter turns them on, it writes a last time when main returns
+	MetricsReporter metricsReporter;
+	if (!strMetrics.empty() && !metricsReporter.start(strMetrics, dblMetricsInterval))
+	{
+		return -1;
+	}
+
+	if (blnCascadeBenchmark)
+	{
+		return runCascadeBenchmark(intFaceThreads);
+	}
 
+	if (blnFaceCountBenchmark)
+	{
+		if (vecInputs.empty())
+		{
+			std::cerr << "error, --bench-faces needs an --input image or clip with a face\n";
+			return -1;
 		}
+		return runFaceCountBenchmark(vecInputs.back(), detectOptions, intFaceThreads);
+	}
 
-		cv::imshow("Detected face", frame);
+	if (blnPipelineBenchmark)
+	{
+		if (vecInputs.empty())
+		{
+			std::cerr << "error, --bench-pipeline needs an --input clip\n";
+			return -1;
+		}
+		return runPipelineBenchmark(vecInputs.back(), detectOptions, maxFrames);
+	}
+
+	if (blnTrackingBenchmark)
+	{
+		if (vecInputs.empty())
+		{
+			std::cerr << "error, --bench-tracking needs an --input clip\n";
+			return -1;
+		}
+		return runTrackingBenchmark(vecInputs.back(), detectOptions, intDetectInterval, maxFrames);
+	}
 
-		// Check if the user pressed the 'Esc' key
-		if (cv::waitKey(1) == 27)
+	if (blnBatch)
+	{
+		if (vecInputs.empty())
 		{
-			break;
+			std::cerr << "error, --batch needs at least one --input\n";
+			return -1;
 		}
+		return runBatchMode(vecInputs, detectOptions, strOutput, intThreads, segmentFrames, blnBatchScaling, blnStageTimes);
+	}
+
+	// Open the input, the default camera unless --input was given
+	FrameSource cap;
+
+	// trap for stream errors
+	if (!cap.open(vecInputs.empty() ? std::string("0") : vecInputs.back()))
+	{
+		return -1;
+	}
+
+	ResultWriter resultWriter;
+	if (blnHeadless && !resultWriter.open(strOutput))
+	{
+		return -1;
+	}
+
+	double dblTicksPerMs = cv::getTickFrequency() / 1000.0;
+	uint64_t frames = 0;
+	int64_t startTick = cv::getTickCount();
 
+
+	// Load the cascades
+	FaceDetector faceDetector(detectOptions);
+	if (!faceDetector.load())
+	{
+		return 0;
+	}
+
+	// the features of several faces are searched in parallel, with a copy of the feature cascades per thread
+	std::unique_ptr<WorkStealingPool> pFacePool;
+	if (intFaceThreads != 1)
+	{
+		pFacePool.reset(new WorkStealingPool(intFaceThreads));
+		if (!faceDetector.setFeaturePool(pFacePool.get()))
+		{
+			return 0;
+		}
+	}
+
+	// faces keep their ids from frame to frame while they are tracked
+	FaceTrackerOptions trackerOptions;
+	trackerOptions.intDetectInterval = intDetectInterval;
+	FaceTracker faceTracker(trackerOptions);
+	FaceDetectFn fnDetect = [&](const Mat& matGray, std::vector<DetectedFace>& faces) { faceDetector.detect(matGray, faces); };
+	std::vector<int> vecIds;
+
+	// The camera is read on its own thread into a ring of the newest frames, see FrameRing
+	FrameRing frameRing;
+	frameRing.start(cap);
+
+	// Detect faces and eyes, or follow the faces of the last detection
+	auto detectFrame = [&](const Mat& matFrame)
+	{
+		if (blnTrack)
+		{
+			faceDetector.prepareGray(matFrame, frame_gray);
+			faceTracker.update(frame_gray, fnDetect);
+			splitTrackedFaces(faceTracker.faces(), detectedFaces, vecIds);
+		}
+		else
+		{
+			faceDetector.detect(matFrame, frame_gray, detectedFaces);
+		}
+	};
+
+	if (blnHeadless)
+	{
+		// Detect in the newest frame, a camera skips the frames detection is too slow for
+		const RingFrame* pRingFrame = nullptr;
+		while ((maxFrames == 0 || frames < maxFrames) && (pRingFrame = frameRing.acquireNewest()) != nullptr)
+		{
+			int64_t frameStartTick = cv::getTickCount();
+			detectFrame(pRingFrame->frame);
+			frames++;
+
+			double dblMs = (cv::getTickCount() - frameStartTick) / dblTicksPerMs;
+			resultWriter.write(faceResultJson(cap.spec(), pRingFrame->frameIndex, pRingFrame->strName, pRingFrame->frame.size(),
+											  dblMs, detectedFaces, vecIds).add("latency_ms", frameRing.recordResult(*pRingFrame)));
+			frameRing.release(pRingFrame);
+		}
+
+		// Check if the camera went away, the end of a video, image directory or stdin is normal
+		if (pRingFrame == nullptr && cap.isLive())
+		{
+			std::cerr << "Unable to capture frame\n";
+		}
+	}
+	else
+	{
+		// Detection runs on its own thread and hands every annotated frame to this thread, which shows the webcam
+		// feed at the rate of the camera however long a detection takes
+		std::mutex mutexResult;
+		Mat matResult;                          // newest annotated frame, handed over by swapping buffers
+		uint64_t resultSeq = 0;
+		std::atomic<bool> blnDone(false);
+
+		std::thread detectThread([&]()
+		{
+			const RingFrame* pRingFrame = nullptr;
+			while (!blnDone && (maxFrames == 0 || frames < maxFrames) && (pRingFrame = frameRing.acquireNewest()) != nullptr)
+			{
+				detectFrame(pRingFrame->frame);
+				frames++;
+
+				pRingFrame->frame.copyTo(frame);
+				drawFaces(frame, detectedFaces, vecIds);
+				std::string strLatency = std::to_string((int)std::lround(frameRing.recordResult(*pRingFrame))) + " ms after capture";
+				putText(frame, strLatency, Point(8, 24), FONT_HERSHEY_SIMPLEX, 0.7, Scalar(0, 255, 0), 2);
+
+				uint64_t seq = pRingFrame->seq;
+				frameRing.release(pRingFrame);
+
+				std::lock_guard<std::mutex> lock(mutexResult);
+				cv::swap(frame, matResult);
+				resultSeq = seq;
+			}
+
+			if (pRingFrame == nullptr && !blnDone && cap.isLive())
+			{
+				std::cerr << "Unable to capture frame\n";
+			}
+			blnDone = true;
+		});
+
+		Mat matShown;
+		uint64_t shownFeedSeq = 0;
+		uint64_t shownResultSeq = 0;
+
+		while (!blnDone)
+		{
+			// Display the webcam feed, the newest frame whether or not it is detected in
+			const RingFrame* pFeed = frameRing.peekNewest(shownFeedSeq);
+			if (pFeed != nullptr)
+			{
+				cv::imshow("Webcam Source Feed", pFeed->frame);
+				shownFeedSeq = pFeed->seq;
+				frameRing.release(pFeed);
+			}
+
+			bool blnNewResult = false;
+			{
+				std::lock_guard<std::mutex> lock(mutexResult);
+				if (resultSeq > shownResultSeq)
+				{
+					cv::swap(matResult, matShown);
+					shownResultSeq = resultSeq;
+					blnNewResult = true;
+				}
+			}
+			if (blnNewResult)
+			{
+				cv::imshow("Detected face", matShown);
+			}
+
+			// Check if the user pressed the 'Esc' key
+			if (cv::waitKey(1) == 27)
+			{
+				break;
+			}
+		}
+
+		// Stopping the ring wakes the detection thread when it waits for a frame
+		blnDone = true;
+		frameRing.stop();
+		detectThread.join();
+	}
+
+	frameRing.stop();
+
+	if (blnHeadless)
+	{
+		// summary on stderr so it never mixes with the JSON lines on stdout
+		double dblSeconds = (cv::getTickCount() - startTick) / cv::getTickFrequency();
+		std::cerr << "processed " << frames << " frames in " << dblSeconds << " s ("
+			<< (dblSeconds > 0 ? frames / dblSeconds : 0.0) << " fps)\n";
+	}
+	frameRing.report(std::cerr);
+
+	if (blnStageTimes)
+	{
+		faceDetector.times().report(std::cerr, "stages");
 	}
 
 	// Release the camera and destroy the window
@@ -130,4 +993,3 @@ int main(int argc, char** argv)
 
 	return 0;
 }
-
@@ -0,0 +1,110 @@
+#!/usr/bin/env bash
+# ###########################################################################################################################
+# pgo.sh :
+#
+# Description: Builds the solution three times with CMake and measures every build with the benchmark CRHSCS:
+#
+#                  release   the default Release build, -O2
+#                  tuned     -O3, -march=native and link time optimization
+#                  pgo       tuned, optimized with a profile of the benchmark
+#
+#              The profile is trained on the CRHSCS text and face benchmarks with another seed than the one that is
+#              measured, so the measured frames are not the ones the profile was taken on, and on the KNearest and
+#              index benchmarks of CharMatch. The builds are then run RUNS times each, in turns so that a change of
+#              the clock or the load of the machine hits every build alike, and the median frames per second of the
+#              text and the face benchmark is reported with the speedup over release.
+#
+#                  ./pgo.sh [cmake arguments]          e.g. ./pgo.sh -DOpenCV_DIR=/opt/opencv/lib/cmake/opencv4
+#
+#              RUNS (default 5) sets the runs per build, BUILD (default _pgo) the directory of the builds; the JSON
+#              lines of every run are kept there as release.jsonl, tuned.jsonl and pgo.jsonl for a closer look. Run
+#              it on an idle machine. Needs GCC or Clang, with Clang also llvm-profdata (or LLVM_PROFDATA).
+#
+# ###########################################################################################################################
+
+set -euo pipefail
+
+ROOT="$(cd "$(dirname "$0")" && pwd)"
+BUILD="${BUILD:-$ROOT/_pgo}"
+RUNS="${RUNS:-5}"
+JOBS="$(nproc 2>/dev/null || sysctl -n hw.ncpu 2>/dev/null || echo 4)"
+LLVM_PROFDATA="${LLVM_PROFDATA:-llvm-profdata}"
+
+TRAIN_SEED=2026
+MEASURE_SEED=12345
+BUILDS="release tuned pgo"
+TUNED="-DCRHSCS_O3=ON -DCRHSCS_NATIVE=ON -DCRHSCS_LTO=ON"
+
+# configure and build one build directory, the output only shows up when it fails
+build() {
+    local strName="$1"
+    shift
+    local strLog="$BUILD/$strName.log"
+    if ! { cmake -S "$ROOT" -B "$BUILD/$strName" -DCMAKE_BUILD_TYPE=Release "$@" && cmake --build "$BUILD/$strName" -j "$JOBS"; } > "$strLog" 2>&1; then
+        cat "$strLog" >&2
+        echo "error, build $strName failed" >&2
+        exit 1
+    fi
+}
+
+# the face benchmark needs the cascades, so CRHSCS runs in FacialDetection like FacialDetection itself
+crhscs() {
+    local strBin="$1"
+    shift
+    (cd "$ROOT/FacialDetection" && "$strBin/CRHSCS" "$@")
+}
+
+# median of the fps of one benchmark in a JSON lines file
+medianFps() {
+    sed -n "s/.*\"benchmark\":\"$2\".*\"fps\":\([-+.0-9eE]*\).*/\1/p" "$1" | sort -g |
+        awk '{ a[NR] = $1 } END { if (NR == 0) print "-"; else if (NR % 2) print a[(NR + 1) / 2]; else print (a[NR / 2] + a[NR / 2 + 1]) / 2 }'
+}
+
+speedup() {
+    awk -v a="$1" -v b="$2" 'BEGIN { if (a == "-" || b == "-" || b == 0) print "-"; else printf "%.2fx\n", a / b }'
+}
+
+mkdir -p "$BUILD"
+
+echo "building release and tuned"
+build release "$@"
+build tuned $TUNED "$@"
+
+echo "training the profile"
+PROFILE="$BUILD/pgo/profile"
+rm -rf "$PROFILE"
+build pgo $TUNED -DCRHSCS_PGO=GENERATE -DCRHSCS_PGO_DIR="$PROFILE" "$@"
+crhscs "$BUILD/pgo/bin" --seed "$TRAIN_SEED" --repeats 2 > /dev/null
+(cd "$ROOT/CharMatch" && "$BUILD/pgo/bin/CharMatch" --bench-knn && "$BUILD/pgo/bin/CharMatch" --bench-index) > /dev/null
+
+# Clang leaves raw profiles that are merged first, GCC reads its .gcda files as they are
+if ls "$PROFILE"/*.profraw > /dev/null 2>&1; then
+    "$LLVM_PROFDATA" merge -o "$PROFILE/crhscs.profdata" "$PROFILE"/*.profraw
+fi
+
+# GCC finds the profile of an object by its path, so the optimized build reuses the directory of the instrumented one
+echo "building pgo"
+build pgo $TUNED -DCRHSCS_PGO=USE -DCRHSCS_PGO_DIR="$PROFILE" "$@"
+
+echo "measuring $RUNS runs per build"
+for strName in $BUILDS; do
+    : > "$BUILD/$strName.jsonl"
+done
+for ((i = 1; i <= RUNS; i++)); do
+    for strName in $BUILDS; do
+        crhscs "$BUILD/$strName/bin" --seed "$MEASURE_SEED" --tag "$strName" --output - 2> /dev/null >> "$BUILD/$strName.jsonl"
+    done
+done
+
+echo
+echo "$(sed -n 's/^CMAKE_CXX_COMPILER:[A-Z]*=//p' "$BUILD/release/CMakeCache.txt"), $(sed -n 's/^model name[^:]*: //p' /proc/cpuinfo 2>/dev/null | head -n 1)"
+echo "median of $RUNS runs, seed $MEASURE_SEED"
+printf "%-10s %12s %9s %12s %9s\n" build "text fps" speedup "faces fps" speedup
+strTextRelease="$(medianFps "$BUILD/release.jsonl" text)"
+strFacesRelease="$(medianFps "$BUILD/release.jsonl" faces)"
+for strName in $BUILDS; do
+    strText="$(medianFps "$BUILD/$strName.jsonl" text)"
+    strFaces="$(medianFps "$BUILD/$strName.jsonl" faces)"
+    printf "%-10s %12s %9s %12s %9s\n" "$strName" "$strText" "$(speedup "$strText" "$strTextRelease")" \
+        "$strFaces" "$(speedup "$strFaces" "$strFacesRelease")"
+done